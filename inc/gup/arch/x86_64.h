@@ -0,0 +1,500 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_ARCH_X86_64_H
+#define GUP_ARCH_X86_64_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/ir.h"
+#include "gup/elf.h"
+
+/*
+ * General purpose registers, in hardware encoding order
+ */
+typedef enum {
+    X86_RAX,
+    X86_RCX,
+    X86_RDX,
+    X86_RBX,
+    X86_RSP,
+    X86_RBP,
+    X86_RSI,
+    X86_RDI,
+    X86_R8,
+    X86_R9,
+    X86_R10,
+    X86_R11,
+    X86_R12,
+    X86_R13,
+    X86_R14,
+    X86_R15,
+    X86_NREG,
+    X86_NOREG = 0xFF
+} x86_reg_t;
+
+/* Register set helpers */
+#define X86_REGBIT(reg) \
+    ((uint16_t)1 << (reg))
+
+/* Scratch registers, never allocated */
+#define X86_SCRATCH0 X86_R11
+#define X86_SCRATCH1 X86_R10
+
+/* Registers a call may clobber (SysV) */
+#define X86_CALLER_SAVED (              \
+    X86_REGBIT(X86_RAX) |               \
+    X86_REGBIT(X86_RCX) |               \
+    X86_REGBIT(X86_RDX) |               \
+    X86_REGBIT(X86_RSI) |               \
+    X86_REGBIT(X86_RDI) |               \
+    X86_REGBIT(X86_R8)  |               \
+    X86_REGBIT(X86_R9)  |               \
+    X86_REGBIT(X86_R10) |               \
+    X86_REGBIT(X86_R11)                 \
+)
+
+/* Registers a callee must preserve (SysV) */
+#define X86_CALLEE_SAVED (              \
+    X86_REGBIT(X86_RBX) |               \
+    X86_REGBIT(X86_RBP) |               \
+    X86_REGBIT(X86_R12) |               \
+    X86_REGBIT(X86_R13) |               \
+    X86_REGBIT(X86_R14) |               \
+    X86_REGBIT(X86_R15)                 \
+)
+
+/* Most integer arguments any convention passes in registers */
+#define X86_NARGREGS 12
+
+/*
+ * Describes how a procedure is called
+ *
+ * SysV is used for anything visible outside the translation
+ * unit. Private procedures get an internal convention with
+ * more argument registers and no callee-saved registers,
+ * callers instead learn what each one really clobbers.
+ *
+ * @args:  Integer argument registers in order
+ * @nargs: Number of argument registers
+ * @saved: Registers the callee must preserve
+ */
+struct x86_conv {
+    const uint8_t *args;
+    size_t nargs;
+    uint16_t saved;
+};
+
+/* Bytes below the stack pointer a leaf may use freely (SysV) */
+#define X86_REDZONE 128
+
+/* CPU features beyond the x86-64 baseline, see mu_target_opt() */
+#define X86_FEAT_POPCNT (1U << 0)
+#define X86_FEAT_LZCNT  (1U << 1)
+#define X86_FEAT_BMI1   (1U << 2)
+#define X86_FEAT_BMI2   (1U << 3)
+#define X86_FEAT_MOVBE  (1U << 4)
+#define X86_FEAT_AVX2   (1U << 5)
+
+/*
+ * Condition codes, in hardware encoding order so a code
+ * is inverted by flipping its low bit
+ */
+typedef enum {
+    X86_CC_B  = 0x2,
+    X86_CC_AE = 0x3,
+    X86_CC_E  = 0x4,
+    X86_CC_NE = 0x5,
+    X86_CC_BE = 0x6,
+    X86_CC_A  = 0x7
+} x86_cc_t;
+
+#define X86_CC_INV(cc) \
+    ((cc) ^ 1)
+
+/*
+ * Valid machine operand kinds
+ */
+typedef enum {
+    X86_OPND_NONE,
+    X86_OPND_REG,
+    X86_OPND_IMM,
+    X86_OPND_MEM
+} x86_opnd_kind_t;
+
+/*
+ * Represents a machine instruction operand
+ *
+ * @kind:  Operand kind
+ * @size:  Operand size in bytes (zero for untyped memory)
+ * @reg:   Register (X86_OPND_REG) or base register (X86_OPND_MEM)
+ * @disp:  Displacement from the base register (X86_OPND_MEM)
+ * @imm:   Immediate value (X86_OPND_IMM)
+ * @label: RIP-relative label, replaces the base (X86_OPND_MEM)
+ * @index: Index register (X86_OPND_MEM)
+ * @scale: Index scale (1, 2, 4 or 8), zero if not indexed
+ */
+struct x86_opnd {
+    x86_opnd_kind_t kind;
+    uint8_t size;
+    uint8_t reg;
+    int32_t disp;
+    uint64_t imm;
+    const char *label;
+    uint8_t index;
+    uint8_t scale;
+};
+
+/*
+ * Machine instruction opcodes
+ */
+typedef enum {
+    X86_OP_NONE,        /* Deleted */
+    X86_OP_LABEL,       /* Local label */
+    X86_OP_MOV,
+    X86_OP_MOVZX,
+    X86_OP_MOVSXD,
+    X86_OP_LEA,
+    X86_OP_ADD,
+    X86_OP_SUB,
+    X86_OP_IMUL,
+    X86_OP_XOR,
+    X86_OP_NEG,
+    X86_OP_INC,
+    X86_OP_DEC,
+    X86_OP_SHL,
+    X86_OP_SHR,
+    X86_OP_MUL,         /* rdx:rax = rax * src */
+    X86_OP_MULX,        /* dst = high half of rdx * src (BMI2) */
+    X86_OP_DIV,
+    X86_OP_CMP,
+    X86_OP_TEST,
+    X86_OP_SETCC,
+    X86_OP_JMP,
+    X86_OP_JCC,
+    X86_OP_CALL,
+    X86_OP_TAILJMP,     /* Jump to a symbol (tail call) */
+    X86_OP_JMPR,        /* Jump to an address in a register */
+    X86_OP_PUSH,
+    X86_OP_LEAVE,
+    X86_OP_RET,
+    X86_OP_MAX
+} x86_op_t;
+
+/*
+ * Represents a single machine instruction
+ *
+ * @op:     Opcode
+ * @cc:     Condition code (X86_OP_SETCC, X86_OP_JCC)
+ * @opnd:   Destination and source operands
+ * @target: Local label (X86_OP_LABEL, X86_OP_JMP, X86_OP_JCC)
+ * @sym:    Called symbol (X86_OP_CALL, X86_OP_TAILJMP)
+ */
+struct x86_minsn {
+    x86_op_t op;
+    x86_cc_t cc;
+    struct x86_opnd opnd[2];
+    size_t target;
+    const char *sym;
+};
+
+/*
+ * Represents a jump table placed in .rodata, each entry is
+ * the offset of a local label from the procedure entry
+ *
+ * @name:    Label of the table
+ * @targets: Local label of each entry
+ * @count:   Number of entries
+ */
+struct x86_jtab {
+    char *name;
+    size_t *targets;
+    size_t count;
+};
+
+/*
+ * Buffered machine instructions of a procedure
+ *
+ * @insns: Instructions
+ * @count: Number of instructions
+ * @cap:   Capacity of the instruction array
+ * @tabs:  Jump tables the instructions refer to
+ * @ntabs: Number of jump tables
+ */
+struct x86_mbuf {
+    struct x86_minsn *insns;
+    size_t count;
+    size_t cap;
+    struct x86_jtab *tabs;
+    size_t ntabs;
+};
+
+/*
+ * Append an instruction to a buffer
+ *
+ * @buf:  Buffer to append to
+ * @insn: Instruction to append
+ *
+ * Returns zero on success
+ */
+int x86_mbuf_push(struct x86_mbuf *buf, const struct x86_minsn *insn);
+
+/*
+ * Add a jump table to a buffer
+ *
+ * @buf:     Buffer to add to
+ * @name:    Label of the table
+ * @targets: Local label of each entry
+ * @count:   Number of entries
+ *
+ * Returns zero on success
+ */
+int x86_mbuf_jtab(struct x86_mbuf *buf, const char *name,
+    const size_t *targets, size_t count);
+
+/*
+ * Release the instructions and jump tables of a buffer
+ *
+ * @buf: Buffer to release
+ */
+void x86_mbuf_free(struct x86_mbuf *buf);
+
+/*
+ * Rewrite a buffer of machine instructions with the peephole
+ * rule table until no rule applies
+ *
+ * @buf: Buffer to optimize
+ */
+void x86_peephole(struct x86_mbuf *buf);
+
+/*
+ * Encode a buffer of machine instructions at the end of the
+ * text section of an object, its jump tables go at the end
+ * of the read-only data section
+ *
+ * @buf: Instructions to encode
+ * @obj: Object to encode into
+ *
+ * Returns zero on success
+ */
+int x86_encode(struct x86_mbuf *buf, struct elf_obj *obj);
+
+/*
+ * Instruction selection nonterminals, what a tree of IR
+ * instructions can be reduced to
+ */
+typedef enum {
+    X86_NT_NONE,
+    X86_NT_STMT,        /* Executed for its effect only */
+    X86_NT_REG,         /* Value in the location of its register */
+    X86_NT_IMM,         /* Constant encoded as an immediate */
+    X86_NT_ANY,         /* Register or immediate, as allocated */
+    X86_NT_INDEX,       /* Register scaled by 2, 4 or 8 */
+    X86_NT_BASEIDX,     /* Register plus a (scaled) register */
+    X86_NT_ADDR,        /* Memory operand [base+index*scale+disp] */
+    X86_NT_MEM,         /* 64-bit value read from memory */
+    X86_NT_CC,          /* Flags set by a comparison */
+    X86_NT_MAX
+} x86_nt_t;
+
+/*
+ * How the machine instructions of a rule are emitted
+ */
+typedef enum {
+    X86_EMIT_INSN,      /* Instruction on its own */
+    X86_EMIT_PASS,      /* Operand passed on unchanged */
+    X86_EMIT_INDEX,     /* reg*scale */
+    X86_EMIT_BASEIDX,   /* reg+reg*scale */
+    X86_EMIT_BASE,      /* [reg] */
+    X86_EMIT_LABEL,     /* [rel label] */
+    X86_EMIT_SLOT,      /* Stack slot of a local */
+    X86_EMIT_DISP,      /* Address plus or minus a constant */
+    X86_EMIT_MEM,       /* Load folded into its user */
+    X86_EMIT_LEA,
+    X86_EMIT_LOAD,
+    X86_EMIT_STORE,
+    X86_EMIT_ALU,       /* Arithmetic with a memory operand */
+    X86_EMIT_MUL_LEA,   /* Multiplication by 3, 5 or 9 (shifted) */
+    X86_EMIT_MULX,      /* High half of a product, leaving rax alone */
+    X86_EMIT_CMP,
+    X86_EMIT_SETCC,
+    X86_EMIT_BRCC,
+    X86_EMIT_BR,
+    X86_EMIT_MAX
+} x86_emit_t;
+
+struct x86_isel;
+
+/*
+ * Represents an instruction selection rule 'lhs: op(kids)'
+ *
+ * Chain rules match no operation and rewrite one nonterminal
+ * as another, those rewriting X86_NT_REG only apply to the
+ * sources of an instruction.
+ *
+ * @lhs:  Nonterminal the rule produces
+ * @op:   Operation matched, IR_NOP for chain rules
+ * @kids: Nonterminals the sources must reduce to (the one
+ *        rewritten for chain rules)
+ * @cost: Cost of the machine instructions emitted
+ * @emit: How the rule is emitted
+ * @ok:   Further check on the instruction, NULL if none
+ */
+struct x86_rule {
+    x86_nt_t lhs;
+    ir_op_t op;
+    x86_nt_t kids[2];
+    uint8_t cost;
+    x86_emit_t emit;
+    bool(*ok)(const struct x86_isel *sel, const struct ir_insn *insn);
+};
+
+/*
+ * Returns true if a rule is a chain rule
+ *
+ * @rule: Rule to check
+ */
+static inline bool
+x86_rule_chain(const struct x86_rule *rule)
+{
+    return rule->op == IR_NOP && rule->lhs != X86_NT_STMT;
+}
+
+/*
+ * Result of instruction selection for a procedure
+ *
+ * Instructions are numbered from one in layout order. Those
+ * folded into the tree of a later instruction are emitted as
+ * part of it, their sources are read there too.
+ *
+ * @cover:    Rule covering each instruction, NULL if folded
+ * @rule:     Cheapest rule per nonterminal for each instruction
+ * @def:      Defining instruction, indexed by register
+ * @pos:      Number of the defining instruction, indexed by
+ *            register
+ * @inner:    Set if the defining instruction is folded, indexed
+ *            by register
+ * @features: CPU features rules may use (X86_FEAT_*)
+ */
+struct x86_isel {
+    const struct x86_rule **cover;
+    const struct x86_rule *(*rule)[X86_NT_MAX];
+    struct ir_insn **def;
+    uint32_t *pos;
+    uint8_t *inner;
+    uint32_t features;
+};
+
+/*
+ * Select the machine instructions of a procedure by covering
+ * its expression trees with the rule table at the lowest cost
+ *
+ * A value only used once, later in the same block, is a
+ * subtree of its user and may be folded into it as long as
+ * nothing in between changes what it reads.
+ *
+ * @func:     Procedure IR (with its CFG built)
+ * @features: CPU features rules may use (X86_FEAT_*)
+ * @sel:      Selection result
+ *
+ * Returns zero on success
+ */
+int x86_isel(struct ir_func *func, uint32_t features, struct x86_isel *sel);
+
+/*
+ * Returns the chain rule deriving a nonterminal from a
+ * register source, NULL if there is none
+ *
+ * @nt: Nonterminal to derive
+ */
+const struct x86_rule *x86_isel_chain(x86_nt_t nt);
+
+/*
+ * Location assigned to a virtual register
+ *
+ * @reg:    Machine register, X86_NOREG if spilled
+ * @slot:   Spill slot index (if spilled), registers never live
+ *          at the same time may share one
+ * @konst:  Register only ever holds the constant in 'imm'
+ * @folded: Every use takes 'imm' as an immediate, the
+ *          register has no location at all
+ * @imm:    Constant value (if 'konst')
+ */
+struct ra_loc {
+    uint8_t reg;
+    uint32_t slot;
+    uint8_t konst : 1;
+    uint8_t folded : 1;
+    uint64_t imm;
+};
+
+/*
+ * Result of register allocation for a procedure
+ *
+ * @loc:         Locations indexed by virtual register
+ * @used:        Every machine register assigned
+ * @spill_count: Number of spill slots needed
+ * @has_calls:   Procedure contains calls
+ */
+struct ra_result {
+    struct ra_loc *loc;
+    uint16_t used;
+    size_t spill_count;
+    bool has_calls;
+};
+
+/*
+ * Allocate machine registers to the virtual registers of a
+ * procedure with linear scan
+ *
+ * @func: Procedure IR (with its CFG built)
+ * @sel:  Instruction selection, registers of folded
+ *        instructions get no location
+ * @res:  Allocation result
+ *
+ * Returns zero on success
+ */
+int x86_regalloc(struct ir_func *func, const struct x86_isel *sel,
+    struct ra_result *res);
+
+/*
+ * Returns the calling convention a procedure is entered with
+ *
+ * @sym: Procedure symbol, NULL if unknown
+ */
+const struct x86_conv *x86_conv(const struct symbol *sym);
+
+/*
+ * Returns the set of machine registers a call leaves
+ * clobbered, including the argument registers it fills
+ *
+ * @func: Procedure making the call
+ * @call: IR_CALL or IR_TAIL instruction
+ */
+uint16_t x86_call_clobbers(const struct ir_func *func, const struct ir_insn *call);
+
+/*
+ * Returns the set of machine registers an instruction
+ * clobbers, values live across it must avoid these
+ *
+ * @func: Procedure the instruction is in
+ * @rule: Rule covering the instruction (see struct x86_isel)
+ * @insn: Instruction to check
+ */
+uint16_t x86_clobbers(const struct ir_func *func, const struct x86_rule *rule,
+    const struct ir_insn *insn);
+
+/*
+ * Returns true if a source operand of an instruction can be
+ * encoded as an immediate instead of a register
+ *
+ * @insn: Instruction to check
+ * @idx:  Index of the source operand (see ir_use())
+ * @imm:  Constant the operand holds
+ */
+bool x86_imm_ok(const struct ir_insn *insn, size_t idx, uint64_t imm);
+
+#endif  /* !GUP_ARCH_X86_64_H */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_ARENA_H
+#define GUP_ARENA_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Default size of an arena chunk */
+#define ARENA_CHUNK_SIZE 0x10000
+
+/*
+ * Represents a single chunk of arena memory
+ *
+ * @next: Next (older) chunk
+ * @size: Usable size of the chunk
+ * @used: Bytes handed out from the chunk
+ * @data: Chunk memory
+ */
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    uint8_t data[];
+};
+
+/*
+ * An arena hands out memory by bumping a pointer through
+ * large chunks, all of which are freed in one sweep.
+ *
+ * @head: Current (newest) chunk
+ */
+struct arena {
+    struct arena_chunk *head;
+};
+
+/*
+ * Initialize an arena
+ *
+ * @res: Arena to initialize
+ *
+ * Returns zero on success
+ */
+int arena_init(struct arena *res);
+
+/*
+ * Allocate zeroed memory from an arena
+ *
+ * @arena: Arena to allocate from
+ * @sz:    Allocation size
+ *
+ * Returns the base of the allocated memory on success
+ */
+void *arena_alloc(struct arena *arena, size_t sz);
+
+/*
+ * Destroy an arena and everything allocated from it
+ *
+ * @arena: Arena to destroy
+ */
+void arena_destroy(struct arena *arena);
+
+#endif  /* !GUP_ARENA_H */
@@ -14,10 +14,48 @@
  *
  * @AST_NONE:  This node has no type
  * @AST_PROC:  This node is a procedure
+ * @AST_GLOBAL: This node is a global variable
+ * @AST_LOCAL:  This node is a local variable declaration
+ * @AST_NUMBER: This node is a numeric literal
+ * @AST_STRING: This node is a string literal
+ * @AST_IDENT:  This node is a reference to a variable or parameter
+ * @AST_CALL:   This node is a procedure call
+ * @AST_BINOP:  This node is a binary operation
+ * @AST_UNOP:   This node is a unary operation
+ * @AST_ASSIGN: This node is an assignment
+ * @AST_RETURN: This node is a return statement
+ * @AST_IF:     This node is an 'if' statement
+ * @AST_ELSE:   This node is an 'else' clause
+ * @AST_WHILE:  This node is a 'while' loop
+ * @AST_FOR:    This node is a 'for' loop
+ * @AST_BREAK:  This node is a 'break' statement
+ * @AST_CONTINUE: This node is a 'continue' statement
+ * @AST_SWITCH:   This node is a 'switch' statement
+ * @AST_CASE:     This node is a 'case' label
+ * @AST_DEFAULT:  This node is a 'default' label
  */
 typedef enum {
     AST_NONE,
-    AST_PROC
+    AST_PROC,
+    AST_GLOBAL,
+    AST_LOCAL,
+    AST_NUMBER,
+    AST_STRING,
+    AST_IDENT,
+    AST_CALL,
+    AST_BINOP,
+    AST_UNOP,
+    AST_ASSIGN,
+    AST_RETURN,
+    AST_IF,
+    AST_ELSE,
+    AST_WHILE,
+    AST_FOR,
+    AST_BREAK,
+    AST_CONTINUE,
+    AST_SWITCH,
+    AST_CASE,
+    AST_DEFAULT
 } ast_type_t;
 
 /*
@@ -25,16 +63,34 @@ typedef enum {
  *
  * @type:       AST node type
  * @epilogue:   End of block if set
- * @left:       Left node
- * @right:      Right node
+ * @tail:       Return must be a tail call (AST_RETURN)
+ * @op:         Operator token (AST_BINOP, AST_UNOP)
+ * @left:       Left node (loop condition, switch selector)
+ * @right:      Right node (loop step)
+ * @init:       Loop initializer (AST_FOR)
+ * @args:       Call arguments (AST_CALL)
+ * @argc:       Number of call arguments
+ * @symid:      Symbol ID (procedures and variables)
+ * @v:          Numeric literal or case value
+ * @str:        String literal data and length
  */
 struct ast_node {
     ast_type_t type;
     uint8_t epilogue : 1;
+    uint8_t tail : 1;
+    tt_t op;
     struct ast_node *left;
     struct ast_node *right;
+    struct ast_node *init;
+    struct ast_node **args;
+    size_t argc;
     union {
         symid_t symid;
+        uint64_t v;
+        struct {
+            char *s;
+            size_t len;
+        } str;
     };
 };
 
@@ -19,4 +19,14 @@
  */
 int cg_resolve_node(struct gup_state *state, struct ast_node *root);
 
+/*
+ * Emit everything deferred until the end of the translation
+ * unit, such as the string literal pool
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+int cg_finish(struct gup_state *state);
+
 #endif  /* !GUP_CODEGEN_H */
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_ELF_H
+#define GUP_ELF_H 1
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/outbuf.h"
+
+/*
+ * Sections an object can place contents in
+ */
+typedef enum {
+    ELF_SEC_NONE,       /* Undefined */
+    ELF_SEC_TEXT,
+    ELF_SEC_DATA,
+    ELF_SEC_BSS,
+    ELF_SEC_RODATA,
+    ELF_SEC_MAX
+} elf_sec_t;
+
+/*
+ * Represents a growable byte buffer
+ *
+ * @data: Buffer contents
+ * @len:  Bytes used
+ * @cap:  Bytes allocated
+ */
+struct elf_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+};
+
+/*
+ * Represents a relocation against a symbol
+ *
+ * @offset: Section offset to patch
+ * @sym:    Symbol index (see elf_sym())
+ * @type:   Machine specific relocation type
+ * @addend: Relocation addend
+ */
+struct elf_rela {
+    uint64_t offset;
+    uint32_t sym;
+    uint32_t type;
+    int64_t addend;
+};
+
+/*
+ * Represents the contents of a single section
+ *
+ * @data:    Section bytes (unused for .bss)
+ * @size:    Section size
+ * @align:   Largest alignment requested
+ * @relocs:  Relocations against the section
+ * @nrelocs: Number of relocations
+ * @cap:     Capacity of the relocation array
+ */
+struct elf_section {
+    struct elf_buf data;
+    size_t size;
+    size_t align;
+    struct elf_rela *relocs;
+    size_t nrelocs;
+    size_t cap;
+};
+
+/*
+ * Represents a symbol
+ *
+ * @name:   Symbol name (owned by the object)
+ * @sec:    Defining section, ELF_SEC_NONE if undefined
+ * @value:  Offset within the defining section
+ * @size:   Size of the object or procedure
+ * @func:   Symbol is a procedure
+ * @global: Symbol is visible outside the object
+ * @index:  Index in the output symbol table
+ */
+struct elf_sym {
+    char *name;
+    elf_sec_t sec;
+    uint64_t value;
+    uint64_t size;
+    uint8_t func : 1;
+    uint8_t global : 1;
+    uint32_t index;
+};
+
+/*
+ * Represents a relocatable object being built
+ *
+ * @machine:  ELF machine type
+ * @sections: Section contents
+ * @syms:     Symbols in order of first reference
+ * @nsyms:    Number of symbols
+ * @symcap:   Capacity of the symbol array
+ * @buckets:  Symbol hash buckets (indices plus one)
+ * @nbuckets: Number of hash buckets (power of two)
+ */
+struct elf_obj {
+    uint16_t machine;
+    struct elf_section sections[ELF_SEC_MAX];
+    struct elf_sym *syms;
+    size_t nsyms;
+    size_t symcap;
+    uint32_t *buckets;
+    size_t nbuckets;
+};
+
+/*
+ * Initialize a relocatable object
+ *
+ * @res:     Object to initialize
+ * @machine: ELF machine type
+ *
+ * Returns zero on success
+ */
+int elf_init(struct elf_obj *res, uint16_t machine);
+
+/*
+ * Release all resources of an object
+ *
+ * @obj: Object to destroy
+ */
+void elf_destroy(struct elf_obj *obj);
+
+/*
+ * Look up a symbol, creating it undefined on first use
+ *
+ * @obj:  Object to look in
+ * @name: Symbol name
+ *
+ * Returns the symbol index, or -1 on failure
+ */
+ssize_t elf_sym(struct elf_obj *obj, const char *name);
+
+/*
+ * Define a symbol at the current end of a section
+ *
+ * @obj:    Object to define in
+ * @name:   Symbol name
+ * @sec:    Section to define the symbol in
+ * @global: If true, symbol is visible outside the object
+ * @func:   If true, symbol is a procedure
+ *
+ * Returns the symbol index, or -1 on failure
+ */
+ssize_t elf_define(struct elf_obj *obj, const char *name, elf_sec_t sec,
+    bool global, bool func);
+
+/*
+ * Mark a symbol as visible outside the object
+ *
+ * @obj:  Object the symbol is in
+ * @name: Symbol name
+ *
+ * Returns zero on success
+ */
+int elf_export(struct elf_obj *obj, const char *name);
+
+/*
+ * Append bytes to a section
+ *
+ * @obj:  Object to append to
+ * @sec:  Section to append to
+ * @data: Bytes to append, zeros if NULL
+ * @len:  Number of bytes
+ *
+ * Returns zero on success
+ */
+int elf_put(struct elf_obj *obj, elf_sec_t sec, const void *data, size_t len);
+
+/*
+ * Pad a section up to an alignment
+ *
+ * @obj:   Object to pad in
+ * @sec:   Section to pad
+ * @align: Alignment (power of two)
+ *
+ * Returns zero on success
+ */
+int elf_align(struct elf_obj *obj, elf_sec_t sec, size_t align);
+
+/*
+ * Record a relocation against a section
+ *
+ * @obj:    Object to record in
+ * @sec:    Section to patch
+ * @offset: Offset within the section to patch
+ * @name:   Symbol the relocation refers to
+ * @type:   Machine specific relocation type
+ * @addend: Relocation addend
+ *
+ * Returns zero on success
+ */
+int elf_reloc(struct elf_obj *obj, elf_sec_t sec, uint64_t offset,
+    const char *name, uint32_t type, int64_t addend);
+
+/*
+ * Returns the current size of a section
+ *
+ * @obj: Object to check
+ * @sec: Section to check
+ */
+static inline size_t
+elf_offset(const struct elf_obj *obj, elf_sec_t sec)
+{
+    return obj->sections[sec].size;
+}
+
+/*
+ * Serialize an object as an ELF64 relocatable file
+ *
+ * @obj: Object to serialize
+ * @ob:  Output buffer to write to
+ *
+ * Returns zero on success
+ */
+int elf_write(struct elf_obj *obj, struct outbuf *ob);
+
+#endif  /* !GUP_ELF_H */
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_INLINE_H
+#define GUP_INLINE_H 1
+
+#include <stdbool.h>
+#include "gup/ir.h"
+
+/* Largest callee cost inlined without being asked to */
+#define INLINE_COST_MAX 16
+
+/* Most cost a single caller may take on by inlining */
+#define INLINE_GROWTH_MAX 256
+
+/*
+ * Returns the cost of inlining a procedure, roughly the
+ * number of machine instructions its body adds
+ *
+ * @func: Procedure IR
+ */
+size_t ir_inline_cost(const struct ir_func *func);
+
+/*
+ * Replace calls to procedures emitted earlier with copies of
+ * their bodies. Small private procedures and those marked
+ * 'inline' are inlined, those marked 'noinline' never are.
+ * Must run before the control flow graph is built.
+ *
+ * @func:     Function to rewrite
+ * @can_tail: Returns true if the target can make a call a tail call
+ *
+ * Returns zero on success
+ */
+int ir_inline(struct ir_func *func,
+    bool(*can_tail)(const struct ir_func *, const struct ir_insn *));
+
+#endif  /* !GUP_INLINE_H */
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_IR_H
+#define GUP_IR_H 1
+
+#include <sys/queue.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/arena.h"
+#include "gup/symbol.h"
+
+/* Virtual register, zero means none */
+typedef uint32_t ir_reg_t;
+
+/*
+ * Represents valid IR operations, every instruction is of
+ * the form 'dst = op src0, src1'. All values are 64 bits
+ * wide, only loads, stores and extensions have a size.
+ *
+ * @IR_NOP:    No operation
+ * @IR_IMM:    dst = imm
+ * @IR_ADDR:   dst = &label
+ * @IR_SLOT:   dst = &stack slot imm
+ * @IR_PARAM:  dst = parameter imm (zero extended from size)
+ * @IR_LOAD:   dst = *src0 (zero extended from size)
+ * @IR_STORE:  *src0 = src1 (truncated to size)
+ * @IR_COPY:   dst = src0
+ * @IR_ZEXT:   dst = src0 (zero extended from size)
+ * @IR_NEG:    dst = -src0
+ * @IR_ADD:    dst = src0 + src1
+ * @IR_SUB:    dst = src0 - src1
+ * @IR_MUL:    dst = src0 * src1
+ * @IR_DIV:    dst = src0 / src1
+ * @IR_MULH:   dst = high 64 bits of src0 * src1
+ * @IR_SHL:    dst = src0 << imm
+ * @IR_SHR:    dst = src0 >> imm
+ * @IR_EQ:     dst = src0 == src1
+ * @IR_NE:     dst = src0 != src1
+ * @IR_LT:     dst = src0 < src1
+ * @IR_GT:     dst = src0 > src1
+ * @IR_LE:     dst = src0 <= src1
+ * @IR_GE:     dst = src0 >= src1
+ * @IR_CALL:   dst = label(args...)
+ * @IR_JMP:    goto target0
+ * @IR_BR:     if src0 goto target0 else goto target1
+ * @IR_SWITCH: goto table[src0], src0 must be less than imm
+ * @IR_RET:    return src0 (if any)
+ * @IR_TAIL:   return label(args...), reusing the frame of the caller
+ * @IR_PHI:    dst = args[i] when entered from predecessor i
+ */
+typedef enum {
+    IR_NOP,
+    IR_IMM,
+    IR_ADDR,
+    IR_SLOT,
+    IR_PARAM,
+    IR_LOAD,
+    IR_STORE,
+    IR_COPY,
+    IR_ZEXT,
+    IR_NEG,
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MULH,
+    IR_SHL,
+    IR_SHR,
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_GT,
+    IR_LE,
+    IR_GE,
+    IR_CALL,
+    IR_JMP,
+    IR_BR,
+    IR_SWITCH,
+    IR_RET,
+    IR_TAIL,
+    IR_PHI,
+    IR_OP_MAX
+} ir_op_t;
+
+struct ir_block;
+
+/*
+ * Represents a single three-address IR instruction
+ *
+ * @op:     Operation
+ * @size:   Access size in bytes (loads, stores, extensions,
+ *          parameters and call results)
+ * @dst:    Destination register
+ * @src:    Source registers
+ * @imm:    Immediate value (IR_IMM), parameter index (IR_PARAM),
+ *          slot index (IR_SLOT, IR_PHI), shift count (IR_SHL, IR_SHR),
+ *          table size (IR_SWITCH), source offset of the statement
+ *          for diagnostics (IR_TAIL)
+ * @label:  Label operand (IR_ADDR, IR_CALL, IR_TAIL)
+ * @sym:    Symbol the label refers to, if any
+ * @args:   Call arguments (IR_CALL, IR_TAIL), incoming values
+ *          in predecessor order (IR_PHI)
+ * @argc:   Number of call arguments or incoming values
+ * @target: Branch targets (IR_JMP, IR_BR)
+ * @table:  Jump table (IR_SWITCH)
+ * @block:  Owning basic block
+ * @link:   Queue link
+ */
+struct ir_insn {
+    ir_op_t op;
+    uint8_t size;
+    ir_reg_t dst;
+    ir_reg_t src[2];
+    uint64_t imm;
+    const char *label;
+    struct symbol *sym;
+    ir_reg_t *args;
+    size_t argc;
+    struct ir_block *target[2];
+    struct ir_block **table;
+    struct ir_block *block;
+    TAILQ_ENTRY(ir_insn) link;
+};
+
+/*
+ * Represents a basic block, straight-line code that ends in
+ * exactly one terminator (IR_JMP, IR_BR, IR_SWITCH, IR_RET
+ * or IR_TAIL)
+ *
+ * @id:     Block ID, unique within its function
+ * @insns:  Instructions in order
+ * @preds:  Predecessor blocks
+ * @npreds: Number of predecessors
+ * @succs:  Successor blocks, each one only once
+ * @nsuccs: Number of successors
+ * @idom:   Immediate dominator, NULL for the entry block
+ * @order:  Position in layout (reverse postorder)
+ * @link:   Queue link
+ */
+struct ir_block {
+    size_t id;
+    TAILQ_HEAD(ir_insn_q, ir_insn) insns;
+    struct ir_block **preds;
+    size_t npreds;
+    struct ir_block **succs;
+    size_t nsuccs;
+    struct ir_block *idom;
+    size_t order;
+    TAILQ_ENTRY(ir_block) link;
+};
+
+/*
+ * Represents a procedure in IR form, the first block is
+ * the entry block
+ *
+ * @sym:         Procedure symbol
+ * @arena:       Arena everything in the function is allocated from
+ * @blocks:      Basic blocks in layout order
+ * @block_count: Number of blocks ever allocated (next block ID)
+ * @reg_count:   Number of virtual registers ever allocated
+ * @slot_count:  Number of stack slots
+ * @slot_cap:    Capacity of the slot size array
+ * @slot_size:   Size of each stack slot in bytes
+ * @link:        Queue link
+ */
+struct ir_func {
+    struct symbol *sym;
+    struct arena *arena;
+    TAILQ_HEAD(ir_block_q, ir_block) blocks;
+    size_t block_count;
+    ir_reg_t reg_count;
+    size_t slot_count;
+    size_t slot_cap;
+    uint8_t *slot_size;
+    TAILQ_ENTRY(ir_func) link;
+};
+
+/*
+ * Returns true if the instruction ends a basic block
+ *
+ * @insn: Instruction to check
+ */
+static inline bool
+ir_is_term(const struct ir_insn *insn)
+{
+    switch (insn->op) {
+    case IR_JMP:
+    case IR_BR:
+    case IR_SWITCH:
+    case IR_RET:
+    case IR_TAIL:
+        return true;
+    default:
+        return false;
+    }
+
+    return false;
+}
+
+/*
+ * Returns the terminator of a block, otherwise NULL if the
+ * block is not yet terminated
+ *
+ * @block: Block to check
+ */
+static inline struct ir_insn *
+ir_block_term(struct ir_block *block)
+{
+    struct ir_insn *insn;
+
+    insn = TAILQ_LAST(&block->insns, ir_insn_q);
+    if (insn == NULL || !ir_is_term(insn)) {
+        return NULL;
+    }
+
+    return insn;
+}
+
+/*
+ * Returns the number of use slots of an instruction, some of
+ * which may be empty (zero)
+ *
+ * @insn: Instruction to check
+ */
+static inline size_t
+ir_nuses(const struct ir_insn *insn)
+{
+    return 2 + insn->argc;
+}
+
+/*
+ * Returns a reference to a use slot of an instruction so that
+ * it may be read or rewritten
+ *
+ * @insn:  Instruction to index
+ * @index: Use slot index (less than ir_nuses())
+ */
+static inline ir_reg_t *
+ir_use(struct ir_insn *insn, size_t index)
+{
+    return (index < 2) ? &insn->src[index] : &insn->args[index - 2];
+}
+
+/*
+ * Returns the number of branch target slots of an
+ * instruction, some of which may be empty (NULL)
+ *
+ * @insn: Instruction to check
+ */
+static inline size_t
+ir_ntargets(const struct ir_insn *insn)
+{
+    return (insn->op == IR_SWITCH) ? insn->imm : 2;
+}
+
+/*
+ * Returns a reference to a branch target slot of an
+ * instruction so that it may be read or rewritten
+ *
+ * @insn:  Instruction to index
+ * @index: Target slot index (less than ir_ntargets())
+ */
+static inline struct ir_block **
+ir_target(struct ir_insn *insn, size_t index)
+{
+    return (insn->op == IR_SWITCH) ? &insn->table[index] : &insn->target[index];
+}
+
+/*
+ * Allocate a new IR function
+ *
+ * @arena: Arena to allocate from
+ * @sym:   Procedure symbol
+ * @res:   Result is written here
+ *
+ * Returns zero on success
+ */
+int ir_func_new(struct arena *arena, struct symbol *sym, struct ir_func **res);
+
+/*
+ * Allocate a new basic block and append it to a function
+ *
+ * @func: Function to append to
+ * @res:  Result is written here
+ *
+ * Returns zero on success
+ */
+int ir_block_new(struct ir_func *func, struct ir_block **res);
+
+/*
+ * Allocate a new instruction and append it to a block
+ *
+ * @func:  Owning function
+ * @block: Block to append to
+ * @op:    Instruction operation
+ * @res:   Result is written here
+ *
+ * Returns zero on success
+ */
+int ir_insn_new(
+    struct ir_func *func, struct ir_block *block,
+    ir_op_t op, struct ir_insn **res
+);
+
+/*
+ * Allocate a new virtual register
+ *
+ * @func: Function to allocate within
+ */
+ir_reg_t ir_reg_new(struct ir_func *func);
+
+/*
+ * Allocate a new stack slot
+ *
+ * @func: Function to allocate within
+ * @size: Size of the slot in bytes
+ * @res:  Slot index is written here
+ *
+ * Returns zero on success
+ */
+int ir_slot_new(struct ir_func *func, uint8_t size, size_t *res);
+
+/*
+ * Returns true if every path from the entry to a block
+ * goes through another, a block dominates itself
+ *
+ * @dom:   Possible dominator
+ * @block: Block to check
+ */
+static inline bool
+ir_dominates(const struct ir_block *dom, const struct ir_block *block)
+{
+    while (block != NULL && block->order > dom->order) {
+        block = block->idom;
+    }
+
+    return block == dom;
+}
+
+/*
+ * Rebuild the control flow graph of a function, computing
+ * successors, predecessors and dominators and dropping
+ * unreachable blocks. Incoming values of phis are kept in
+ * step with the predecessors, edges may go away but never
+ * be added while there are phis.
+ *
+ * @func: Function to rebuild
+ *
+ * Returns zero on success
+ */
+int ir_cfg_build(struct ir_func *func);
+
+/*
+ * Turn calls in tail position into tail calls, a call is in
+ * tail position if the procedure returns right after it with
+ * either nothing or the result of the call, and that result is
+ * at least as wide as its own. Must run before the control
+ * flow graph is built.
+ *
+ * @func:     Function to rewrite
+ * @can_tail: Returns true if the target can make a call a tail call
+ */
+void ir_tail_calls(struct ir_func *func,
+    bool(*can_tail)(const struct ir_func *, const struct ir_insn *));
+
+/*
+ * Dump a function in human readable form
+ *
+ * @func: Function to dump
+ * @fp:   Stream to dump to
+ */
+void ir_dump(struct ir_func *func, FILE *fp);
+
+#endif  /* !GUP_IR_H */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_JIT_H
+#define GUP_JIT_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/elf.h"
+
+/*
+ * Represents an object loaded into executable memory
+ *
+ * @base:    Base of the mapping
+ * @size:    Size of the mapping
+ * @secbase: Load address of each section
+ * @stubs:   Jump stub per symbol, 0 if it has none
+ */
+struct jit_image {
+    uint8_t *base;
+    size_t size;
+    uintptr_t secbase[ELF_SEC_MAX];
+    uintptr_t *stubs;
+};
+
+/*
+ * Load an object into memory, resolve symbols it does not
+ * define against the running process and apply relocations.
+ *
+ * @res: Image to initialize
+ * @obj: Object to load
+ *
+ * Returns zero on success
+ */
+int jit_load(struct jit_image *res, const struct elf_obj *obj);
+
+/*
+ * Look up the address of a symbol defined by a loaded object
+ *
+ * @img:  Loaded image
+ * @obj:  Object the image was loaded from
+ * @name: Symbol name
+ *
+ * Returns the address of the symbol, or NULL if not defined
+ */
+void *jit_sym(const struct jit_image *img, const struct elf_obj *obj,
+    const char *name);
+
+/*
+ * Unmap a loaded image
+ *
+ * @img: Image to unload
+ */
+void jit_unload(struct jit_image *img);
+
+#endif  /* !GUP_JIT_H */
@@ -7,7 +7,41 @@
 #define GUP_MU_H 1
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "gup/state.h"
+#include "gup/ir.h"
+
+/*
+ * Represents the kinds of data a global may be
+ * initialized with
+ *
+ * @MU_DATA_ZERO:  Zero filled (or uninitialized)
+ * @MU_DATA_INT:   Integer constant
+ * @MU_DATA_ADDR:  Address of another label
+ */
+typedef enum {
+    MU_DATA_ZERO,
+    MU_DATA_INT,
+    MU_DATA_ADDR
+} mu_data_t;
+
+/*
+ * Describes the storage and contents of a global
+ *
+ * @type:  Kind of initializer
+ * @size:  Size of the storage in bytes
+ * @align: Required alignment in bytes
+ * @value: Integer value (MU_DATA_INT)
+ * @label: Label to take the address of (MU_DATA_ADDR)
+ */
+struct mu_data {
+    mu_data_t type;
+    size_t size;
+    size_t align;
+    uint64_t value;
+    const char *label;
+};
 
 /*
  * Emit a label into assembly
@@ -29,4 +63,109 @@ int mu_emit_label(struct gup_state *state, const char *label, bool global);
  */
 int mu_emit_ret(struct gup_state *state);
 
+/*
+ * Emit a global variable, zero filled globals are reserved
+ * in '.bss' while everything else goes in '.data'
+ *
+ * @state:  Compiler state
+ * @name:   Name of the global
+ * @global: If true, symbol is global
+ * @data:   Storage and contents of the global
+ *
+ * Returns zero on success
+ */
+int mu_emit_global(
+    struct gup_state *state, const char *name,
+    bool global, const struct mu_data *data
+);
+
+/*
+ * Emit machine code for a procedure from its IR
+ *
+ * @state: Compiler state
+ * @func:  Procedure IR
+ *
+ * Returns zero on success
+ */
+int mu_emit_proc(struct gup_state *state, struct ir_func *func);
+
+/*
+ * Declare a symbol defined outside of the translation unit
+ *
+ * @state: Compiler state
+ * @name:  Symbol name
+ *
+ * Returns zero on success
+ */
+int mu_emit_extern(struct gup_state *state, const char *name);
+
+/*
+ * Emit every literal in the string pool into the read-only
+ * data section
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+int mu_emit_strpool(struct gup_state *state);
+
+/*
+ * Finish the output once everything has been emitted, when
+ * emitting an object this is where it gets written out
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+int mu_finish(struct gup_state *state);
+
+/*
+ * Apply a machine specific target option (-m), one of:
+ *
+ * 'arch=<cpu>'       Assume what a CPU supports
+ * 'features=<list>'  Enable a comma separated list of CPU
+ *                    features, 'no-<feature>' disables one
+ * '<feature>'        Same for a single feature
+ *
+ * @opt:      Option text
+ * @features: CPU features generated code may use, updated
+ *
+ * Returns zero on success
+ */
+int mu_target_opt(const char *opt, uint32_t *features);
+
+/*
+ * Returns true if a call can be made as a tail call which
+ * reuses the frame of the caller
+ *
+ * @func: Procedure making the call
+ * @call: IR_CALL instruction
+ */
+bool mu_can_tail(const struct ir_func *func, const struct ir_insn *call);
+
+/*
+ * Write a stub that jumps to an absolute address, used by the
+ * JIT to reach symbols out of range of a direct branch
+ *
+ * @buf:    Buffer to write the stub to, NULL to only get the size
+ * @target: Address to jump to
+ *
+ * Returns the size of the stub in bytes
+ */
+size_t mu_jit_stub(uint8_t *buf, uint64_t target);
+
+/*
+ * Apply a relocation to code or data loaded in memory
+ *
+ * @place:  Address being patched
+ * @value:  Address of the symbol
+ * @stub:   Address of the stub for the symbol, 0 if none
+ * @type:   Machine specific relocation type
+ * @addend: Relocation addend
+ *
+ * Returns zero on success
+ */
+int mu_jit_reloc(uint8_t *place, uint64_t value, uint64_t stub,
+    uint32_t type, int64_t addend);
+
 #endif  /* !GUP_MU_H */
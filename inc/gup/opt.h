@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_OPT_H
+#define GUP_OPT_H 1
+
+#include <stdbool.h>
+#include "gup/ir.h"
+
+/*
+ * Returns true if an instruction has no effect beyond its
+ * destination register, so it can go once that is unused
+ *
+ * @insn: Instruction to check
+ */
+static inline bool
+ir_is_pure(const struct ir_insn *insn)
+{
+    switch (insn->op) {
+    case IR_IMM:
+    case IR_ADDR:
+    case IR_SLOT:
+    case IR_PARAM:
+    case IR_LOAD:
+    case IR_COPY:
+    case IR_ZEXT:
+    case IR_NEG:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_MULH:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_GT:
+    case IR_LE:
+    case IR_GE:
+    case IR_PHI:
+        return true;
+    default:
+        return false;
+    }
+
+    return false;
+}
+
+/*
+ * Promote stack slots that are only loaded from and stored
+ * to into registers, placing phis where stores meet. Needs
+ * the control flow graph.
+ *
+ * @func: Function to rewrite
+ *
+ * Returns zero on success
+ */
+int ir_mem2reg(struct ir_func *func);
+
+/*
+ * Replace phis with copies at the end of each predecessor,
+ * which the backend can deal with
+ *
+ * @func: Function to rewrite
+ *
+ * Returns zero on success
+ */
+int ir_ssa_lower(struct ir_func *func);
+
+/*
+ * Sparse conditional constant propagation, folds whatever is
+ * constant on every path that can run and turns branches on
+ * constants into jumps. Needs the control flow graph, which
+ * must be built again afterwards to drop the blocks left
+ * unreachable.
+ *
+ * @func: Function to rewrite
+ *
+ * Returns zero on success
+ */
+int ir_sccp(struct ir_func *func);
+
+/*
+ * Global value numbering, computations (address ones included)
+ * done again where an earlier result is still available are
+ * rewritten to use it, loads only while memory is known to be
+ * unchanged. Needs the control flow graph, what it leaves
+ * unused is up to ir_dce() to remove.
+ *
+ * @func: Function to rewrite
+ *
+ * Returns zero on success
+ */
+int ir_gvn(struct ir_func *func);
+
+/*
+ * Remove pure instructions whose results never reach anything
+ * with an effect, dead cycles (such as through phis) included
+ *
+ * @func: Function to rewrite
+ *
+ * Returns zero on success
+ */
+int ir_dce(struct ir_func *func);
+
+/*
+ * Represents a natural loop, the blocks reaching a back edge
+ * into the header without going through it
+ *
+ * @header: Block every iteration starts in, it dominates the loop
+ * @pre:    Only block entering the loop from outside, NULL unless
+ *          it jumps to the header and nowhere else
+ * @latch:  Only block jumping back to the header, NULL if several do
+ * @body:   Set for blocks within the loop, indexed by block ID
+ * @size:   Number of blocks within the loop
+ * @link:   Queue link
+ */
+struct ir_loop {
+    struct ir_block *header;
+    struct ir_block *pre;
+    struct ir_block *latch;
+    uint8_t *body;
+    size_t size;
+    TAILQ_ENTRY(ir_loop) link;
+};
+
+TAILQ_HEAD(ir_loop_q, ir_loop);
+
+/*
+ * Find the natural loops of a function, inner loops come
+ * before the loops containing them. Needs the control flow
+ * graph, the result stays valid until it changes.
+ *
+ * @func: Function to look at
+ * @res:  Loops are added here
+ *
+ * Returns zero on success
+ */
+int ir_loop_find(struct ir_func *func, struct ir_loop_q *res);
+
+/*
+ * Loop invariant code motion, pure computations giving the
+ * same result on every iteration move to the block entering
+ * the loop. Loads only move out of loops that never store or
+ * call.
+ *
+ * @func:  Function to rewrite
+ * @loops: Loops found by ir_loop_find()
+ *
+ * Returns zero on success
+ */
+int ir_licm(struct ir_func *func, struct ir_loop_q *loops);
+
+/*
+ * Induction variable strength reduction, a multiplication of
+ * a value stepped by a constant amount each iteration (i) by
+ * a loop invariant one (k) becomes a value of its own that
+ * is stepped by k times the step. What it leaves unused is
+ * up to ir_dce() to remove.
+ *
+ * @func:  Function to rewrite
+ * @loops: Loops found by ir_loop_find()
+ *
+ * Returns zero on success
+ */
+int ir_ivsr(struct ir_func *func, struct ir_loop_q *loops);
+
+/*
+ * Strength reduce multiplications and divisions by constants,
+ * powers of two become shifts and other divisors a multiply
+ * by their reciprocal (IR_MULH). What it leaves unused is up
+ * to ir_dce() to remove.
+ *
+ * @func: Function to rewrite
+ *
+ * Returns zero on success
+ */
+int ir_muldiv(struct ir_func *func);
+
+#endif  /* !GUP_OPT_H */
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_OUTBUF_H
+#define GUP_OUTBUF_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Size of a single output chunk */
+#define OUTBUF_CHUNK_SIZE 0x40000
+
+/* Chunks gathered into a single writev() */
+#define OUTBUF_CHUNK_MAX 16
+
+/*
+ * An append-only output buffer, data is gathered into large
+ * chunks which are written out together once all of them
+ * fill up or the buffer is flushed.
+ *
+ * @fd:     File descriptor to write to
+ * @chunks: Chunk storage
+ * @fill:   Bytes used per chunk
+ * @cur:    Index of the chunk being appended to
+ * @head:   Chunk being appended to
+ * @len:    Bytes used in the chunk being appended to
+ * @error:  Set once a write or allocation failed
+ */
+struct outbuf {
+    int fd;
+    char *chunks[OUTBUF_CHUNK_MAX];
+    size_t fill[OUTBUF_CHUNK_MAX];
+    size_t cur;
+    char *head;
+    size_t len;
+    int error;
+};
+
+/*
+ * Represents a pre-rendered output fragment
+ *
+ * @s:   Fragment text
+ * @len: Length of the text
+ */
+struct outbuf_frag {
+    const char *s;
+    size_t len;
+};
+
+/* Build a fragment from a string literal */
+#define OUTBUF_FRAG(str) \
+    { (str), sizeof(str) - 1 }
+
+/*
+ * Initialize an output buffer
+ *
+ * @res: Buffer to initialize
+ * @fd:  File descriptor to write to
+ *
+ * Returns zero on success
+ */
+int outbuf_init(struct outbuf *res, int fd);
+
+/*
+ * Write out everything buffered so far
+ *
+ * @ob: Buffer to flush
+ *
+ * Returns zero on success, or -1 if this or any earlier
+ * operation on the buffer failed
+ */
+int outbuf_flush(struct outbuf *ob);
+
+/*
+ * Release the chunks of an output buffer, anything not yet
+ * flushed is discarded
+ *
+ * @ob: Buffer to destroy
+ */
+void outbuf_destroy(struct outbuf *ob);
+
+/*
+ * Append data that does not fit in the current chunk
+ *
+ * @ob:   Buffer to append to
+ * @data: Data to append
+ * @len:  Length of data
+ *
+ * Returns zero on success
+ */
+int outbuf_write_slow(struct outbuf *ob, const void *data, size_t len);
+
+/*
+ * Append an unsigned integer in decimal
+ *
+ * @ob: Buffer to append to
+ * @v:  Value to append
+ *
+ * Returns zero on success
+ */
+int outbuf_putu(struct outbuf *ob, uint64_t v);
+
+/*
+ * Append a signed integer in decimal
+ *
+ * @ob: Buffer to append to
+ * @v:  Value to append
+ *
+ * Returns zero on success
+ */
+int outbuf_puti(struct outbuf *ob, int64_t v);
+
+/*
+ * Append raw data
+ *
+ * @ob:   Buffer to append to
+ * @data: Data to append
+ * @len:  Length of data
+ *
+ * Returns zero on success
+ */
+static inline int
+outbuf_write(struct outbuf *ob, const void *data, size_t len)
+{
+    if (len <= OUTBUF_CHUNK_SIZE - ob->len) {
+        memcpy(ob->head + ob->len, data, len);
+        ob->len += len;
+        return 0;
+    }
+
+    return outbuf_write_slow(ob, data, len);
+}
+
+/*
+ * Append a single character
+ *
+ * @ob: Buffer to append to
+ * @c:  Character to append
+ */
+static inline int
+outbuf_putc(struct outbuf *ob, char c)
+{
+    if (ob->len < OUTBUF_CHUNK_SIZE) {
+        ob->head[ob->len++] = c;
+        return 0;
+    }
+
+    return outbuf_write_slow(ob, &c, 1);
+}
+
+/*
+ * Append a NUL terminated string, such as an identifier
+ *
+ * @ob: Buffer to append to
+ * @s:  String to append
+ */
+static inline int
+outbuf_puts(struct outbuf *ob, const char *s)
+{
+    return outbuf_write(ob, s, strlen(s));
+}
+
+/*
+ * Append a pre-rendered fragment
+ *
+ * @ob:   Buffer to append to
+ * @frag: Fragment to append
+ */
+static inline int
+outbuf_frag(struct outbuf *ob, const struct outbuf_frag *frag)
+{
+    return outbuf_write(ob, frag->s, frag->len);
+}
+
+#endif  /* !GUP_OUTBUF_H */
@@ -34,4 +34,25 @@ tt_t scope_top(struct gup_state *state);
  */
 tt_t scope_pop(struct gup_state *state);
 
+/*
+ * Find the innermost loop scope
+ *
+ * @state: Compiler state
+ *
+ * Returns the index of the loop scope within the scope stack,
+ * or a less than zero value if not within a loop
+ */
+int scope_loop(struct gup_state *state);
+
+/*
+ * Find the innermost scope a 'break' leaves, either a
+ * loop or a 'switch'
+ *
+ * @state: Compiler state
+ *
+ * Returns the index of the scope within the scope stack,
+ * or a less than zero value if there is none
+ */
+int scope_break(struct gup_state *state);
+
 #endif  /* !GUP_SCOPE_H */
@@ -12,39 +12,104 @@
 #include "gup/tokbuf.h"
 #include "gup/ptrbox.h"
 #include "gup/symbol.h"
+#include "gup/strpool.h"
+#include "gup/arena.h"
+#include "gup/outbuf.h"
+#include "gup/elf.h"
+#include "gup/ir.h"
 
 /* Maximum scope depth */
 #define SCOPE_STACK_MAX 8
 
+/*
+ * IR construction state for the procedure being generated
+ *
+ * @func:   Function being built
+ * @block:  Block being appended to
+ * @alt:    Per-scope 'else' block, or the continuation if there is none
+ *          (where 'break' goes in a loop)
+ * @join:   Per-scope join block after an 'else' (where 'continue'
+ *          goes in a loop)
+ * @head:   Per-scope loop header, the condition is checked here
+ * @step:   Per-scope step of a 'for' loop
+ * @sw:     Per-scope 'switch' being built
+ * @params: Register holding each parameter
+ */
+struct ir_builder {
+    struct ir_func *func;
+    struct ir_block *block;
+    struct ir_block *alt[SCOPE_STACK_MAX];
+    struct ir_block *join[SCOPE_STACK_MAX];
+    struct ir_block *head[SCOPE_STACK_MAX];
+    struct ast_node *step[SCOPE_STACK_MAX];
+    struct ir_switch *sw[SCOPE_STACK_MAX];
+    ir_reg_t params[PROC_MAX_PARAMS];
+};
+
 /*
  * Represents the compiler state
  *
- * @in_fd:      Input file descriptor
- * @out_fp:     Output file pointer
+ * @in_buf:     Input source buffer
+ * @in_len:     Length of input source buffer
+ * @in_off:     Current lexer offset into input source
+ * @out_fd:     Output file descriptor
+ * @out:        Buffered output
  * @cur_pass:   Current compiler pass (0-based)
- * @line_num:   Current line number
+ * @tok_off:    Input offset of the most recent token
+ * @nl_index:   Offsets of each newline in the input (built lazily)
+ * @nl_count:   Number of entries in the newline index
  * @ifx_depth:  #IFXXX directive depth
  * @putback:    Lexer putback buffer
+ * @section:    Current output section (owned by the backend)
  * @scope_depth: Current scope depth
  * @scope_stack: Used to keep track of scope
  * @mactoks:    Macro tokens left
  * @tokbuf:     Parser token buffer
  * @ptrbox:     Global pointer box
  * @symtab:     Global symbol table
+ * @strpool:    String literal pool
+ * @ir_arena:   Arena backing all IR in the translation unit
+ * @irb:        IR builder state
+ * @procs:      Procedures awaiting emission, in definition order
+ * @entry:      Procedure kept even if unreferenced (e.g., JIT entry)
+ * @elf:        Object being built (if 'emit_obj')
+ * @features:   CPU features generated code may use (machine
+ *              specific, see mu_target_opt())
+ * @dump_ir:    If set, dump IR to stdout before emission
+ * @emit_obj:   If set, emit an ELF object instead of assembly
+ * @jit:        If set, keep the object in memory for the JIT
+ * @no_redzone: If set, never touch memory below the stack pointer
  */
 struct gup_state {
-    int in_fd;
-    FILE *out_fp;
+    char *in_buf;
+    size_t in_len;
+    size_t in_off;
+    int out_fd;
+    struct outbuf out;
     uint8_t cur_pass;
-    size_t line_num;
+    size_t tok_off;
+    size_t *nl_index;
+    size_t nl_count;
     size_t ifx_depth;
     char putback;
+    uint8_t section;
     uint8_t scope_depth;
     tt_t scope_stack[SCOPE_STACK_MAX];
     struct tokbuf *mactoks;
     struct tokbuf tokbuf;
     struct ptrbox ptrbox;
     struct symbol_table symtab;
+    struct strpool strpool;
+    struct arena ir_arena;
+    struct ir_builder irb;
+    TAILQ_HEAD(ir_func_q, ir_func) procs;
+    const char *entry;
+    struct elf_obj elf;
+    uint32_t features;
+    uint8_t dump_ir : 1;
+    uint8_t emit_obj : 1;
+    uint8_t jit : 1;
+    uint8_t no_redzone : 1;
 };
 
 /*
@@ -52,12 +117,25 @@ struct gup_state {
  *
  * @res:        Result is written here
  * @in_path:    Input file path
- * @out_path:   Output file path
+ * @out_path:   Output file path, NULL to write nothing
  *
  * Returns zero on success
  */
 int gup_state_init(struct gup_state *res, const char *in_path, const char *out_path);
 
+/*
+ * Compute the line and column of an input source offset, the
+ * newline index is built on first use.
+ *
+ * @state: Compiler state
+ * @off:   Input source offset
+ * @line:  1-based line number is written here
+ * @col:   1-based column number is written here
+ *
+ * Returns zero on success
+ */
+int gup_state_locate(struct gup_state *state, size_t off, size_t *line, size_t *col);
+
 /*
  * Destroy a previously initialized GUP state
  *
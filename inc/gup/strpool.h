@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_STRPOOL_H
+#define GUP_STRPOOL_H 1
+
+#include <sys/queue.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Format of the label given to a pooled literal */
+#define STRPOOL_LABEL_PREFIX "str."
+#define STRPOOL_LABEL_FMT STRPOOL_LABEL_PREFIX "%zu"
+
+/*
+ * Represents a unique string literal within the pool
+ *
+ * @data:   String data (NUL terminated)
+ * @len:    Length of data excluding the terminator
+ * @hash:   Content hash of the data
+ * @id:     Pool-wide literal ID, used to form its label
+ * @chain:  Next entry in the same hash bucket
+ * @link:   Queue link (insertion order)
+ */
+struct strpool_entry {
+    char *data;
+    size_t len;
+    uint64_t hash;
+    size_t id;
+    struct strpool_entry *chain;
+    TAILQ_ENTRY(strpool_entry) link;
+};
+
+/*
+ * A string pool deduplicates string literals across a
+ * translation unit so that each unique literal is only
+ * emitted once.
+ *
+ * @entries:      Unique entries in insertion order
+ * @buckets:      Hash buckets
+ * @bucket_count: Number of hash buckets (power of two)
+ * @entry_count:  Number of unique entries
+ */
+struct strpool {
+    TAILQ_HEAD(, strpool_entry) entries;
+    struct strpool_entry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+};
+
+/*
+ * Initialize a string pool
+ *
+ * @res: Pool to initialize
+ *
+ * Returns zero on success
+ */
+int strpool_init(struct strpool *res);
+
+/*
+ * Intern a string literal, returning the entry of an identical
+ * literal if one already exists in the pool
+ *
+ * @pool: Pool to intern within
+ * @data: String data
+ * @len:  Length of string data
+ * @res:  Pool entry is written here
+ *
+ * Returns zero on success
+ */
+int strpool_intern(
+    struct strpool *pool, const char *data,
+    size_t len, struct strpool_entry **res
+);
+
+/*
+ * Destroy a string pool
+ *
+ * @pool: Pool to destroy
+ */
+void strpool_destroy(struct strpool *pool);
+
+#endif  /* !GUP_STRPOOL_H */
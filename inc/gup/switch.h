@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#ifndef GUP_SWITCH_H
+#define GUP_SWITCH_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gup/ir.h"
+
+/* Fewest cases worth a jump table */
+#define SWITCH_TABLE_MIN 4
+
+/* Most entries a single jump table may have */
+#define SWITCH_TABLE_MAX 4096
+
+/* Lowest percentage of jump table entries that must be cases */
+#define SWITCH_DENSITY 40
+
+/* Most case clusters tested one after another */
+#define SWITCH_CHAIN_MAX 3
+
+/*
+ * Represents a single 'case' of a switch
+ *
+ * @v:     Case value
+ * @block: Block the case starts
+ */
+struct ir_case {
+    uint64_t v;
+    struct ir_block *block;
+};
+
+/*
+ * Represents a switch statement being built
+ *
+ * @sel:      Register holding the selector
+ * @dispatch: Unterminated block the dispatch goes into
+ * @def:      Block of the 'default' label, NULL if none
+ * @cases:    Cases in source order
+ * @ncases:   Number of cases
+ * @cap:      Capacity of the case array
+ */
+struct ir_switch {
+    ir_reg_t sel;
+    struct ir_block *dispatch;
+    struct ir_block *def;
+    struct ir_case *cases;
+    size_t ncases;
+    size_t cap;
+};
+
+/*
+ * Add a case to a switch, case values must be distinct
+ *
+ * @func:  Function the switch is in
+ * @sw:    Switch to add to
+ * @v:     Case value
+ * @block: Block the case starts
+ *
+ * Returns zero on success
+ */
+int ir_switch_add(struct ir_func *func, struct ir_switch *sw, uint64_t v,
+    struct ir_block *block);
+
+/*
+ * Lower the dispatch of a switch once all of its cases are
+ * known. Dense runs of cases become bounds checked jump
+ * tables, the rest is found by a balanced binary search that
+ * ends in short chains of compares.
+ *
+ * @func: Function the switch is in
+ * @sw:   Switch to lower
+ * @exit: Block following the switch
+ *
+ * Returns zero on success
+ */
+int ir_switch_lower(struct ir_func *func, struct ir_switch *sw,
+    struct ir_block *exit);
+
+#endif  /* !GUP_SWITCH_H */
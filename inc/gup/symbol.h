@@ -13,19 +13,31 @@
 #include "gup/tokbuf.h"
 #include "gup/types.h"
 
+struct ir_func;
+
 /* Symbol ID */
 typedef size_t symid_t;
 
+/* Maximum number of procedure parameters */
+#define PROC_MAX_PARAMS 16
+
 /*
  * Represents valid program symbol times
  *
  * @SYMBOL_NONE:  Symbol has a no type
  * @SYMBOL_MACRO: Symbol is a macro
+ * @SYMBOL_FUNC:  Symbol is a procedure
+ * @SYMBOL_VAR:   Symbol is a global variable
+ * @SYMBOL_PARAM: Symbol is a parameter of the current procedure
+ * @SYMBOL_LOCAL: Symbol is a local variable of the current procedure
  */
 typedef enum {
     SYMBOL_NONE,
     SYMBOL_MACRO,
-    SYMBOL_FUNC
+    SYMBOL_FUNC,
+    SYMBOL_VAR,
+    SYMBOL_PARAM,
+    SYMBOL_LOCAL
 } symbol_type_t;
 
 /*
@@ -35,7 +47,22 @@ typedef enum {
  * @type:       Symbol type
  * @id:         Symbol ID
  * @pub:        If set, is public
+ * @defined:    If set, procedure has a body
+ * @fwdcall:    If set, procedure was called before its body was seen
+ * @internal:   If set, procedure uses the internal calling convention
+ * @emitted:    If set, machine code for the procedure is out
+ * @aligned:    If set, calls must keep the stack aligned (once emitted)
+ * @always_inline: If set, procedure is inlined wherever possible
+ * @noinline:   If set, procedure is never inlined
+ * @live:       If set, procedure is reachable from a public one
+ * @clobbers:   Registers a call clobbers, backend specific (once emitted)
+ * @ir:         IR of the procedure kept for inlining (once defined)
  * @dtype:      Data type to lookup
+ * @nparams:    Number of parameters (procedures)
+ * @params:     Parameter types (procedures)
+ * @argno:      Parameter index (parameters)
+ * @slot:       Stack slot index (locals)
+ * @depth:      Scope depth the symbol was declared at (locals)
  * @mactok:     Macro tokens
  * @link:       Queue link
  */
@@ -44,7 +71,22 @@ struct symbol {
     symbol_type_t type;
     symid_t id;
     uint8_t pub : 1;
+    uint8_t defined : 1;
+    uint8_t fwdcall : 1;
+    uint8_t internal : 1;
+    uint8_t emitted : 1;
+    uint8_t aligned : 1;
+    uint8_t always_inline : 1;
+    uint8_t noinline : 1;
+    uint8_t live : 1;
+    uint32_t clobbers;
+    struct ir_func *ir;
     struct data_type dtype;
+    uint8_t nparams;
+    struct data_type params[PROC_MAX_PARAMS];
+    uint8_t argno;
+    size_t slot;
+    uint8_t depth;
     struct tokbuf mactok;
     TAILQ_ENTRY(symbol) link;
 };
@@ -105,6 +147,23 @@ int symbol_new(
     symbol_type_t type, struct symbol **res
 );
 
+/*
+ * Remove and free every symbol of a given type
+ *
+ * @table: Symbol table to remove from
+ * @type:  Symbol type to remove
+ */
+void symbol_drop(struct symbol_table *table, symbol_type_t type);
+
+/*
+ * Remove and free every local declared deeper than a given
+ * scope depth
+ *
+ * @table: Symbol table to remove from
+ * @depth: Scope depth left
+ */
+void symbol_drop_scope(struct symbol_table *table, uint8_t depth);
+
 /*
  * Destroy a symbol table
  *
@@ -58,6 +58,16 @@ int tokbuf_push(struct tokbuf *buf, struct token *tok);
  */
 struct token *tokbuf_pop(struct tokbuf *buf);
 
+/*
+ * Peek at the token at the start of the token buffer
+ * without popping it
+ *
+ * @buf: Buffer to peek
+ *
+ * Returns NULL if there are no more tokens
+ */
+struct token *tokbuf_peek(struct tokbuf *buf);
+
 /*
  * Lookbehind the current token buffer position with n steps
  *
@@ -15,6 +15,8 @@
 typedef enum {
     TT_NONE,        /* <NONE> */
     TT_IDENT,       /* <IDENT> */
+    TT_STRING,      /* <STRING> */
+    TT_NUMBER,      /* <NUMBER> */
     TT_NEWLINE,     /* '\n' */
     TT_DEFINE,      /* '#define' */
     TT_IFDEF,       /* '#ifdef' */
@@ -34,16 +36,48 @@ typedef enum {
     TT_LBRACE,      /* '{' */
     TT_RBRACE,      /* '}' */
     TT_SEMI,        /* ';' */
+    TT_COMMA,       /* ',' */
+    TT_COLON,       /* ':' */
+    TT_EQUALS,      /* '=' */
+    TT_EQEQ,        /* '==' */
+    TT_NE,          /* '!=' */
     TT_PUB,         /* 'pub' */
     TT_PROC,        /* 'proc' */
     TT_VOID,        /* 'void' */
+    TT_U8,          /* 'u8' */
+    TT_U16,         /* 'u16' */
+    TT_U32,         /* 'u32' */
+    TT_U64,         /* 'u64' */
+    TT_RETURN,      /* 'return' */
+    TT_IF,          /* 'if' */
+    TT_ELSE,        /* 'else' */
+    TT_TAIL,        /* 'tail' */
+    TT_INLINE,      /* 'inline' */
+    TT_NOINLINE,    /* 'noinline' */
+    TT_WHILE,       /* 'while' */
+    TT_FOR,         /* 'for' */
+    TT_BREAK,       /* 'break' */
+    TT_CONTINUE,    /* 'continue' */
+    TT_SWITCH,      /* 'switch' */
+    TT_CASE,        /* 'case' */
+    TT_DEFAULT,     /* 'default' */
 } tt_t;
 
+/*
+ * Represents a lexical token
+ *
+ * @type: Token type
+ * @off:  Byte offset of the token within the input source
+ * @len:  Length of string literal data (excluding terminator)
+ */
 struct token {
     tt_t type;
+    size_t off;
+    size_t len;
     union {
         char c;
         char *s;
+        uint64_t v;
     };
 };
 
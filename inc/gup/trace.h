@@ -7,9 +7,27 @@
 #define GUP_TRACE_H 1
 
 #include <stdio.h>
+#include "gup/state.h"
 
 #define trace_error(state, fmt, ...)            \
     printf("[error] " fmt, ##__VA_ARGS__);      \
-    printf("near line %zu\n", (state)->line_num);
+    trace_where((state));
+
+/*
+ * Print the source location of the most recent token
+ *
+ * @state: Compiler state
+ */
+static inline void
+trace_where(struct gup_state *state)
+{
+    size_t line, col;
+
+    if (gup_state_locate(state, state->tok_off, &line, &col) < 0) {
+        return;
+    }
+
+    printf("near line %zu, column %zu\n", line, col);
+}
 
 #endif  /* !GUP_TRACE_H */
@@ -6,6 +6,8 @@
 #ifndef GUP_TYPES_H
 #define GUP_TYPES_H 1
 
+#include <stdint.h>
+#include <stddef.h>
 #include "gup/token.h"
 
 /*
@@ -13,19 +15,29 @@
  *
  * @GUP_TYPE_BAD:   Invalid type
  * @GUP_TYPE_VOID:  Type absent
+ * @GUP_TYPE_U8:    Unsigned 8-bit integer
+ * @GUP_TYPE_U16:   Unsigned 16-bit integer
+ * @GUP_TYPE_U32:   Unsigned 32-bit integer
+ * @GUP_TYPE_U64:   Unsigned 64-bit integer
  */
 typedef enum {
     GUP_TYPE_BAD,
-    GUP_TYPE_VOID
+    GUP_TYPE_VOID,
+    GUP_TYPE_U8,
+    GUP_TYPE_U16,
+    GUP_TYPE_U32,
+    GUP_TYPE_U64
 } gup_type_t;
 
 /*
  * Represents a valid data type
  *
- * @type: Data type class
+ * @type:      Data type class
+ * @ptr_depth: Levels of pointer indirection
  */
 struct data_type {
     gup_type_t type;
+    uint8_t ptr_depth;
 };
 
 /*
@@ -40,10 +52,37 @@ tok_to_type(tt_t tt)
 {
     switch (tt) {
     case TT_VOID:   return GUP_TYPE_VOID;
+    case TT_U8:     return GUP_TYPE_U8;
+    case TT_U16:    return GUP_TYPE_U16;
+    case TT_U32:    return GUP_TYPE_U32;
+    case TT_U64:    return GUP_TYPE_U64;
     default:        return GUP_TYPE_BAD;
     }
 
     return GUP_TYPE_BAD;
 }
 
+/*
+ * Returns the size of a data type in bytes
+ *
+ * @dtype: Data type to check
+ */
+static inline size_t
+type_size(const struct data_type *dtype)
+{
+    if (dtype->ptr_depth > 0) {
+        return sizeof(uint64_t);
+    }
+
+    switch (dtype->type) {
+    case GUP_TYPE_U8:   return 1;
+    case GUP_TYPE_U16:  return 2;
+    case GUP_TYPE_U32:  return 4;
+    case GUP_TYPE_U64:  return 8;
+    default:            return 0;
+    }
+
+    return 0;
+}
+
 #endif  /* !GUP_TYPES_H */
@@ -5,6 +5,14 @@
 
 TARGET = x86_64
 
+# CPU the generated code may assume (-march) and features
+# enabled or disabled on top of it (-mfeatures), e.g.:
+#   MARCH = x86-64-v3
+#   MFEATURES = no-avx2,popcnt
+MARCH = x86-64
+MFEATURES =
+
 # Host compiler
 CC = gcc
-CFLAGS = -Wall -pedantic -Iinc/ -MMD
+CFLAGS = -Wall -pedantic -Iinc/ -MMD \
+    -DGUP_MARCH=\"$(MARCH)\" -DGUP_MFEATURES=\"$(MFEATURES)\"
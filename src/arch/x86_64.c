@@ -3,9 +3,1827 @@
  * Provided under the BSD-3 clause.
  */
 
+#include <elf.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include "gup/mu.h"
+#include "gup/arch/x86_64.h"
+
+/*
+ * Valid output sections
+ */
+typedef enum {
+    SECTION_NONE,
+    SECTION_TEXT,
+    SECTION_DATA,
+    SECTION_BSS,
+    SECTION_RODATA
+} section_t;
+
+static const struct outbuf_frag sectab[] = {
+    [SECTION_TEXT]   = OUTBUF_FRAG("section .text\n"),
+    [SECTION_DATA]   = OUTBUF_FRAG("section .data\n"),
+    [SECTION_BSS]    = OUTBUF_FRAG("section .bss\n"),
+    [SECTION_RODATA] = OUTBUF_FRAG("section .rodata\n")
+};
+
+/*
+ * Switch the output section if it is not already current
+ *
+ * @state:   Compiler state
+ * @section: Section to switch to
+ */
+static void
+mu_section(struct gup_state *state, section_t section)
+{
+    if (state->section == section) {
+        return;
+    }
+
+    outbuf_frag(&state->out, &sectab[section]);
+    state->section = section;
+}
+
+/*
+ * Per-procedure emission context
+ *
+ * @state:   Compiler state
+ * @func:    Procedure being emitted
+ * @conv:    Calling convention of the procedure
+ * @sel:     Instruction selection result
+ * @ra:      Register allocation result
+ * @buf:     Buffered machine instructions
+ * @nsaved:  Number of callee-saved registers preserved
+ * @saved:   Callee-saved registers preserved, in save order
+ * @local:   Offset of each local stack slot in the locals area
+ * @nlocal:  Size of the locals area in bytes, a multiple of 8
+ * @frame:   Size of the frame below the saved frame pointer
+ * @nout:    Arguments passed on the stack by the largest call
+ * @base:    Register frame slots are addressed from
+ * @bias:    Offset of the frame top from the base register
+ * @align:   Set if calls need the stack 16 byte aligned
+ * @error:   Set if buffering an instruction failed
+ * @scratch: Scratch registers taken by the tree being emitted
+ */
+struct x86_ctx {
+    struct gup_state *state;
+    struct ir_func *func;
+    const struct x86_conv *conv;
+    struct x86_isel sel;
+    struct ra_result ra;
+    struct x86_mbuf buf;
+    size_t nsaved;
+    uint8_t saved[X86_NREG];
+    uint32_t *local;
+    size_t nlocal;
+    size_t frame;
+    size_t nout;
+    x86_reg_t base;
+    int32_t bias;
+    bool align;
+    bool error;
+    uint16_t scratch;
+};
+
+/* Integer argument registers in order */
+static const uint8_t sysv_args[] = {
+    X86_RDI, X86_RSI, X86_RDX, X86_RCX, X86_R8, X86_R9
+};
+
+static const uint8_t internal_args[X86_NARGREGS] = {
+    X86_RDI, X86_RSI, X86_RDX, X86_RCX, X86_R8, X86_R9,
+    X86_RAX, X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15
+};
+
+static const struct x86_conv sysv_conv = {
+    .args = sysv_args,
+    .nargs = sizeof(sysv_args),
+    .saved = X86_CALLEE_SAVED
+};
+
+static const struct x86_conv internal_conv = {
+    .args = internal_args,
+    .nargs = sizeof(internal_args),
+    .saved = X86_REGBIT(X86_RBP)
+};
+
+/* Condition codes for IR comparisons (all unsigned) */
+static const x86_cc_t cctab[] = {
+    [IR_EQ] = X86_CC_E,
+    [IR_NE] = X86_CC_NE,
+    [IR_LT] = X86_CC_B,
+    [IR_GT] = X86_CC_A,
+    [IR_LE] = X86_CC_BE,
+    [IR_GE] = X86_CC_AE
+};
+
+/* Conditional jumps and sets, indexed by condition code */
+static const struct outbuf_frag jcctab[] = {
+    [X86_CC_B]  = OUTBUF_FRAG("\tjb .L"),
+    [X86_CC_AE] = OUTBUF_FRAG("\tjae .L"),
+    [X86_CC_E]  = OUTBUF_FRAG("\tje .L"),
+    [X86_CC_NE] = OUTBUF_FRAG("\tjne .L"),
+    [X86_CC_BE] = OUTBUF_FRAG("\tjbe .L"),
+    [X86_CC_A]  = OUTBUF_FRAG("\tja .L")
+};
+
+static const struct outbuf_frag setcctab[] = {
+    [X86_CC_B]  = OUTBUF_FRAG("\tsetb"),
+    [X86_CC_AE] = OUTBUF_FRAG("\tsetae"),
+    [X86_CC_E]  = OUTBUF_FRAG("\tsete"),
+    [X86_CC_NE] = OUTBUF_FRAG("\tsetne"),
+    [X86_CC_BE] = OUTBUF_FRAG("\tsetbe"),
+    [X86_CC_A]  = OUTBUF_FRAG("\tseta")
+};
+
+/* Instruction mnemonics */
+static const struct outbuf_frag mnemtab[] = {
+    [X86_OP_MOV]    = OUTBUF_FRAG("\tmov"),
+    [X86_OP_MOVZX]  = OUTBUF_FRAG("\tmovzx"),
+    [X86_OP_MOVSXD] = OUTBUF_FRAG("\tmovsxd"),
+    [X86_OP_LEA]    = OUTBUF_FRAG("\tlea"),
+    [X86_OP_ADD]    = OUTBUF_FRAG("\tadd"),
+    [X86_OP_SUB]    = OUTBUF_FRAG("\tsub"),
+    [X86_OP_IMUL]   = OUTBUF_FRAG("\timul"),
+    [X86_OP_XOR]    = OUTBUF_FRAG("\txor"),
+    [X86_OP_NEG]    = OUTBUF_FRAG("\tneg"),
+    [X86_OP_INC]    = OUTBUF_FRAG("\tinc"),
+    [X86_OP_DEC]    = OUTBUF_FRAG("\tdec"),
+    [X86_OP_SHL]    = OUTBUF_FRAG("\tshl"),
+    [X86_OP_SHR]    = OUTBUF_FRAG("\tshr"),
+    [X86_OP_MUL]    = OUTBUF_FRAG("\tmul"),
+    [X86_OP_MULX]   = OUTBUF_FRAG("\tmulx"),
+    [X86_OP_DIV]    = OUTBUF_FRAG("\tdiv"),
+    [X86_OP_CMP]    = OUTBUF_FRAG("\tcmp"),
+    [X86_OP_TEST]   = OUTBUF_FRAG("\ttest"),
+    [X86_OP_JMPR]   = OUTBUF_FRAG("\tjmp"),
+    [X86_OP_PUSH]   = OUTBUF_FRAG("\tpush"),
+    [X86_OP_LEAVE]  = OUTBUF_FRAG("\tleave")
+};
+
+/* Register names indexed by size class then register */
+static const struct outbuf_frag regtab[4][X86_NREG] = {
+    {
+        OUTBUF_FRAG("al"), OUTBUF_FRAG("cl"), OUTBUF_FRAG("dl"),
+        OUTBUF_FRAG("bl"), OUTBUF_FRAG("spl"), OUTBUF_FRAG("bpl"),
+        OUTBUF_FRAG("sil"), OUTBUF_FRAG("dil"), OUTBUF_FRAG("r8b"),
+        OUTBUF_FRAG("r9b"), OUTBUF_FRAG("r10b"), OUTBUF_FRAG("r11b"),
+        OUTBUF_FRAG("r12b"), OUTBUF_FRAG("r13b"), OUTBUF_FRAG("r14b"),
+        OUTBUF_FRAG("r15b")
+    },
+    {
+        OUTBUF_FRAG("ax"), OUTBUF_FRAG("cx"), OUTBUF_FRAG("dx"),
+        OUTBUF_FRAG("bx"), OUTBUF_FRAG("sp"), OUTBUF_FRAG("bp"),
+        OUTBUF_FRAG("si"), OUTBUF_FRAG("di"), OUTBUF_FRAG("r8w"),
+        OUTBUF_FRAG("r9w"), OUTBUF_FRAG("r10w"), OUTBUF_FRAG("r11w"),
+        OUTBUF_FRAG("r12w"), OUTBUF_FRAG("r13w"), OUTBUF_FRAG("r14w"),
+        OUTBUF_FRAG("r15w")
+    },
+    {
+        OUTBUF_FRAG("eax"), OUTBUF_FRAG("ecx"), OUTBUF_FRAG("edx"),
+        OUTBUF_FRAG("ebx"), OUTBUF_FRAG("esp"), OUTBUF_FRAG("ebp"),
+        OUTBUF_FRAG("esi"), OUTBUF_FRAG("edi"), OUTBUF_FRAG("r8d"),
+        OUTBUF_FRAG("r9d"), OUTBUF_FRAG("r10d"), OUTBUF_FRAG("r11d"),
+        OUTBUF_FRAG("r12d"), OUTBUF_FRAG("r13d"), OUTBUF_FRAG("r14d"),
+        OUTBUF_FRAG("r15d")
+    },
+    {
+        OUTBUF_FRAG("rax"), OUTBUF_FRAG("rcx"), OUTBUF_FRAG("rdx"),
+        OUTBUF_FRAG("rbx"), OUTBUF_FRAG("rsp"), OUTBUF_FRAG("rbp"),
+        OUTBUF_FRAG("rsi"), OUTBUF_FRAG("rdi"), OUTBUF_FRAG("r8"),
+        OUTBUF_FRAG("r9"), OUTBUF_FRAG("r10"), OUTBUF_FRAG("r11"),
+        OUTBUF_FRAG("r12"), OUTBUF_FRAG("r13"), OUTBUF_FRAG("r14"),
+        OUTBUF_FRAG("r15")
+    }
+};
+
+/* Memory operand prefixes indexed by size */
+static const struct outbuf_frag sztab[] = {
+    [0] = OUTBUF_FRAG("["),
+    [1] = OUTBUF_FRAG("byte ["),
+    [2] = OUTBUF_FRAG("word ["),
+    [4] = OUTBUF_FRAG("dword ["),
+    [8] = OUTBUF_FRAG("qword [")
+};
+
+/*
+ * Returns the size class (regtab index) of an operand size
+ *
+ * @size: Operand size in bytes
+ */
+static inline size_t
+x86_szclass(uint8_t size)
+{
+    switch (size) {
+    case 1:     return 0;
+    case 2:     return 1;
+    case 4:     return 2;
+    default:    return 3;
+    }
+
+    return 3;
+}
+
+/*
+ * Returns a register operand
+ *
+ * @reg:  Register
+ * @size: Operand size in bytes
+ */
+static inline struct x86_opnd
+x86_reg(uint8_t reg, uint8_t size)
+{
+    struct x86_opnd opnd = { X86_OPND_REG, size, reg, 0, 0, NULL };
+
+    return opnd;
+}
+
+/*
+ * Returns an immediate operand
+ *
+ * @imm: Immediate value
+ */
+static inline struct x86_opnd
+x86_imm(uint64_t imm)
+{
+    struct x86_opnd opnd = { X86_OPND_IMM, 8, X86_NOREG, 0, imm, NULL };
+
+    return opnd;
+}
+
+/*
+ * Returns a memory operand
+ *
+ * @base: Base register
+ * @disp: Displacement
+ * @size: Operand size in bytes
+ */
+static inline struct x86_opnd
+x86_mem(uint8_t base, int32_t disp, uint8_t size)
+{
+    struct x86_opnd opnd = { X86_OPND_MEM, size, base, disp, 0, NULL };
+
+    return opnd;
+}
+
+/*
+ * Returns true if two operands name the same location
+ *
+ * @a: First operand
+ * @b: Second operand
+ */
+static inline bool
+x86_same(const struct x86_opnd *a, const struct x86_opnd *b)
+{
+    if (a->kind != b->kind) {
+        return false;
+    }
+
+    switch (a->kind) {
+    case X86_OPND_REG:
+        return a->reg == b->reg;
+    case X86_OPND_MEM:
+        return a->reg == b->reg && a->disp == b->disp && a->label == b->label &&
+            a->scale == b->scale && (a->scale == 0 || a->index == b->index);
+    default:
+        return false;
+    }
+
+    return false;
+}
+
+/*
+ * Returns a frame slot, callee-saved registers come first
+ * followed by the spill slots and then the locals area
+ *
+ * @ctx: Emission context
+ * @idx: Frame slot index
+ */
+static inline struct x86_opnd
+x86_frame_slot(struct x86_ctx *ctx, size_t idx)
+{
+    return x86_mem(ctx->base, ctx->bias - (int32_t)(8 * (idx + 1)), 8);
+}
+
+/*
+ * Returns the address of the stack slot of a local
+ *
+ * @ctx: Emission context
+ * @idx: Local stack slot index
+ */
+static inline struct x86_opnd
+x86_local(struct x86_ctx *ctx, size_t idx)
+{
+    int32_t top;
+
+    top = ctx->bias - (int32_t)(8 * (ctx->nsaved + ctx->ra.spill_count));
+    return x86_mem(ctx->base, top - (int32_t)(ctx->nlocal - ctx->local[idx]), 0);
+}
+
+/*
+ * Lay out the stack slots of locals, largest first so every
+ * slot is naturally aligned without any padding between them
+ *
+ * @ctx: Emission context
+ *
+ * Returns zero on success
+ */
+static int
+x86_layout_locals(struct x86_ctx *ctx)
+{
+    struct ir_func *func = ctx->func;
+    uint8_t size;
+    size_t i;
+
+    ctx->nlocal = 0;
+    if (func->slot_count == 0) {
+        return 0;
+    }
+
+    ctx->local = arena_alloc(func->arena, func->slot_count * sizeof(*ctx->local));
+    if (ctx->local == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (size = 8; size > 0; size >>= 1) {
+        for (i = 0; i < func->slot_count; ++i) {
+            if (func->slot_size[i] != size)
+                continue;
+
+            ctx->local[i] = ctx->nlocal;
+            ctx->nlocal += size;
+        }
+    }
+
+    ctx->nlocal = (ctx->nlocal + 7) & ~(size_t)7;
+    return 0;
+}
+
+/*
+ * Returns a parameter passed on the stack by the caller
+ *
+ * @ctx: Emission context
+ * @idx: Index among the stack parameters
+ */
+static inline struct x86_opnd
+x86_incoming(struct x86_ctx *ctx, size_t idx)
+{
+    /* Skip the return address, and the saved rbp if there is one */
+    if (ctx->base == X86_RBP) {
+        return x86_mem(X86_RBP, (int32_t)(16 + 8 * idx), 8);
+    }
+
+    return x86_mem(X86_RSP, ctx->bias + (int32_t)(8 + 8 * idx), 8);
+}
+
+/*
+ * Returns the operand a virtual register was allocated to
+ *
+ * @ctx:  Emission context
+ * @vreg: Virtual register
+ */
+static struct x86_opnd
+x86_vreg(struct x86_ctx *ctx, ir_reg_t vreg)
+{
+    struct ra_loc *loc = &ctx->ra.loc[vreg];
+
+    if (loc->reg != X86_NOREG) {
+        return x86_reg(loc->reg, 8);
+    }
+
+    return x86_frame_slot(ctx, ctx->nsaved + loc->slot);
+}
+
+/*
+ * Returns the operand for a source of an instruction, an
+ * immediate if the register is a constant the instruction
+ * can encode directly
+ *
+ * @ctx:  Emission context
+ * @insn: IR instruction
+ * @idx:  Source index (see ir_use())
+ */
+static struct x86_opnd
+x86_src(struct x86_ctx *ctx, struct ir_insn *insn, size_t idx)
+{
+    ir_reg_t vreg = *ir_use(insn, idx);
+    struct ra_loc *loc = &ctx->ra.loc[vreg];
+
+    if (loc->konst && x86_imm_ok(insn, idx, loc->imm)) {
+        return x86_imm(loc->imm);
+    }
+
+    return x86_vreg(ctx, vreg);
+}
+
+/*
+ * Print a single operand
+ *
+ * @ob:   Output buffer
+ * @opnd: Operand to print
+ */
+static void
+x86_print_opnd(struct outbuf *ob, const struct x86_opnd *opnd)
+{
+    switch (opnd->kind) {
+    case X86_OPND_REG:
+        outbuf_frag(ob, &regtab[x86_szclass(opnd->size)][opnd->reg]);
+        break;
+    case X86_OPND_IMM:
+        outbuf_putu(ob, opnd->imm);
+        break;
+    case X86_OPND_MEM:
+        outbuf_frag(ob, &sztab[opnd->size]);
+        if (opnd->label != NULL) {
+            outbuf_write(ob, "rel ", 4);
+            outbuf_puts(ob, opnd->label);
+            outbuf_putc(ob, ']');
+            break;
+        }
+
+        outbuf_frag(ob, &regtab[3][opnd->reg]);
+        if (opnd->scale != 0) {
+            outbuf_putc(ob, '+');
+            outbuf_frag(ob, &regtab[3][opnd->index]);
+            outbuf_putc(ob, '*');
+            outbuf_putu(ob, opnd->scale);
+        }
+
+        if (opnd->disp > 0) {
+            outbuf_putc(ob, '+');
+        }
+
+        if (opnd->disp != 0) {
+            outbuf_puti(ob, opnd->disp);
+        }
+
+        outbuf_putc(ob, ']');
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Print a single buffered machine instruction
+ *
+ * @state: Compiler state
+ * @insn:  Instruction to print
+ */
+static int
+x86_print_insn(struct gup_state *state, const struct x86_minsn *insn)
+{
+    struct outbuf *ob = &state->out;
+
+    switch (insn->op) {
+    case X86_OP_NONE:
+        return 0;
+    case X86_OP_LABEL:
+        outbuf_write(ob, ".L", 2);
+        outbuf_putu(ob, insn->target);
+        outbuf_write(ob, ":\n", 2);
+        return 0;
+    case X86_OP_JMP:
+        outbuf_write(ob, "\tjmp .L", 7);
+        outbuf_putu(ob, insn->target);
+        outbuf_putc(ob, '\n');
+        return 0;
+    case X86_OP_JCC:
+        outbuf_frag(ob, &jcctab[insn->cc]);
+        outbuf_putu(ob, insn->target);
+        outbuf_putc(ob, '\n');
+        return 0;
+    case X86_OP_CALL:
+        outbuf_write(ob, "\tcall ", 6);
+        outbuf_puts(ob, insn->sym);
+        outbuf_write(ob, " wrt ..plt\n", 11);
+        return 0;
+    case X86_OP_TAILJMP:
+        outbuf_write(ob, "\tjmp ", 5);
+        outbuf_puts(ob, insn->sym);
+        outbuf_write(ob, " wrt ..plt\n", 11);
+        return 0;
+    case X86_OP_RET:
+        return mu_emit_ret(state);
+    case X86_OP_SETCC:
+        outbuf_frag(ob, &setcctab[insn->cc]);
+        break;
+    default:
+        outbuf_frag(ob, &mnemtab[insn->op]);
+        break;
+    }
+
+    if (insn->opnd[0].kind != X86_OPND_NONE) {
+        outbuf_putc(ob, ' ');
+        x86_print_opnd(ob, &insn->opnd[0]);
+    }
+
+    /* Both halves go to the destination, the high one wins */
+    if (insn->op == X86_OP_MULX) {
+        outbuf_write(ob, ", ", 2);
+        x86_print_opnd(ob, &insn->opnd[0]);
+    }
+
+    if (insn->opnd[1].kind != X86_OPND_NONE) {
+        outbuf_write(ob, ", ", 2);
+        x86_print_opnd(ob, &insn->opnd[1]);
+    }
+
+    outbuf_putc(ob, '\n');
+    return 0;
+}
+
+/*
+ * Buffer a machine instruction with up to two operands
+ *
+ * @ctx: Emission context
+ * @op:  Instruction opcode
+ * @dst: Destination operand (or NULL)
+ * @src: Source operand (or NULL)
+ */
+static void
+x86_ins(struct x86_ctx *ctx, x86_op_t op, const struct x86_opnd *dst,
+    const struct x86_opnd *src)
+{
+    struct x86_minsn insn;
+
+    memset(&insn, 0, sizeof(insn));
+    insn.op = op;
+    if (dst != NULL) {
+        insn.opnd[0] = *dst;
+    }
+
+    if (src != NULL) {
+        insn.opnd[1] = *src;
+    }
+
+    if (x86_mbuf_push(&ctx->buf, &insn) < 0) {
+        ctx->error = true;
+    }
+}
+
+/*
+ * Buffer a control transfer or conditional instruction
+ *
+ * @ctx:    Emission context
+ * @op:     X86_OP_LABEL, X86_OP_JMP, X86_OP_JCC or X86_OP_SETCC
+ * @cc:     Condition code (X86_OP_JCC, X86_OP_SETCC)
+ * @target: Local label (X86_OP_LABEL, X86_OP_JMP, X86_OP_JCC)
+ * @dst:    Destination operand (X86_OP_SETCC)
+ */
+static void
+x86_ins_cc(struct x86_ctx *ctx, x86_op_t op, x86_cc_t cc, size_t target,
+    const struct x86_opnd *dst)
+{
+    struct x86_minsn insn;
+
+    memset(&insn, 0, sizeof(insn));
+    insn.op = op;
+    insn.cc = cc;
+    insn.target = target;
+    if (dst != NULL) {
+        insn.opnd[0] = *dst;
+    }
+
+    if (x86_mbuf_push(&ctx->buf, &insn) < 0) {
+        ctx->error = true;
+    }
+}
+
+/*
+ * Returns true if an immediate can be encoded as a sign
+ * extended 32-bit value
+ *
+ * @imm: Immediate to check
+ */
+static inline bool
+x86_imm32(uint64_t imm)
+{
+    return (int64_t)imm == (int32_t)imm;
+}
+
+/*
+ * Move one operand into another, going through a scratch
+ * register when both are in memory
+ *
+ * @ctx: Emission context
+ * @dst: Destination operand
+ * @src: Source operand
+ */
+static void
+x86_mov(struct x86_ctx *ctx, const struct x86_opnd *dst, const struct x86_opnd *src)
+{
+    struct x86_opnd tmp;
+
+    if (x86_same(dst, src)) {
+        return;
+    }
+
+    if (dst->kind == X86_OPND_MEM) {
+        if (src->kind == X86_OPND_MEM || (src->kind == X86_OPND_IMM && !x86_imm32(src->imm))) {
+            tmp = x86_reg(X86_SCRATCH0, dst->size);
+            x86_ins(ctx, X86_OP_MOV, &tmp, src);
+            x86_ins(ctx, X86_OP_MOV, dst, &tmp);
+            return;
+        }
+    }
+
+    x86_ins(ctx, X86_OP_MOV, dst, src);
+}
+
+/*
+ * Returns an operand as a register, loading it into a
+ * scratch register if it lives in memory
+ *
+ * @ctx:     Emission context
+ * @opnd:    Operand to load
+ * @scratch: Scratch register to use
+ */
+static struct x86_opnd
+x86_in_reg(struct x86_ctx *ctx, const struct x86_opnd *opnd, uint8_t scratch)
+{
+    struct x86_opnd tmp;
+
+    if (opnd->kind == X86_OPND_REG) {
+        return *opnd;
+    }
+
+    tmp = x86_reg(scratch, opnd->size);
+    x86_ins(ctx, X86_OP_MOV, &tmp, opnd);
+    return tmp;
+}
+
+/*
+ * Returns the register a result should be computed in, the
+ * destination itself if it is a register
+ *
+ * @dst: Destination operand
+ */
+static inline struct x86_opnd
+x86_work(const struct x86_opnd *dst)
+{
+    if (dst->kind == X86_OPND_REG) {
+        return *dst;
+    }
+
+    return x86_reg(X86_SCRATCH0, 8);
+}
+
+/*
+ * Move a value into a destination, zero extending it from
+ * the size of the source
+ *
+ * @ctx: Emission context
+ * @dst: Destination operand
+ * @src: Source operand (register or memory)
+ */
+static void
+x86_zext(struct x86_ctx *ctx, const struct x86_opnd *dst, const struct x86_opnd *src)
+{
+    struct x86_opnd work;
+
+    if (src->size == 8) {
+        x86_mov(ctx, dst, src);
+        return;
+    }
+
+    /* Writes to 32-bit registers clear the upper half */
+    work = x86_work(dst);
+    work.size = 4;
+    x86_ins(ctx, (src->size < 4) ? X86_OP_MOVZX : X86_OP_MOV, &work, src);
+    work.size = 8;
+    x86_mov(ctx, dst, &work);
+}
+
+/*
+ * Decide how the frame is addressed and buffer the code
+ * setting it up
+ *
+ * Leaf procedures never need the frame pointer, their slots
+ * are addressed from the stack pointer. If they fit in the
+ * red zone below it the stack pointer is not even moved,
+ * otherwise it is dropped just far enough (with no calls the
+ * stack needs no alignment). The same goes for procedures
+ * whose calls only reach callees that don't care about
+ * alignment, minus the red zone which calls would trample.
+ *
+ * @ctx: Emission context, 'frame' holds the bytes needed
+ */
+static void
+x86_frame_setup(struct x86_ctx *ctx)
+{
+    struct x86_opnd reg, src;
+
+    ctx->frame += 8 * ctx->nout;
+    if (!ctx->ra.has_calls || !ctx->align) {
+        ctx->base = X86_RSP;
+        ctx->bias = 0;
+        if (ctx->frame == 0)
+            return;
+        if (!ctx->ra.has_calls && !ctx->state->no_redzone &&
+            ctx->frame <= X86_REDZONE)
+            return;
+
+        ctx->bias = ctx->frame;
+        reg = x86_reg(X86_RSP, 8);
+        src = x86_imm(ctx->frame);
+        x86_ins(ctx, X86_OP_SUB, &reg, &src);
+        return;
+    }
+
+    /* Keep the stack 16 byte aligned at call sites */
+    ctx->frame = (ctx->frame + 15) & ~(size_t)15;
+    ctx->base = X86_RBP;
+    ctx->bias = 0;
+
+    reg = x86_reg(X86_RBP, 8);
+    x86_ins(ctx, X86_OP_PUSH, &reg, NULL);
+    src = x86_reg(X86_RSP, 8);
+    x86_ins(ctx, X86_OP_MOV, &reg, &src);
+    if (ctx->frame > 0) {
+        reg = x86_reg(X86_RSP, 8);
+        src = x86_imm(ctx->frame);
+        x86_ins(ctx, X86_OP_SUB, &reg, &src);
+    }
+}
+
+/*
+ * Buffer the procedure epilogue and return, or jump to
+ * another procedure which then returns in our place
+ *
+ * @ctx:  Emission context
+ * @tail: Procedure to jump to, NULL to return
+ */
+static void
+x86_epilogue(struct x86_ctx *ctx, const char *tail)
+{
+    struct x86_minsn jmp;
+    struct x86_opnd reg, mem;
+    size_t i;
+
+    for (i = 0; i < ctx->nsaved; ++i) {
+        reg = x86_reg(ctx->saved[i], 8);
+        mem = x86_frame_slot(ctx, i);
+        x86_ins(ctx, X86_OP_MOV, &reg, &mem);
+    }
+
+    if (ctx->base == X86_RBP) {
+        x86_ins(ctx, X86_OP_LEAVE, NULL, NULL);
+    } else if (ctx->bias > 0) {
+        reg = x86_reg(X86_RSP, 8);
+        mem = x86_imm(ctx->bias);
+        x86_ins(ctx, X86_OP_ADD, &reg, &mem);
+    }
+
+    if (tail == NULL) {
+        x86_ins(ctx, X86_OP_RET, NULL, NULL);
+        return;
+    }
+
+    memset(&jmp, 0, sizeof(jmp));
+    jmp.op = X86_OP_TAILJMP;
+    jmp.sym = tail;
+    if (x86_mbuf_push(&ctx->buf, &jmp) < 0) {
+        ctx->error = true;
+    }
+}
+
+/*
+ * Buffer a two-operand arithmetic instruction computing
+ * 'dst = a op b'
+ *
+ * @ctx:  Emission context
+ * @op:   Instruction opcode
+ * @insn: IR instruction
+ */
+static void
+x86_arith(struct x86_ctx *ctx, x86_op_t op, struct ir_insn *insn)
+{
+    struct x86_opnd dst, a, b, work;
+
+    dst = x86_vreg(ctx, insn->dst);
+    a = x86_vreg(ctx, insn->src[0]);
+    b = x86_src(ctx, insn, 1);
+
+    /* Commutative operations can work in b's register */
+    if (op != X86_OP_SUB && dst.kind == X86_OPND_REG && x86_same(&dst, &b)) {
+        x86_ins(ctx, op, &dst, &a);
+        return;
+    }
+
+    /* imul can't write to memory */
+    if (dst.kind == X86_OPND_REG && !x86_same(&dst, &b)) {
+        work = dst;
+    } else if (dst.kind == X86_OPND_MEM && op != X86_OP_IMUL && x86_same(&dst, &a)
+        && b.kind != X86_OPND_MEM) {
+        x86_ins(ctx, op, &dst, &b);
+        return;
+    } else {
+        work = x86_reg(X86_SCRATCH0, 8);
+    }
+
+    x86_mov(ctx, &work, &a);
+    x86_ins(ctx, op, &work, &b);
+    x86_mov(ctx, &dst, &work);
+}
+
+/*
+ * Buffer a multiplication by a constant of the form 3, 5 or
+ * 9 times a power of two as a lea, shifted if need be
+ *
+ * @ctx:  Emission context
+ * @insn: IR_MUL instruction
+ * @imm:  Constant factor
+ *
+ * Returns false if the constant is not of that form
+ */
+static bool
+x86_mul_lea(struct x86_ctx *ctx, struct ir_insn *insn, uint64_t imm)
+{
+    struct x86_opnd dst, a, work, mem, count;
+    uint8_t shift = 0;
+
+    while (imm != 0 && (imm & 1) == 0) {
+        imm >>= 1;
+        ++shift;
+    }
+
+    if (imm != 3 && imm != 5 && imm != 9) {
+        return false;
+    }
+
+    /* a + a * (imm - 1) */
+    dst = x86_vreg(ctx, insn->dst);
+    a = x86_vreg(ctx, insn->src[0]);
+    a = x86_in_reg(ctx, &a, X86_SCRATCH0);
+    work = x86_work(&dst);
+    mem = x86_mem(a.reg, 0, 0);
+    mem.index = a.reg;
+    mem.scale = imm - 1;
+    x86_ins(ctx, X86_OP_LEA, &work, &mem);
+    if (shift > 0) {
+        count = x86_imm(shift);
+        x86_ins(ctx, X86_OP_SHL, &work, &count);
+    }
+
+    x86_mov(ctx, &dst, &work);
+    return true;
+}
+
+const struct x86_conv *
+x86_conv(const struct symbol *sym)
+{
+    if (sym == NULL || !sym->internal) {
+        return &sysv_conv;
+    }
+
+    return &internal_conv;
+}
+
+/*
+ * Returns the set of argument registers a call fills
+ *
+ * @conv: Calling convention of the callee
+ * @argc: Number of arguments
+ */
+static uint16_t
+x86_arg_mask(const struct x86_conv *conv, size_t argc)
+{
+    uint16_t mask = 0;
+    size_t i;
+
+    for (i = 0; i < argc && i < conv->nargs; ++i) {
+        mask |= X86_REGBIT(conv->args[i]);
+    }
+
+    return mask;
+}
+
+uint16_t
+x86_call_clobbers(const struct ir_func *func, const struct ir_insn *call)
+{
+    const struct symbol *callee = call->sym;
+    const struct x86_conv *conv = x86_conv(callee);
+    uint16_t mask;
+
+    /*
+     * Private procedures emitted already tell us exactly what
+     * they touch, anything else (including ourselves, still
+     * being emitted) may touch whatever it need not preserve.
+     */
+    if (callee != NULL && callee != func->sym && callee->emitted && !callee->pub) {
+        mask = callee->clobbers;
+    } else {
+        mask = ~(conv->saved | X86_REGBIT(X86_RSP)) & 0xFFFF;
+    }
+
+    return mask | x86_arg_mask(conv, call->argc);
+}
+
+/*
+ * Returns true if a call must be made with the stack 16 byte
+ * aligned
+ *
+ * @func:   Procedure making the call
+ * @callee: Procedure being called
+ */
+static bool
+x86_call_aligned(const struct ir_func *func, const struct symbol *callee)
+{
+    /* Our own calls are aligned if anything else needs it */
+    if (callee == func->sym) {
+        return false;
+    }
+
+    if (callee == NULL || !callee->internal || !callee->emitted) {
+        return true;
+    }
+
+    return callee->aligned;
+}
+
+uint16_t
+x86_clobbers(const struct ir_func *func, const struct x86_rule *rule,
+    const struct ir_insn *insn)
+{
+    const struct x86_conv *conv;
+
+    switch (insn->op) {
+    case IR_PARAM:
+        /* Earlier parameters must keep out of this one's way */
+        conv = x86_conv(func->sym);
+        if (insn->imm < conv->nargs)
+            return X86_REGBIT(conv->args[insn->imm]);
+        return 0;
+    case IR_CALL:
+        return x86_call_clobbers(func, insn);
+    case IR_MULH:
+        /* mulx only needs a factor in rdx */
+        if (rule != NULL && rule->emit == X86_EMIT_MULX)
+            return X86_REGBIT(X86_RDX);
+        /* Fallthrough */
+    case IR_DIV:
+        return X86_REGBIT(X86_RAX) | X86_REGBIT(X86_RDX);
+    default:
+        return 0;
+    }
+
+    return 0;
+}
+
+bool
+x86_imm_ok(const struct ir_insn *insn, size_t idx, uint64_t imm)
+{
+    /* Arguments are moved into place, any constant will do */
+    if ((insn->op == IR_CALL || insn->op == IR_TAIL) && idx >= 2) {
+        return true;
+    }
+
+    if (idx != 1 || !x86_imm32(imm)) {
+        return false;
+    }
+
+    switch (insn->op) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_GT:
+    case IR_LE:
+    case IR_GE:
+    case IR_STORE:
+        return true;
+    default:
+        return false;
+    }
+
+    return false;
+}
+
+/*
+ * Returns true if an argument register is still read by a
+ * pending move
+ *
+ * @src:     Move sources
+ * @pending: Moves not yet made
+ * @n:       Number of moves
+ * @reg:     Register to check
+ */
+static bool
+x86_arg_busy(const struct x86_opnd *src, const bool *pending, size_t n,
+    uint8_t reg)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (pending[i] && src[i].kind == X86_OPND_REG && src[i].reg == reg)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Move the arguments of a call into place, arguments past
+ * the register ones go to the bottom of the frame
+ *
+ * The register moves happen in parallel: a move is only made
+ * once nothing still needs the old value of its destination,
+ * a cycle is broken by parking one register in scratch.
+ *
+ * @ctx:  Emission context
+ * @insn: IR_CALL or IR_TAIL instruction
+ */
+static void
+x86_call_args(struct x86_ctx *ctx, struct ir_insn *insn)
+{
+    const struct x86_conv *conv = x86_conv(insn->sym);
+    const uint8_t *argregs = conv->args;
+    struct x86_opnd src[X86_NARGREGS], dst, tmp;
+    bool pending[X86_NARGREGS], progress;
+    size_t n, i, j;
+
+    for (i = conv->nargs; i < insn->argc; ++i) {
+        tmp = x86_src(ctx, insn, i + 2);
+        dst = x86_mem(X86_RSP, (int32_t)(8 * (i - conv->nargs)), 8);
+        x86_mov(ctx, &dst, &tmp);
+    }
+
+    n = (insn->argc < conv->nargs) ? insn->argc : conv->nargs;
+    for (i = 0; i < n; ++i) {
+        src[i] = x86_src(ctx, insn, i + 2);
+        pending[i] = !(src[i].kind == X86_OPND_REG && src[i].reg == argregs[i]);
+    }
+
+    for (;;) {
+        do {
+            progress = false;
+            for (i = 0; i < n; ++i) {
+                if (!pending[i])
+                    continue;
+
+                pending[i] = false;
+                if (x86_arg_busy(src, pending, n, argregs[i])) {
+                    pending[i] = true;
+                    continue;
+                }
+
+                dst = x86_reg(argregs[i], 8);
+                x86_mov(ctx, &dst, &src[i]);
+                progress = true;
+            }
+        } while (progress);
+
+        for (i = 0; i < n && !pending[i]; ++i);
+        if (i == n) {
+            break;
+        }
+
+        /* Everything left waits on each other */
+        dst = x86_reg(X86_SCRATCH0, 8);
+        tmp = x86_reg(argregs[i], 8);
+        x86_mov(ctx, &dst, &tmp);
+        for (j = 0; j < n; ++j) {
+            if (pending[j] && x86_same(&src[j], &tmp))
+                src[j] = dst;
+        }
+    }
+}
+
+/*
+ * Jump through a table of offsets from the procedure entry,
+ * the index is known to be in bounds
+ *
+ * @ctx:  Emission context
+ * @insn: IR_SWITCH instruction
+ *
+ * Returns zero on success
+ */
+static int
+x86_jump_table(struct x86_ctx *ctx, struct ir_insn *insn)
+{
+    struct x86_opnd idx, base, tab, ent, entry, tmp;
+    const char *proc = ctx->func->sym->name;
+    size_t *targets, len, i;
+    char *name;
+    int retval;
+
+    len = strlen(proc) + 32;
+    name = malloc(len);
+    targets = malloc(insn->imm * sizeof(*targets));
+    if (name == NULL || targets == NULL) {
+        free(name);
+        free(targets);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    snprintf(name, len, "%s.Lt%zu", proc, ctx->buf.ntabs);
+    for (i = 0; i < insn->imm; ++i) {
+        targets[i] = insn->table[i]->id;
+    }
+
+    retval = x86_mbuf_jtab(&ctx->buf, name, targets, insn->imm);
+    free(name);
+    free(targets);
+    if (retval < 0) {
+        return -1;
+    }
+
+    idx = x86_vreg(ctx, insn->src[0]);
+    if (idx.kind != X86_OPND_REG) {
+        tmp = x86_reg(X86_SCRATCH1, 8);
+        x86_mov(ctx, &tmp, &idx);
+        idx = tmp;
+    }
+
+    base = x86_reg(X86_SCRATCH0, 8);
+    tab = x86_mem(X86_NOREG, 0, 0);
+    tab.label = ctx->buf.tabs[ctx->buf.ntabs - 1].name;
+    x86_ins(ctx, X86_OP_LEA, &base, &tab);
+
+    ent = x86_mem(X86_SCRATCH0, 0, 4);
+    ent.index = idx.reg;
+    ent.scale = 4;
+    tmp = x86_reg(X86_SCRATCH1, 8);
+    x86_ins(ctx, X86_OP_MOVSXD, &tmp, &ent);
+
+    entry = x86_mem(X86_NOREG, 0, 0);
+    entry.label = proc;
+    x86_ins(ctx, X86_OP_LEA, &base, &entry);
+    x86_ins(ctx, X86_OP_ADD, &tmp, &base);
+    x86_ins(ctx, X86_OP_JMPR, &tmp, NULL);
+    return 0;
+}
+
+/*
+ * Buffer the machine instructions of an IR instruction
+ * emitted on its own (X86_EMIT_INSN)
+ *
+ * @ctx:  Emission context
+ * @insn: Instruction to emit
+ */
+static int
+mu_emit_insn(struct x86_ctx *ctx, struct ir_insn *insn)
+{
+    struct x86_opnd dst, a, b, work, tmp;
+    struct x86_minsn call;
+
+    if (insn->dst != 0) {
+        dst = x86_vreg(ctx, insn->dst);
+    }
+
+    switch (insn->op) {
+    case IR_NOP:
+        break;
+    case IR_IMM:
+        if (ctx->ra.loc[insn->dst].folded) {
+            break;
+        }
+
+        tmp = x86_imm(insn->imm);
+        x86_mov(ctx, &dst, &tmp);
+        break;
+    case IR_COPY:
+        a = x86_vreg(ctx, insn->src[0]);
+        x86_mov(ctx, &dst, &a);
+        break;
+    case IR_ZEXT:
+        a = x86_vreg(ctx, insn->src[0]);
+        a.size = insn->size;
+        x86_zext(ctx, &dst, &a);
+        break;
+    case IR_NEG:
+        a = x86_vreg(ctx, insn->src[0]);
+        x86_mov(ctx, &dst, &a);
+        x86_ins(ctx, X86_OP_NEG, &dst, NULL);
+        break;
+    case IR_SUB:
+        x86_arith(ctx, X86_OP_SUB, insn);
+        break;
+    case IR_MUL:
+        x86_arith(ctx, X86_OP_IMUL, insn);
+        break;
+    case IR_SHL:
+    case IR_SHR:
+        a = x86_vreg(ctx, insn->src[0]);
+        tmp = x86_imm(insn->imm);
+        x86_mov(ctx, &dst, &a);
+        x86_ins(ctx, (insn->op == IR_SHL) ? X86_OP_SHL : X86_OP_SHR, &dst, &tmp);
+        break;
+    case IR_MULH:
+        /* Either factor can be the one already in rax */
+        a = x86_vreg(ctx, insn->src[0]);
+        b = x86_vreg(ctx, insn->src[1]);
+        if (b.kind == X86_OPND_REG && b.reg == X86_RAX) {
+            tmp = a;
+            a = b;
+            b = tmp;
+        }
+
+        /* Same as below, the high half is left in rdx */
+        if (b.kind == X86_OPND_REG && (b.reg == X86_RAX || b.reg == X86_RDX)) {
+            tmp = x86_reg(X86_SCRATCH0, 8);
+            x86_mov(ctx, &tmp, &b);
+            b = tmp;
+        }
+
+        tmp = x86_reg(X86_RAX, 8);
+        x86_mov(ctx, &tmp, &a);
+        x86_ins(ctx, X86_OP_MUL, &b, NULL);
+        tmp = x86_reg(X86_RDX, 8);
+        x86_mov(ctx, &dst, &tmp);
+        break;
+    case IR_DIV:
+        /* Move the divisor out of the way of rax and rdx first */
+        b = x86_vreg(ctx, insn->src[1]);
+        if (b.kind == X86_OPND_REG && (b.reg == X86_RAX || b.reg == X86_RDX)) {
+            tmp = x86_reg(X86_SCRATCH0, 8);
+            x86_mov(ctx, &tmp, &b);
+            b = tmp;
+        }
+
+        a = x86_vreg(ctx, insn->src[0]);
+        tmp = x86_reg(X86_RAX, 8);
+        x86_mov(ctx, &tmp, &a);
+        work = x86_reg(X86_RDX, 4);
+        x86_ins(ctx, X86_OP_XOR, &work, &work);
+        x86_ins(ctx, X86_OP_DIV, &b, NULL);
+        x86_mov(ctx, &dst, &tmp);
+        break;
+    case IR_PARAM:
+        if (insn->imm < ctx->conv->nargs) {
+            tmp = x86_reg(ctx->conv->args[insn->imm], insn->size);
+        } else {
+            tmp = x86_incoming(ctx, insn->imm - ctx->conv->nargs);
+            tmp.size = insn->size;
+        }
+
+        x86_zext(ctx, &dst, &tmp);
+        break;
+    case IR_CALL:
+        x86_call_args(ctx, insn);
+        memset(&call, 0, sizeof(call));
+        call.op = X86_OP_CALL;
+        call.sym = insn->label;
+        if (x86_mbuf_push(&ctx->buf, &call) < 0) {
+            return -1;
+        }
+
+        /* Only the low bytes of a narrow result are defined */
+        if (insn->dst != 0) {
+            tmp = x86_reg(X86_RAX, insn->size);
+            x86_zext(ctx, &dst, &tmp);
+        }
+
+        break;
+    case IR_JMP:
+        x86_ins_cc(ctx, X86_OP_JMP, 0, insn->target[0]->id, NULL);
+        break;
+    case IR_SWITCH:
+        if (x86_jump_table(ctx, insn) < 0) {
+            return -1;
+        }
+
+        break;
+    case IR_RET:
+        if (insn->src[0] != 0) {
+            a = x86_vreg(ctx, insn->src[0]);
+            tmp = x86_reg(X86_RAX, 8);
+            x86_mov(ctx, &tmp, &a);
+        }
+
+        x86_epilogue(ctx, NULL);
+        break;
+    case IR_TAIL:
+        x86_call_args(ctx, insn);
+        x86_epilogue(ctx, insn->label);
+        break;
+    default:
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return ctx->error ? -1 : 0;
+}
+
+/*
+ * Returns an operand in a register, loading it into a
+ * scratch register the tree being emitted has not taken yet
+ * if it lives in memory
+ *
+ * @ctx:  Emission context
+ * @opnd: Operand to load
+ */
+static struct x86_opnd
+x86_tree_reg(struct x86_ctx *ctx, const struct x86_opnd *opnd)
+{
+    uint8_t scratch;
+
+    if (opnd->kind == X86_OPND_REG) {
+        return *opnd;
+    }
+
+    scratch = (ctx->scratch & X86_REGBIT(X86_SCRATCH0)) ? X86_SCRATCH1 : X86_SCRATCH0;
+    ctx->scratch |= X86_REGBIT(scratch);
+    return x86_in_reg(ctx, opnd, scratch);
+}
+
+/*
+ * Returns a scratch register the tree being emitted has not
+ * taken yet. If an address already holds both, it is
+ * computed into one of them first.
+ *
+ * @ctx: Emission context
+ * @mem: Memory operand of the tree (or NULL)
+ */
+static struct x86_opnd
+x86_tree_scratch(struct x86_ctx *ctx, struct x86_opnd *mem)
+{
+    uint16_t both = X86_REGBIT(X86_SCRATCH0) | X86_REGBIT(X86_SCRATCH1);
+    struct x86_opnd tmp;
+    uint8_t scratch;
+
+    if (mem != NULL && (ctx->scratch & both) == both) {
+        tmp = x86_reg(X86_SCRATCH0, 8);
+        x86_ins(ctx, X86_OP_LEA, &tmp, mem);
+        *mem = x86_mem(X86_SCRATCH0, 0, mem->size);
+        ctx->scratch = X86_REGBIT(X86_SCRATCH0);
+    }
+
+    scratch = (ctx->scratch & X86_REGBIT(X86_SCRATCH0)) ? X86_SCRATCH1 : X86_SCRATCH0;
+    ctx->scratch |= X86_REGBIT(scratch);
+    return x86_reg(scratch, 8);
+}
+
+/*
+ * Returns true if a memory operand reads a register
+ *
+ * @mem: Memory operand
+ * @reg: Register to check
+ */
+static inline bool
+x86_mem_uses(const struct x86_opnd *mem, uint8_t reg)
+{
+    if (mem->kind != X86_OPND_MEM || mem->label != NULL) {
+        return false;
+    }
+
+    return mem->reg == reg || (mem->scale != 0 && mem->index == reg);
+}
+
+/*
+ * Buffer the machine instructions of a rule once the sources
+ * are reduced to what it expects
+ *
+ * @ctx:  Emission context
+ * @insn: Instruction the rule covers
+ * @rule: Rule to emit
+ * @kids: Operands the sources were reduced to
+ * @res:  Operand the rule produces, if it produces one
+ *
+ * Returns zero on success
+ */
+static int
+x86_emit_rule(struct x86_ctx *ctx, struct ir_insn *insn,
+    const struct x86_rule *rule, struct x86_opnd *kids, struct x86_opnd *res)
+{
+    struct x86_opnd dst, a, b, work, tmp;
+    x86_op_t op;
+    int32_t disp;
+    size_t i;
+
+    switch (rule->emit) {
+    case X86_EMIT_INSN:
+        return mu_emit_insn(ctx, insn);
+    case X86_EMIT_PASS:
+        *res = kids[0];
+        break;
+    case X86_EMIT_INDEX:
+        a = x86_tree_reg(ctx, &kids[0]);
+        *res = x86_mem(X86_NOREG, 0, 0);
+        res->index = a.reg;
+        res->scale = 1 << insn->imm;
+        break;
+    case X86_EMIT_BASEIDX:
+        /* The index is whichever side is already scaled */
+        i = (rule->kids[0] == X86_NT_INDEX) ? 0 : 1;
+        if (rule->kids[i] == X86_NT_INDEX) {
+            *res = kids[i];
+        } else {
+            b = x86_tree_reg(ctx, &kids[i]);
+            *res = x86_mem(X86_NOREG, 0, 0);
+            res->index = b.reg;
+            res->scale = 1;
+        }
+
+        a = x86_tree_reg(ctx, &kids[1 - i]);
+        res->reg = a.reg;
+        break;
+    case X86_EMIT_BASE:
+        a = x86_tree_reg(ctx, &kids[0]);
+        *res = x86_mem(a.reg, 0, 0);
+        break;
+    case X86_EMIT_LABEL:
+        *res = x86_mem(X86_NOREG, 0, 0);
+        res->label = insn->label;
+        break;
+    case X86_EMIT_SLOT:
+        *res = x86_local(ctx, insn->imm);
+        break;
+    case X86_EMIT_DISP:
+        if (rule->kids[0] == X86_NT_BASEIDX) {
+            *res = kids[0];
+        } else {
+            a = x86_tree_reg(ctx, &kids[0]);
+            *res = x86_mem(a.reg, 0, 0);
+        }
+
+        disp = (int32_t)kids[1].imm;
+        res->disp += (insn->op == IR_SUB) ? -disp : disp;
+        break;
+    case X86_EMIT_MEM:
+        *res = kids[0];
+        res->size = insn->size;
+        break;
+    case X86_EMIT_LEA:
+        dst = x86_vreg(ctx, insn->dst);
+        work = x86_work(&dst);
+        x86_ins(ctx, X86_OP_LEA, &work, &kids[0]);
+        x86_mov(ctx, &dst, &work);
+        break;
+    case X86_EMIT_LOAD:
+        dst = x86_vreg(ctx, insn->dst);
+        work = x86_work(&dst);
+        tmp = kids[0];
+        tmp.size = insn->size;
+        if (insn->size < 4) {
+            work.size = 4;
+            x86_ins(ctx, X86_OP_MOVZX, &work, &tmp);
+        } else {
+            work.size = insn->size;
+            x86_ins(ctx, X86_OP_MOV, &work, &tmp);
+        }
+
+        work.size = 8;
+        x86_mov(ctx, &dst, &work);
+        break;
+    case X86_EMIT_STORE:
+        tmp = kids[0];
+        b = kids[1];
+        if (b.kind == X86_OPND_IMM && insn->size < 8) {
+            b.imm &= ((uint64_t)1 << (8 * insn->size)) - 1;
+        } else if (b.kind == X86_OPND_MEM) {
+            work = x86_tree_scratch(ctx, &tmp);
+            x86_ins(ctx, X86_OP_MOV, &work, &b);
+            b = work;
+        }
+
+        if (b.kind == X86_OPND_REG) {
+            b.size = insn->size;
+        }
+
+        tmp.size = insn->size;
+        x86_ins(ctx, X86_OP_MOV, &tmp, &b);
+        break;
+    case X86_EMIT_ALU:
+        i = (rule->kids[0] == X86_NT_MEM) ? 0 : 1;
+        a = kids[1 - i];
+        tmp = kids[i];
+        switch (insn->op) {
+        case IR_ADD:
+            op = X86_OP_ADD;
+            break;
+        case IR_SUB:
+            op = X86_OP_SUB;
+            break;
+        default:
+            op = X86_OP_IMUL;
+            break;
+        }
+
+        /* The address must survive the copy into the work register */
+        dst = x86_vreg(ctx, insn->dst);
+        if (dst.kind == X86_OPND_REG && !x86_mem_uses(&tmp, dst.reg)) {
+            work = dst;
+        } else {
+            work = x86_tree_scratch(ctx, &tmp);
+        }
+
+        x86_mov(ctx, &work, &a);
+        x86_ins(ctx, op, &work, &tmp);
+        x86_mov(ctx, &dst, &work);
+        break;
+    case X86_EMIT_MUL_LEA:
+        x86_mul_lea(ctx, insn, kids[1].imm);
+        break;
+    case X86_EMIT_MULX:
+        /* Either factor can be the one already in rdx */
+        a = kids[0];
+        b = kids[1];
+        if (b.kind == X86_OPND_REG && b.reg == X86_RDX) {
+            a = kids[1];
+            b = kids[0];
+        }
+
+        tmp = x86_reg(X86_RDX, 8);
+        x86_mov(ctx, &tmp, &a);
+        dst = x86_vreg(ctx, insn->dst);
+        work = x86_work(&dst);
+        x86_ins(ctx, X86_OP_MULX, &work, &b);
+        x86_mov(ctx, &dst, &work);
+        break;
+    case X86_EMIT_CMP:
+        a = kids[0];
+        b = kids[1];
+        if (a.kind == X86_OPND_MEM && b.kind == X86_OPND_MEM) {
+            tmp = x86_tree_scratch(ctx, &b);
+            x86_ins(ctx, X86_OP_MOV, &tmp, &a);
+            a = tmp;
+        }
+
+        x86_ins(ctx, X86_OP_CMP, &a, &b);
+        *res = x86_imm(cctab[insn->op]);
+        break;
+    case X86_EMIT_SETCC:
+        dst = x86_vreg(ctx, insn->dst);
+        work = x86_work(&dst);
+        work.size = 1;
+        x86_ins_cc(ctx, X86_OP_SETCC, kids[0].imm, 0, &work);
+        tmp = work;
+        work.size = 4;
+        x86_ins(ctx, X86_OP_MOVZX, &work, &tmp);
+        work.size = 8;
+        x86_mov(ctx, &dst, &work);
+        break;
+    case X86_EMIT_BRCC:
+        x86_ins_cc(ctx, X86_OP_JCC, kids[0].imm, insn->target[0]->id, NULL);
+        x86_ins_cc(ctx, X86_OP_JMP, 0, insn->target[1]->id, NULL);
+        break;
+    case X86_EMIT_BR:
+        a = kids[0];
+        if (a.kind == X86_OPND_REG) {
+            x86_ins(ctx, X86_OP_TEST, &a, &a);
+        } else {
+            tmp = x86_imm(0);
+            x86_ins(ctx, X86_OP_CMP, &a, &tmp);
+        }
+
+        x86_ins_cc(ctx, X86_OP_JCC, X86_CC_NE, insn->target[0]->id, NULL);
+        x86_ins_cc(ctx, X86_OP_JMP, 0, insn->target[1]->id, NULL);
+        break;
+    default:
+        errno = -EINVAL;
+        return -1;
+    }
+
+    return ctx->error ? -1 : 0;
+}
+
+/*
+ * Reduce an instruction with a rule, emitting the trees
+ * folded into it first
+ *
+ * @ctx:  Emission context
+ * @insn: Instruction to reduce
+ * @num:  Instruction number (see struct x86_isel)
+ * @rule: Rule to reduce with
+ * @res:  Operand the rule produces, if it produces one
+ *
+ * Returns zero on success
+ */
+static int
+x86_reduce(struct x86_ctx *ctx, struct ir_insn *insn, uint32_t num,
+    const struct x86_rule *rule, struct x86_opnd *res)
+{
+    const struct x86_isel *sel = &ctx->sel;
+    struct x86_opnd kids[2], leaf;
+    uint32_t pos;
+    ir_reg_t reg;
+    size_t i;
+
+    memset(kids, 0, sizeof(kids));
+    memset(res, 0, sizeof(*res));
+    if (x86_rule_chain(rule)) {
+        if (x86_reduce(ctx, insn, num, sel->rule[num][rule->kids[0]], &kids[0]) < 0)
+            return -1;
+
+        return x86_emit_rule(ctx, insn, rule, kids, res);
+    }
+
+    for (i = 0; i < 2; ++i) {
+        reg = insn->src[i];
+        switch (rule->kids[i]) {
+        case X86_NT_NONE:
+            continue;
+        case X86_NT_REG:
+            kids[i] = x86_vreg(ctx, reg);
+            continue;
+        case X86_NT_IMM:
+            kids[i] = x86_imm(ctx->ra.loc[reg].imm);
+            continue;
+        case X86_NT_ANY:
+            if (reg != 0)
+                kids[i] = x86_src(ctx, insn, i);
+            continue;
+        default:
+            break;
+        }
+
+        if (sel->inner[reg]) {
+            pos = sel->pos[reg];
+            if (x86_reduce(ctx, sel->def[reg], pos, sel->rule[pos][rule->kids[i]], &kids[i]) < 0)
+                return -1;
+
+            continue;
+        }
+
+        /* A source on its own goes through a chain rule */
+        leaf = x86_vreg(ctx, reg);
+        if (x86_emit_rule(ctx, insn, x86_isel_chain(rule->kids[i]), &leaf, &kids[i]) < 0)
+            return -1;
+    }
+
+    return x86_emit_rule(ctx, insn, rule, kids, res);
+}
+
+/*
+ * Emit the data of a single string literal as a 'db'
+ * directive, printable runs are quoted and everything else
+ * is emitted as a numeric byte.
+ *
+ * @state: Compiler state
+ * @entry: String pool entry
+ */
+static void
+mu_emit_strdata(struct gup_state *state, struct strpool_entry *entry)
+{
+    struct outbuf *ob = &state->out;
+    size_t i, run;
+    unsigned char c;
+
+    outbuf_write(ob, "\tdb ", 4);
+    for (i = 0; i < entry->len;) {
+        /* Printable runs go out in one piece */
+        for (run = i; run < entry->len; ++run) {
+            c = entry->data[run];
+            if (!isprint(c) || c == '"')
+                break;
+        }
+
+        if (run > i) {
+            outbuf_putc(ob, '"');
+            outbuf_write(ob, &entry->data[i], run - i);
+            outbuf_write(ob, "\", ", 3);
+            i = run;
+            continue;
+        }
+
+        outbuf_putu(ob, (unsigned char)entry->data[i++]);
+        outbuf_write(ob, ", ", 2);
+    }
+
+    outbuf_write(ob, "0\n", 2);
+}
+
+/*
+ * Place every literal in the string pool in the read-only
+ * data section of the object
+ *
+ * @state: Compiler state
+ */
+static int
+mu_obj_strpool(struct gup_state *state)
+{
+    struct strpool_entry *entry;
+    char label[32];
+
+    TAILQ_FOREACH(entry, &state->strpool.entries, link) {
+        snprintf(label, sizeof(label), STRPOOL_LABEL_FMT, entry->id);
+        if (elf_define(&state->elf, label, ELF_SEC_RODATA, false, false) < 0)
+            return -1;
+        if (elf_put(&state->elf, ELF_SEC_RODATA, entry->data, entry->len + 1) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Place a global in the data or bss section of the object
+ *
+ * @state:  Compiler state
+ * @name:   Name of the global
+ * @global: If true, symbol is global
+ * @data:   Storage and contents of the global
+ */
+static int
+mu_obj_global(struct gup_state *state, const char *name, bool global,
+    const struct mu_data *data)
+{
+    struct elf_obj *obj = &state->elf;
+    elf_sec_t sec;
+    uint8_t bytes[8];
+    ssize_t idx;
+    size_t i;
+
+    sec = (data->type == MU_DATA_ZERO) ? ELF_SEC_BSS : ELF_SEC_DATA;
+    if (elf_align(obj, sec, data->align) < 0) {
+        return -1;
+    }
+
+    if ((idx = elf_define(obj, name, sec, global, false)) < 0) {
+        return -1;
+    }
+
+    obj->syms[idx].size = data->size;
+    switch (data->type) {
+    case MU_DATA_ZERO:
+        return elf_put(obj, sec, NULL, data->size);
+    case MU_DATA_INT:
+        for (i = 0; i < data->size; ++i) {
+            bytes[i] = (data->value >> (8 * i)) & 0xFF;
+        }
+
+        return elf_put(obj, sec, bytes, data->size);
+    case MU_DATA_ADDR:
+        if (elf_reloc(obj, sec, elf_offset(obj, sec), data->label,
+            (data->size == 8) ? R_X86_64_64 : R_X86_64_32, 0) < 0)
+            return -1;
+
+        return elf_put(obj, sec, NULL, data->size);
+    }
+
+    return 0;
+}
+
+/*
+ * Emit the jump tables of a procedure into .rodata
+ *
+ * @state: Compiler state
+ * @proc:  Procedure name
+ * @buf:   Machine instructions of the procedure
+ */
+static void
+mu_emit_jtabs(struct gup_state *state, const char *proc,
+    const struct x86_mbuf *buf)
+{
+    struct outbuf *ob = &state->out;
+    const struct x86_jtab *tab;
+    size_t i, j;
+
+    for (i = 0; i < buf->ntabs; ++i) {
+        tab = &buf->tabs[i];
+        mu_section(state, SECTION_RODATA);
+        outbuf_write(ob, "align 4\n", 8);
+        outbuf_puts(ob, tab->name);
+        outbuf_write(ob, ":\n", 2);
+        for (j = 0; j < tab->count; ++j) {
+            outbuf_write(ob, "\tdd ", 4);
+            outbuf_puts(ob, proc);
+            outbuf_write(ob, ".L", 2);
+            outbuf_putu(ob, tab->targets[j]);
+            outbuf_write(ob, " - ", 3);
+            outbuf_puts(ob, proc);
+            outbuf_putc(ob, '\n');
+        }
+    }
+}
+
+/*
+ * Encode a procedure into the text section of the object
+ *
+ * @state: Compiler state
+ * @name:  Procedure name
+ * @pub:   If true, procedure is global
+ * @buf:   Machine instructions of the procedure
+ */
+static int
+mu_obj_proc(struct gup_state *state, const char *name, bool pub,
+    struct x86_mbuf *buf)
+{
+    struct elf_obj *obj = &state->elf;
+    ssize_t idx;
+    size_t start;
+
+    start = elf_offset(obj, ELF_SEC_TEXT);
+    if ((idx = elf_define(obj, name, ELF_SEC_TEXT, pub, true)) < 0) {
+        return -1;
+    }
+
+    if (x86_encode(buf, obj) < 0) {
+        return -1;
+    }
+
+    obj->syms[idx].size = elf_offset(obj, ELF_SEC_TEXT) - start;
+    return 0;
+}
 
 int
 mu_emit_label(struct gup_state *state, const char *label, bool global)
@@ -15,20 +1833,19 @@ mu_emit_label(struct gup_state *state, const char *label, bool global)
         return -1;
     }
 
-    if (global) {
-        fprintf(
-            state->out_fp,
-            "[global %s]\n",
-            label
-        );
+    if (state->emit_obj) {
+        return (elf_define(&state->elf, label, ELF_SEC_TEXT, global, false) < 0) ? -1 : 0;
     }
 
-    fprintf(
-        state->out_fp,
-        "%s:\n",
-        label
-    );
+    mu_section(state, SECTION_TEXT);
+    if (global) {
+        outbuf_write(&state->out, "[global ", 8);
+        outbuf_puts(&state->out, label);
+        outbuf_write(&state->out, "]\n", 2);
+    }
 
+    outbuf_puts(&state->out, label);
+    outbuf_write(&state->out, ":\n", 2);
     return 0;
 }
 
@@ -40,10 +1857,526 @@ mu_emit_ret(struct gup_state *state)
         return -1;
     }
 
-    fprintf(
-        state->out_fp,
-        "\tret\n"
-    );
+    if (state->emit_obj) {
+        return elf_put(&state->elf, ELF_SEC_TEXT, "\xC3", 1);
+    }
+
+    outbuf_write(&state->out, "\tret\n", 5);
+    return 0;
+}
+
+int
+mu_emit_strpool(struct gup_state *state)
+{
+    struct strpool_entry *entry;
+
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (state->strpool.entry_count == 0) {
+        return 0;
+    }
+
+    if (state->emit_obj) {
+        return mu_obj_strpool(state);
+    }
+
+    mu_section(state, SECTION_RODATA);
+    TAILQ_FOREACH(entry, &state->strpool.entries, link) {
+        outbuf_write(&state->out, STRPOOL_LABEL_PREFIX, sizeof(STRPOOL_LABEL_PREFIX) - 1);
+        outbuf_putu(&state->out, entry->id);
+        outbuf_write(&state->out, ":\n", 2);
+        mu_emit_strdata(state, entry);
+    }
+
+    return 0;
+}
+
+int
+mu_emit_global(struct gup_state *state, const char *name, bool global,
+    const struct mu_data *data)
+{
+    static const struct outbuf_frag dtab[] = {
+        [1] = OUTBUF_FRAG("\tdb "),
+        [2] = OUTBUF_FRAG("\tdw "),
+        [4] = OUTBUF_FRAG("\tdd "),
+        [8] = OUTBUF_FRAG("\tdq ")
+    };
+    struct outbuf *ob;
+
+    if (state == NULL || name == NULL || data == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (data->size > 8 && data->type != MU_DATA_ZERO) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (state->emit_obj) {
+        return mu_obj_global(state, name, global, data);
+    }
+
+    ob = &state->out;
+
+    /* Zero filled storage takes no space in the image */
+    if (data->type == MU_DATA_ZERO) {
+        mu_section(state, SECTION_BSS);
+    } else {
+        mu_section(state, SECTION_DATA);
+    }
+
+    if (global) {
+        outbuf_write(ob, "[global ", 8);
+        outbuf_puts(ob, name);
+        outbuf_write(ob, "]\n", 2);
+    }
+
+    if (data->align > 1) {
+        if (data->type == MU_DATA_ZERO) {
+            outbuf_write(ob, "alignb ", 7);
+        } else {
+            outbuf_write(ob, "align ", 6);
+        }
+
+        outbuf_putu(ob, data->align);
+        outbuf_putc(ob, '\n');
+    }
+
+    outbuf_puts(ob, name);
+    outbuf_write(ob, ":\n", 2);
+    switch (data->type) {
+    case MU_DATA_ZERO:
+        outbuf_write(ob, "\tresb ", 6);
+        outbuf_putu(ob, data->size);
+        break;
+    case MU_DATA_INT:
+        outbuf_frag(ob, &dtab[data->size]);
+        outbuf_putu(ob, data->value);
+        break;
+    case MU_DATA_ADDR:
+        outbuf_frag(ob, &dtab[data->size]);
+        outbuf_puts(ob, data->label);
+        break;
+    }
+
+    outbuf_putc(ob, '\n');
+
+    return 0;
+}
+
+int
+mu_emit_proc(struct gup_state *state, struct ir_func *func)
+{
+    const struct x86_conv *conv;
+    const struct x86_rule *rule;
+    struct x86_opnd reg, src, res;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    struct x86_ctx ctx;
+    uint16_t touched;
+    uint32_t num = 0;
+    int retval;
+    size_t i;
+    uint8_t r;
+
+    if (state == NULL || func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.state = state;
+    ctx.func = func;
+    ctx.conv = x86_conv(func->sym);
+    ctx.align = !func->sym->internal;
+    if (x86_isel(func, state->features, &ctx.sel) < 0) {
+        return -1;
+    }
+
+    if (x86_regalloc(func, &ctx.sel, &ctx.ra) < 0) {
+        return -1;
+    }
+
+    /* Return value and scratch registers are always fair game */
+    touched = ctx.ra.used | X86_REGBIT(X86_RAX);
+    touched |= X86_REGBIT(X86_SCRATCH0) | X86_REGBIT(X86_SCRATCH1);
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            rule = ctx.sel.cover[++num];
+            switch (insn->op) {
+            case IR_CALL:
+                /* Outgoing stack arguments sit at the bottom of the frame */
+                conv = x86_conv(insn->sym);
+                if (insn->argc > conv->nargs + ctx.nout)
+                    ctx.nout = insn->argc - conv->nargs;
+                /* Fallthrough */
+            case IR_TAIL:
+                /* Recursion touches nothing we don't already */
+                if (insn->sym == func->sym)
+                    touched |= x86_arg_mask(ctx.conv, insn->argc);
+                else
+                    touched |= x86_call_clobbers(func, insn);
+                if (x86_call_aligned(func, insn->sym))
+                    ctx.align = true;
+                break;
+            case IR_DIV:
+            case IR_MULH:
+                touched |= x86_clobbers(func, rule, insn);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    /* Registers we must preserve but touch are kept in the frame */
+    for (r = 0; r < X86_NREG; ++r) {
+        if (r != X86_RBP && (touched & ctx.conv->saved & X86_REGBIT(r)))
+            ctx.saved[ctx.nsaved++] = r;
+    }
+
+    if (x86_layout_locals(&ctx) < 0) {
+        return -1;
+    }
+
+    ctx.frame = 8 * (ctx.nsaved + ctx.ra.spill_count) + ctx.nlocal;
+    x86_frame_setup(&ctx);
+    for (r = 0; r < ctx.nsaved; ++r) {
+        src = x86_reg(ctx.saved[r], 8);
+        reg = x86_frame_slot(&ctx, r);
+        x86_ins(&ctx, X86_OP_MOV, &reg, &src);
+    }
+
+    /* Folded instructions are emitted as part of their tree */
+    num = 0;
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        x86_ins_cc(&ctx, X86_OP_LABEL, 0, block->id, NULL);
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            rule = ctx.sel.cover[++num];
+            if (rule == NULL)
+                continue;
+
+            ctx.scratch = 0;
+            if (x86_reduce(&ctx, insn, num, rule, &res) < 0) {
+                x86_mbuf_free(&ctx.buf);
+                return -1;
+            }
+        }
+    }
+
+    if (ctx.error) {
+        x86_mbuf_free(&ctx.buf);
+        return -1;
+    }
+
+    /* Later callers of private procs only avoid what we touch */
+    func->sym->clobbers = touched & ~(ctx.conv->saved | X86_REGBIT(X86_RSP));
+    func->sym->aligned = ctx.align;
+    func->sym->emitted = 1;
+
+    x86_peephole(&ctx.buf);
+    if (state->emit_obj) {
+        retval = mu_obj_proc(state, func->sym->name, func->sym->pub, &ctx.buf);
+        x86_mbuf_free(&ctx.buf);
+        return retval;
+    }
+
+    if (mu_emit_label(state, func->sym->name, func->sym->pub) < 0) {
+        x86_mbuf_free(&ctx.buf);
+        return -1;
+    }
+
+    for (i = 0; i < ctx.buf.count; ++i) {
+        if (x86_print_insn(state, &ctx.buf.insns[i]) < 0)
+            break;
+    }
+
+    if (i == ctx.buf.count) {
+        mu_emit_jtabs(state, func->sym->name, &ctx.buf);
+    }
+
+    x86_mbuf_free(&ctx.buf);
+    return (i < ctx.buf.count) ? -1 : 0;
+}
+
+int
+mu_emit_extern(struct gup_state *state, const char *name)
+{
+    if (state == NULL || name == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Imports are whatever is left undefined */
+    if (state->emit_obj) {
+        return elf_export(&state->elf, name);
+    }
+
+    outbuf_write(&state->out, "[extern ", 8);
+    outbuf_puts(&state->out, name);
+    outbuf_write(&state->out, "]\n", 2);
+    return 0;
+}
+
+int
+mu_finish(struct gup_state *state)
+{
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (!state->emit_obj) {
+        return 0;
+    }
+
+    state->elf.machine = EM_X86_64;
+    if (state->jit) {
+        return 0;
+    }
+
+    return elf_write(&state->elf, &state->out);
+}
+
+/*
+ * Represents a CPU feature or a CPU that can be targeted
+ *
+ * @name:     Name used with -m
+ * @features: CPU features it stands for
+ */
+struct x86_feat {
+    const char *name;
+    uint32_t features;
+};
+
+static const struct x86_feat feattab[] = {
+    { "popcnt", X86_FEAT_POPCNT },
+    { "lzcnt",  X86_FEAT_LZCNT },
+    { "bmi",    X86_FEAT_BMI1 },
+    { "bmi1",   X86_FEAT_BMI1 },
+    { "bmi2",   X86_FEAT_BMI2 },
+    { "movbe",  X86_FEAT_MOVBE },
+    { "avx2",   X86_FEAT_AVX2 }
+};
+
+/* Microarchitecture levels of the x86-64 psABI */
+#define X86_LEVEL_V2 X86_FEAT_POPCNT
+#define X86_LEVEL_V3 (                  \
+    X86_LEVEL_V2 |                      \
+    X86_FEAT_LZCNT |                    \
+    X86_FEAT_BMI1 |                     \
+    X86_FEAT_BMI2 |                     \
+    X86_FEAT_MOVBE |                    \
+    X86_FEAT_AVX2                       \
+)
+
+static const struct x86_feat cputab[] = {
+    { "x86-64",    0 },
+    { "x86-64-v2", X86_LEVEL_V2 },
+    { "x86-64-v3", X86_LEVEL_V3 },
+    { "x86-64-v4", X86_LEVEL_V3 }
+};
+
+/*
+ * Returns the CPU features of the host
+ */
+static uint32_t
+x86_native(void)
+{
+    uint32_t features = 0;
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt"))
+        features |= X86_FEAT_POPCNT;
+    if (__builtin_cpu_supports("lzcnt"))
+        features |= X86_FEAT_LZCNT;
+    if (__builtin_cpu_supports("bmi"))
+        features |= X86_FEAT_BMI1;
+    if (__builtin_cpu_supports("bmi2"))
+        features |= X86_FEAT_BMI2;
+    if (__builtin_cpu_supports("movbe"))
+        features |= X86_FEAT_MOVBE;
+    if (__builtin_cpu_supports("avx2"))
+        features |= X86_FEAT_AVX2;
+#endif  /* __GNUC__ && __x86_64__ */
+
+    return features;
+}
+
+/*
+ * Enable or disable (with a 'no-' prefix) a single CPU
+ * feature
+ *
+ * @name:     Feature name, not necessarily terminated
+ * @len:      Length of the name
+ * @features: CPU features to update
+ *
+ * Returns zero on success
+ */
+static int
+x86_feature(const char *name, size_t len, uint32_t *features)
+{
+    bool on = true;
+    size_t i;
+
+    if (len > 3 && strncmp(name, "no-", 3) == 0) {
+        name += 3;
+        len -= 3;
+        on = false;
+    }
+
+    for (i = 0; i < sizeof(feattab) / sizeof(*feattab); ++i) {
+        if (strlen(feattab[i].name) != len || strncmp(feattab[i].name, name, len) != 0)
+            continue;
+
+        if (on) {
+            *features |= feattab[i].features;
+        } else {
+            *features &= ~feattab[i].features;
+        }
+
+        return 0;
+    }
+
+    errno = -EINVAL;
+    return -1;
+}
+
+int
+mu_target_opt(const char *opt, uint32_t *features)
+{
+    const char *p;
+    size_t i, len;
+
+    if (opt == NULL || features == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (strncmp(opt, "arch=", 5) == 0) {
+        opt += 5;
+        if (strcmp(opt, "native") == 0) {
+            *features = x86_native();
+            return 0;
+        }
+
+        for (i = 0; i < sizeof(cputab) / sizeof(*cputab); ++i) {
+            if (strcmp(cputab[i].name, opt) == 0) {
+                *features = cputab[i].features;
+                return 0;
+            }
+        }
+
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (strncmp(opt, "features=", 9) != 0) {
+        return x86_feature(opt, strlen(opt), features);
+    }
+
+    for (p = opt + 9; *p != '\0'; p += len + (p[len] == ',')) {
+        len = strcspn(p, ",");
+        if (x86_feature(p, len, features) < 0)
+            return -1;
+    }
 
     return 0;
 }
+
+bool
+mu_can_tail(const struct ir_func *func, const struct ir_insn *call)
+{
+    const struct x86_conv *conv = x86_conv(func->sym);
+    const struct x86_conv *callee = x86_conv(call->sym);
+    uint16_t mask;
+
+    /* Stack arguments would land in the frame being given up */
+    if (call->argc > callee->nargs) {
+        return false;
+    }
+
+    /*
+     * The callee returns straight to our caller, which expects
+     * whatever we must preserve to survive. Arguments landing
+     * in such registers would also be undone by the epilogue.
+     */
+    mask = x86_call_clobbers(func, call);
+    if (call->sym != func->sym && (mask & conv->saved) != 0) {
+        return false;
+    }
+
+    return true;
+}
+
+size_t
+mu_jit_stub(uint8_t *buf, uint64_t target)
+{
+    /* jmp [rip+0] ; dq target */
+    static const uint8_t jmp[] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+
+    if (buf != NULL) {
+        memcpy(buf, jmp, sizeof(jmp));
+        memcpy(&buf[sizeof(jmp)], &target, sizeof(target));
+    }
+
+    return sizeof(jmp) + sizeof(target);
+}
+
+int
+mu_jit_reloc(uint8_t *place, uint64_t value, uint64_t stub,
+    uint32_t type, int64_t addend)
+{
+    int64_t disp;
+    uint32_t val32;
+
+    if (place == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    switch (type) {
+    case R_X86_64_PC32:
+    case R_X86_64_PLT32:
+        disp = (int64_t)(value + addend - (uint64_t)place);
+
+        /* Only calls may go through a stub, data must be reached directly */
+        if (disp < INT32_MIN || disp > INT32_MAX) {
+            if (type == R_X86_64_PLT32 && stub != 0)
+                disp = (int64_t)(stub + addend - (uint64_t)place);
+        }
+
+        if (disp < INT32_MIN || disp > INT32_MAX) {
+            errno = -ERANGE;
+            return -1;
+        }
+
+        val32 = (uint32_t)disp;
+        memcpy(place, &val32, sizeof(val32));
+        return 0;
+    case R_X86_64_64:
+        value += addend;
+        memcpy(place, &value, sizeof(value));
+        return 0;
+    case R_X86_64_32:
+        value += addend;
+        if (value > UINT32_MAX) {
+            errno = -ERANGE;
+            return -1;
+        }
+
+        val32 = (uint32_t)value;
+        memcpy(place, &val32, sizeof(val32));
+        return 0;
+    default:
+        break;
+    }
+
+    errno = -ENOTSUP;
+    return -1;
+}
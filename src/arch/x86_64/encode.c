@@ -0,0 +1,668 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/arch/x86_64.h"
+
+/* Longest possible instruction */
+#define ENC_MAX 15
+
+/* ModR/M helpers */
+#define MODRM(mod, reg, rm) \
+    ((uint8_t)(((mod) << 6) | (((reg) & 7) << 3) | ((rm) & 7)))
+
+/* ALU opcode extensions (also the opcode row) */
+#define ALU_ADD 0
+#define ALU_SUB 5
+#define ALU_XOR 6
+#define ALU_CMP 7
+
+/*
+ * A single encoded instruction
+ *
+ * @b:      Instruction bytes
+ * @len:    Number of bytes
+ * @reloc:  Set if the instruction needs a relocation
+ * @roff:   Offset of the relocated field
+ * @rsym:   Symbol the relocation refers to
+ * @rtype:  Relocation type
+ * @radd:   Relocation addend
+ */
+struct x86_enc {
+    uint8_t b[ENC_MAX];
+    size_t len;
+    bool reloc;
+    size_t roff;
+    const char *rsym;
+    uint32_t rtype;
+    int64_t radd;
+};
+
+/*
+ * Returns true if a value fits in a sign extended byte
+ *
+ * @v: Value to check
+ */
+static inline bool
+enc_fits8(int64_t v)
+{
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+/*
+ * Append a little endian value
+ *
+ * @e:    Encoding to append to
+ * @v:    Value to append
+ * @size: Size in bytes
+ */
+static inline void
+enc_le(struct x86_enc *e, uint64_t v, size_t size)
+{
+    while (size-- > 0) {
+        e->b[e->len++] = v & 0xFF;
+        v >>= 8;
+    }
+}
+
+/*
+ * Returns true if a byte sized register operand is one of
+ * spl/bpl/sil/dil, which can only be named with a REX prefix
+ *
+ * @opnd: Operand to check
+ */
+static inline bool
+enc_rexbyte(const struct x86_opnd *opnd)
+{
+    return opnd != NULL && opnd->kind == X86_OPND_REG && opnd->size == 1 &&
+        opnd->reg >= X86_RSP && opnd->reg <= X86_RDI;
+}
+
+/*
+ * Emit the operand size and REX prefixes
+ *
+ * @e:    Encoding to append to
+ * @size: Operand size
+ * @reg:  Register in the ModR/M reg field (or opcode)
+ * @rm:   Operand in the ModR/M r/m field (or NULL)
+ * @rop:  Register operand in the reg field (or NULL)
+ */
+static void
+enc_prefix(struct x86_enc *e, uint8_t size, uint8_t reg,
+    const struct x86_opnd *rm, const struct x86_opnd *rop)
+{
+    uint8_t rex = 0;
+
+    if (size == 2) {
+        e->b[e->len++] = 0x66;
+    }
+
+    if (size == 8) {
+        rex |= 0x08;
+    }
+
+    if (reg != X86_NOREG && reg >= X86_R8) {
+        rex |= 0x04;
+    }
+
+    if (rm != NULL && rm->label == NULL && rm->reg != X86_NOREG && rm->reg >= X86_R8) {
+        rex |= 0x01;
+    }
+
+    if (rm != NULL && rm->kind == X86_OPND_MEM && rm->scale != 0 && rm->index >= X86_R8) {
+        rex |= 0x02;
+    }
+
+    if (rex != 0 || enc_rexbyte(rm) || enc_rexbyte(rop)) {
+        e->b[e->len++] = 0x40 | rex;
+    }
+}
+
+/*
+ * Emit a three byte VEX prefix
+ *
+ * @e:    Encoding to append to
+ * @map:  Opcode map (1 = 0F, 2 = 0F38, 3 = 0F3A)
+ * @pp:   Implied prefix (0 = none, 1 = 66, 2 = F3, 3 = F2)
+ * @reg:  Register in the ModR/M reg field
+ * @vvvv: Register in the VEX.vvvv field
+ * @rm:   Operand in the ModR/M r/m field
+ */
+static void
+enc_vex(struct x86_enc *e, uint8_t map, uint8_t pp, uint8_t reg,
+    uint8_t vvvv, const struct x86_opnd *rm)
+{
+    uint8_t rxb = 0;
+
+    if (reg >= X86_R8) {
+        rxb |= 0x04;
+    }
+
+    if (rm->kind == X86_OPND_MEM && rm->scale != 0 && rm->index >= X86_R8) {
+        rxb |= 0x02;
+    }
+
+    if (rm->label == NULL && rm->reg != X86_NOREG && rm->reg >= X86_R8) {
+        rxb |= 0x01;
+    }
+
+    /* R, X, B and vvvv are stored inverted, W is always set */
+    e->b[e->len++] = 0xC4;
+    e->b[e->len++] = ((~rxb & 7) << 5) | map;
+    e->b[e->len++] = 0x80 | ((~vvvv & 15) << 3) | pp;
+}
+
+/*
+ * Returns the SIB scale field of an index scale
+ *
+ * @scale: Index scale (1, 2, 4 or 8)
+ */
+static inline uint8_t
+enc_scale(uint8_t scale)
+{
+    return (scale >= 4) ? ((scale == 8) ? 3 : 2) : scale - 1;
+}
+
+/*
+ * Emit the ModR/M byte and whatever addressing follows it
+ *
+ * @e:     Encoding to append to
+ * @reg:   Register or opcode extension for the reg field
+ * @rm:    Register or memory operand
+ * @trail: Immediate bytes that follow the addressing
+ */
+static void
+enc_modrm(struct x86_enc *e, uint8_t reg, const struct x86_opnd *rm, size_t trail)
+{
+    uint8_t mod;
+
+    if (rm->kind == X86_OPND_REG) {
+        e->b[e->len++] = MODRM(3, reg, rm->reg);
+        return;
+    }
+
+    /* RIP-relative, the displacement is left to the linker */
+    if (rm->label != NULL) {
+        e->b[e->len++] = MODRM(0, reg, 5);
+        e->reloc = true;
+        e->roff = e->len;
+        e->rsym = rm->label;
+        e->rtype = R_X86_64_PC32;
+        e->radd = -4 - (int64_t)trail;
+        enc_le(e, 0, 4);
+        return;
+    }
+
+    /* rbp/r13 always need a displacement */
+    if (rm->disp == 0 && (rm->reg & 7) != X86_RBP) {
+        mod = 0;
+    } else if (enc_fits8(rm->disp)) {
+        mod = 1;
+    } else {
+        mod = 2;
+    }
+
+    /* rsp/r12 and indexing need a SIB byte, index 4 is none */
+    if (rm->scale != 0) {
+        e->b[e->len++] = MODRM(mod, reg, X86_RSP);
+        e->b[e->len++] = MODRM(enc_scale(rm->scale), rm->index, rm->reg);
+    } else if ((rm->reg & 7) == X86_RSP) {
+        e->b[e->len++] = MODRM(mod, reg, X86_RSP);
+        e->b[e->len++] = 0x24;
+    } else {
+        e->b[e->len++] = MODRM(mod, reg, rm->reg);
+    }
+
+    if (mod != 0) {
+        enc_le(e, rm->disp, (mod == 1) ? 1 : 4);
+    }
+}
+
+/*
+ * Encode an instruction of the form 'op reg, r/m'
+ *
+ * @e:     Encoding to append to
+ * @size:  Operand size (selects the prefixes)
+ * @op:    Opcode bytes
+ * @oplen: Number of opcode bytes
+ * @reg:   Register operand or opcode extension
+ * @rop:   Register operand in the reg field (or NULL)
+ * @rm:    Register or memory operand
+ * @trail: Immediate bytes that follow the addressing
+ */
+static void
+enc_rm(struct x86_enc *e, uint8_t size, const uint8_t *op, size_t oplen,
+    uint8_t reg, const struct x86_opnd *rop, const struct x86_opnd *rm,
+    size_t trail)
+{
+    enc_prefix(e, size, (rop != NULL) ? reg : X86_NOREG, rm, rop);
+    memcpy(&e->b[e->len], op, oplen);
+    e->len += oplen;
+    enc_modrm(e, reg, rm, trail);
+}
+
+/*
+ * Encode a single byte opcode of the form 'op reg, r/m'
+ */
+static inline void
+enc_rm1(struct x86_enc *e, uint8_t size, uint8_t op, uint8_t reg,
+    const struct x86_opnd *rop, const struct x86_opnd *rm, size_t trail)
+{
+    enc_rm(e, size, &op, 1, reg, rop, rm, trail);
+}
+
+/*
+ * Returns the size of the immediate an ALU instruction needs
+ *
+ * @size: Operand size
+ * @imm:  Immediate value
+ */
+static inline size_t
+enc_alu_immsize(uint8_t size, uint64_t imm)
+{
+    if (size == 1 || enc_fits8((int64_t)imm)) {
+        return 1;
+    }
+
+    return (size == 2) ? 2 : 4;
+}
+
+/*
+ * Encode an ALU instruction (add, sub, xor, cmp)
+ *
+ * @e:   Encoding to append to
+ * @alu: ALU operation
+ * @dst: Destination operand
+ * @src: Source operand
+ */
+static int
+enc_alu(struct x86_enc *e, uint8_t alu, const struct x86_opnd *dst,
+    const struct x86_opnd *src)
+{
+    uint8_t size = dst->size, byte = (dst->size == 1) ? 0 : 1;
+    size_t isz;
+
+    switch (src->kind) {
+    case X86_OPND_IMM:
+        isz = enc_alu_immsize(size, src->imm);
+        if (size == 1) {
+            enc_rm1(e, size, 0x80, alu, NULL, dst, 1);
+        } else {
+            enc_rm1(e, size, (isz == 1) ? 0x83 : 0x81, alu, NULL, dst, isz);
+        }
+
+        enc_le(e, src->imm, isz);
+        return 0;
+    case X86_OPND_REG:
+        enc_rm1(e, size, (alu << 3) | byte, src->reg, src, dst, 0);
+        return 0;
+    case X86_OPND_MEM:
+        if (dst->kind != X86_OPND_REG)
+            break;
+
+        enc_rm1(e, size, (alu << 3) | 2 | byte, dst->reg, dst, src, 0);
+        return 0;
+    default:
+        break;
+    }
+
+    errno = -EINVAL;
+    return -1;
+}
+
+/*
+ * Encode a mov
+ *
+ * @e:   Encoding to append to
+ * @dst: Destination operand
+ * @src: Source operand
+ */
+static int
+enc_mov(struct x86_enc *e, const struct x86_opnd *dst, const struct x86_opnd *src)
+{
+    uint8_t size = dst->size, byte = (dst->size == 1) ? 0 : 1;
+    uint64_t imm = src->imm;
+    size_t isz;
+
+    switch (src->kind) {
+    case X86_OPND_REG:
+        enc_rm1(e, size, 0x88 | byte, src->reg, src, dst, 0);
+        return 0;
+    case X86_OPND_MEM:
+        if (dst->kind != X86_OPND_REG)
+            break;
+
+        enc_rm1(e, size, 0x8A | byte, dst->reg, dst, src, 0);
+        return 0;
+    case X86_OPND_IMM:
+        isz = (size == 8) ? 4 : size;
+        if (dst->kind == X86_OPND_MEM) {
+            enc_rm1(e, size, 0xC6 | byte, 0, NULL, dst, isz);
+            enc_le(e, imm, isz);
+            return 0;
+        }
+
+        /* 32-bit moves zero extend, so prefer those */
+        if (size == 8 && imm <= UINT32_MAX) {
+            size = 4;
+            isz = 4;
+        } else if (size == 8 && (int64_t)imm == (int32_t)imm) {
+            enc_rm1(e, size, 0xC7, 0, NULL, dst, 4);
+            enc_le(e, imm, 4);
+            return 0;
+        } else if (size == 8) {
+            isz = 8;
+        }
+
+        enc_prefix(e, size, X86_NOREG, dst, NULL);
+        e->b[e->len++] = ((size == 1) ? 0xB0 : 0xB8) | (dst->reg & 7);
+        enc_le(e, imm, isz);
+        return 0;
+    default:
+        break;
+    }
+
+    errno = -EINVAL;
+    return -1;
+}
+
+/*
+ * Encode a single machine instruction that is not a jump
+ *
+ * @e:    Encoding to write to
+ * @insn: Instruction to encode
+ */
+static int
+enc_insn(struct x86_enc *e, const struct x86_minsn *insn)
+{
+    const struct x86_opnd *dst = &insn->opnd[0], *src = &insn->opnd[1];
+    uint8_t op[2];
+    size_t isz;
+
+    memset(e, 0, sizeof(*e));
+    switch (insn->op) {
+    case X86_OP_NONE:
+    case X86_OP_LABEL:
+        return 0;
+    case X86_OP_MOV:
+        return enc_mov(e, dst, src);
+    case X86_OP_MOVZX:
+        op[0] = 0x0F;
+        op[1] = (src->size == 1) ? 0xB6 : 0xB7;
+        enc_rm(e, dst->size, op, 2, dst->reg, dst, src, 0);
+        return 0;
+    case X86_OP_MOVSXD:
+        enc_rm1(e, 8, 0x63, dst->reg, dst, src, 0);
+        return 0;
+    case X86_OP_LEA:
+        enc_rm1(e, 8, 0x8D, dst->reg, dst, src, 0);
+        return 0;
+    case X86_OP_ADD:
+        return enc_alu(e, ALU_ADD, dst, src);
+    case X86_OP_SUB:
+        return enc_alu(e, ALU_SUB, dst, src);
+    case X86_OP_XOR:
+        return enc_alu(e, ALU_XOR, dst, src);
+    case X86_OP_CMP:
+        return enc_alu(e, ALU_CMP, dst, src);
+    case X86_OP_IMUL:
+        if (src->kind == X86_OPND_IMM) {
+            isz = enc_fits8((int64_t)src->imm) ? 1 : 4;
+            enc_rm1(e, dst->size, (isz == 1) ? 0x6B : 0x69, dst->reg, dst, dst, isz);
+            enc_le(e, src->imm, isz);
+            return 0;
+        }
+
+        op[0] = 0x0F;
+        op[1] = 0xAF;
+        enc_rm(e, dst->size, op, 2, dst->reg, dst, src, 0);
+        return 0;
+    case X86_OP_NEG:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0xF6 : 0xF7, 3, NULL, dst, 0);
+        return 0;
+    case X86_OP_MUL:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0xF6 : 0xF7, 4, NULL, dst, 0);
+        return 0;
+    case X86_OP_DIV:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0xF6 : 0xF7, 6, NULL, dst, 0);
+        return 0;
+    case X86_OP_MULX:
+        /* VEX.LZ.F2.0F38.W1 F6, both halves to dst */
+        enc_vex(e, 2, 3, dst->reg, dst->reg, src);
+        e->b[e->len++] = 0xF6;
+        enc_modrm(e, dst->reg, src, 0);
+        return 0;
+    case X86_OP_SHL:
+    case X86_OP_SHR:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0xC0 : 0xC1,
+            (insn->op == X86_OP_SHL) ? 4 : 5, NULL, dst, 1);
+        enc_le(e, src->imm, 1);
+        return 0;
+    case X86_OP_INC:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0xFE : 0xFF, 0, NULL, dst, 0);
+        return 0;
+    case X86_OP_DEC:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0xFE : 0xFF, 1, NULL, dst, 0);
+        return 0;
+    case X86_OP_TEST:
+        enc_rm1(e, dst->size, (dst->size == 1) ? 0x84 : 0x85, src->reg, src, dst, 0);
+        return 0;
+    case X86_OP_SETCC:
+        op[0] = 0x0F;
+        op[1] = 0x90 | insn->cc;
+        enc_rm(e, 1, op, 2, 0, NULL, dst, 0);
+        return 0;
+    case X86_OP_PUSH:
+        if (dst->reg >= X86_R8)
+            e->b[e->len++] = 0x41;
+
+        e->b[e->len++] = 0x50 | (dst->reg & 7);
+        return 0;
+    case X86_OP_JMPR:
+        /* Near jumps are always 64-bit, no REX.W needed */
+        enc_rm1(e, 4, 0xFF, 4, NULL, dst, 0);
+        return 0;
+    case X86_OP_LEAVE:
+        e->b[e->len++] = 0xC9;
+        return 0;
+    case X86_OP_RET:
+        e->b[e->len++] = 0xC3;
+        return 0;
+    case X86_OP_CALL:
+    case X86_OP_TAILJMP:
+        e->b[e->len++] = (insn->op == X86_OP_CALL) ? 0xE8 : 0xE9;
+        e->reloc = true;
+        e->roff = e->len;
+        e->rsym = insn->sym;
+        e->rtype = R_X86_64_PLT32;
+        e->radd = -4;
+        enc_le(e, 0, 4);
+        return 0;
+    default:
+        break;
+    }
+
+    errno = -EINVAL;
+    return -1;
+}
+
+/*
+ * Returns the size of a jump
+ *
+ * @insn:  Jump instruction
+ * @isfar: Jump needs a 32-bit displacement
+ */
+static inline size_t
+enc_jmp_size(const struct x86_minsn *insn, bool isfar)
+{
+    if (!isfar) {
+        return 2;
+    }
+
+    return (insn->op == X86_OP_JMP) ? 5 : 6;
+}
+
+/*
+ * Append a jump table to the read-only data section, each
+ * entry is the offset of its label from the procedure entry
+ *
+ * @obj:     Object to append to
+ * @tab:     Jump table
+ * @label:   Offset of each local label
+ * @nlabels: Number of local labels
+ *
+ * Returns zero on success
+ */
+static int
+enc_jtab(struct elf_obj *obj, const struct x86_jtab *tab, const size_t *label,
+    size_t nlabels)
+{
+    struct x86_enc e;
+    ssize_t idx;
+    size_t i;
+
+    if (elf_align(obj, ELF_SEC_RODATA, 4) < 0) {
+        return -1;
+    }
+
+    if ((idx = elf_define(obj, tab->name, ELF_SEC_RODATA, false, false)) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < tab->count; ++i) {
+        if (tab->targets[i] >= nlabels) {
+            errno = -EINVAL;
+            return -1;
+        }
+
+        memset(&e, 0, sizeof(e));
+        enc_le(&e, label[tab->targets[i]], 4);
+        if (elf_put(obj, ELF_SEC_RODATA, e.b, e.len) < 0)
+            return -1;
+    }
+
+    obj->syms[idx].size = 4 * tab->count;
+    return 0;
+}
+
+int
+x86_encode(struct x86_mbuf *buf, struct elf_obj *obj)
+{
+    struct x86_minsn *insn;
+    struct x86_enc e;
+    size_t *off, *label, nlabels = 0, i, base, size;
+    bool *isfar, changed;
+    int64_t disp;
+    int retval = -1;
+
+    if (buf == NULL || obj == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < buf->count; ++i) {
+        if (buf->insns[i].op == X86_OP_LABEL && buf->insns[i].target >= nlabels)
+            nlabels = buf->insns[i].target + 1;
+    }
+
+    off = calloc(buf->count + 1, sizeof(*off));
+    label = calloc(nlabels + 1, sizeof(*label));
+    isfar = calloc(buf->count + 1, sizeof(*isfar));
+    if (off == NULL || label == NULL || isfar == NULL) {
+        errno = -ENOMEM;
+        goto done;
+    }
+
+    /*
+     * Jumps start out short and are widened until every
+     * displacement fits, widening only ever moves labels
+     * further apart so this settles.
+     */
+    do {
+        changed = false;
+        for (i = 0; i < buf->count; ++i) {
+            insn = &buf->insns[i];
+            if (insn->op == X86_OP_LABEL)
+                label[insn->target] = off[i];
+
+            if (insn->op == X86_OP_JMP || insn->op == X86_OP_JCC) {
+                size = enc_jmp_size(insn, isfar[i]);
+            } else if (enc_insn(&e, insn) < 0) {
+                goto done;
+            } else {
+                size = e.len;
+            }
+
+            off[i + 1] = off[i] + size;
+        }
+
+        for (i = 0; i < buf->count; ++i) {
+            insn = &buf->insns[i];
+            if (insn->op != X86_OP_JMP && insn->op != X86_OP_JCC)
+                continue;
+            if (isfar[i])
+                continue;
+            if (insn->target >= nlabels) {
+                errno = -EINVAL;
+                goto done;
+            }
+
+            disp = (int64_t)label[insn->target] - (int64_t)off[i + 1];
+            if (!enc_fits8(disp)) {
+                isfar[i] = true;
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    base = elf_offset(obj, ELF_SEC_TEXT);
+    for (i = 0; i < buf->count; ++i) {
+        insn = &buf->insns[i];
+        if (insn->op == X86_OP_JMP || insn->op == X86_OP_JCC) {
+            memset(&e, 0, sizeof(e));
+            disp = (int64_t)label[insn->target] - (int64_t)off[i + 1];
+            if (!isfar[i]) {
+                e.b[e.len++] = (insn->op == X86_OP_JMP) ? 0xEB : 0x70 | insn->cc;
+                enc_le(&e, disp, 1);
+            } else if (insn->op == X86_OP_JMP) {
+                e.b[e.len++] = 0xE9;
+                enc_le(&e, disp, 4);
+            } else {
+                e.b[e.len++] = 0x0F;
+                e.b[e.len++] = 0x80 | insn->cc;
+                enc_le(&e, disp, 4);
+            }
+        } else if (enc_insn(&e, insn) < 0) {
+            goto done;
+        }
+
+        if (e.reloc) {
+            if (elf_reloc(obj, ELF_SEC_TEXT, base + off[i] + e.roff, e.rsym,
+                e.rtype, e.radd) < 0)
+                goto done;
+        }
+
+        if (elf_put(obj, ELF_SEC_TEXT, e.b, e.len) < 0) {
+            goto done;
+        }
+    }
+
+    for (i = 0; i < buf->ntabs; ++i) {
+        if (enc_jtab(obj, &buf->tabs[i], label, nlabels) < 0)
+            goto done;
+    }
+
+    retval = 0;
+done:
+    free(off);
+    free(label);
+    free(isfar);
+    return retval;
+}
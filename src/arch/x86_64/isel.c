@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "gup/arch/x86_64.h"
+
+/* Cost of a nonterminal that can't be derived */
+#define ISEL_INF 0xFFFF
+
+/*
+ * Returns true if a shift can become an index scale
+ */
+static bool
+isel_scale(const struct x86_isel *sel, const struct ir_insn *insn)
+{
+    return insn->imm >= 1 && insn->imm <= 3;
+}
+
+/*
+ * Returns true if the constant subtracted still fits a
+ * displacement once negated
+ */
+static bool
+isel_negdisp(const struct x86_isel *sel, const struct ir_insn *insn)
+{
+    return sel->def[insn->src[1]]->imm != (uint64_t)INT32_MIN;
+}
+
+/*
+ * Returns true if a load reads a full 64-bit value
+ */
+static bool
+isel_full(const struct x86_isel *sel, const struct ir_insn *insn)
+{
+    return insn->size == 8;
+}
+
+/*
+ * Returns true if a constant factor is 3, 5 or 9 times a
+ * power of two
+ */
+static bool
+isel_mul_lea(const struct x86_isel *sel, const struct ir_insn *insn)
+{
+    uint64_t imm = sel->def[insn->src[1]]->imm;
+
+    while (imm != 0 && (imm & 1) == 0) {
+        imm >>= 1;
+    }
+
+    return imm == 3 || imm == 5 || imm == 9;
+}
+
+/*
+ * Returns true if mulx may be used
+ */
+static bool
+isel_bmi2(const struct x86_isel *sel, const struct ir_insn *insn)
+{
+    return (sel->features & X86_FEAT_BMI2) != 0;
+}
+
+/* Comparisons set the flags for a branch or setcc */
+#define ISEL_CMP(op)                                                        \
+    { X86_NT_CC,      op,        { X86_NT_REG, X86_NT_ANY },     1, X86_EMIT_CMP,     NULL }, \
+    { X86_NT_CC,      op,        { X86_NT_REG, X86_NT_MEM },     1, X86_EMIT_CMP,     NULL }
+
+/* Instructions emitted on their own */
+#define ISEL_INSN(lhs, op) \
+    { lhs,            op,        { X86_NT_ANY, X86_NT_ANY },     1, X86_EMIT_INSN,    NULL }
+
+static const struct x86_rule rules[] = {
+    /* Addressing */
+    { X86_NT_INDEX,   IR_SHL,    { X86_NT_REG },                 0, X86_EMIT_INDEX,   isel_scale },
+    { X86_NT_BASEIDX, IR_ADD,    { X86_NT_REG, X86_NT_REG },     0, X86_EMIT_BASEIDX, NULL },
+    { X86_NT_BASEIDX, IR_ADD,    { X86_NT_REG, X86_NT_INDEX },   0, X86_EMIT_BASEIDX, NULL },
+    { X86_NT_BASEIDX, IR_ADD,    { X86_NT_INDEX, X86_NT_REG },   0, X86_EMIT_BASEIDX, NULL },
+    { X86_NT_ADDR,    IR_ADDR,   { X86_NT_NONE },                0, X86_EMIT_LABEL,   NULL },
+    { X86_NT_ADDR,    IR_SLOT,   { X86_NT_NONE },                0, X86_EMIT_SLOT,    NULL },
+    { X86_NT_ADDR,    IR_ADD,    { X86_NT_REG, X86_NT_IMM },     0, X86_EMIT_DISP,    NULL },
+    { X86_NT_ADDR,    IR_ADD,    { X86_NT_BASEIDX, X86_NT_IMM }, 0, X86_EMIT_DISP,    NULL },
+    { X86_NT_ADDR,    IR_SUB,    { X86_NT_REG, X86_NT_IMM },     0, X86_EMIT_DISP,    isel_negdisp },
+    { X86_NT_ADDR,    IR_NOP,    { X86_NT_REG },                 0, X86_EMIT_BASE,    NULL },
+    { X86_NT_ADDR,    IR_NOP,    { X86_NT_BASEIDX },             0, X86_EMIT_PASS,    NULL },
+    { X86_NT_MEM,     IR_LOAD,   { X86_NT_ADDR },                0, X86_EMIT_MEM,     isel_full },
+
+    /* Values */
+    { X86_NT_REG,     IR_NOP,    { X86_NT_ADDR },                1, X86_EMIT_LEA,     NULL },
+    { X86_NT_REG,     IR_LOAD,   { X86_NT_ADDR },                1, X86_EMIT_LOAD,    NULL },
+    { X86_NT_REG,     IR_ADD,    { X86_NT_REG, X86_NT_MEM },     2, X86_EMIT_ALU,     NULL },
+    { X86_NT_REG,     IR_ADD,    { X86_NT_MEM, X86_NT_REG },     2, X86_EMIT_ALU,     NULL },
+    { X86_NT_REG,     IR_SUB,    { X86_NT_REG, X86_NT_MEM },     2, X86_EMIT_ALU,     NULL },
+    { X86_NT_REG,     IR_MUL,    { X86_NT_REG, X86_NT_IMM },     1, X86_EMIT_MUL_LEA, isel_mul_lea },
+    { X86_NT_REG,     IR_MUL,    { X86_NT_REG, X86_NT_MEM },     2, X86_EMIT_ALU,     NULL },
+    { X86_NT_REG,     IR_MUL,    { X86_NT_MEM, X86_NT_REG },     2, X86_EMIT_ALU,     NULL },
+    { X86_NT_REG,     IR_MULH,   { X86_NT_REG, X86_NT_REG },     1, X86_EMIT_MULX,    isel_bmi2 },
+    { X86_NT_REG,     IR_NOP,    { X86_NT_CC },                  2, X86_EMIT_SETCC,   NULL },
+    ISEL_CMP(IR_EQ),
+    ISEL_CMP(IR_NE),
+    ISEL_CMP(IR_LT),
+    ISEL_CMP(IR_GT),
+    ISEL_CMP(IR_LE),
+    ISEL_CMP(IR_GE),
+
+    /* Statements */
+    { X86_NT_STMT,    IR_STORE,  { X86_NT_ADDR, X86_NT_REG },    1, X86_EMIT_STORE,   NULL },
+    { X86_NT_STMT,    IR_STORE,  { X86_NT_ADDR, X86_NT_IMM },    1, X86_EMIT_STORE,   NULL },
+    { X86_NT_STMT,    IR_BR,     { X86_NT_CC },                  2, X86_EMIT_BRCC,    NULL },
+    { X86_NT_STMT,    IR_BR,     { X86_NT_REG },                 3, X86_EMIT_BR,      NULL },
+
+    /* Everything else */
+    ISEL_INSN(X86_NT_STMT, IR_NOP),
+    ISEL_INSN(X86_NT_REG,  IR_IMM),
+    ISEL_INSN(X86_NT_REG,  IR_PARAM),
+    ISEL_INSN(X86_NT_REG,  IR_COPY),
+    ISEL_INSN(X86_NT_REG,  IR_ZEXT),
+    ISEL_INSN(X86_NT_REG,  IR_NEG),
+    ISEL_INSN(X86_NT_REG,  IR_SUB),
+    ISEL_INSN(X86_NT_REG,  IR_MUL),
+    ISEL_INSN(X86_NT_REG,  IR_DIV),
+    ISEL_INSN(X86_NT_REG,  IR_MULH),
+    ISEL_INSN(X86_NT_REG,  IR_SHL),
+    ISEL_INSN(X86_NT_REG,  IR_SHR),
+    ISEL_INSN(X86_NT_REG,  IR_CALL),
+    ISEL_INSN(X86_NT_STMT, IR_CALL),
+    ISEL_INSN(X86_NT_STMT, IR_JMP),
+    ISEL_INSN(X86_NT_STMT, IR_SWITCH),
+    ISEL_INSN(X86_NT_STMT, IR_RET),
+    ISEL_INSN(X86_NT_STMT, IR_TAIL)
+};
+
+#define ISEL_NRULES (sizeof(rules) / sizeof(*rules))
+
+/*
+ * Labelling context
+ *
+ * @func:     Procedure being covered
+ * @sel:      Selection result
+ * @insns:    Instructions by number
+ * @cost:     Cheapest cost per nonterminal, by instruction number
+ * @ndefs:    Definition count (up to two), indexed by register
+ * @nuses:    Use count (up to two), indexed by register
+ * @lo:       Earliest instruction a tree reads registers at,
+ *            indexed by register
+ * @lomem:    Earliest instruction a tree reads memory at,
+ *            indexed by register
+ * @cand:     Set if a register may be folded into its user
+ * @lastread: Last instruction reading a register, indexed by
+ *            register
+ * @fence:    Last instruction trees may not reach across
+ * @memfence: Last instruction that wrote memory
+ */
+struct isel_ctx {
+    struct ir_func *func;
+    struct x86_isel *sel;
+    struct ir_insn **insns;
+    uint16_t (*cost)[X86_NT_MAX];
+    uint8_t *ndefs;
+    uint8_t *nuses;
+    uint32_t *lo;
+    uint32_t *lomem;
+    uint8_t *cand;
+    uint32_t *lastread;
+    uint32_t fence;
+    uint32_t memfence;
+};
+
+const struct x86_rule *
+x86_isel_chain(x86_nt_t nt)
+{
+    size_t i;
+
+    for (i = 0; i < ISEL_NRULES; ++i) {
+        if (rules[i].op == IR_NOP && rules[i].lhs == nt && rules[i].kids[0] == X86_NT_REG)
+            return &rules[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns true if a nonterminal is a plain operand, never
+ * the root of a folded tree
+ *
+ * @nt: Nonterminal to check
+ */
+static inline bool
+isel_is_leaf(x86_nt_t nt)
+{
+    return nt == X86_NT_REG || nt == X86_NT_IMM || nt == X86_NT_ANY;
+}
+
+/*
+ * Returns a cost clamped below ISEL_INF, long chains of
+ * folded values must not look impossible
+ *
+ * @cost: Cost to clamp
+ */
+static inline uint16_t
+isel_sat(uint32_t cost)
+{
+    return (cost < ISEL_INF) ? cost : ISEL_INF - 1;
+}
+
+/*
+ * Returns true if a register always holds the same constant
+ *
+ * @ctx: Labelling context
+ * @reg: Register to check
+ */
+static inline bool
+isel_konst(struct isel_ctx *ctx, ir_reg_t reg)
+{
+    return ctx->ndefs[reg] == 1 && ctx->sel->def[reg]->op == IR_IMM;
+}
+
+/*
+ * Returns true if the value of a source may be folded into
+ * the instruction reading it
+ *
+ * @ctx:  Labelling context
+ * @insn: Instruction reading the source
+ * @reg:  Source register
+ */
+static bool
+isel_foldable(struct isel_ctx *ctx, const struct ir_insn *insn, ir_reg_t reg)
+{
+    const struct ir_insn *def = ctx->sel->def[reg];
+
+    if (reg == 0 || ctx->ndefs[reg] != 1 || ctx->nuses[reg] != 1) {
+        return false;
+    }
+
+    if (def->block != insn->block) {
+        return false;
+    }
+
+    return ctx->lo[reg] > ctx->fence && ctx->lomem[reg] > ctx->memfence;
+}
+
+/*
+ * Returns the cost of a source reduced to a nonterminal,
+ * either as an operand on its own or as a folded tree
+ *
+ * @ctx:  Labelling context
+ * @insn: Instruction reading the source
+ * @idx:  Source index
+ * @nt:   Nonterminal wanted
+ * @node: Set if the folded tree is cheaper (or NULL)
+ */
+static uint16_t
+isel_kid_cost(struct isel_ctx *ctx, const struct ir_insn *insn, size_t idx,
+    x86_nt_t nt, bool *node)
+{
+    const struct x86_rule *chain;
+    ir_reg_t reg = insn->src[idx];
+    uint16_t leaf, best = ISEL_INF;
+    uint32_t own;
+    bool imm;
+
+    if (node != NULL) {
+        *node = false;
+    }
+
+    if (nt == X86_NT_NONE) {
+        return 0;
+    }
+
+    if (reg == 0) {
+        return (nt == X86_NT_ANY) ? 0 : ISEL_INF;
+    }
+
+    /* Constants the instruction can encode need no register */
+    imm = isel_konst(ctx, reg) && x86_imm_ok(insn, idx, ctx->sel->def[reg]->imm);
+    own = ctx->sel->pos[reg];
+    leaf = ctx->cand[reg] ? ctx->cost[own][X86_NT_REG] : 0;
+    switch (nt) {
+    case X86_NT_IMM:
+        return imm ? 0 : ISEL_INF;
+    case X86_NT_ANY:
+        return imm ? 0 : leaf;
+    case X86_NT_REG:
+        return imm ? ISEL_INF : leaf;
+    default:
+        break;
+    }
+
+    if (!imm && leaf != ISEL_INF && (chain = x86_isel_chain(nt)) != NULL) {
+        best = isel_sat((uint32_t)leaf + chain->cost);
+    }
+
+    /* Ties go to the tree, it saves a register */
+    if (ctx->cand[reg] && ctx->cost[own][nt] <= best && ctx->cost[own][nt] != ISEL_INF) {
+        best = ctx->cost[own][nt];
+        if (node != NULL)
+            *node = true;
+    }
+
+    return best;
+}
+
+/*
+ * Find the cheapest rule for every nonterminal an instruction
+ * can be reduced to, chain rules are applied until nothing
+ * gets any cheaper
+ *
+ * @ctx:  Labelling context
+ * @insn: Instruction to label
+ * @num:  Instruction number
+ */
+static void
+isel_label(struct isel_ctx *ctx, struct ir_insn *insn, uint32_t num)
+{
+    uint16_t *cost = ctx->cost[num], kid;
+    const struct x86_rule *rule;
+    uint32_t sum;
+    bool changed;
+    size_t i, k;
+
+    for (k = 0; k < X86_NT_MAX; ++k) {
+        cost[k] = ISEL_INF;
+    }
+
+    for (i = 0; i < ISEL_NRULES; ++i) {
+        rule = &rules[i];
+        if (rule->op != insn->op || x86_rule_chain(rule))
+            continue;
+
+        sum = rule->cost;
+        for (k = 0; k < 2; ++k) {
+            kid = isel_kid_cost(ctx, insn, k, rule->kids[k], NULL);
+            if (kid == ISEL_INF)
+                break;
+
+            sum += kid;
+        }
+
+        if (k < 2 || isel_sat(sum) >= cost[rule->lhs])
+            continue;
+        if (rule->ok != NULL && !rule->ok(ctx->sel, insn))
+            continue;
+
+        cost[rule->lhs] = isel_sat(sum);
+        ctx->sel->rule[num][rule->lhs] = rule;
+    }
+
+    /* A register is only ever an operand, see x86_isel_chain() */
+    do {
+        changed = false;
+        for (i = 0; i < ISEL_NRULES; ++i) {
+            rule = &rules[i];
+            if (!x86_rule_chain(rule) || rule->kids[0] == X86_NT_REG)
+                continue;
+
+            sum = cost[rule->kids[0]] + rule->cost;
+            if (cost[rule->kids[0]] == ISEL_INF || isel_sat(sum) >= cost[rule->lhs])
+                continue;
+
+            cost[rule->lhs] = isel_sat(sum);
+            ctx->sel->rule[num][rule->lhs] = rule;
+            changed = true;
+        }
+    } while (changed);
+}
+
+/*
+ * Fold the trees a rule reduces sources to into an
+ * instruction
+ *
+ * @ctx:  Labelling context
+ * @insn: Instruction covered
+ * @num:  Instruction number
+ * @rule: Rule covering it
+ */
+static void
+isel_mark(struct isel_ctx *ctx, struct ir_insn *insn, uint32_t num,
+    const struct x86_rule *rule)
+{
+    struct x86_isel *sel = ctx->sel;
+    ir_reg_t reg;
+    bool node;
+    size_t i;
+
+    if (x86_rule_chain(rule)) {
+        isel_mark(ctx, insn, num, sel->rule[num][rule->kids[0]]);
+        return;
+    }
+
+    for (i = 0; i < 2; ++i) {
+        if (isel_is_leaf(rule->kids[i]) || rule->kids[i] == X86_NT_NONE)
+            continue;
+
+        isel_kid_cost(ctx, insn, i, rule->kids[i], &node);
+        if (!node)
+            continue;
+
+        reg = insn->src[i];
+        sel->inner[reg] = 1;
+        isel_mark(ctx, sel->def[reg], sel->pos[reg],
+            sel->rule[sel->pos[reg]][rule->kids[i]]);
+    }
+}
+
+int
+x86_isel(struct ir_func *func, uint32_t features, struct x86_isel *sel)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+    struct isel_ctx ctx;
+    uint32_t n = 0, num;
+    x86_nt_t goal;
+    ir_reg_t reg;
+    size_t i;
+
+    if (func == NULL || sel == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            ++n;
+        }
+    }
+
+    ctx.func = func;
+    ctx.sel = sel;
+    sel->features = features;
+    ctx.fence = 0;
+    ctx.memfence = 0;
+    ctx.insns = arena_alloc(func->arena, (n + 1) * sizeof(*ctx.insns));
+    ctx.cost = arena_alloc(func->arena, (n + 1) * sizeof(*ctx.cost));
+    ctx.ndefs = arena_alloc(func->arena, func->reg_count + 1);
+    ctx.nuses = arena_alloc(func->arena, func->reg_count + 1);
+    ctx.lo = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.lo));
+    ctx.lomem = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.lomem));
+    ctx.cand = arena_alloc(func->arena, func->reg_count + 1);
+    ctx.lastread = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.lastread));
+    sel->cover = arena_alloc(func->arena, (n + 1) * sizeof(*sel->cover));
+    sel->rule = arena_alloc(func->arena, (n + 1) * sizeof(*sel->rule));
+    sel->def = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*sel->def));
+    sel->pos = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*sel->pos));
+    sel->inner = arena_alloc(func->arena, func->reg_count + 1);
+    if (ctx.insns == NULL || ctx.cost == NULL || ctx.ndefs == NULL ||
+        ctx.nuses == NULL || ctx.lo == NULL || ctx.lomem == NULL ||
+        ctx.cand == NULL || ctx.lastread == NULL || sel->cover == NULL || sel->rule == NULL ||
+        sel->def == NULL || sel->pos == NULL || sel->inner == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    num = 0;
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            ctx.insns[++num] = insn;
+            for (i = 0; i < ir_nuses(insn); ++i) {
+                reg = *ir_use(insn, i);
+                if (reg != 0 && ctx.nuses[reg] < 2)
+                    ++ctx.nuses[reg];
+            }
+
+            if (insn->dst == 0)
+                continue;
+            if (ctx.ndefs[insn->dst] < 2)
+                ++ctx.ndefs[insn->dst];
+
+            sel->def[insn->dst] = insn;
+            sel->pos[insn->dst] = num;
+        }
+    }
+
+    /*
+     * Label bottom up in layout order, sources always come
+     * before the instructions reading them. A tree may only
+     * move its reads down to its root if nothing in between
+     * redefines a register read before (only registers with
+     * more than one definition ever are) or calls out, nor
+     * writes memory if it loads.
+     */
+    for (num = 1; num <= n; ++num) {
+        insn = ctx.insns[num];
+        if (insn->dst != 0) {
+            ctx.lo[insn->dst] = num;
+            ctx.lomem[insn->dst] = (insn->op == IR_LOAD) ? num : UINT32_MAX;
+        }
+
+        for (i = 0; i < 2; ++i) {
+            reg = insn->src[i];
+            if (reg == 0 || !isel_foldable(&ctx, insn, reg))
+                continue;
+
+            ctx.cand[reg] = 1;
+            if (insn->dst == 0)
+                continue;
+            if (ctx.lo[reg] < ctx.lo[insn->dst])
+                ctx.lo[insn->dst] = ctx.lo[reg];
+            if (ctx.lomem[reg] < ctx.lomem[insn->dst])
+                ctx.lomem[insn->dst] = ctx.lomem[reg];
+        }
+
+        isel_label(&ctx, insn, num);
+        goal = (insn->dst != 0) ? X86_NT_REG : X86_NT_STMT;
+        if (ctx.cost[num][goal] == ISEL_INF) {
+            errno = -EINVAL;
+            return -1;
+        }
+
+        sel->cover[num] = sel->rule[num][goal];
+        for (i = 0; i < ir_nuses(insn); ++i) {
+            ctx.lastread[*ir_use(insn, i)] = num;
+        }
+
+        if (insn->op == IR_CALL || insn->op == IR_TAIL) {
+            ctx.fence = num;
+            ctx.memfence = num;
+        } else if (insn->op == IR_STORE) {
+            ctx.memfence = num;
+        } else if (insn->dst != 0 && ctx.ndefs[insn->dst] > 1) {
+            if (ctx.lastread[insn->dst] > ctx.fence)
+                ctx.fence = ctx.lastread[insn->dst];
+        }
+    }
+
+    /* Cover top down, whatever a tree leaves out is a root of its own */
+    for (num = n; num > 0; --num) {
+        insn = ctx.insns[num];
+        if (insn->dst != 0 && sel->inner[insn->dst]) {
+            sel->cover[num] = NULL;
+            continue;
+        }
+
+        isel_mark(&ctx, insn, num, sel->cover[num]);
+    }
+
+    return 0;
+}
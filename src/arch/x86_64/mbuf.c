@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/arch/x86_64.h"
+
+#define MBUF_INIT_CAP 64
+
+int
+x86_mbuf_push(struct x86_mbuf *buf, const struct x86_minsn *insn)
+{
+    struct x86_minsn *insns;
+    size_t cap;
+
+    if (buf == NULL || insn == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (buf->count >= buf->cap) {
+        cap = (buf->cap == 0) ? MBUF_INIT_CAP : buf->cap * 2;
+        insns = realloc(buf->insns, cap * sizeof(*insns));
+        if (insns == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        buf->insns = insns;
+        buf->cap = cap;
+    }
+
+    buf->insns[buf->count++] = *insn;
+    return 0;
+}
+
+int
+x86_mbuf_jtab(struct x86_mbuf *buf, const char *name, const size_t *targets,
+    size_t count)
+{
+    struct x86_jtab *tabs, *tab;
+
+    if (buf == NULL || name == NULL || targets == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    tabs = realloc(buf->tabs, (buf->ntabs + 1) * sizeof(*tabs));
+    if (tabs == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    buf->tabs = tabs;
+    tab = &tabs[buf->ntabs];
+    tab->name = strdup(name);
+    tab->targets = malloc(count * sizeof(*tab->targets));
+    if (tab->name == NULL || tab->targets == NULL) {
+        free(tab->name);
+        free(tab->targets);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    memcpy(tab->targets, targets, count * sizeof(*targets));
+    tab->count = count;
+    ++buf->ntabs;
+    return 0;
+}
+
+void
+x86_mbuf_free(struct x86_mbuf *buf)
+{
+    size_t i;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    for (i = 0; i < buf->ntabs; ++i) {
+        free(buf->tabs[i].name);
+        free(buf->tabs[i].targets);
+    }
+
+    free(buf->insns);
+    free(buf->tabs);
+    buf->insns = NULL;
+    buf->tabs = NULL;
+    buf->count = 0;
+    buf->cap = 0;
+    buf->ntabs = 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "gup/arch/x86_64.h"
+
+/* Longest instruction window a rule can match */
+#define PEEP_WINDOW_MAX 3
+
+/*
+ * Represents a single peephole rule
+ *
+ * @len:   Number of instructions in the window
+ * @ops:   Opcodes the window must consist of
+ * @apply: Rewrite the window, returns true if it changed anything
+ */
+struct peep_rule {
+    size_t len;
+    x86_op_t ops[PEEP_WINDOW_MAX];
+    bool(*apply)(struct x86_mbuf *buf, size_t *win);
+};
+
+/*
+ * Returns true if two operands name the same location
+ * with the same size
+ *
+ * @a: First operand
+ * @b: Second operand
+ */
+static bool
+peep_same(const struct x86_opnd *a, const struct x86_opnd *b)
+{
+    if (a->kind != b->kind || a->size != b->size) {
+        return false;
+    }
+
+    switch (a->kind) {
+    case X86_OPND_REG:
+        return a->reg == b->reg;
+    case X86_OPND_MEM:
+        return a->reg == b->reg && a->disp == b->disp && a->label == b->label &&
+            a->scale == b->scale && (a->scale == 0 || a->index == b->index);
+    default:
+        break;
+    }
+
+    return false;
+}
+
+/*
+ * Returns true if writing an operand changes what another
+ * operand refers to or holds
+ *
+ * @dst:  Operand being written
+ * @opnd: Operand to check
+ */
+static bool
+peep_clobbers(const struct x86_opnd *dst, const struct x86_opnd *opnd)
+{
+    if (dst->kind != X86_OPND_REG) {
+        return false;
+    }
+
+    switch (opnd->kind) {
+    case X86_OPND_REG:
+        return opnd->reg == dst->reg;
+    case X86_OPND_MEM:
+        if (opnd->scale != 0 && opnd->index == dst->reg)
+            return true;
+        return opnd->label == NULL && opnd->reg == dst->reg;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+/*
+ * Returns true if the flags an instruction leaves behind are
+ * never read
+ *
+ * @buf: Instruction buffer
+ * @idx: Index of the instruction
+ */
+static bool
+peep_flags_dead(struct x86_mbuf *buf, size_t idx)
+{
+    size_t i;
+
+    for (i = idx + 1; i < buf->count; ++i) {
+        switch (buf->insns[i].op) {
+        case X86_OP_SETCC:
+        case X86_OP_JCC:
+            return false;
+        case X86_OP_NONE:
+        case X86_OP_MOV:
+        case X86_OP_MOVZX:
+        case X86_OP_LEA:
+        case X86_OP_MULX:
+        case X86_OP_PUSH:
+            continue;
+        default:
+            /*
+             * Everything else either overwrites the flags or
+             * ends the block, flags never live across blocks.
+             */
+            return true;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * mov x, x
+ */
+static bool
+peep_mov_self(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *mov = &buf->insns[win[0]];
+
+    if (!peep_same(&mov->opnd[0], &mov->opnd[1])) {
+        return false;
+    }
+
+    /* mov r32, r32 clears the upper half */
+    if (mov->opnd[0].kind == X86_OPND_REG && mov->opnd[0].size == 4) {
+        return false;
+    }
+
+    mov->op = X86_OP_NONE;
+    return true;
+}
+
+/*
+ * mov a, b ; mov b, a  ->  mov a, b
+ */
+static bool
+peep_mov_back(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *first = &buf->insns[win[0]];
+    struct x86_minsn *second = &buf->insns[win[1]];
+
+    if (!peep_same(&first->opnd[0], &second->opnd[1])) {
+        return false;
+    }
+
+    if (!peep_same(&first->opnd[1], &second->opnd[0])) {
+        return false;
+    }
+
+    /* mov r, [r] moves the address out from under us */
+    if (peep_clobbers(&first->opnd[0], &first->opnd[1])) {
+        return false;
+    }
+
+    /* A narrow reload may define the upper bits, e.g. mov r32, [m] */
+    if (second->opnd[0].kind == X86_OPND_REG && second->opnd[0].size < 8) {
+        return false;
+    }
+
+    second->op = X86_OP_NONE;
+    return true;
+}
+
+/*
+ * mov [m], r ; mov r2, [m]  ->  mov [m], r ; mov r2, r
+ * mov r, [m] ; mov r2, [m]  ->  mov r, [m] ; mov r2, r
+ */
+static bool
+peep_forward(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *first = &buf->insns[win[0]];
+    struct x86_minsn *second = &buf->insns[win[1]];
+    struct x86_opnd *mem, *reg;
+
+    if (first->opnd[0].kind == X86_OPND_MEM) {
+        mem = &first->opnd[0];
+        reg = &first->opnd[1];
+    } else {
+        mem = &first->opnd[1];
+        reg = &first->opnd[0];
+    }
+
+    if (mem->kind != X86_OPND_MEM || reg->kind != X86_OPND_REG) {
+        return false;
+    }
+
+    if (second->opnd[0].kind != X86_OPND_REG) {
+        return false;
+    }
+
+    if (!peep_same(mem, &second->opnd[1])) {
+        return false;
+    }
+
+    if (peep_clobbers(reg, mem)) {
+        return false;
+    }
+
+    second->opnd[1] = *reg;
+    return true;
+}
+
+/*
+ * mov r, 0  ->  xor r32, r32
+ */
+static bool
+peep_zero(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *mov = &buf->insns[win[0]];
+
+    if (mov->opnd[0].kind != X86_OPND_REG) {
+        return false;
+    }
+
+    if (mov->opnd[1].kind != X86_OPND_IMM || mov->opnd[1].imm != 0) {
+        return false;
+    }
+
+    if (!peep_flags_dead(buf, win[0])) {
+        return false;
+    }
+
+    /* Writes to the 32-bit register zero the upper half */
+    mov->op = X86_OP_XOR;
+    if (mov->opnd[0].size == 8) {
+        mov->opnd[0].size = 4;
+    }
+
+    mov->opnd[1] = mov->opnd[0];
+    return true;
+}
+
+/*
+ * lea r, [r+x]     ->  add r, x
+ * lea r, [x+r]     ->  add r, x
+ * lea r, [r+disp]  ->  add r, disp
+ */
+static bool
+peep_lea_add(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *lea = &buf->insns[win[0]];
+    struct x86_opnd *dst = &lea->opnd[0], *mem = &lea->opnd[1];
+    struct x86_opnd src;
+
+    if (mem->label != NULL || dst->size != 8) {
+        return false;
+    }
+
+    memset(&src, 0, sizeof(src));
+    if (mem->scale == 0 && mem->reg == dst->reg && mem->disp != INT32_MIN) {
+        src.kind = X86_OPND_IMM;
+        src.size = 8;
+        src.imm = (mem->disp < 0) ? -mem->disp : mem->disp;
+    } else if (mem->scale == 1 && mem->disp == 0) {
+        if (mem->reg != dst->reg && mem->index != dst->reg)
+            return false;
+
+        src.kind = X86_OPND_REG;
+        src.size = 8;
+        src.reg = (mem->reg == dst->reg) ? mem->index : mem->reg;
+    } else {
+        return false;
+    }
+
+    /* Unlike lea, add writes the flags */
+    if (!peep_flags_dead(buf, win[0])) {
+        return false;
+    }
+
+    lea->op = (mem->disp < 0) ? X86_OP_SUB : X86_OP_ADD;
+    lea->opnd[1] = src;
+    return true;
+}
+
+/*
+ * add x, 1  ->  inc x
+ * sub x, 1  ->  dec x
+ */
+static bool
+peep_step(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *insn = &buf->insns[win[0]];
+
+    if (insn->opnd[1].kind != X86_OPND_IMM || insn->opnd[1].imm != 1) {
+        return false;
+    }
+
+    /* inc/dec leave CF alone, only safe if nobody looks */
+    if (!peep_flags_dead(buf, win[0])) {
+        return false;
+    }
+
+    insn->op = (insn->op == X86_OP_ADD) ? X86_OP_INC : X86_OP_DEC;
+    insn->opnd[1].kind = X86_OPND_NONE;
+    return true;
+}
+
+/*
+ * jmp L ; L:  ->  L:
+ */
+static bool
+peep_jmp_next(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *jmp = &buf->insns[win[0]];
+
+    if (jmp->target != buf->insns[win[1]].target) {
+        return false;
+    }
+
+    jmp->op = X86_OP_NONE;
+    return true;
+}
+
+/*
+ * jcc L1 ; jmp L2 ; L1:  ->  jncc L2 ; L1:
+ */
+static bool
+peep_jcc_over(struct x86_mbuf *buf, size_t *win)
+{
+    struct x86_minsn *jcc = &buf->insns[win[0]];
+    struct x86_minsn *jmp = &buf->insns[win[1]];
+
+    if (jcc->target != buf->insns[win[2]].target) {
+        return false;
+    }
+
+    jcc->cc = X86_CC_INV(jcc->cc);
+    jcc->target = jmp->target;
+    jmp->op = X86_OP_NONE;
+    return true;
+}
+
+static const struct peep_rule rules[] = {
+    { 1, { X86_OP_MOV }, peep_mov_self },
+    { 2, { X86_OP_MOV, X86_OP_MOV }, peep_mov_back },
+    { 2, { X86_OP_MOV, X86_OP_MOV }, peep_forward },
+    { 1, { X86_OP_MOV }, peep_zero },
+    { 1, { X86_OP_LEA }, peep_lea_add },
+    { 1, { X86_OP_ADD }, peep_step },
+    { 1, { X86_OP_SUB }, peep_step },
+    { 2, { X86_OP_JMP, X86_OP_LABEL }, peep_jmp_next },
+    { 3, { X86_OP_JCC, X86_OP_JMP, X86_OP_LABEL }, peep_jcc_over }
+};
+
+/*
+ * Gather a window of live instructions and check it
+ * against the opcodes of a rule
+ *
+ * @buf:  Instruction buffer
+ * @idx:  Index of the first instruction
+ * @rule: Rule to match
+ * @win:  Indices of the window instructions
+ */
+static bool
+peep_match(struct x86_mbuf *buf, size_t idx, const struct peep_rule *rule,
+    size_t *win)
+{
+    size_t n = 0;
+
+    while (n < rule->len && idx < buf->count) {
+        if (buf->insns[idx].op != X86_OP_NONE) {
+            if (buf->insns[idx].op != rule->ops[n])
+                return false;
+            win[n++] = idx;
+        }
+
+        ++idx;
+    }
+
+    return n == rule->len;
+}
+
+void
+x86_peephole(struct x86_mbuf *buf)
+{
+    size_t win[PEEP_WINDOW_MAX];
+    size_t i, r, out;
+    bool changed;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    do {
+        changed = false;
+        for (i = 0; i < buf->count; ++i) {
+            for (r = 0; r < sizeof(rules) / sizeof(*rules); ++r) {
+                if (buf->insns[i].op == X86_OP_NONE)
+                    break;
+                if (!peep_match(buf, i, &rules[r], win))
+                    continue;
+                if (rules[r].apply(buf, win))
+                    changed = true;
+            }
+        }
+    } while (changed);
+
+    /* Squeeze out deleted instructions */
+    out = 0;
+    for (i = 0; i < buf->count; ++i) {
+        if (buf->insns[i].op != X86_OP_NONE)
+            buf->insns[out++] = buf->insns[i];
+    }
+
+    buf->count = out;
+}
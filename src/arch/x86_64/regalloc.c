@@ -0,0 +1,733 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/arch/x86_64.h"
+
+/* Bitset helpers */
+#define BS_WORDS(n)         (((n) + 63) / 64)
+#define BS_TEST(bs, i)      (((bs)[(i) / 64] >> ((i) % 64)) & 1)
+#define BS_SET(bs, i)       ((bs)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+#define BS_CLR(bs, i)       ((bs)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+
+/* Loop depth past which uses stop growing in cost */
+#define RA_DEPTH_MAX 5
+
+/*
+ * Allocation order, caller-saved registers come first as
+ * they cost nothing to use when no call is crossed
+ */
+static const x86_reg_t ra_order[] = {
+    X86_RAX, X86_RCX, X86_RDX, X86_RSI, X86_RDI, X86_R8, X86_R9,
+    X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15
+};
+
+/* Every allocatable register */
+#define RA_ALLOCATABLE \
+    (~(X86_REGBIT(X86_RSP) | X86_REGBIT(X86_RBP) | \
+       X86_REGBIT(X86_SCRATCH0) | X86_REGBIT(X86_SCRATCH1)) & 0xFFFF)
+
+/*
+ * Represents the live interval of a virtual register, a
+ * single range covering every point where it is live
+ *
+ * @vreg:   Virtual register
+ * @start:  First position the register is live
+ * @end:    Last position the register is live
+ * @forbid: Registers clobbered while the interval is live
+ * @hint:   Preferred register, X86_NOREG if none
+ * @cost:   Use count weighted by loop depth
+ * @nuses:  Number of uses needing a location
+ * @reg:    Assigned register, X86_NOREG if spilled
+ */
+struct ra_interval {
+    ir_reg_t vreg;
+    uint32_t start;
+    uint32_t end;
+    uint16_t forbid;
+    uint8_t hint;
+    uint64_t cost;
+    size_t nuses;
+    uint8_t reg;
+};
+
+/*
+ * A point in the procedure where registers are clobbered
+ *
+ * @pos:  Position of the clobbering instruction
+ * @mask: Registers clobbered
+ */
+struct ra_clobber {
+    uint32_t pos;
+    uint16_t mask;
+};
+
+/*
+ * Allocation context
+ *
+ * @func:      Procedure being allocated
+ * @sel:       Instruction selection of the procedure
+ * @loc:       Locations being assigned, see 'struct ra_result'
+ * @nregs:     Number of virtual registers (including zero)
+ * @words:     Words per liveness bitset
+ * @live_in:   Live-in set per block ID
+ * @live_out:  Live-out set per block ID
+ * @depth:     Loop depth per block ID
+ * @ivs:       Intervals indexed by virtual register
+ * @clobbers:  Clobber points
+ * @nclobbers: Number of clobber points
+ */
+struct ra_ctx {
+    struct ir_func *func;
+    const struct x86_isel *sel;
+    struct ra_loc *loc;
+    size_t nregs;
+    size_t words;
+    uint64_t **live_in;
+    uint64_t **live_out;
+    uint8_t *depth;
+    struct ra_interval *ivs;
+    struct ra_clobber *clobbers;
+    size_t nclobbers;
+};
+
+/*
+ * Approximate the loop depth of every block, a successor
+ * laid out at or before its predecessor closes a loop over
+ * every block in between
+ *
+ * @ctx: Allocation context
+ */
+static int
+ra_loop_depth(struct ra_ctx *ctx)
+{
+    struct ir_block *block, *iter, **order;
+    size_t *index, n = 0, i, j, k;
+
+    index = calloc(ctx->func->block_count, sizeof(*index));
+    order = calloc(ctx->func->block_count, sizeof(*order));
+    if (index == NULL || order == NULL) {
+        free(index);
+        free(order);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &ctx->func->blocks, link) {
+        index[block->id] = n;
+        order[n++] = block;
+    }
+
+    for (i = 0; i < n; ++i) {
+        block = order[i];
+        for (j = 0; j < block->nsuccs; ++j) {
+            if (index[block->succs[j]->id] > i)
+                continue;
+
+            for (k = index[block->succs[j]->id]; k <= i; ++k) {
+                iter = order[k];
+                if (ctx->depth[iter->id] < RA_DEPTH_MAX)
+                    ++ctx->depth[iter->id];
+            }
+        }
+    }
+
+    free(index);
+    free(order);
+    return 0;
+}
+
+/*
+ * Find the virtual registers that only ever hold a single
+ * constant, uses of them may become immediates
+ *
+ * @ctx: Allocation context
+ */
+static int
+ra_consts(struct ra_ctx *ctx)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+    uint8_t *ndefs;
+    size_t r;
+
+    ndefs = arena_alloc(ctx->func->arena, ctx->nregs);
+    if (ndefs == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &ctx->func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst == 0)
+                continue;
+            if (ndefs[insn->dst] < 2)
+                ++ndefs[insn->dst];
+
+            ctx->loc[insn->dst].konst = (insn->op == IR_IMM);
+            ctx->loc[insn->dst].imm = insn->imm;
+        }
+    }
+
+    for (r = 1; r < ctx->nregs; ++r) {
+        if (ndefs[r] > 1)
+            ctx->loc[r].konst = 0;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns true if a use is encoded as an immediate and
+ * needs no register
+ *
+ * @ctx:  Allocation context
+ * @insn: Instruction
+ * @idx:  Use index
+ */
+static inline bool
+ra_folded(struct ra_ctx *ctx, struct ir_insn *insn, size_t idx)
+{
+    struct ra_loc *loc = &ctx->loc[*ir_use(insn, idx)];
+
+    return loc->konst && x86_imm_ok(insn, idx, loc->imm);
+}
+
+/*
+ * Compute live-in and live-out sets for every block
+ *
+ * @ctx: Allocation context
+ */
+static int
+ra_liveness(struct ra_ctx *ctx)
+{
+    struct ir_func *func = ctx->func;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    uint64_t **gen, **kill, *out, *in, word;
+    ir_reg_t *use;
+    size_t i, w;
+    bool changed;
+
+    gen = arena_alloc(func->arena, func->block_count * sizeof(*gen));
+    kill = arena_alloc(func->arena, func->block_count * sizeof(*kill));
+    ctx->live_in = arena_alloc(func->arena, func->block_count * sizeof(*gen));
+    ctx->live_out = arena_alloc(func->arena, func->block_count * sizeof(*gen));
+    if (gen == NULL || kill == NULL || ctx->live_in == NULL || ctx->live_out == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        gen[block->id] = arena_alloc(func->arena, ctx->words * 8);
+        kill[block->id] = arena_alloc(func->arena, ctx->words * 8);
+        ctx->live_in[block->id] = arena_alloc(func->arena, ctx->words * 8);
+        ctx->live_out[block->id] = arena_alloc(func->arena, ctx->words * 8);
+        if (ctx->live_out[block->id] == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        /* Uses not preceded by a def within the block are live-in */
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            for (i = 0; i < ir_nuses(insn); ++i) {
+                use = ir_use(insn, i);
+                if (*use == 0 || ra_folded(ctx, insn, i))
+                    continue;
+                if (!BS_TEST(kill[block->id], *use))
+                    BS_SET(gen[block->id], *use);
+            }
+
+            if (insn->dst != 0) {
+                BS_SET(kill[block->id], insn->dst);
+            }
+        }
+    }
+
+    do {
+        changed = false;
+        TAILQ_FOREACH_REVERSE(block, &func->blocks, ir_block_q, link) {
+            out = ctx->live_out[block->id];
+            in = ctx->live_in[block->id];
+            for (w = 0; w < ctx->words; ++w) {
+                word = 0;
+                for (i = 0; i < block->nsuccs; ++i)
+                    word |= ctx->live_in[block->succs[i]->id][w];
+
+                out[w] = word;
+                word = gen[block->id][w] | (word & ~kill[block->id][w]);
+                if (word != in[w]) {
+                    in[w] = word;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+
+    return 0;
+}
+
+/*
+ * Extend an interval to cover a position
+ *
+ * @iv:  Interval to extend
+ * @pos: Position to cover
+ */
+static inline void
+ra_extend(struct ra_interval *iv, uint32_t pos)
+{
+    if (pos < iv->start)
+        iv->start = pos;
+    if (pos > iv->end)
+        iv->end = pos;
+}
+
+/*
+ * Record a use of a register, a use of a folded value reads
+ * its sources instead
+ *
+ * @ctx:    Allocation context
+ * @insn:   Instruction
+ * @idx:    Use index
+ * @pos:    Position the use is read at
+ * @weight: Cost of the use
+ */
+static void
+ra_use(struct ra_ctx *ctx, struct ir_insn *insn, size_t idx, uint32_t pos,
+    uint64_t weight)
+{
+    struct ir_insn *def;
+    ir_reg_t reg = *ir_use(insn, idx);
+    size_t i;
+
+    if (reg == 0 || ra_folded(ctx, insn, idx)) {
+        return;
+    }
+
+    if (ctx->sel->inner[reg]) {
+        def = ctx->sel->def[reg];
+        for (i = 0; i < ir_nuses(def); ++i)
+            ra_use(ctx, def, i, pos, weight);
+
+        return;
+    }
+
+    ra_extend(&ctx->ivs[reg], pos);
+    ctx->ivs[reg].cost += weight;
+    ++ctx->ivs[reg].nuses;
+}
+
+/*
+ * Hint call arguments towards the registers they are
+ * passed in
+ *
+ * @ctx:  Allocation context
+ * @insn: IR_CALL or IR_TAIL instruction
+ */
+static void
+ra_hint_args(struct ra_ctx *ctx, struct ir_insn *insn)
+{
+    const struct x86_conv *conv = x86_conv(insn->sym);
+    struct ra_interval *iv;
+    size_t i;
+
+    for (i = 0; i < insn->argc && i < conv->nargs; ++i) {
+        if (insn->args[i] == 0 || ra_folded(ctx, insn, i + 2))
+            continue;
+
+        iv = &ctx->ivs[insn->args[i]];
+        if (iv->hint == X86_NOREG)
+            iv->hint = conv->args[i];
+    }
+}
+
+/*
+ * Build the live interval of every virtual register along
+ * with the clobber points of the procedure
+ *
+ * @ctx: Allocation context
+ * @res: Allocation result
+ */
+static int
+ra_intervals(struct ra_ctx *ctx, struct ra_result *res)
+{
+    struct ir_func *func = ctx->func;
+    const struct x86_conv *conv = x86_conv(func->sym);
+    const struct x86_rule *rule;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    struct ra_interval *iv;
+    uint32_t pos = 0, bstart;
+    uint64_t weight;
+    uint16_t mask;
+    ir_reg_t r;
+    size_t i, ninsns = 0;
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            ++ninsns;
+        }
+    }
+
+    ctx->ivs = arena_alloc(func->arena, ctx->nregs * sizeof(*ctx->ivs));
+    ctx->clobbers = arena_alloc(func->arena, (ninsns + 1) * sizeof(*ctx->clobbers));
+    if (ctx->ivs == NULL || ctx->clobbers == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (r = 0; r < ctx->nregs; ++r) {
+        ctx->ivs[r].vreg = r;
+        ctx->ivs[r].start = UINT32_MAX;
+        ctx->ivs[r].hint = X86_NOREG;
+        ctx->ivs[r].reg = X86_NOREG;
+    }
+
+    /*
+     * Each instruction takes two positions, sources are read
+     * at the first and the destination is written at the second.
+     */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        bstart = pos;
+        weight = (uint64_t)1 << (3 * ctx->depth[block->id]);
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            /* Folded values are computed where they are used */
+            rule = ctx->sel->cover[pos / 2 + 1];
+            if (rule == NULL) {
+                pos += 2;
+                continue;
+            }
+
+            for (i = 0; i < ir_nuses(insn); ++i) {
+                ra_use(ctx, insn, i, pos, weight);
+            }
+
+            if (insn->dst != 0) {
+                ra_extend(&ctx->ivs[insn->dst], pos + 1);
+                ctx->ivs[insn->dst].cost += weight;
+            }
+
+            switch (insn->op) {
+            case IR_PARAM:
+                if (insn->imm < conv->nargs)
+                    ctx->ivs[insn->dst].hint = conv->args[insn->imm];
+                break;
+            case IR_CALL:
+                res->has_calls = true;
+                /* Fallthrough */
+            case IR_TAIL:
+                ra_hint_args(ctx, insn);
+                /* Fallthrough */
+            case IR_DIV:
+                if (insn->dst != 0)
+                    ctx->ivs[insn->dst].hint = X86_RAX;
+                break;
+            case IR_MULH:
+                if (rule->emit != X86_EMIT_MULX)
+                    ctx->ivs[insn->dst].hint = X86_RDX;
+                break;
+            case IR_RET:
+                if (insn->src[0] != 0 && ctx->ivs[insn->src[0]].hint == X86_NOREG)
+                    ctx->ivs[insn->src[0]].hint = X86_RAX;
+                break;
+            default:
+                break;
+            }
+
+            if ((mask = x86_clobbers(func, rule, insn)) != 0) {
+                ctx->clobbers[ctx->nclobbers].pos = pos;
+                ctx->clobbers[ctx->nclobbers++].mask = mask;
+            }
+
+            pos += 2;
+        }
+
+        /* Live-in and live-out registers span the whole block */
+        for (r = 1; r < ctx->nregs; ++r) {
+            if (BS_TEST(ctx->live_in[block->id], r))
+                ra_extend(&ctx->ivs[r], bstart);
+            if (BS_TEST(ctx->live_out[block->id], r))
+                ra_extend(&ctx->ivs[r], pos - 1);
+        }
+    }
+
+    /* Anything live across a clobber must avoid it */
+    for (r = 1; r < ctx->nregs; ++r) {
+        iv = &ctx->ivs[r];
+        if (iv->start == UINT32_MAX)
+            continue;
+
+        /* Constants nobody needs in a register go away */
+        if (ctx->loc[r].konst && iv->nuses == 0) {
+            ctx->loc[r].folded = 1;
+            iv->start = UINT32_MAX;
+            continue;
+        }
+
+        for (i = 0; i < ctx->nclobbers; ++i) {
+            if (iv->start <= ctx->clobbers[i].pos && ctx->clobbers[i].pos < iv->end)
+                iv->forbid |= ctx->clobbers[i].mask;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the spill weight of an interval, intervals with a
+ * lower weight are spilled first
+ *
+ * @iv: Interval to check
+ */
+static inline uint64_t
+ra_weight(const struct ra_interval *iv)
+{
+    return (iv->cost << 16) / ((uint64_t)(iv->end - iv->start) + 1);
+}
+
+/*
+ * Order intervals by increasing start position
+ */
+static int
+ra_cmp_start(const void *a, const void *b)
+{
+    const struct ra_interval *ia = *(struct ra_interval *const *)a;
+    const struct ra_interval *ib = *(struct ra_interval *const *)b;
+
+    if (ia->start != ib->start)
+        return (ia->start < ib->start) ? -1 : 1;
+
+    return (ia->vreg < ib->vreg) ? -1 : (ia->vreg > ib->vreg);
+}
+
+/*
+ * Pick a register for an interval out of a set of free
+ * registers, honouring its hint if possible
+ *
+ * @iv:    Interval to pick for
+ * @avail: Free registers
+ *
+ * Returns X86_NOREG if nothing is free
+ */
+static uint8_t
+ra_pick(const struct ra_interval *iv, uint16_t avail)
+{
+    size_t i;
+
+    avail &= ~iv->forbid;
+    if (iv->hint != X86_NOREG && (avail & X86_REGBIT(iv->hint))) {
+        return iv->hint;
+    }
+
+    for (i = 0; i < sizeof(ra_order) / sizeof(ra_order[0]); ++i) {
+        if (avail & X86_REGBIT(ra_order[i]))
+            return ra_order[i];
+    }
+
+    return X86_NOREG;
+}
+
+/*
+ * Run linear scan over the sorted intervals
+ *
+ * @ctx:    Allocation context
+ * @sorted: Intervals sorted by start
+ * @count:  Number of intervals
+ * @res:    Allocation result
+ */
+static int
+ra_scan(struct ra_ctx *ctx, struct ra_interval **sorted, size_t count,
+    struct ra_result *res)
+{
+    struct ra_interval **active, *iv, *victim;
+    size_t nactive = 0, i, j, vi;
+    uint16_t avail = RA_ALLOCATABLE;
+    uint8_t reg;
+
+    active = calloc(count + 1, sizeof(*active));
+    if (active == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i) {
+        iv = sorted[i];
+
+        /* Expire intervals that ended before this one starts */
+        for (j = 0; j < nactive;) {
+            if (active[j]->end < iv->start) {
+                avail |= X86_REGBIT(active[j]->reg);
+                active[j] = active[--nactive];
+                continue;
+            }
+
+            ++j;
+        }
+
+        reg = ra_pick(iv, avail);
+        if (reg != X86_NOREG) {
+            iv->reg = reg;
+            avail &= ~X86_REGBIT(reg);
+            active[nactive++] = iv;
+            continue;
+        }
+
+        /*
+         * Nothing is free, find the cheapest active interval
+         * holding a register this one may use and spill it if
+         * it is cheaper than spilling this interval.
+         */
+        victim = NULL;
+        vi = 0;
+        for (j = 0; j < nactive; ++j) {
+            if (iv->forbid & X86_REGBIT(active[j]->reg))
+                continue;
+            if (victim == NULL || ra_weight(active[j]) < ra_weight(victim)) {
+                victim = active[j];
+                vi = j;
+            }
+        }
+
+        if (victim == NULL || ra_weight(victim) >= ra_weight(iv)) {
+            continue;
+        }
+
+        iv->reg = victim->reg;
+        victim->reg = X86_NOREG;
+        active[vi] = iv;
+    }
+
+    free(active);
+    return 0;
+}
+
+/*
+ * Give every spilled interval a frame slot, intervals that
+ * never overlap share one
+ *
+ * @ctx:    Allocation context
+ * @sorted: Intervals sorted by start
+ * @count:  Number of intervals
+ * @res:    Allocation result
+ */
+static int
+ra_slots(struct ra_ctx *ctx, struct ra_interval **sorted, size_t count,
+    struct ra_result *res)
+{
+    struct ra_interval *iv;
+    uint32_t *slot_end;
+    size_t i, slot;
+
+    slot_end = calloc(count + 1, sizeof(*slot_end));
+    if (slot_end == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i) {
+        iv = sorted[i];
+        if (iv->reg != X86_NOREG)
+            continue;
+
+        /*
+         * Keep a gap of one position so a source is never
+         * overwritten by the destination of the same instruction.
+         */
+        for (slot = 0; slot < res->spill_count; ++slot) {
+            if (slot_end[slot] + 1 < iv->start)
+                break;
+        }
+
+        if (slot == res->spill_count)
+            ++res->spill_count;
+
+        slot_end[slot] = iv->end;
+        ctx->loc[iv->vreg].slot = slot;
+    }
+
+    free(slot_end);
+    return 0;
+}
+
+int
+x86_regalloc(struct ir_func *func, const struct x86_isel *sel,
+    struct ra_result *res)
+{
+    struct ra_interval **sorted;
+    struct ra_ctx ctx;
+    struct ra_loc *loc;
+    size_t count = 0;
+    ir_reg_t r;
+
+    if (func == NULL || sel == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(res, 0, sizeof(*res));
+    ctx.func = func;
+    ctx.sel = sel;
+    ctx.nregs = (size_t)func->reg_count + 1;
+    ctx.words = BS_WORDS(ctx.nregs);
+    ctx.depth = arena_alloc(func->arena, func->block_count);
+    res->loc = arena_alloc(func->arena, ctx.nregs * sizeof(*res->loc));
+    if (ctx.depth == NULL || res->loc == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    ctx.loc = res->loc;
+    if (ra_loop_depth(&ctx) < 0) {
+        return -1;
+    }
+
+    if (ra_consts(&ctx) < 0) {
+        return -1;
+    }
+
+    if (ra_liveness(&ctx) < 0) {
+        return -1;
+    }
+
+    if (ra_intervals(&ctx, res) < 0) {
+        return -1;
+    }
+
+    sorted = calloc(ctx.nregs, sizeof(*sorted));
+    if (sorted == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (r = 1; r < ctx.nregs; ++r) {
+        if (ctx.ivs[r].start != UINT32_MAX)
+            sorted[count++] = &ctx.ivs[r];
+    }
+
+    qsort(sorted, count, sizeof(*sorted), ra_cmp_start);
+    if (ra_scan(&ctx, sorted, count, res) < 0) {
+        free(sorted);
+        return -1;
+    }
+
+    if (ra_slots(&ctx, sorted, count, res) < 0) {
+        free(sorted);
+        return -1;
+    }
+
+    free(sorted);
+    for (r = 1; r < ctx.nregs; ++r) {
+        loc = &res->loc[r];
+        loc->reg = ctx.ivs[r].reg;
+        if (ctx.ivs[r].start != UINT32_MAX && loc->reg != X86_NOREG)
+            res->used |= X86_REGBIT(loc->reg);
+    }
+
+    return 0;
+}
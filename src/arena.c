@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/arena.h"
+
+/* Allocation alignment */
+#define ARENA_ALIGN 8
+
+int
+arena_init(struct arena *res)
+{
+    if (res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    res->head = NULL;
+    return 0;
+}
+
+void *
+arena_alloc(struct arena *arena, size_t sz)
+{
+    struct arena_chunk *chunk;
+    size_t chunk_sz;
+    void *p;
+
+    if (arena == NULL || sz == 0) {
+        return NULL;
+    }
+
+    sz = (sz + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    chunk = arena->head;
+
+    /* Grab a new chunk if this one is exhausted */
+    if (chunk == NULL || chunk->size - chunk->used < sz) {
+        chunk_sz = (sz > ARENA_CHUNK_SIZE) ? sz : ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(*chunk) + chunk_sz);
+        if (chunk == NULL) {
+            errno = -ENOMEM;
+            return NULL;
+        }
+
+        chunk->size = chunk_sz;
+        chunk->used = 0;
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+
+    p = &chunk->data[chunk->used];
+    chunk->used += sz;
+    memset(p, 0, sz);
+    return p;
+}
+
+void
+arena_destroy(struct arena *arena)
+{
+    struct arena_chunk *chunk;
+
+    if (arena == NULL) {
+        return;
+    }
+
+    while ((chunk = arena->head) != NULL) {
+        arena->head = chunk->next;
+        free(chunk);
+    }
+}
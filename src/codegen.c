@@ -3,51 +3,1050 @@
  * Provided under the BSD-3 clause.
  */
 
+#include <stdbool.h>
+#include <stdio.h>
 #include <stddef.h>
+#include <string.h>
 #include <errno.h>
 #include "gup/codegen.h"
+#include "gup/inline.h"
+#include "gup/opt.h"
 #include "gup/trace.h"
+#include "gup/scope.h"
 #include "gup/symbol.h"
 #include "gup/mu.h"
+#include "gup/ir.h"
+#include "gup/switch.h"
 
 /*
- * Emit machine code for a procedure
+ * Returns the block to append instructions to, code following
+ * a terminator is unreachable and goes into a fresh block that
+ * is later dropped
+ *
+ * @state: Compiler state
+ */
+static struct ir_block *
+cg_block(struct gup_state *state)
+{
+    struct ir_builder *irb = &state->irb;
+
+    if (ir_block_term(irb->block) != NULL) {
+        if (ir_block_new(irb->func, &irb->block) < 0)
+            return NULL;
+    }
+
+    return irb->block;
+}
+
+/*
+ * Append an instruction to the current block
+ *
+ * @state: Compiler state
+ * @op:    Instruction operation
+ * @res:   Instruction result
+ *
+ * Returns zero on success
+ */
+static int
+cg_insn(struct gup_state *state, ir_op_t op, struct ir_insn **res)
+{
+    struct ir_block *block;
+
+    if ((block = cg_block(state)) == NULL) {
+        return -1;
+    }
+
+    return ir_insn_new(state->irb.func, block, op, res);
+}
+
+/*
+ * Terminate the current block with a jump if it is not
+ * already terminated
+ *
+ * @state:  Compiler state
+ * @target: Jump target
+ *
+ * Returns zero on success
+ */
+static int
+cg_jump(struct gup_state *state, struct ir_block *target)
+{
+    struct ir_insn *insn;
+
+    if (ir_block_term(state->irb.block) != NULL) {
+        return 0;
+    }
+
+    if (cg_insn(state, IR_JMP, &insn) < 0) {
+        return -1;
+    }
+
+    insn->target[0] = target;
+    return 0;
+}
+
+/*
+ * Convert a binary operator token into an IR operation
+ *
+ * @tt: Token type to convert
+ *
+ * Returns IR_NOP on failure
+ */
+static ir_op_t
+cg_binop(tt_t tt)
+{
+    switch (tt) {
+    case TT_PLUS:   return IR_ADD;
+    case TT_MINUS:  return IR_SUB;
+    case TT_STAR:   return IR_MUL;
+    case TT_SLASH:  return IR_DIV;
+    case TT_EQEQ:   return IR_EQ;
+    case TT_NE:     return IR_NE;
+    case TT_LT:     return IR_LT;
+    case TT_GT:     return IR_GT;
+    case TT_LTE:    return IR_LE;
+    case TT_GTE:    return IR_GE;
+    default:        return IR_NOP;
+    }
+
+    return IR_NOP;
+}
+
+/*
+ * Emit the address of a variable, locals live in a stack
+ * slot of the procedure
+ *
+ * @state:  Compiler state
+ * @symbol: Global or local symbol
+ * @res:    Register holding the address
+ *
+ * Returns zero on success
+ */
+static int
+cg_emit_addr(struct gup_state *state, struct symbol *symbol, ir_reg_t *res)
+{
+    struct ir_insn *insn;
+
+    if (symbol->type == SYMBOL_LOCAL) {
+        if (cg_insn(state, IR_SLOT, &insn) < 0)
+            return -1;
+
+        insn->dst = ir_reg_new(state->irb.func);
+        insn->imm = symbol->slot;
+        insn->size = type_size(&symbol->dtype);
+        *res = insn->dst;
+        return 0;
+    }
+
+    if (cg_insn(state, IR_ADDR, &insn) < 0) {
+        return -1;
+    }
+
+    insn->dst = ir_reg_new(state->irb.func);
+    insn->label = symbol->name;
+    insn->sym = symbol;
+    *res = insn->dst;
+    return 0;
+}
+
+/*
+ * Emit IR to evaluate an expression
+ *
+ * @state: Compiler state
+ * @root:  Expression root
+ * @res:   Register holding the result
+ *
+ * Returns zero on success
+ */
+static int
+cg_emit_expr(struct gup_state *state, struct ast_node *root, ir_reg_t *res)
+{
+    struct ir_func *func = state->irb.func;
+    struct strpool_entry *str;
+    ir_reg_t *args = NULL;
+    size_t i;
+    struct symbol *symbol;
+    struct ir_insn *insn;
+    ir_reg_t lhs, rhs, addr;
+    char *label;
+
+    switch (root->type) {
+    case AST_NUMBER:
+        if (cg_insn(state, IR_IMM, &insn) < 0) {
+            return -1;
+        }
+
+        insn->imm = root->v;
+        break;
+    case AST_STRING:
+        if (strpool_intern(&state->strpool, root->str.s, root->str.len, &str) < 0) {
+            return -1;
+        }
+
+        if ((label = arena_alloc(func->arena, 32)) == NULL) {
+            return -1;
+        }
+
+        snprintf(label, 32, STRPOOL_LABEL_FMT, str->id);
+        if (cg_insn(state, IR_ADDR, &insn) < 0) {
+            return -1;
+        }
+
+        insn->label = label;
+        break;
+    case AST_IDENT:
+        symbol = symbol_from_id(&state->symtab, root->symid);
+        if (symbol == NULL) {
+            trace_error(state, "identifier symbol unresolved\n");
+            return -1;
+        }
+
+        /* Parameters already live in a register */
+        if (symbol->type == SYMBOL_PARAM) {
+            *res = state->irb.params[symbol->argno];
+            return 0;
+        }
+
+        if (cg_emit_addr(state, symbol, &addr) < 0) {
+            return -1;
+        }
+
+        if (cg_insn(state, IR_LOAD, &insn) < 0) {
+            return -1;
+        }
+
+        insn->size = type_size(&symbol->dtype);
+        insn->src[0] = addr;
+        break;
+    case AST_CALL:
+        symbol = symbol_from_id(&state->symtab, root->symid);
+        if (symbol == NULL) {
+            trace_error(state, "call symbol unresolved\n");
+            return -1;
+        }
+
+        /* Only procs fully known here may use the internal convention */
+        if (!symbol->defined) {
+            symbol->fwdcall = 1;
+        }
+
+        if (root->argc > 0) {
+            args = arena_alloc(func->arena, root->argc * sizeof(*args));
+            if (args == NULL)
+                return -1;
+        }
+
+        /* Arguments are evaluated left to right */
+        for (i = 0; i < root->argc; ++i) {
+            if (cg_emit_expr(state, root->args[i], &args[i]) < 0)
+                return -1;
+
+            if (args[i] == 0) {
+                trace_error(state, "void value used as argument\n");
+                return -1;
+            }
+        }
+
+        if (cg_insn(state, IR_CALL, &insn) < 0) {
+            return -1;
+        }
+
+        insn->label = symbol->name;
+        insn->sym = symbol;
+        insn->args = args;
+        insn->argc = root->argc;
+        insn->size = type_size(&symbol->dtype);
+
+        /* A void call has no result */
+        if (type_size(&symbol->dtype) == 0) {
+            *res = 0;
+            return 0;
+        }
+
+        break;
+    case AST_BINOP:
+        if (cg_emit_expr(state, root->left, &lhs) < 0) {
+            return -1;
+        }
+
+        if (cg_emit_expr(state, root->right, &rhs) < 0) {
+            return -1;
+        }
+
+        if (lhs == 0 || rhs == 0) {
+            trace_error(state, "void value used in expression\n");
+            return -1;
+        }
+
+        if (cg_insn(state, cg_binop(root->op), &insn) < 0) {
+            return -1;
+        }
+
+        insn->src[0] = lhs;
+        insn->src[1] = rhs;
+        break;
+    case AST_UNOP:
+        if (cg_emit_expr(state, root->left, &lhs) < 0) {
+            return -1;
+        }
+
+        if (lhs == 0) {
+            trace_error(state, "void value used in expression\n");
+            return -1;
+        }
+
+        if (cg_insn(state, IR_NEG, &insn) < 0) {
+            return -1;
+        }
+
+        insn->src[0] = lhs;
+        break;
+    default:
+        trace_error(state, "bad expression node %d\n", root->type);
+        return -1;
+    }
+
+    insn->dst = ir_reg_new(func);
+    *res = insn->dst;
+    return 0;
+}
+
+/*
+ * Begin or end a procedure, the IR of the procedure is queued
+ * for the backend once its body is complete
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_proc(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    struct ir_loop_q loops;
+    struct ir_insn *insn;
+    struct symbol *symbol;
+    size_t i;
+
+    if (state == NULL || root == NULL) {
+        return -1;
+    }
+
+    if (root->type != AST_PROC) {
+        return -1;
+    }
+
+    if (!root->epilogue) {
+        symbol = symbol_from_id(&state->symtab, root->symid);
+        if (symbol == NULL) {
+            trace_error(state, "proc root symbol unresolved\n");
+            return -1;
+        }
+
+        if (ir_func_new(&state->ir_arena, symbol, &irb->func) < 0) {
+            return -1;
+        }
+
+        /*
+         * Private procs nobody called ahead of time can only
+         * ever be called from code we generate ourselves, the
+         * JIT entry is called from C.
+         */
+        symbol->internal = !symbol->pub && !symbol->fwdcall &&
+            (state->entry == NULL || strcmp(symbol->name, state->entry) != 0);
+
+        if (ir_block_new(irb->func, &irb->block) < 0) {
+            return -1;
+        }
+
+        /* Parameters are all picked up on entry */
+        for (i = 0; i < symbol->nparams; ++i) {
+            if (cg_insn(state, IR_PARAM, &insn) < 0)
+                return -1;
+
+            insn->dst = ir_reg_new(irb->func);
+            insn->imm = i;
+            insn->size = type_size(&symbol->params[i]);
+            irb->params[i] = insn->dst;
+        }
+
+        return 0;
+    }
+
+    /* Falling off the end returns */
+    if (ir_block_term(irb->block) == NULL) {
+        if (cg_insn(state, IR_RET, &insn) < 0)
+            return -1;
+    }
+
+    if (ir_inline(irb->func, mu_can_tail) < 0) {
+        trace_error(state, "failed to inline calls\n");
+        return -1;
+    }
+
+    if (ir_cfg_build(irb->func) < 0) {
+        trace_error(state, "failed to build cfg\n");
+        return -1;
+    }
+
+    /* Locals become registers first so the rest sees through them */
+    if (ir_mem2reg(irb->func) < 0) {
+        trace_error(state, "failed to promote locals of '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    /* Constants from inlined arguments fold away too */
+    if (ir_sccp(irb->func) < 0) {
+        trace_error(state, "failed to optimize '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    if (ir_cfg_build(irb->func) < 0) {
+        trace_error(state, "failed to build cfg\n");
+        return -1;
+    }
+
+    if (ir_dce(irb->func) < 0 || ir_gvn(irb->func) < 0 || ir_dce(irb->func) < 0) {
+        trace_error(state, "failed to optimize '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    /* Neither loop pass changes the CFG, the loops stay valid */
+    TAILQ_INIT(&loops);
+    if (ir_loop_find(irb->func, &loops) < 0) {
+        trace_error(state, "failed to find loops of '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    if (ir_licm(irb->func, &loops) < 0 || ir_ivsr(irb->func, &loops) < 0) {
+        trace_error(state, "failed to optimize loops of '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    if (ir_muldiv(irb->func) < 0) {
+        trace_error(state, "failed to optimize '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    /*
+     * Starting values of inner reductions may leave outer loops,
+     * as may the reciprocals of divisors
+     */
+    if (ir_licm(irb->func, &loops) < 0 || ir_dce(irb->func) < 0) {
+        trace_error(state, "failed to optimize loops of '%s'\n", irb->func->sym->name);
+        return -1;
+    }
+
+    /* Later callers may copy the body */
+    irb->func->sym->ir = irb->func;
+    TAILQ_INSERT_TAIL(&state->procs, irb->func, link);
+    irb->func = NULL;
+    irb->block = NULL;
+    return 0;
+}
+
+/*
+ * Store a value to a variable
+ *
+ * @state:  Compiler state
+ * @symbol: Global or local symbol
+ * @value:  Register holding the value
+ *
+ * Returns zero on success
+ */
+static int
+cg_emit_store(struct gup_state *state, struct symbol *symbol, ir_reg_t value)
+{
+    struct ir_insn *insn;
+    ir_reg_t addr;
+
+    if (cg_emit_addr(state, symbol, &addr) < 0) {
+        return -1;
+    }
+
+    if (cg_insn(state, IR_STORE, &insn) < 0) {
+        return -1;
+    }
+
+    insn->size = type_size(&symbol->dtype);
+    insn->src[0] = addr;
+    insn->src[1] = value;
+    return 0;
+}
+
+/*
+ * Emit an assignment to a variable
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_assign(struct gup_state *state, struct ast_node *root)
+{
+    struct symbol *symbol;
+    ir_reg_t value;
+
+    symbol = symbol_from_id(&state->symtab, root->left->symid);
+    if (symbol == NULL) {
+        trace_error(state, "assignment symbol unresolved\n");
+        return -1;
+    }
+
+    if (symbol->type != SYMBOL_VAR && symbol->type != SYMBOL_LOCAL) {
+        trace_error(state, "cannot assign to '%s'\n", symbol->name);
+        return -1;
+    }
+
+    if (cg_emit_expr(state, root->right, &value) < 0) {
+        return -1;
+    }
+
+    if (value == 0) {
+        trace_error(state, "void value used in assignment\n");
+        return -1;
+    }
+
+    return cg_emit_store(state, symbol, value);
+}
+
+/*
+ * Emit a local variable declaration, giving the local its
+ * stack slot and initial value
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_local(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_func *func = state->irb.func;
+    struct symbol *symbol;
+    struct ir_insn *insn;
+    ir_reg_t value;
+
+    symbol = symbol_from_id(&state->symtab, root->symid);
+    if (symbol == NULL) {
+        trace_error(state, "local symbol unresolved\n");
+        return -1;
+    }
+
+    if (ir_slot_new(func, type_size(&symbol->dtype), &symbol->slot) < 0) {
+        trace_error(state, "failed to allocate local in '%s'\n", func->sym->name);
+        return -1;
+    }
+
+    if (root->right == NULL) {
+        if (cg_insn(state, IR_IMM, &insn) < 0)
+            return -1;
+
+        insn->dst = ir_reg_new(func);
+        value = insn->dst;
+    } else if (cg_emit_expr(state, root->right, &value) < 0) {
+        return -1;
+    }
+
+    if (value == 0) {
+        trace_error(state, "void value used in assignment\n");
+        return -1;
+    }
+
+    return cg_emit_store(state, symbol, value);
+}
+
+/*
+ * Emit a 'tail return', the call replaces the return
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_tail(struct gup_state *state, struct ast_node *root)
+{
+    struct symbol *symbol = state->irb.func->sym;
+    struct symbol *callee;
+    struct ir_insn *insn;
+    ir_reg_t value;
+
+    callee = symbol_from_id(&state->symtab, root->left->symid);
+    if (callee == NULL) {
+        trace_error(state, "call symbol unresolved\n");
+        return -1;
+    }
+
+    /* A void proc may drop the result, anything else needs one */
+    if (type_size(&symbol->dtype) != 0 && type_size(&callee->dtype) == 0) {
+        trace_error(state, "proc '%s' must return a value\n", symbol->name);
+        return -1;
+    }
+
+    /* Nothing would be left to zero-extend a narrower result */
+    if (type_size(&callee->dtype) < type_size(&symbol->dtype)) {
+        trace_error(
+            state, "cannot tail call '%s' from '%s', it returns a narrower type\n",
+            callee->name, symbol->name
+        );
+
+        return -1;
+    }
+
+    if (cg_emit_expr(state, root->left, &value) < 0) {
+        return -1;
+    }
+
+    insn = TAILQ_LAST(&state->irb.block->insns, ir_insn_q);
+    if (insn == NULL || insn->op != IR_CALL) {
+        trace_error(state, "bad tail call\n");
+        return -1;
+    }
+
+    /*
+     * The callee returns straight to whoever called us, so it
+     * must preserve whatever they expect us to preserve. Procs
+     * are only emitted by cg_finish(), after this is known.
+     */
+    if (!symbol->internal) {
+        callee->internal = 0;
+    }
+
+    /* Whether the target can honour it is checked on emission */
+    insn->op = IR_TAIL;
+    insn->dst = 0;
+    insn->imm = state->tok_off;
+    return 0;
+}
+
+/*
+ * Emit a return statement
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_return(struct gup_state *state, struct ast_node *root)
+{
+    struct symbol *symbol = state->irb.func->sym;
+    struct ir_insn *insn;
+    ir_reg_t value = 0;
+    bool is_void;
+
+    if (root->tail) {
+        return cg_emit_tail(state, root);
+    }
+
+    is_void = type_size(&symbol->dtype) == 0;
+    if (is_void && root->left != NULL) {
+        trace_error(state, "void proc '%s' returns a value\n", symbol->name);
+        return -1;
+    }
+
+    if (!is_void && root->left == NULL) {
+        trace_error(state, "proc '%s' must return a value\n", symbol->name);
+        return -1;
+    }
+
+    if (root->left != NULL) {
+        if (cg_emit_expr(state, root->left, &value) < 0)
+            return -1;
+    }
+
+    if (cg_insn(state, IR_RET, &insn) < 0) {
+        return -1;
+    }
+
+    insn->src[0] = value;
+    return 0;
+}
+
+/*
+ * Emit the start or end of an 'if' statement
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_if(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    struct ir_block *then;
+    struct ir_insn *insn;
+    uint8_t depth;
+    ir_reg_t cond;
+
+    /* Without an 'else' the alternative block continues on */
+    if (root->epilogue) {
+        depth = state->scope_depth;
+        if (cg_jump(state, irb->alt[depth]) < 0) {
+            return -1;
+        }
+
+        irb->block = irb->alt[depth];
+        return 0;
+    }
+
+    depth = state->scope_depth - 1;
+    if (cg_emit_expr(state, root->left, &cond) < 0) {
+        return -1;
+    }
+
+    if (cond == 0) {
+        trace_error(state, "void value used as condition\n");
+        return -1;
+    }
+
+    if (cg_insn(state, IR_BR, &insn) < 0) {
+        return -1;
+    }
+
+    if (ir_block_new(irb->func, &then) < 0) {
+        return -1;
+    }
+
+    if (ir_block_new(irb->func, &irb->alt[depth]) < 0) {
+        return -1;
+    }
+
+    insn->src[0] = cond;
+    insn->target[0] = then;
+    insn->target[1] = irb->alt[depth];
+    irb->block = then;
+    return 0;
+}
+
+/*
+ * Emit the start or end of an 'else' clause
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_else(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    uint8_t depth;
+
+    if (root->epilogue) {
+        depth = state->scope_depth;
+        if (cg_jump(state, irb->join[depth]) < 0) {
+            return -1;
+        }
+
+        irb->block = irb->join[depth];
+        return 0;
+    }
+
+    /* The 'then' side jumps over the 'else' side */
+    depth = state->scope_depth - 1;
+    if (ir_block_new(irb->func, &irb->join[depth]) < 0) {
+        return -1;
+    }
+
+    if (cg_jump(state, irb->join[depth]) < 0) {
+        return -1;
+    }
+
+    irb->block = irb->alt[depth];
+    return 0;
+}
+
+/*
+ * Emit the start or end of a 'while' or 'for' loop. Each
+ * iteration starts by checking the condition in the header,
+ * a 'for' loop runs its step in a block of its own that
+ * 'continue' goes to.
  *
  * @state: Compiler state
  * @root:  AST node root
  */
 static int
-cg_emit_proc(struct gup_state *state, struct ast_node *root)
+cg_emit_loop(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    struct ir_block *body;
+    struct ir_insn *insn;
+    uint8_t depth;
+    ir_reg_t cond;
+
+    if (root->epilogue) {
+        depth = state->scope_depth;
+        if (cg_jump(state, irb->join[depth]) < 0) {
+            return -1;
+        }
+
+        if (irb->join[depth] != irb->head[depth]) {
+            irb->block = irb->join[depth];
+            if (irb->step[depth] != NULL && cg_resolve_node(state, irb->step[depth]) < 0)
+                return -1;
+            if (cg_jump(state, irb->head[depth]) < 0)
+                return -1;
+        }
+
+        irb->block = irb->alt[depth];
+        return 0;
+    }
+
+    depth = state->scope_depth - 1;
+    if (root->init != NULL) {
+        if (cg_resolve_node(state, root->init) < 0)
+            return -1;
+    }
+
+    if (ir_block_new(irb->func, &irb->head[depth]) < 0) {
+        return -1;
+    }
+
+    if (ir_block_new(irb->func, &body) < 0) {
+        return -1;
+    }
+
+    if (ir_block_new(irb->func, &irb->alt[depth]) < 0) {
+        return -1;
+    }
+
+    irb->join[depth] = irb->head[depth];
+    irb->step[depth] = root->right;
+    if (root->type == AST_FOR) {
+        if (ir_block_new(irb->func, &irb->join[depth]) < 0)
+            return -1;
+    }
+
+    if (cg_jump(state, irb->head[depth]) < 0) {
+        return -1;
+    }
+
+    /* Without a condition the loop only ends by 'break' */
+    irb->block = irb->head[depth];
+    if (root->left == NULL) {
+        if (cg_jump(state, body) < 0)
+            return -1;
+
+        irb->block = body;
+        return 0;
+    }
+
+    if (cg_emit_expr(state, root->left, &cond) < 0) {
+        return -1;
+    }
+
+    if (cond == 0) {
+        trace_error(state, "void value used as condition\n");
+        return -1;
+    }
+
+    if (cg_insn(state, IR_BR, &insn) < 0) {
+        return -1;
+    }
+
+    insn->src[0] = cond;
+    insn->target[0] = body;
+    insn->target[1] = irb->alt[depth];
+    irb->block = body;
+    return 0;
+}
+
+/*
+ * Emit the start or end of a 'switch' statement. The
+ * dispatch is only lowered at the end once every case is
+ * known, it goes into the block the selector was computed
+ * in. Code before the first label can't be reached.
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_switch(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    struct ir_switch *sw;
+    uint8_t depth;
+    ir_reg_t sel;
+
+    if (root->epilogue) {
+        depth = state->scope_depth;
+        if (cg_jump(state, irb->alt[depth]) < 0) {
+            return -1;
+        }
+
+        if (ir_switch_lower(irb->func, irb->sw[depth], irb->alt[depth]) < 0) {
+            return -1;
+        }
+
+        irb->block = irb->alt[depth];
+        return 0;
+    }
+
+    depth = state->scope_depth - 1;
+    if (cg_emit_expr(state, root->left, &sel) < 0) {
+        return -1;
+    }
+
+    if (sel == 0) {
+        trace_error(state, "void value used as selector\n");
+        return -1;
+    }
+
+    if ((sw = arena_alloc(irb->func->arena, sizeof(*sw))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    sw->sel = sel;
+    if ((sw->dispatch = cg_block(state)) == NULL) {
+        return -1;
+    }
+
+    if (ir_block_new(irb->func, &irb->alt[depth]) < 0) {
+        return -1;
+    }
+
+    irb->sw[depth] = sw;
+    return ir_block_new(irb->func, &irb->block);
+}
+
+/*
+ * Emit a 'case' or 'default' label, control falls through
+ * from the one before
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_case(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    struct ir_switch *sw;
+    struct ir_block *block;
+    size_t i;
+
+    sw = irb->sw[state->scope_depth - 1];
+    if (root->type == AST_DEFAULT && sw->def != NULL) {
+        trace_error(state, "duplicate default label\n");
+        return -1;
+    }
+
+    for (i = 0; root->type == AST_CASE && i < sw->ncases; ++i) {
+        if (sw->cases[i].v == root->v) {
+            trace_error(state, "duplicate case value %llu\n", (unsigned long long)root->v);
+            return -1;
+        }
+    }
+
+    if (ir_block_new(irb->func, &block) < 0) {
+        return -1;
+    }
+
+    if (cg_jump(state, block) < 0) {
+        return -1;
+    }
+
+    irb->block = block;
+    if (root->type == AST_DEFAULT) {
+        sw->def = block;
+        return 0;
+    }
+
+    return ir_switch_add(irb->func, sw, root->v, block);
+}
+
+/*
+ * Emit a 'break' out of the innermost loop or 'switch', or
+ * a 'continue' of the innermost loop
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_jump(struct gup_state *state, struct ast_node *root)
+{
+    struct ir_builder *irb = &state->irb;
+    int depth;
+
+    if (root->type == AST_BREAK) {
+        depth = scope_break(state);
+    } else {
+        depth = scope_loop(state);
+    }
+
+    if (depth < 0) {
+        trace_error(state, "jump outside of a loop\n");
+        return -1;
+    }
+
+    if (root->type == AST_BREAK) {
+        return cg_jump(state, irb->alt[depth]);
+    }
+
+    return cg_jump(state, irb->join[depth]);
+}
+
+/*
+ * Emit storage for a global variable
+ *
+ * @state: Compiler state
+ * @root:  AST node root
+ */
+static int
+cg_emit_global(struct gup_state *state, struct ast_node *root)
 {
     struct symbol *symbol;
-    int retval;
+    struct strpool_entry *str;
+    struct ast_node *init;
+    struct mu_data data;
+    char label[32];
 
     if (state == NULL || root == NULL) {
         return -1;
     }
 
-    if (root->type != AST_PROC) {
+    if (root->type != AST_GLOBAL) {
         return -1;
     }
 
     symbol = symbol_from_id(&state->symtab, root->symid);
     if (symbol == NULL) {
-        trace_error(state, "proc root symbol unresolved\n");
+        trace_error(state, "global root symbol unresolved\n");
         return -1;
     }
 
-    if (root->epilogue) {
-        retval = mu_emit_ret(state);
-    } else {
-        retval = mu_emit_label(state, symbol->name, symbol->pub);
+    data.type = MU_DATA_ZERO;
+    data.size = type_size(&symbol->dtype);
+    data.align = data.size;
+    data.value = 0;
+    data.label = NULL;
+
+    /* An explicit zero is no different from no initializer */
+    if ((init = root->right) == NULL) {
+        return mu_emit_global(state, symbol->name, symbol->pub, &data);
+    }
+
+    switch (init->type) {
+    case AST_NUMBER:
+        if (init->v != 0) {
+            data.type = MU_DATA_INT;
+            data.value = init->v;
+        }
+
+        break;
+    case AST_STRING:
+        if (strpool_intern(&state->strpool, init->str.s, init->str.len, &str) < 0) {
+            return -1;
+        }
+
+        snprintf(label, sizeof(label), STRPOOL_LABEL_FMT, str->id);
+        data.type = MU_DATA_ADDR;
+        data.label = label;
+        break;
+    default:
+        trace_error(state, "bad global initializer\n");
+        return -1;
     }
 
-    return retval;
+    return mu_emit_global(state, symbol->name, symbol->pub, &data);
 }
 
 int
 cg_resolve_node(struct gup_state *state, struct ast_node *root)
 {
+    ir_reg_t value;
+
     if (state == NULL || root == NULL) {
         errno = -EINVAL;
         return -1;
@@ -59,6 +1058,75 @@ cg_resolve_node(struct gup_state *state, struct ast_node *root)
             return -1;
         }
 
+        break;
+    case AST_GLOBAL:
+        if (cg_emit_global(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_ASSIGN:
+        if (cg_emit_assign(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_LOCAL:
+        if (cg_emit_local(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_CALL:
+        if (cg_emit_expr(state, root, &value) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_RETURN:
+        if (cg_emit_return(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_IF:
+        if (cg_emit_if(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_ELSE:
+        if (cg_emit_else(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_WHILE:
+    case AST_FOR:
+        if (cg_emit_loop(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_BREAK:
+    case AST_CONTINUE:
+        if (cg_emit_jump(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_SWITCH:
+        if (cg_emit_switch(state, root) < 0) {
+            return -1;
+        }
+
+        break;
+    case AST_CASE:
+    case AST_DEFAULT:
+        if (cg_emit_case(state, root) < 0) {
+            return -1;
+        }
+
         break;
     default:
         trace_error(state, "unknown ast node %d\n", root->type);
@@ -67,3 +1135,147 @@ cg_resolve_node(struct gup_state *state, struct ast_node *root)
 
     return 0;
 }
+
+/*
+ * Mark every procedure a live one refers to as live too,
+ * undefined ones included
+ *
+ * @func:  Live procedure to start from
+ * @stack: Work stack, room for every defined procedure
+ */
+static void
+cg_mark_live(struct ir_func *func, struct ir_func **stack)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+    struct symbol *ref;
+    size_t depth = 0;
+
+    if (func->sym->live) {
+        return;
+    }
+
+    func->sym->live = 1;
+    stack[depth++] = func;
+    while (depth > 0) {
+        func = stack[--depth];
+        TAILQ_FOREACH(block, &func->blocks, link) {
+            TAILQ_FOREACH(insn, &block->insns, link) {
+                if ((ref = insn->sym) == NULL || ref->type != SYMBOL_FUNC)
+                    continue;
+                if (ref->live)
+                    continue;
+
+                ref->live = 1;
+                if (ref->ir != NULL)
+                    stack[depth++] = ref->ir;
+            }
+        }
+    }
+}
+
+/*
+ * Hand a procedure over to the backend, everything it calls
+ * that is defined earlier has been by now
+ *
+ * @state: Compiler state
+ * @func:  Procedure to emit
+ */
+static int
+cg_emit_func(struct gup_state *state, struct ir_func *func)
+{
+    struct ir_block *block;
+    struct ir_insn *term;
+
+    /* Kept up to here so that inlined copies stay in SSA form */
+    if (ir_ssa_lower(func) < 0) {
+        trace_error(state, "failed to lower phis of '%s'\n", func->sym->name);
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        term = ir_block_term(block);
+        if (term->op != IR_TAIL || mu_can_tail(func, term))
+            continue;
+
+        /* Parsing is long done, point at the statement instead */
+        state->tok_off = term->imm;
+        trace_error(
+            state, "cannot tail call '%s' from '%s'\n",
+            term->label, func->sym->name
+        );
+
+        return -1;
+    }
+
+    ir_tail_calls(func, mu_can_tail);
+    if (ir_cfg_build(func) < 0) {
+        trace_error(state, "failed to build cfg\n");
+        return -1;
+    }
+
+    if (state->dump_ir) {
+        ir_dump(func, stdout);
+    }
+
+    return mu_emit_proc(state, func);
+}
+
+int
+cg_finish(struct gup_state *state)
+{
+    struct ir_func *func, **stack;
+    struct symbol *symbol;
+    size_t nprocs = 0;
+
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    TAILQ_FOREACH(func, &state->procs, link) {
+        ++nprocs;
+    }
+
+    stack = arena_alloc(&state->ir_arena, (nprocs + 1) * sizeof(*stack));
+    if (stack == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /*
+     * Public procedures are the roots of the call graph, private
+     * ones none of them can reach are never emitted.
+     */
+    TAILQ_FOREACH(func, &state->procs, link) {
+        symbol = func->sym;
+        if (symbol->pub)
+            cg_mark_live(func, stack);
+        if (state->entry != NULL && strcmp(symbol->name, state->entry) == 0)
+            cg_mark_live(func, stack);
+    }
+
+    TAILQ_FOREACH(func, &state->procs, link) {
+        if (!func->sym->live)
+            continue;
+        if (cg_emit_func(state, func) < 0)
+            return -1;
+    }
+
+    /* String literals go out in one batch */
+    if (mu_emit_strpool(state) < 0) {
+        return -1;
+    }
+
+    /* Procedures that were only ever declared live elsewhere */
+    TAILQ_FOREACH(symbol, &state->symtab.entries, link) {
+        if (symbol->type != SYMBOL_FUNC || symbol->defined)
+            continue;
+        if (!symbol->live)
+            continue;
+        if (mu_emit_extern(state, symbol->name) < 0)
+            return -1;
+    }
+
+    return mu_finish(state);
+}
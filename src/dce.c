@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "gup/opt.h"
+
+/*
+ * Marking state
+ *
+ * @needed: Needed registers, indexed by register
+ * @stack:  Needed registers whose definitions are yet to be
+ *          marked from
+ * @top:    Number of registers on the stack
+ */
+struct dce_ctx {
+    uint8_t *needed;
+    ir_reg_t *stack;
+    size_t top;
+};
+
+/*
+ * Mark the registers an instruction reads as needed
+ *
+ * @ctx:  Marking state
+ * @insn: Instruction to mark from
+ */
+static void
+dce_mark(struct dce_ctx *ctx, struct ir_insn *insn)
+{
+    ir_reg_t reg;
+    size_t i;
+
+    for (i = 0; i < ir_nuses(insn); ++i) {
+        reg = *ir_use(insn, i);
+        if (reg != 0 && !ctx->needed[reg]) {
+            ctx->needed[reg] = 1;
+            ctx->stack[ctx->top++] = reg;
+        }
+    }
+}
+
+int
+ir_dce(struct ir_func *func)
+{
+    struct ir_block *block;
+    struct ir_insn *insn, *next, **defs;
+    struct dce_ctx ctx;
+    size_t nregs, i;
+    uint32_t *first;
+    ir_reg_t reg;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    nregs = (size_t)func->reg_count + 1;
+    ctx.top = 0;
+    ctx.needed = arena_alloc(func->arena, nregs);
+    ctx.stack = arena_alloc(func->arena, nregs * sizeof(*ctx.stack));
+    first = arena_alloc(func->arena, (nregs + 1) * sizeof(*first));
+    if (ctx.needed == NULL || ctx.stack == NULL || first == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Definitions of each register, registers may have several */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst != 0)
+                ++first[insn->dst + 1];
+        }
+    }
+
+    for (i = 1; i <= nregs; ++i) {
+        first[i] += first[i - 1];
+    }
+
+    defs = arena_alloc(func->arena, (first[nregs] + 1) * sizeof(*defs));
+    if (defs == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /*
+     * Anything with an effect is needed along with what it
+     * reads, and what defines that in turn. Values only
+     * feeding each other are never marked.
+     */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst != 0)
+                defs[first[insn->dst]++] = insn;
+            if (!ir_is_pure(insn))
+                dce_mark(&ctx, insn);
+        }
+    }
+
+    /* Filling moved each start up to where the next begins */
+    while (ctx.top > 0) {
+        reg = ctx.stack[--ctx.top];
+        for (i = first[reg - 1]; i < first[reg]; ++i)
+            dce_mark(&ctx, defs[i]);
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        for (insn = TAILQ_FIRST(&block->insns); insn != NULL; insn = next) {
+            next = TAILQ_NEXT(insn, link);
+            if (ir_is_pure(insn) && !ctx.needed[insn->dst])
+                TAILQ_REMOVE(&block->insns, insn, link);
+        }
+    }
+
+    return 0;
+}
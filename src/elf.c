@@ -0,0 +1,617 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/elf.h"
+
+#define ELF_INIT_BUCKETS 64
+
+/* FNV-1a parameters */
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+/*
+ * Describes a section the object may carry
+ *
+ * @name:  Section name
+ * @type:  Section type
+ * @flags: Section flags
+ */
+struct elf_secinfo {
+    const char *name;
+    uint32_t type;
+    uint64_t flags;
+};
+
+static const struct elf_secinfo secinfo[] = {
+    [ELF_SEC_TEXT]   = { ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR },
+    [ELF_SEC_DATA]   = { ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE },
+    [ELF_SEC_BSS]    = { ".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE },
+    [ELF_SEC_RODATA] = { ".rodata", SHT_PROGBITS, SHF_ALLOC }
+};
+
+/*
+ * Hash a symbol name with FNV-1a
+ *
+ * @name: Name to hash
+ */
+static uint64_t
+elf_hash(const char *name)
+{
+    uint64_t hash = FNV_OFFSET;
+
+    while (*name != '\0') {
+        hash ^= (uint8_t)*name++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Make room for more bytes in a buffer
+ *
+ * @buf: Buffer to grow
+ * @len: Number of bytes needed past the end
+ *
+ * Returns zero on success
+ */
+static int
+elf_buf_reserve(struct elf_buf *buf, size_t len)
+{
+    uint8_t *data;
+    size_t cap;
+
+    if (buf->len + len <= buf->cap) {
+        return 0;
+    }
+
+    cap = (buf->cap == 0) ? 256 : buf->cap;
+    while (cap < buf->len + len) {
+        cap *= 2;
+    }
+
+    data = realloc(buf->data, cap);
+    if (data == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+/*
+ * Append bytes to a buffer
+ *
+ * @buf:  Buffer to append to
+ * @data: Bytes to append, zeros if NULL
+ * @len:  Number of bytes
+ *
+ * Returns zero on success
+ */
+static int
+elf_buf_put(struct elf_buf *buf, const void *data, size_t len)
+{
+    /* An empty buffer may not have any storage yet */
+    if (len == 0) {
+        return 0;
+    }
+
+    if (elf_buf_reserve(buf, len) < 0) {
+        return -1;
+    }
+
+    if (data == NULL) {
+        memset(&buf->data[buf->len], 0, len);
+    } else {
+        memcpy(&buf->data[buf->len], data, len);
+    }
+
+    buf->len += len;
+    return 0;
+}
+
+/*
+ * Double the number of hash buckets and rehash every symbol
+ *
+ * @obj: Object to grow
+ *
+ * Returns zero on success
+ */
+static int
+elf_grow_buckets(struct elf_obj *obj)
+{
+    size_t nbuckets = obj->nbuckets * 2;
+    uint32_t *buckets;
+    size_t i, b;
+
+    buckets = calloc(nbuckets, sizeof(*buckets));
+    if (buckets == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < obj->nsyms; ++i) {
+        b = elf_hash(obj->syms[i].name) & (nbuckets - 1);
+        while (buckets[b] != 0)
+            b = (b + 1) & (nbuckets - 1);
+
+        buckets[b] = i + 1;
+    }
+
+    free(obj->buckets);
+    obj->buckets = buckets;
+    obj->nbuckets = nbuckets;
+    return 0;
+}
+
+int
+elf_init(struct elf_obj *res, uint16_t machine)
+{
+    if (res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    res->machine = machine;
+    res->nbuckets = ELF_INIT_BUCKETS;
+    res->buckets = calloc(res->nbuckets, sizeof(*res->buckets));
+    if (res->buckets == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+elf_destroy(struct elf_obj *obj)
+{
+    size_t i;
+
+    if (obj == NULL) {
+        return;
+    }
+
+    for (i = 0; i < ELF_SEC_MAX; ++i) {
+        free(obj->sections[i].data.data);
+        free(obj->sections[i].relocs);
+    }
+
+    for (i = 0; i < obj->nsyms; ++i) {
+        free(obj->syms[i].name);
+    }
+
+    free(obj->syms);
+    free(obj->buckets);
+    memset(obj, 0, sizeof(*obj));
+}
+
+ssize_t
+elf_sym(struct elf_obj *obj, const char *name)
+{
+    struct elf_sym *syms;
+    size_t b, cap;
+
+    if (obj == NULL || name == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Open addressing, buckets hold the symbol index plus one */
+    b = elf_hash(name) & (obj->nbuckets - 1);
+    while (obj->buckets[b] != 0) {
+        if (strcmp(obj->syms[obj->buckets[b] - 1].name, name) == 0)
+            return obj->buckets[b] - 1;
+
+        b = (b + 1) & (obj->nbuckets - 1);
+    }
+
+    if (obj->nsyms >= obj->symcap) {
+        cap = (obj->symcap == 0) ? 64 : obj->symcap * 2;
+        syms = realloc(obj->syms, cap * sizeof(*syms));
+        if (syms == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        obj->syms = syms;
+        obj->symcap = cap;
+    }
+
+    memset(&obj->syms[obj->nsyms], 0, sizeof(*obj->syms));
+    obj->syms[obj->nsyms].name = strdup(name);
+    if (obj->syms[obj->nsyms].name == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    obj->buckets[b] = ++obj->nsyms;
+
+    /* Keep the load factor under 3/4 */
+    if (obj->nsyms * 4 >= obj->nbuckets * 3) {
+        if (elf_grow_buckets(obj) < 0)
+            return -1;
+    }
+
+    return obj->nsyms - 1;
+}
+
+ssize_t
+elf_define(struct elf_obj *obj, const char *name, elf_sec_t sec,
+    bool global, bool func)
+{
+    struct elf_sym *sym;
+    ssize_t idx;
+
+    if (obj == NULL || sec == ELF_SEC_NONE || sec >= ELF_SEC_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((idx = elf_sym(obj, name)) < 0) {
+        return -1;
+    }
+
+    sym = &obj->syms[idx];
+    if (sym->sec != ELF_SEC_NONE) {
+        errno = -EEXIST;
+        return -1;
+    }
+
+    sym->sec = sec;
+    sym->value = obj->sections[sec].size;
+    sym->func = func;
+    sym->global |= global;
+    return idx;
+}
+
+int
+elf_export(struct elf_obj *obj, const char *name)
+{
+    ssize_t idx;
+
+    if ((idx = elf_sym(obj, name)) < 0) {
+        return -1;
+    }
+
+    obj->syms[idx].global = 1;
+    return 0;
+}
+
+int
+elf_put(struct elf_obj *obj, elf_sec_t sec, const void *data, size_t len)
+{
+    struct elf_section *section;
+
+    if (obj == NULL || sec == ELF_SEC_NONE || sec >= ELF_SEC_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    section = &obj->sections[sec];
+    if (secinfo[sec].type != SHT_NOBITS) {
+        if (elf_buf_put(&section->data, data, len) < 0)
+            return -1;
+    }
+
+    section->size += len;
+    return 0;
+}
+
+int
+elf_align(struct elf_obj *obj, elf_sec_t sec, size_t align)
+{
+    struct elf_section *section;
+    size_t pad;
+
+    if (obj == NULL || sec == ELF_SEC_NONE || sec >= ELF_SEC_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (align <= 1) {
+        return 0;
+    }
+
+    section = &obj->sections[sec];
+    if (align > section->align) {
+        section->align = align;
+    }
+
+    pad = (align - (section->size & (align - 1))) & (align - 1);
+    return elf_put(obj, sec, NULL, pad);
+}
+
+int
+elf_reloc(struct elf_obj *obj, elf_sec_t sec, uint64_t offset,
+    const char *name, uint32_t type, int64_t addend)
+{
+    struct elf_section *section;
+    struct elf_rela *relocs;
+    ssize_t idx;
+    size_t cap;
+
+    if (obj == NULL || sec == ELF_SEC_NONE || sec >= ELF_SEC_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((idx = elf_sym(obj, name)) < 0) {
+        return -1;
+    }
+
+    section = &obj->sections[sec];
+    if (section->nrelocs >= section->cap) {
+        cap = (section->cap == 0) ? 32 : section->cap * 2;
+        relocs = realloc(section->relocs, cap * sizeof(*relocs));
+        if (relocs == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        section->relocs = relocs;
+        section->cap = cap;
+    }
+
+    relocs = &section->relocs[section->nrelocs++];
+    relocs->offset = offset;
+    relocs->sym = idx;
+    relocs->type = type;
+    relocs->addend = addend;
+    return 0;
+}
+
+/*
+ * Append zero padding to an output buffer
+ *
+ * @ob:  Output buffer
+ * @len: Number of zero bytes
+ */
+static void
+elf_pad(struct outbuf *ob, size_t len)
+{
+    static const char zero[16];
+
+    while (len > sizeof(zero)) {
+        outbuf_write(ob, zero, sizeof(zero));
+        len -= sizeof(zero);
+    }
+
+    outbuf_write(ob, zero, len);
+}
+
+int
+elf_write(struct elf_obj *obj, struct outbuf *ob)
+{
+    Elf64_Shdr shdrs[ELF_SEC_MAX * 2 + 3];
+    struct elf_buf symtab = { 0 }, strtab = { 0 }, shstrtab = { 0 };
+    struct elf_buf rela[ELF_SEC_MAX];
+    struct elf_section *section;
+    struct elf_sym *sym;
+    const void *data;
+    Elf64_Ehdr ehdr;
+    Elf64_Sym esym;
+    Elf64_Rela erela;
+    uint32_t nlocal, index, symtab_idx;
+    size_t i, j, nshdrs, off;
+    int retval = -1;
+    bool pass;
+
+    if (obj == NULL || ob == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(shdrs, 0, sizeof(shdrs));
+    memset(rela, 0, sizeof(rela));
+    if (elf_buf_put(&strtab, NULL, 1) < 0 || elf_buf_put(&shstrtab, NULL, 1) < 0) {
+        goto done;
+    }
+
+    /*
+     * Locals must come before globals in the symbol table,
+     * and anything left undefined is an import.
+     */
+    memset(&esym, 0, sizeof(esym));
+    if (elf_buf_put(&symtab, &esym, sizeof(esym)) < 0) {
+        goto done;
+    }
+
+    index = 1;
+    nlocal = 1;
+    for (pass = false; ; pass = true) {
+        for (i = 0; i < obj->nsyms; ++i) {
+            sym = &obj->syms[i];
+            if ((sym->global || sym->sec == ELF_SEC_NONE) != pass)
+                continue;
+
+            memset(&esym, 0, sizeof(esym));
+            esym.st_name = strtab.len;
+            esym.st_info = ELF64_ST_INFO(
+                pass ? STB_GLOBAL : STB_LOCAL,
+                (sym->sec == ELF_SEC_NONE) ? STT_NOTYPE :
+                    (sym->func ? STT_FUNC : STT_OBJECT)
+            );
+            esym.st_shndx = (sym->sec == ELF_SEC_NONE) ? SHN_UNDEF : sym->sec;
+            esym.st_value = sym->value;
+            esym.st_size = sym->size;
+            if (elf_buf_put(&strtab, sym->name, strlen(sym->name) + 1) < 0)
+                goto done;
+            if (elf_buf_put(&symtab, &esym, sizeof(esym)) < 0)
+                goto done;
+
+            sym->index = index++;
+        }
+
+        if (pass) {
+            break;
+        }
+
+        nlocal = index;
+    }
+
+    /* Section headers, the content sections keep their IDs */
+    for (i = ELF_SEC_TEXT; i < ELF_SEC_MAX; ++i) {
+        section = &obj->sections[i];
+        shdrs[i].sh_name = shstrtab.len;
+        shdrs[i].sh_type = secinfo[i].type;
+        shdrs[i].sh_flags = secinfo[i].flags;
+        shdrs[i].sh_size = section->size;
+        shdrs[i].sh_addralign = (section->align == 0) ? 1 : section->align;
+        if (elf_buf_put(&shstrtab, secinfo[i].name, strlen(secinfo[i].name) + 1) < 0)
+            goto done;
+    }
+
+    /* An empty note keeps linkers from assuming an executable stack */
+    nshdrs = ELF_SEC_MAX;
+    shdrs[nshdrs].sh_name = shstrtab.len;
+    shdrs[nshdrs].sh_type = SHT_PROGBITS;
+    shdrs[nshdrs].sh_addralign = 1;
+    if (elf_buf_put(&shstrtab, ".note.GNU-stack", 16) < 0) {
+        goto done;
+    }
+
+    symtab_idx = ++nshdrs;
+    for (i = ELF_SEC_TEXT; i < ELF_SEC_MAX; ++i) {
+        if (obj->sections[i].nrelocs > 0)
+            ++symtab_idx;
+    }
+
+    for (i = ELF_SEC_TEXT; i < ELF_SEC_MAX; ++i) {
+        section = &obj->sections[i];
+        if (section->nrelocs == 0)
+            continue;
+
+        for (j = 0; j < section->nrelocs; ++j) {
+            erela.r_offset = section->relocs[j].offset;
+            erela.r_info = ELF64_R_INFO(
+                obj->syms[section->relocs[j].sym].index,
+                section->relocs[j].type
+            );
+            erela.r_addend = section->relocs[j].addend;
+            if (elf_buf_put(&rela[i], &erela, sizeof(erela)) < 0)
+                goto done;
+        }
+
+        shdrs[nshdrs].sh_name = shstrtab.len;
+        shdrs[nshdrs].sh_type = SHT_RELA;
+        shdrs[nshdrs].sh_flags = SHF_INFO_LINK;
+        shdrs[nshdrs].sh_size = rela[i].len;
+        shdrs[nshdrs].sh_link = symtab_idx;
+        shdrs[nshdrs].sh_info = i;
+        shdrs[nshdrs].sh_addralign = 8;
+        shdrs[nshdrs].sh_entsize = sizeof(erela);
+        if (elf_buf_put(&shstrtab, ".rela", 5) < 0)
+            goto done;
+        if (elf_buf_put(&shstrtab, secinfo[i].name, strlen(secinfo[i].name) + 1) < 0)
+            goto done;
+
+        ++nshdrs;
+    }
+
+    shdrs[nshdrs].sh_name = shstrtab.len;
+    shdrs[nshdrs].sh_type = SHT_SYMTAB;
+    shdrs[nshdrs].sh_size = symtab.len;
+    shdrs[nshdrs].sh_link = nshdrs + 1;
+    shdrs[nshdrs].sh_info = nlocal;
+    shdrs[nshdrs].sh_addralign = 8;
+    shdrs[nshdrs].sh_entsize = sizeof(esym);
+    if (elf_buf_put(&shstrtab, ".symtab", 8) < 0) {
+        goto done;
+    }
+
+    ++nshdrs;
+    shdrs[nshdrs].sh_name = shstrtab.len;
+    shdrs[nshdrs].sh_type = SHT_STRTAB;
+    shdrs[nshdrs].sh_size = strtab.len;
+    shdrs[nshdrs].sh_addralign = 1;
+    if (elf_buf_put(&shstrtab, ".strtab", 8) < 0) {
+        goto done;
+    }
+
+    ++nshdrs;
+    shdrs[nshdrs].sh_name = shstrtab.len;
+    shdrs[nshdrs].sh_type = SHT_STRTAB;
+    shdrs[nshdrs].sh_addralign = 1;
+    if (elf_buf_put(&shstrtab, ".shstrtab", 10) < 0) {
+        goto done;
+    }
+
+    shdrs[nshdrs].sh_size = shstrtab.len;
+    ++nshdrs;
+
+    /* Lay the contents out after the file header */
+    off = sizeof(ehdr);
+    for (i = 1; i < nshdrs; ++i) {
+        if (shdrs[i].sh_addralign > 1)
+            off = (off + shdrs[i].sh_addralign - 1) & ~(shdrs[i].sh_addralign - 1);
+
+        shdrs[i].sh_offset = off;
+        if (shdrs[i].sh_type != SHT_NOBITS)
+            off += shdrs[i].sh_size;
+    }
+
+    off = (off + 7) & ~(size_t)7;
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = obj->machine;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = off;
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = nshdrs;
+    ehdr.e_shstrndx = nshdrs - 1;
+    outbuf_write(ob, &ehdr, sizeof(ehdr));
+
+    off = sizeof(ehdr);
+    for (i = 1; i < nshdrs; ++i) {
+        if (shdrs[i].sh_type == SHT_NOBITS)
+            continue;
+
+        elf_pad(ob, shdrs[i].sh_offset - off);
+        if (i < ELF_SEC_MAX) {
+            data = obj->sections[i].data.data;
+        } else if (shdrs[i].sh_type == SHT_RELA) {
+            data = rela[shdrs[i].sh_info].data;
+        } else if (shdrs[i].sh_type == SHT_SYMTAB) {
+            data = symtab.data;
+        } else if (i == nshdrs - 1) {
+            data = shstrtab.data;
+        } else {
+            data = strtab.data;
+        }
+
+        if (shdrs[i].sh_size > 0)
+            outbuf_write(ob, data, shdrs[i].sh_size);
+
+        off = shdrs[i].sh_offset + shdrs[i].sh_size;
+    }
+
+    elf_pad(ob, ehdr.e_shoff - off);
+    outbuf_write(ob, shdrs, nshdrs * sizeof(*shdrs));
+    retval = 0;
+done:
+    for (i = 0; i < ELF_SEC_MAX; ++i) {
+        free(rela[i].data);
+    }
+
+    free(symtab.data);
+    free(strtab.data);
+    free(shstrtab.data);
+    return retval;
+}
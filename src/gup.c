@@ -3,18 +3,49 @@
  * Provided under the BSD-3 clause.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include "gup/state.h"
 #include "gup/parser.h"
+#include "gup/codegen.h"
+#include "gup/jit.h"
+#include "gup/mu.h"
 
 #define GUP_VERSION "0.0.1"
 #define DEFAULT_ASMOUT "gupgen.asm"
+#define DEFAULT_OBJOUT "gupgen.o"
+
+/* CPU targeted unless told otherwise (-march, -mfeatures) */
+#ifndef GUP_MARCH
+#define GUP_MARCH ""
+#endif  /* !GUP_MARCH */
+
+#ifndef GUP_MFEATURES
+#define GUP_MFEATURES ""
+#endif  /* !GUP_MFEATURES */
 
 /* Output file path */
-static const char *out_path = "a.out";
+static const char *out_path = NULL;
+
+/* Dump IR if set */
+static bool dump_ir = false;
+
+/* Emit an ELF object if set */
+static bool emit_obj = false;
+
+/* Procedure to run in memory, NULL if not JIT'ing */
+static const char *jit_entry = NULL;
+
+/* Never use the red zone if set (e.g., kernel code) */
+static bool no_redzone = false;
+
+/* CPU features generated code may use, see mu_target_opt() */
+static uint32_t features = 0;
 
 static void
 help(void)
@@ -25,9 +56,48 @@ help(void)
         "[-h]   Display this help menu\n"
         "[-v]   Display the gup version\n"
         "[-o]   Output file path\n"
+        "[-c]   Emit an ELF object instead of assembly\n"
+        "[-d]   Dump IR to stdout\n"
+        "[-j]   Run the given procedure in memory\n"
+        "[-m]   Target option, one of:\n"
+        "         no-red-zone      never use the red zone\n"
+        "         arch=<cpu>       assume what a CPU supports (x86-64,\n"
+        "                          x86-64-v2, x86-64-v3, native)\n"
+        "         features=<list>  enable CPU features (popcnt, lzcnt,\n"
+        "                          bmi, bmi2, movbe, avx2), no-<f>\n"
+        "                          disables one\n"
+        "         <f>, no-<f>      same for a single feature\n"
     );
 }
 
+/*
+ * Apply a target option given with -m
+ *
+ * @opt: Option text
+ *
+ * Returns zero on success
+ */
+static int
+target_opt(const char *opt)
+{
+    if (strcmp(opt, "no-red-zone") == 0) {
+        no_redzone = true;
+        return 0;
+    }
+
+    if (strcmp(opt, "red-zone") == 0) {
+        no_redzone = false;
+        return 0;
+    }
+
+    if (mu_target_opt(opt, &features) == 0) {
+        return 0;
+    }
+
+    printf("fatal: unknown target option '-m%s'\n", opt);
+    return -1;
+}
+
 static void
 version(void)
 {
@@ -40,21 +110,119 @@ version(void)
     );
 }
 
+/*
+ * Returns the time elapsed since a point in nanoseconds
+ *
+ * @start: Point to measure from
+ */
+static uint64_t
+elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000ULL +
+        (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Load the compiled object into memory and call the
+ * entry procedure
+ *
+ * @state:   Compiler state
+ * @compile: Time taken to compile in nanoseconds
+ */
+static void
+run(struct gup_state *state, uint64_t compile)
+{
+    struct jit_image img;
+    struct timespec start;
+    struct symbol *symbol;
+    uint64_t(*entry)(void);
+    uint64_t result, load, exec;
+    size_t size;
+
+    symbol = symbol_from_name(&state->symtab, jit_entry);
+    if (symbol == NULL || symbol->type != SYMBOL_FUNC) {
+        printf("fatal: no procedure '%s' to run\n", jit_entry);
+        return;
+    }
+
+    /* The entry is called as a u64 (void) from C */
+    size = type_size(&symbol->dtype);
+    if (symbol->nparams > 0 || symbol->dtype.ptr_depth > 0 || size == 0) {
+        printf("fatal: '%s' must take no parameters and return an integer\n", jit_entry);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (jit_load(&img, &state->elf) < 0) {
+        printf("fatal: failed to load object into memory\n");
+        return;
+    }
+
+    load = elapsed(&start);
+    *(void **)&entry = jit_sym(&img, &state->elf, jit_entry);
+    if (entry == NULL) {
+        printf("fatal: no procedure '%s' to run\n", jit_entry);
+        jit_unload(&img);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result = entry();
+    exec = elapsed(&start);
+
+    /* Bits above a narrower return type are undefined */
+    if (size < sizeof(result)) {
+        result &= ((uint64_t)1 << (size * 8)) - 1;
+    }
+
+    printf("%s() = %llu\n", jit_entry, (unsigned long long)result);
+    printf(
+        "compile %llu.%03llu ms, load %llu.%03llu ms, run %llu.%03llu ms\n",
+        (unsigned long long)compile / 1000000,
+        (unsigned long long)compile / 1000 % 1000,
+        (unsigned long long)load / 1000000,
+        (unsigned long long)load / 1000 % 1000,
+        (unsigned long long)exec / 1000000,
+        (unsigned long long)exec / 1000 % 1000
+    );
+
+    jit_unload(&img);
+}
+
 static void
 compile(const char *path)
 {
     struct gup_state state;
+    struct timespec start;
+    const char *out;
 
     if (path == NULL) {
         return;
     }
 
-    if (gup_state_init(&state, path, DEFAULT_ASMOUT) < 0) {
+    out = out_path;
+    if (out == NULL && jit_entry == NULL) {
+        out = emit_obj ? DEFAULT_OBJOUT : DEFAULT_ASMOUT;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (gup_state_init(&state, path, out) < 0) {
         printf("fatal: failed to initialize gup state\n");
         perror("gup_state_init");
         return;
     }
 
+    state.dump_ir = dump_ir;
+    state.emit_obj = emit_obj || jit_entry != NULL;
+    state.jit = jit_entry != NULL;
+    state.entry = jit_entry;
+    state.no_redzone = no_redzone;
+    state.features = features;
+
     /* Pass 0 */
     if (gup_parse(&state) < 0) {
         gup_state_destroy(&state);
@@ -67,6 +235,23 @@ compile(const char *path)
         return;
     }
 
+    if (cg_finish(&state) < 0) {
+        gup_state_destroy(&state);
+        return;
+    }
+
+    if (state.jit) {
+        run(&state, elapsed(&start));
+        gup_state_destroy(&state);
+        return;
+    }
+
+    if (outbuf_flush(&state.out) < 0) {
+        perror("outbuf_flush");
+        gup_state_destroy(&state);
+        return;
+    }
+
     gup_state_destroy(&state);
 }
 
@@ -81,7 +266,16 @@ main(int argc, char **argv)
         return -1;
     }
 
-    while ((opt = getopt(argc, argv, "hvo:")) != -1) {
+    /* Build time defaults, see mk/default.mk */
+    if (GUP_MARCH[0] != '\0' && target_opt("arch=" GUP_MARCH) < 0) {
+        return -1;
+    }
+
+    if (GUP_MFEATURES[0] != '\0' && target_opt("features=" GUP_MFEATURES) < 0) {
+        return -1;
+    }
+
+    while ((opt = getopt(argc, argv, "hvdcj:m:o:")) != -1) {
         switch (opt) {
         case 'h':
             help();
@@ -92,6 +286,19 @@ main(int argc, char **argv)
         case 'o':
             out_path = strdup(optarg);
             break;
+        case 'd':
+            dump_ir = true;
+            break;
+        case 'c':
+            emit_obj = true;
+            break;
+        case 'j':
+            jit_entry = strdup(optarg);
+            break;
+        case 'm':
+            if (target_opt(optarg) < 0)
+                return -1;
+            break;
         }
     }
 
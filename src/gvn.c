@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/opt.h"
+
+/* Number of value table buckets */
+#define GVN_HASH_SIZE 128
+
+/*
+ * Represents a value computed somewhere in a function
+ *
+ * @op:    Operation (after normalizing the operand order)
+ * @size:  Access or extension size
+ * @src:   Value numbers of the operands
+ * @imm:   Immediate value (IR_IMM), slot index (IR_SLOT), shift
+ *         count (IR_SHL, IR_SHR)
+ * @label: Label operand (IR_ADDR)
+ * @mem:   Memory state the value was loaded in (IR_LOAD)
+ * @block: Block the value is computed in
+ * @reg:   Register holding the value
+ * @vn:    Value number
+ * @next:  Next entry in the bucket
+ */
+struct gvn_entry {
+    ir_op_t op;
+    uint8_t size;
+    ir_reg_t src[2];
+    uint64_t imm;
+    const char *label;
+    size_t mem;
+    struct ir_block *block;
+    ir_reg_t reg;
+    ir_reg_t vn;
+    struct gvn_entry *next;
+};
+
+/*
+ * Numbering context
+ *
+ * Only registers with a single definition take part, those
+ * given more than one by inlining are left alone.
+ *
+ * @func:    Function being numbered
+ * @table:   Value table
+ * @ndefs:   Definition count, indexed by register
+ * @vn:      Value number, indexed by register
+ * @repl:    Register uses are rewritten to, indexed by register
+ * @mem_out: Memory state at the end of a block, indexed by block ID
+ * @mem_gen: Last memory state handed out
+ */
+struct gvn_ctx {
+    struct ir_func *func;
+    struct gvn_entry *table[GVN_HASH_SIZE];
+    uint8_t *ndefs;
+    ir_reg_t *vn;
+    ir_reg_t *repl;
+    size_t *mem_out;
+    size_t mem_gen;
+};
+
+/*
+ * Returns true if an instruction computes a value that
+ * may be reused
+ *
+ * @insn: Instruction to check
+ */
+static bool
+gvn_numbered(const struct ir_insn *insn)
+{
+    switch (insn->op) {
+    case IR_IMM:
+    case IR_ADDR:
+    case IR_SLOT:
+    case IR_LOAD:
+    case IR_ZEXT:
+    case IR_NEG:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MULH:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_GT:
+    case IR_LE:
+    case IR_GE:
+        return true;
+    default:
+        return false;
+    }
+
+    return false;
+}
+
+/*
+ * Normalize the operand order of a key so that equivalent
+ * operations look the same
+ *
+ * @key: Key to normalize
+ */
+static void
+gvn_normalize(struct gvn_entry *key)
+{
+    ir_reg_t tmp;
+
+    switch (key->op) {
+    case IR_GT:
+        key->op = IR_LT;
+        break;
+    case IR_GE:
+        key->op = IR_LE;
+        break;
+    case IR_ADD:
+    case IR_MUL:
+    case IR_MULH:
+    case IR_EQ:
+    case IR_NE:
+        if (key->src[0] <= key->src[1])
+            return;
+        break;
+    default:
+        return;
+    }
+
+    tmp = key->src[0];
+    key->src[0] = key->src[1];
+    key->src[1] = tmp;
+}
+
+/*
+ * Returns the bucket a key lives in
+ *
+ * @key: Key to hash
+ */
+static size_t
+gvn_hash(const struct gvn_entry *key)
+{
+    const char *p;
+    uint64_t h;
+
+    h = key->op;
+    h = h * 31 + key->size;
+    h = h * 31 + key->src[0];
+    h = h * 31 + key->src[1];
+    h = h * 31 + key->imm;
+    h = h * 31 + key->mem;
+    for (p = key->label; p != NULL && *p != '\0'; ++p) {
+        h = h * 31 + *p;
+    }
+
+    return h % GVN_HASH_SIZE;
+}
+
+/*
+ * Returns true if two keys name the same value
+ *
+ * @a: First key
+ * @b: Second key
+ */
+static bool
+gvn_same(const struct gvn_entry *a, const struct gvn_entry *b)
+{
+    if (a->op != b->op || a->size != b->size || a->imm != b->imm) {
+        return false;
+    }
+
+    if (a->src[0] != b->src[0] || a->src[1] != b->src[1] || a->mem != b->mem) {
+        return false;
+    }
+
+    if (a->label == NULL || b->label == NULL) {
+        return a->label == b->label;
+    }
+
+    return strcmp(a->label, b->label) == 0;
+}
+
+/*
+ * Look a value up, it is only available if computed in a
+ * block dominating the one asking. Constants are the same
+ * everywhere and are always found.
+ *
+ * @ctx:   Numbering context
+ * @key:   Value to look up
+ * @block: Block asking for it
+ */
+static struct gvn_entry *
+gvn_lookup(struct gvn_ctx *ctx, const struct gvn_entry *key,
+    struct ir_block *block)
+{
+    struct gvn_entry *entry;
+
+    entry = ctx->table[gvn_hash(key)];
+    for (; entry != NULL; entry = entry->next) {
+        if (!gvn_same(entry, key))
+            continue;
+        if (key->op == IR_IMM || ir_dominates(entry->block, block))
+            return entry;
+    }
+
+    return NULL;
+}
+
+/*
+ * Record a value as available from here on
+ *
+ * @ctx: Numbering context
+ * @key: Value to record
+ *
+ * Returns zero on success
+ */
+static int
+gvn_insert(struct gvn_ctx *ctx, const struct gvn_entry *key)
+{
+    struct gvn_entry *entry;
+    size_t hash;
+
+    entry = arena_alloc(ctx->func->arena, sizeof(*entry));
+    if (entry == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    *entry = *key;
+    hash = gvn_hash(key);
+    entry->next = ctx->table[hash];
+    ctx->table[hash] = entry;
+    return 0;
+}
+
+/*
+ * Returns true if a register has exactly one definition
+ *
+ * @ctx: Numbering context
+ * @reg: Register to check
+ */
+static inline bool
+gvn_single(struct gvn_ctx *ctx, ir_reg_t reg)
+{
+    return reg != 0 && ctx->ndefs[reg] == 1;
+}
+
+/*
+ * Number a single instruction, uses of a value computed
+ * earlier are rewritten to the register already holding it
+ *
+ * @ctx:   Numbering context
+ * @block: Block the instruction is in
+ * @insn:  Instruction to number
+ * @mem:   Current memory state
+ *
+ * Returns zero on success
+ */
+static int
+gvn_insn(struct gvn_ctx *ctx, struct ir_block *block, struct ir_insn *insn,
+    size_t *mem)
+{
+    struct gvn_entry key, *entry;
+    size_t i;
+
+    for (i = 0; i < ir_nuses(insn); ++i) {
+        if (gvn_single(ctx, *ir_use(insn, i)))
+            *ir_use(insn, i) = ctx->repl[*ir_use(insn, i)];
+    }
+
+    memset(&key, 0, sizeof(key));
+    switch (insn->op) {
+    case IR_STORE:
+        /* A full width load right after gives back what was stored */
+        *mem = ++ctx->mem_gen;
+        if (insn->size < 8 || !gvn_single(ctx, insn->src[0]))
+            return 0;
+        if (!gvn_single(ctx, insn->src[1]))
+            return 0;
+
+        key.op = IR_LOAD;
+        key.size = insn->size;
+        key.src[0] = ctx->vn[insn->src[0]];
+        key.mem = *mem;
+        key.block = block;
+        key.reg = insn->src[1];
+        key.vn = ctx->vn[insn->src[1]];
+        return gvn_insert(ctx, &key);
+    case IR_CALL:
+    case IR_TAIL:
+        *mem = ++ctx->mem_gen;
+        return 0;
+    case IR_COPY:
+        if (!gvn_single(ctx, insn->dst) || !gvn_single(ctx, insn->src[0]))
+            return 0;
+
+        ctx->repl[insn->dst] = insn->src[0];
+        ctx->vn[insn->dst] = ctx->vn[insn->src[0]];
+        return 0;
+    default:
+        break;
+    }
+
+    if (!gvn_numbered(insn) || !gvn_single(ctx, insn->dst)) {
+        return 0;
+    }
+
+    for (i = 0; i < 2; ++i) {
+        if (insn->src[i] != 0 && !gvn_single(ctx, insn->src[i]))
+            return 0;
+
+        key.src[i] = ctx->vn[insn->src[i]];
+    }
+
+    key.op = insn->op;
+    key.size = insn->size;
+    key.imm = insn->imm;
+    key.label = insn->label;
+    key.mem = (insn->op == IR_LOAD) ? *mem : 0;
+    gvn_normalize(&key);
+
+    if ((entry = gvn_lookup(ctx, &key, block)) != NULL) {
+        /*
+         * Constants only share a number, they are cheaper to
+         * materialize again than to keep in a register.
+         */
+        ctx->vn[insn->dst] = entry->vn;
+        if (insn->op != IR_IMM)
+            ctx->repl[insn->dst] = entry->reg;
+
+        return 0;
+    }
+
+    key.block = block;
+    key.reg = insn->dst;
+    key.vn = insn->dst;
+    return gvn_insert(ctx, &key);
+}
+
+int
+ir_gvn(struct ir_func *func)
+{
+    struct gvn_ctx ctx;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    size_t mem, i;
+    ir_reg_t r;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.func = func;
+    ctx.ndefs = arena_alloc(func->arena, func->reg_count + 1);
+    ctx.vn = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.vn));
+    ctx.repl = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.repl));
+    ctx.mem_out = arena_alloc(func->arena, func->block_count * sizeof(*ctx.mem_out));
+    if (ctx.ndefs == NULL || ctx.vn == NULL || ctx.repl == NULL || ctx.mem_out == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (r = 0; r <= func->reg_count; ++r) {
+        ctx.vn[r] = r;
+        ctx.repl[r] = r;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst != 0 && ctx.ndefs[insn->dst] < 2)
+                ++ctx.ndefs[insn->dst];
+        }
+    }
+
+    /*
+     * Blocks are in reverse postorder so dominators come first.
+     * Memory is only known to be unchanged on entry to a block
+     * reached from nowhere but its immediate dominator.
+     */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if (block->npreds == 1 && block->preds[0] == block->idom) {
+            mem = ctx.mem_out[block->idom->id];
+        } else {
+            mem = ++ctx.mem_gen;
+        }
+
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (gvn_insn(&ctx, block, insn, &mem) < 0)
+                return -1;
+        }
+
+        ctx.mem_out[block->id] = mem;
+    }
+
+    /* Values coming around a back edge were numbered after their phi */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op != IR_PHI)
+                continue;
+
+            for (i = 0; i < insn->argc; ++i) {
+                if (gvn_single(&ctx, insn->args[i]))
+                    insn->args[i] = ctx.repl[insn->args[i]];
+            }
+        }
+    }
+
+    return 0;
+}
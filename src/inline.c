@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "gup/inline.h"
+#include "gup/types.h"
+
+/*
+ * State of a single call being inlined
+ *
+ * @func:   Function being inlined into
+ * @callee: Body being copied
+ * @call:   Call being replaced
+ * @cont:   Block the copy returns to, NULL in tail position
+ * @base:   Offset of callee registers within the caller
+ * @slots:  Offset of callee stack slots within the caller
+ * @blocks: Copies of the callee blocks, indexed by block ID
+ */
+struct inline_ctx {
+    struct ir_func *func;
+    struct ir_func *callee;
+    struct ir_insn *call;
+    struct ir_block *cont;
+    ir_reg_t base;
+    size_t slots;
+    struct ir_block **blocks;
+};
+
+size_t
+ir_inline_cost(const struct ir_func *func)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+    size_t cost = 0;
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            switch (insn->op) {
+            case IR_NOP:
+            case IR_PARAM:
+            case IR_COPY:
+            case IR_JMP:
+                /* Usually coalesced or laid out away */
+                break;
+            case IR_CALL:
+            case IR_TAIL:
+                cost += 1 + insn->argc;
+                break;
+            default:
+                ++cost;
+                break;
+            }
+        }
+    }
+
+    return cost;
+}
+
+/*
+ * Returns true if a call should be inlined, charging its cost
+ * to the growth budget of the caller
+ *
+ * @func:     Function making the call
+ * @call:     IR_CALL or IR_TAIL instruction
+ * @budget:   Growth budget left
+ * @can_tail: Returns true if the target can make a call a tail call
+ */
+static bool
+inline_wanted(struct ir_func *func, struct ir_insn *call, size_t *budget,
+    bool(*can_tail)(const struct ir_func *, const struct ir_insn *))
+{
+    struct symbol *callee = call->sym;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    size_t cost;
+
+    /* Only procs emitted earlier have a body to copy */
+    if (callee == NULL || callee->ir == NULL || callee->noinline) {
+        return false;
+    }
+
+    /* Tail calls copied into a tail call must stay tail calls */
+    if (call->op == IR_TAIL) {
+        TAILQ_FOREACH(block, &callee->ir->blocks, link) {
+            insn = ir_block_term(block);
+            if (insn->op == IR_TAIL && !can_tail(func, insn))
+                return false;
+        }
+    }
+
+    if (callee->always_inline) {
+        return true;
+    }
+
+    if (callee->pub) {
+        return false;
+    }
+
+    cost = ir_inline_cost(callee->ir);
+    if (cost > INLINE_COST_MAX || cost > *budget) {
+        return false;
+    }
+
+    *budget -= cost;
+    return true;
+}
+
+/*
+ * Map a callee register into the caller
+ *
+ * @ctx: Inline context
+ * @reg: Callee register
+ */
+static inline ir_reg_t
+inline_reg(struct inline_ctx *ctx, ir_reg_t reg)
+{
+    return (reg == 0) ? 0 : ctx->base + reg;
+}
+
+/*
+ * Append a move that zero extends from a size
+ *
+ * @ctx:   Inline context
+ * @block: Block to append to
+ * @dst:   Destination register
+ * @src:   Source register
+ * @size:  Size of the value in bytes
+ *
+ * Returns zero on success
+ */
+static int
+inline_move(struct inline_ctx *ctx, struct ir_block *block, ir_reg_t dst,
+    ir_reg_t src, uint8_t size)
+{
+    struct ir_insn *insn;
+
+    if (ir_insn_new(ctx->func, block, (size < 8) ? IR_ZEXT : IR_COPY, &insn) < 0) {
+        return -1;
+    }
+
+    insn->size = size;
+    insn->dst = dst;
+    insn->src[0] = src;
+    return 0;
+}
+
+/*
+ * Append the code handing a value back from the copied body,
+ * the caller returns it too if the call was in tail position
+ *
+ * @ctx:   Inline context
+ * @block: Block to append to
+ * @value: Register holding the value, zero if none
+ *
+ * Returns zero on success
+ */
+static int
+inline_return(struct inline_ctx *ctx, struct ir_block *block, ir_reg_t value)
+{
+    struct ir_insn *call = ctx->call;
+    struct ir_insn *insn;
+    ir_reg_t res;
+    size_t size;
+
+    if (ctx->cont != NULL) {
+        if (call->dst != 0 && value != 0) {
+            if (inline_move(ctx, block, call->dst, value, call->size) < 0)
+                return -1;
+        }
+
+        if (ir_insn_new(ctx->func, block, IR_JMP, &insn) < 0) {
+            return -1;
+        }
+
+        insn->target[0] = ctx->cont;
+        return 0;
+    }
+
+    /* The callee truncated its result, our caller might not */
+    size = type_size(&ctx->func->sym->dtype);
+    res = (size != 0) ? value : 0;
+    if (res != 0 && call->size < size) {
+        res = ir_reg_new(ctx->func);
+        if (inline_move(ctx, block, res, value, call->size) < 0)
+            return -1;
+    }
+
+    if (ir_insn_new(ctx->func, block, IR_RET, &insn) < 0) {
+        return -1;
+    }
+
+    insn->src[0] = res;
+    return 0;
+}
+
+/*
+ * Append a copy of a callee instruction
+ *
+ * @ctx:   Inline context
+ * @block: Block to append to
+ * @src:   Instruction to copy
+ *
+ * Returns zero on success
+ */
+static int
+inline_copy(struct inline_ctx *ctx, struct ir_block *block, struct ir_insn *src)
+{
+    struct ir_insn *insn;
+    size_t i;
+
+    switch (src->op) {
+    case IR_PARAM:
+        /* Arguments are narrowed just as the callee would */
+        return inline_move(
+            ctx, block,
+            inline_reg(ctx, src->dst),
+            ctx->call->args[src->imm],
+            src->size
+        );
+    case IR_RET:
+        return inline_return(ctx, block, inline_reg(ctx, src->src[0]));
+    default:
+        break;
+    }
+
+    if (ir_insn_new(ctx->func, block, src->op, &insn) < 0) {
+        return -1;
+    }
+
+    insn->size = src->size;
+    insn->dst = inline_reg(ctx, src->dst);
+    insn->src[0] = inline_reg(ctx, src->src[0]);
+    insn->src[1] = inline_reg(ctx, src->src[1]);
+    insn->imm = src->imm;
+    insn->label = src->label;
+    insn->sym = src->sym;
+    insn->argc = src->argc;
+    if (src->op == IR_SLOT) {
+        insn->imm += ctx->slots;
+    }
+
+    if (src->op == IR_SWITCH) {
+        insn->table = arena_alloc(ctx->func->arena, src->imm * sizeof(*insn->table));
+        if (insn->table == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < ir_ntargets(src); ++i) {
+        if (*ir_target(src, i) != NULL)
+            *ir_target(insn, i) = ctx->blocks[(*ir_target(src, i))->id];
+    }
+
+    if (src->argc > 0) {
+        insn->args = arena_alloc(ctx->func->arena, src->argc * sizeof(*insn->args));
+        if (insn->args == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        for (i = 0; i < src->argc; ++i)
+            insn->args[i] = inline_reg(ctx, src->args[i]);
+    }
+
+    /* Out of tail position a tail call returns to the copy */
+    if (src->op == IR_TAIL && ctx->cont != NULL) {
+        insn->op = IR_CALL;
+        if (insn->size != 0)
+            insn->dst = ir_reg_new(ctx->func);
+
+        return inline_return(ctx, block, insn->dst);
+    }
+
+    return 0;
+}
+
+/*
+ * Give the copy of a callee block the copies of its
+ * predecessors, so that the next control flow graph rebuild
+ * can match up the incoming values of its phis
+ *
+ * @ctx: Inline context
+ * @src: Callee block
+ *
+ * Returns zero on success
+ */
+static int
+inline_preds(struct inline_ctx *ctx, struct ir_block *src)
+{
+    struct ir_block *block = ctx->blocks[src->id];
+    size_t i;
+
+    if (src->npreds == 0) {
+        return 0;
+    }
+
+    block->preds = arena_alloc(ctx->func->arena, src->npreds * sizeof(*block->preds));
+    if (block->preds == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < src->npreds; ++i) {
+        block->preds[i] = ctx->blocks[src->preds[i]->id];
+    }
+
+    block->npreds = src->npreds;
+    return 0;
+}
+
+/*
+ * The end of a block moved to another one, which is now
+ * the predecessor of wherever it branches to
+ *
+ * @block: Block that was split
+ * @cont:  Block holding the end of it
+ *
+ * Returns zero on success
+ */
+static int
+inline_split(struct ir_block *block, struct ir_block *cont)
+{
+    struct ir_insn *term;
+    struct ir_block *succ;
+    size_t i, j;
+
+    if ((term = ir_block_term(cont)) == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < ir_ntargets(term); ++i) {
+        if ((succ = *ir_target(term, i)) == NULL)
+            continue;
+
+        for (j = 0; j < succ->npreds; ++j) {
+            if (succ->preds[j] == block)
+                succ->preds[j] = cont;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Replace a call with a copy of the body of the callee
+ *
+ * @func:  Function making the call
+ * @block: Block the call is in
+ * @call:  IR_CALL or IR_TAIL instruction
+ *
+ * Returns zero on success
+ */
+static int
+inline_call(struct ir_func *func, struct ir_block *block, struct ir_insn *call)
+{
+    struct inline_ctx ctx;
+    struct ir_block *src;
+    struct ir_insn *insn;
+    size_t i, slot;
+
+    ctx.func = func;
+    ctx.callee = call->sym->ir;
+    ctx.call = call;
+    ctx.cont = NULL;
+    ctx.base = func->reg_count;
+    ctx.slots = func->slot_count;
+    func->reg_count += ctx.callee->reg_count;
+    /* Locals still in memory come along and need a slot */
+    for (i = 0; i < ctx.callee->slot_count; ++i) {
+        if (ir_slot_new(func, ctx.callee->slot_size[i], &slot) < 0)
+            return -1;
+    }
+
+    ctx.blocks = arena_alloc(
+        func->arena,
+        ctx.callee->block_count * sizeof(*ctx.blocks)
+    );
+
+    if (ctx.blocks == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Whatever follows the call carries on once the copy is done */
+    if (call->op == IR_CALL) {
+        if (ir_block_new(func, &ctx.cont) < 0) {
+            return -1;
+        }
+
+        while ((insn = TAILQ_NEXT(call, link)) != NULL) {
+            TAILQ_REMOVE(&block->insns, insn, link);
+            insn->block = ctx.cont;
+            TAILQ_INSERT_TAIL(&ctx.cont->insns, insn, link);
+        }
+
+        if (inline_split(block, ctx.cont) < 0) {
+            return -1;
+        }
+    }
+
+    TAILQ_FOREACH(src, &ctx.callee->blocks, link) {
+        if (ir_block_new(func, &ctx.blocks[src->id]) < 0)
+            return -1;
+    }
+
+    /* Phis in the copy pick their values by predecessor */
+    TAILQ_FOREACH(src, &ctx.callee->blocks, link) {
+        if (inline_preds(&ctx, src) < 0)
+            return -1;
+    }
+
+    TAILQ_FOREACH(src, &ctx.callee->blocks, link) {
+        TAILQ_FOREACH(insn, &src->insns, link) {
+            if (inline_copy(&ctx, ctx.blocks[src->id], insn) < 0)
+                return -1;
+        }
+    }
+
+    /* The call itself becomes a jump into the copy */
+    src = TAILQ_FIRST(&ctx.callee->blocks);
+    call->op = IR_JMP;
+    call->size = 0;
+    call->dst = 0;
+    call->label = NULL;
+    call->sym = NULL;
+    call->args = NULL;
+    call->argc = 0;
+    call->target[0] = ctx.blocks[src->id];
+    return 0;
+}
+
+int
+ir_inline(struct ir_func *func,
+    bool(*can_tail)(const struct ir_func *, const struct ir_insn *))
+{
+    size_t budget = INLINE_GROWTH_MAX;
+    struct ir_block *block;
+    struct ir_insn *insn;
+
+    if (func == NULL || can_tail == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Copies land at the end and get their own look later */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op != IR_CALL && insn->op != IR_TAIL)
+                continue;
+            if (!inline_wanted(func, insn, &budget, can_tail))
+                continue;
+            if (inline_call(func, block, insn) < 0)
+                return -1;
+
+            /* The rest of the block moved along with it */
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/ir.h"
+
+/* Initial capacity of the slot size array */
+#define IR_SLOT_INIT_CAP 8
+
+/* Operation mnemonics for dumps */
+static const char *optab[] = {
+    [IR_NOP]    = "nop",
+    [IR_IMM]    = "imm",
+    [IR_ADDR]   = "addr",
+    [IR_SLOT]   = "slot",
+    [IR_PARAM]  = "param",
+    [IR_LOAD]   = "load",
+    [IR_STORE]  = "store",
+    [IR_COPY]   = "copy",
+    [IR_ZEXT]   = "zext",
+    [IR_NEG]    = "neg",
+    [IR_ADD]    = "add",
+    [IR_SUB]    = "sub",
+    [IR_MUL]    = "mul",
+    [IR_DIV]    = "div",
+    [IR_MULH]   = "mulh",
+    [IR_SHL]    = "shl",
+    [IR_SHR]    = "shr",
+    [IR_EQ]     = "eq",
+    [IR_NE]     = "ne",
+    [IR_LT]     = "lt",
+    [IR_GT]     = "gt",
+    [IR_LE]     = "le",
+    [IR_GE]     = "ge",
+    [IR_CALL]   = "call",
+    [IR_JMP]    = "jmp",
+    [IR_BR]     = "br",
+    [IR_SWITCH] = "switch",
+    [IR_RET]    = "ret",
+    [IR_TAIL]   = "tail",
+    [IR_PHI]    = "phi"
+};
+
+int
+ir_func_new(struct arena *arena, struct symbol *sym, struct ir_func **res)
+{
+    struct ir_func *func;
+
+    if (arena == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((func = arena_alloc(arena, sizeof(*func))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    func->sym = sym;
+    func->arena = arena;
+    TAILQ_INIT(&func->blocks);
+    *res = func;
+    return 0;
+}
+
+int
+ir_block_new(struct ir_func *func, struct ir_block **res)
+{
+    struct ir_block *block;
+
+    if (func == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((block = arena_alloc(func->arena, sizeof(*block))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    block->id = func->block_count++;
+    TAILQ_INIT(&block->insns);
+    TAILQ_INSERT_TAIL(&func->blocks, block, link);
+    *res = block;
+    return 0;
+}
+
+int
+ir_insn_new(struct ir_func *func, struct ir_block *block, ir_op_t op,
+    struct ir_insn **res)
+{
+    struct ir_insn *insn;
+
+    if (func == NULL || block == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((insn = arena_alloc(func->arena, sizeof(*insn))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    insn->op = op;
+    insn->block = block;
+    TAILQ_INSERT_TAIL(&block->insns, insn, link);
+    *res = insn;
+    return 0;
+}
+
+ir_reg_t
+ir_reg_new(struct ir_func *func)
+{
+    /* Register zero is reserved to mean none */
+    return ++func->reg_count;
+}
+
+int
+ir_slot_new(struct ir_func *func, uint8_t size, size_t *res)
+{
+    uint8_t *sizes;
+    size_t cap;
+
+    if (func == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* The arena can't grow in place, so double into a new array */
+    if (func->slot_count >= func->slot_cap) {
+        cap = (func->slot_cap == 0) ? IR_SLOT_INIT_CAP : func->slot_cap * 2;
+        sizes = arena_alloc(func->arena, cap);
+        if (sizes == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        if (func->slot_count > 0)
+            memcpy(sizes, func->slot_size, func->slot_count);
+
+        func->slot_size = sizes;
+        func->slot_cap = cap;
+    }
+
+    func->slot_size[func->slot_count] = size;
+    *res = func->slot_count++;
+    return 0;
+}
+
+/*
+ * Walk every block reachable from a given block, recording
+ * them in postorder
+ *
+ * @block: Block to start at
+ * @seen:  Reachability map indexed by block ID
+ * @post:  Postorder is written here
+ * @npost: Number of blocks written so far
+ */
+static void
+ir_cfg_walk(struct ir_block *block, uint8_t *seen, struct ir_block **post,
+    size_t *npost)
+{
+    size_t i;
+
+    if (seen[block->id]) {
+        return;
+    }
+
+    /*
+     * Visit the last successor first so that the first branch
+     * target (the 'then' side) is laid out right after its
+     * predecessor and can be fallen into.
+     */
+    seen[block->id] = 1;
+    for (i = block->nsuccs; i > 0; --i) {
+        ir_cfg_walk(block->succs[i - 1], seen, post, npost);
+    }
+
+    post[(*npost)++] = block;
+}
+
+/*
+ * Find the nearest block dominating two others
+ *
+ * @a: First block
+ * @b: Second block
+ */
+static struct ir_block *
+ir_dom_meet(struct ir_block *a, struct ir_block *b)
+{
+    while (a != b) {
+        while (a->order > b->order)
+            a = a->idom;
+        while (b->order > a->order)
+            b = b->idom;
+    }
+
+    return a;
+}
+
+/*
+ * Compute immediate dominators, blocks must already be laid
+ * out in reverse postorder with predecessors known
+ *
+ * @func: Function to compute dominators of
+ */
+static void
+ir_dom_build(struct ir_func *func)
+{
+    struct ir_block *block, *entry, *idom;
+    bool changed;
+    size_t i, order = 0;
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        block->order = order++;
+        block->idom = NULL;
+    }
+
+    /*
+     * The entry dominates itself while iterating so that the
+     * meet always has somewhere to stop.
+     */
+    entry = TAILQ_FIRST(&func->blocks);
+    entry->idom = entry;
+    do {
+        changed = false;
+        TAILQ_FOREACH(block, &func->blocks, link) {
+            if (block == entry)
+                continue;
+
+            idom = NULL;
+            for (i = 0; i < block->npreds; ++i) {
+                if (block->preds[i]->idom == NULL)
+                    continue;
+
+                idom = (idom == NULL) ? block->preds[i]
+                    : ir_dom_meet(idom, block->preds[i]);
+            }
+
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    entry->idom = NULL;
+}
+
+/*
+ * Reorder the incoming values of the phis in a block to
+ * match its new predecessors
+ *
+ * @func:  Owning function
+ * @block: Block to fix up
+ * @old:   Predecessors before the rebuild
+ * @nold:  Number of predecessors before the rebuild
+ *
+ * Returns zero on success
+ */
+static int
+ir_cfg_phis(struct ir_func *func, struct ir_block *block,
+    struct ir_block **old, size_t nold)
+{
+    struct ir_insn *insn;
+    ir_reg_t *args;
+    size_t i, j;
+
+    TAILQ_FOREACH(insn, &block->insns, link) {
+        if (insn->op != IR_PHI)
+            continue;
+
+        args = NULL;
+        if (block->npreds > 0) {
+            args = arena_alloc(func->arena, block->npreds * sizeof(*args));
+            if (args == NULL) {
+                errno = -ENOMEM;
+                return -1;
+            }
+        }
+
+        for (i = 0; i < block->npreds; ++i) {
+            for (j = 0; j < nold && old[j] != block->preds[i]; ++j);
+            if (j == nold || j >= insn->argc) {
+                errno = -EINVAL;
+                return -1;
+            }
+
+            args[i] = insn->args[j];
+        }
+
+        insn->args = args;
+        insn->argc = block->npreds;
+    }
+
+    return 0;
+}
+
+int
+ir_cfg_build(struct ir_func *func)
+{
+    struct ir_block *block, *tmp, **post, ***old;
+    struct ir_insn *term;
+    uint8_t *seen;
+    size_t i, *nold, npost = 0;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    old = arena_alloc(func->arena, func->block_count * sizeof(*old));
+    nold = arena_alloc(func->arena, func->block_count * sizeof(*nold));
+    seen = arena_alloc(func->arena, func->block_count);
+    post = arena_alloc(func->arena, func->block_count * sizeof(*post));
+    if (old == NULL || nold == NULL || seen == NULL || post == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if ((term = ir_block_term(block)) == NULL) {
+            errno = -EINVAL;
+            return -1;
+        }
+
+        old[block->id] = block->preds;
+        nold[block->id] = block->npreds;
+
+        block->nsuccs = 0;
+        block->npreds = 0;
+        block->succs = arena_alloc(
+            func->arena,
+            ir_ntargets(term) * sizeof(*block->succs)
+        );
+
+        if (block->succs == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        /* A jump table names the same block any number of times */
+        for (i = 0; i < ir_ntargets(term); ++i) {
+            if ((tmp = *ir_target(term, i)) == NULL || seen[tmp->id])
+                continue;
+
+            seen[tmp->id] = 1;
+            block->succs[block->nsuccs++] = tmp;
+        }
+
+        for (i = 0; i < block->nsuccs; ++i) {
+            seen[block->succs[i]->id] = 0;
+        }
+    }
+
+    /*
+     * Lay the blocks out in reverse postorder, which also drops
+     * anything the entry block can't reach.
+     */
+    ir_cfg_walk(TAILQ_FIRST(&func->blocks), seen, post, &npost);
+    TAILQ_INIT(&func->blocks);
+    while (npost > 0) {
+        block = post[--npost];
+        TAILQ_INSERT_TAIL(&func->blocks, block, link);
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        for (i = 0; i < block->nsuccs; ++i)
+            ++block->succs[i]->npreds;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        block->preds = NULL;
+        if (block->npreds == 0)
+            continue;
+
+        block->preds = arena_alloc(
+            func->arena,
+            block->npreds * sizeof(*block->preds)
+        );
+
+        if (block->preds == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        block->npreds = 0;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        for (i = 0; i < block->nsuccs; ++i) {
+            tmp = block->succs[i];
+            tmp->preds[tmp->npreds++] = block;
+        }
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if (ir_cfg_phis(func, block, old[block->id], nold[block->id]) < 0)
+            return -1;
+    }
+
+    ir_dom_build(func);
+    return 0;
+}
+
+/*
+ * Returns true if a block does nothing but return without
+ * a value
+ *
+ * @block: Block to check
+ */
+static bool
+ir_block_void_ret(struct ir_block *block)
+{
+    struct ir_insn *insn = TAILQ_FIRST(&block->insns);
+
+    if (insn == NULL || insn != TAILQ_LAST(&block->insns, ir_insn_q)) {
+        return false;
+    }
+
+    return insn->op == IR_RET && insn->src[0] == 0;
+}
+
+void
+ir_tail_calls(struct ir_func *func,
+    bool(*can_tail)(const struct ir_func *, const struct ir_insn *))
+{
+    struct ir_block *block;
+    struct ir_insn *term, *call;
+
+    if (func == NULL) {
+        return;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if ((term = ir_block_term(block)) == NULL)
+            continue;
+        if ((call = TAILQ_PREV(term, ir_insn_q, link)) == NULL)
+            continue;
+        if (call->op != IR_CALL || !can_tail(func, call))
+            continue;
+
+        switch (term->op) {
+        case IR_RET:
+            if (term->src[0] != 0 && term->src[0] != call->dst)
+                continue;
+            /* The call zero-extends a narrow result, a jump would not */
+            if (call->size < type_size(&func->sym->dtype))
+                continue;
+            break;
+        case IR_JMP:
+            /* Falling off the end of a void proc */
+            if (!ir_block_void_ret(term->target[0]))
+                continue;
+            break;
+        default:
+            continue;
+        }
+
+        TAILQ_REMOVE(&block->insns, term, link);
+        call->op = IR_TAIL;
+        call->dst = 0;
+    }
+}
+
+/*
+ * Dump a single instruction
+ *
+ * @insn: Instruction to dump
+ * @fp:   Stream to dump to
+ */
+static void
+ir_dump_insn(struct ir_insn *insn, FILE *fp)
+{
+    size_t i;
+
+    fprintf(fp, "\t");
+    if (insn->dst != 0) {
+        fprintf(fp, "%%%u = ", insn->dst);
+    }
+
+    fprintf(fp, "%s", optab[insn->op]);
+    switch (insn->op) {
+    case IR_IMM:
+        fprintf(fp, " %llu", (unsigned long long)insn->imm);
+        break;
+    case IR_ADDR:
+        fprintf(fp, " %s", insn->label);
+        break;
+    case IR_SLOT:
+    case IR_PARAM:
+        fprintf(fp, ".%u %llu", insn->size, (unsigned long long)insn->imm);
+        break;
+    case IR_LOAD:
+    case IR_ZEXT:
+        fprintf(fp, ".%u %%%u", insn->size, insn->src[0]);
+        break;
+    case IR_STORE:
+        fprintf(fp, ".%u %%%u, %%%u", insn->size, insn->src[0], insn->src[1]);
+        break;
+    case IR_SHL:
+    case IR_SHR:
+        fprintf(fp, " %%%u, %llu", insn->src[0], (unsigned long long)insn->imm);
+        break;
+    case IR_CALL:
+    case IR_TAIL:
+        fprintf(fp, " %s(", insn->label);
+        for (i = 0; i < insn->argc; ++i) {
+            fprintf(fp, "%s%%%u", (i > 0) ? ", " : "", insn->args[i]);
+        }
+
+        fprintf(fp, ")");
+        break;
+    case IR_PHI:
+        for (i = 0; i < insn->argc; ++i) {
+            fprintf(
+                fp, "%s[%%%u, .L%zu]",
+                (i > 0) ? ", " : " ",
+                insn->args[i],
+                insn->block->preds[i]->id
+            );
+        }
+
+        break;
+    case IR_JMP:
+        fprintf(fp, " .L%zu", insn->target[0]->id);
+        break;
+    case IR_BR:
+        fprintf(
+            fp, " %%%u, .L%zu, .L%zu",
+            insn->src[0],
+            insn->target[0]->id,
+            insn->target[1]->id
+        );
+        break;
+    case IR_SWITCH:
+        fprintf(fp, " %%%u, [", insn->src[0]);
+        for (i = 0; i < insn->imm; ++i) {
+            fprintf(fp, "%s.L%zu", (i > 0) ? ", " : "", insn->table[i]->id);
+        }
+
+        fprintf(fp, "]");
+        break;
+    default:
+        for (i = 0; i < 2 && insn->src[i] != 0; ++i) {
+            fprintf(fp, "%s%%%u", (i > 0) ? ", " : " ", insn->src[i]);
+        }
+
+        break;
+    }
+
+    fprintf(fp, "\n");
+}
+
+void
+ir_dump(struct ir_func *func, FILE *fp)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+
+    if (func == NULL || fp == NULL) {
+        return;
+    }
+
+    fprintf(fp, "proc %s:\n", func->sym->name);
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        fprintf(fp, ".L%zu:\n", block->id);
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            ir_dump_insn(insn, fp);
+        }
+    }
+}
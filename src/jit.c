@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include "gup/jit.h"
+#include "gup/mu.h"
+
+/* Order sections are laid out in after the code */
+static const elf_sec_t dataorder[] = {
+    ELF_SEC_RODATA,
+    ELF_SEC_DATA,
+    ELF_SEC_BSS
+};
+
+/*
+ * Round a value up to an alignment
+ *
+ * @v:     Value to round
+ * @align: Alignment (power of two, zero means none)
+ */
+static inline size_t
+jit_align(size_t v, size_t align)
+{
+    if (align == 0) {
+        return v;
+    }
+
+    return (v + align - 1) & ~(align - 1);
+}
+
+/*
+ * Returns the address a symbol resolves to, symbols the object
+ * does not define are looked up in the running process
+ *
+ * @img: Image being loaded
+ * @sym: Symbol to resolve
+ */
+static uintptr_t
+jit_resolve(const struct jit_image *img, const struct elf_sym *sym)
+{
+    if (sym->sec != ELF_SEC_NONE) {
+        return img->secbase[sym->sec] + sym->value;
+    }
+
+    return (uintptr_t)dlsym(RTLD_DEFAULT, sym->name);
+}
+
+/*
+ * Apply every relocation against a section
+ *
+ * @img: Image being loaded
+ * @obj: Object being loaded
+ * @sec: Section to relocate
+ *
+ * Returns zero on success
+ */
+static int
+jit_relocate(struct jit_image *img, const struct elf_obj *obj, elf_sec_t sec)
+{
+    const struct elf_section *s = &obj->sections[sec];
+    const struct elf_rela *rela;
+    const struct elf_sym *sym;
+    uintptr_t value;
+    size_t i;
+
+    for (i = 0; i < s->nrelocs; ++i) {
+        rela = &s->relocs[i];
+        sym = &obj->syms[rela->sym];
+        value = jit_resolve(img, sym);
+        if (value == 0) {
+            fprintf(stderr, "jit: undefined symbol '%s'\n", sym->name);
+            errno = -ENOENT;
+            return -1;
+        }
+
+        if (mu_jit_reloc((uint8_t *)img->secbase[sec] + rela->offset, value,
+                         img->stubs[rela->sym], rela->type, rela->addend) < 0) {
+            fprintf(stderr, "jit: cannot relocate against '%s'\n", sym->name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+jit_load(struct jit_image *res, const struct elf_obj *obj)
+{
+    const struct elf_section *s;
+    size_t pagesize, stubsize, nstubs = 0;
+    size_t off, textend, i;
+    uintptr_t target;
+    uint8_t *stub;
+    elf_sec_t sec;
+
+    if (res == NULL || obj == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    pagesize = sysconf(_SC_PAGESIZE);
+    stubsize = mu_jit_stub(NULL, 0);
+    for (i = 0; i < obj->nsyms; ++i) {
+        if (obj->syms[i].sec == ELF_SEC_NONE)
+            ++nstubs;
+    }
+
+    /*
+     * Code and the stubs for reaching the rest of the process
+     * share the executable pages, everything else follows on
+     * pages of its own.
+     */
+    off = obj->sections[ELF_SEC_TEXT].size;
+    off = jit_align(off, 16) + nstubs * stubsize;
+    textend = jit_align(off, pagesize);
+    off = textend;
+    for (i = 0; i < sizeof(dataorder) / sizeof(*dataorder); ++i) {
+        s = &obj->sections[dataorder[i]];
+        off = jit_align(off, s->align);
+        res->secbase[dataorder[i]] = off;
+        off += s->size;
+    }
+
+    res->size = jit_align(off, pagesize);
+    if (res->size == 0) {
+        res->size = pagesize;
+    }
+
+    res->base = mmap(NULL, res->size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (res->base == MAP_FAILED) {
+        res->base = NULL;
+        return -1;
+    }
+
+    res->stubs = calloc(obj->nsyms + 1, sizeof(*res->stubs));
+    if (res->stubs == NULL) {
+        jit_unload(res);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Place each section, .bss is already zero */
+    res->secbase[ELF_SEC_TEXT] = 0;
+    for (sec = ELF_SEC_TEXT; sec < ELF_SEC_MAX; ++sec) {
+        res->secbase[sec] += (uintptr_t)res->base;
+        s = &obj->sections[sec];
+        if (sec != ELF_SEC_BSS && s->size > 0)
+            memcpy((void *)res->secbase[sec], s->data.data, s->size);
+    }
+
+    stub = res->base + jit_align(obj->sections[ELF_SEC_TEXT].size, 16);
+    for (i = 0; i < obj->nsyms; ++i) {
+        if (obj->syms[i].sec != ELF_SEC_NONE)
+            continue;
+        if ((target = jit_resolve(res, &obj->syms[i])) == 0)
+            continue;
+
+        mu_jit_stub(stub, target);
+        res->stubs[i] = (uintptr_t)stub;
+        stub += stubsize;
+    }
+
+    for (sec = ELF_SEC_TEXT; sec < ELF_SEC_MAX; ++sec) {
+        if (jit_relocate(res, obj, sec) < 0) {
+            jit_unload(res);
+            return -1;
+        }
+    }
+
+    if (mprotect(res->base, textend, PROT_READ | PROT_EXEC) < 0) {
+        jit_unload(res);
+        return -1;
+    }
+
+    return 0;
+}
+
+void *
+jit_sym(const struct jit_image *img, const struct elf_obj *obj,
+    const char *name)
+{
+    const struct elf_sym *sym;
+    size_t i;
+
+    if (img == NULL || obj == NULL || name == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < obj->nsyms; ++i) {
+        sym = &obj->syms[i];
+        if (sym->sec == ELF_SEC_NONE)
+            continue;
+        if (strcmp(sym->name, name) == 0)
+            return (void *)jit_resolve(img, sym);
+    }
+
+    return NULL;
+}
+
+void
+jit_unload(struct jit_image *img)
+{
+    if (img == NULL) {
+        return;
+    }
+
+    if (img->base != NULL) {
+        munmap(img->base, img->size);
+    }
+
+    free(img->stubs);
+    img->stubs = NULL;
+    img->base = NULL;
+}
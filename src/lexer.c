@@ -3,6 +3,7 @@
  * Provided under the BSD-3 clause.
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -13,6 +14,7 @@
 #include "gup/lexer.h"
 #include "gup/state.h"
 #include "gup/ptrbox.h"
+#include "gup/trace.h"
 
 /*
  * Returns true if the given input character counts
@@ -86,9 +88,8 @@ lexer_consume(struct gup_state *state, bool accept_ws)
      * Begin reading bytes from the input source and if we
      * can, skip all whitespace encountered.
      */
-    while (read(state->in_fd, &c, 1) > 0) {
-        if (c == '\n')
-            ++state->line_num;
+    while (state->in_off < state->in_len) {
+        c = state->in_buf[state->in_off++];
         if (!accept_ws && lexer_is_ws(c))
             continue;
 
@@ -98,6 +99,64 @@ lexer_consume(struct gup_state *state, bool accept_ws)
     return '\0';
 }
 
+/*
+ * Skip over a comment, the opening '/' has already been
+ * consumed
+ *
+ * @state: Compiler state
+ *
+ * Returns zero if a comment was skipped, a value of 1 if the
+ * '/' does not begin a comment and less than zero on error.
+ */
+static int
+lexer_skip_comment(struct gup_state *state)
+{
+    const char *start, *end, *p;
+
+    if (state == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    start = &state->in_buf[state->in_off];
+    end = &state->in_buf[state->in_len];
+    if (start >= end) {
+        return 1;
+    }
+
+    switch (*start++) {
+    case '/':
+        /*
+         * Leave the newline in place so that directives like
+         * '#define' still see the end of their line.
+         */
+        p = memchr(start, '\n', end - start);
+        state->in_off = (p == NULL) ? state->in_len : p - state->in_buf;
+        return 0;
+    case '*':
+        for (p = start; p < end; ++p) {
+            p = memchr(p, '*', end - p);
+            if (p == NULL || p + 1 >= end) {
+                break;
+            }
+
+            if (p[1] != '/') {
+                continue;
+            }
+
+            state->in_off = (p + 2) - state->in_buf;
+            return 0;
+        }
+
+        state->tok_off = start - state->in_buf - 2;
+        state->in_off = state->in_len;
+        trace_error(state, "unterminated comment\n");
+        return -1;
+    }
+
+    return 1;
+}
+
 /*
  * Scan for an identifiers
  *
@@ -163,6 +222,164 @@ lexer_scan_ident(struct gup_state *state, int lc, struct token *res)
     return 0;
 }
 
+/*
+ * Scan a numeric literal, either decimal or hexadecimal
+ * with a '0x' prefix
+ *
+ * @state: Compiler state
+ * @lc:    Last character
+ * @res:   Token result
+ *
+ * Returns zero on success
+ */
+static int
+lexer_scan_number(struct gup_state *state, int lc, struct token *res)
+{
+    uint64_t v = 0;
+    int base = 10;
+    char c;
+
+    if (state == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (!isdigit(lc)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    c = state->in_buf[state->in_off];
+    if (lc == '0' && (c == 'x' || c == 'X')) {
+        ++state->in_off;
+        base = 16;
+    } else {
+        v = lc - '0';
+    }
+
+    while (state->in_off < state->in_len) {
+        c = state->in_buf[state->in_off];
+        if (isdigit(c)) {
+            c -= '0';
+        } else if (base == 16 && isxdigit(c)) {
+            c = (tolower(c) - 'a') + 10;
+        } else if (isalpha(c) || c == '_') {
+            trace_error(state, "bad numeric literal\n");
+            return -1;
+        } else {
+            break;
+        }
+
+        v = (v * base) + c;
+        ++state->in_off;
+    }
+
+    res->type = TT_NUMBER;
+    res->v = v;
+    return 0;
+}
+
+/*
+ * Decode an escape sequence within a string literal, the
+ * backslash has already been consumed
+ *
+ * @state: Compiler state
+ *
+ * Returns the decoded byte, otherwise a value less than zero
+ * on an invalid escape.
+ */
+static int
+lexer_scan_escape(struct gup_state *state)
+{
+    char c;
+
+    if (state->in_off >= state->in_len) {
+        return -1;
+    }
+
+    c = state->in_buf[state->in_off++];
+    switch (c) {
+    case 'n':   return '\n';
+    case 't':   return '\t';
+    case 'r':   return '\r';
+    case '0':   return '\0';
+    case '\\':  return '\\';
+    case '"':   return '"';
+    case '\'':  return '\'';
+    }
+
+    return -1;
+}
+
+/*
+ * Scan a string literal, the opening quote has already
+ * been consumed
+ *
+ * @state: Compiler state
+ * @res:   Token result
+ *
+ * Returns zero on success
+ */
+static int
+lexer_scan_string(struct gup_state *state, struct token *res)
+{
+    const char *start, *end, *limit;
+    char *buf;
+    size_t bufsz = 0;
+    int c;
+
+    if (state == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /*
+     * The decoded literal can never be longer than its span in
+     * the source, so size the buffer by locating the closing
+     * quote (or whatever ends the literal early) first. Every
+     * escape is two characters.
+     */
+    start = &state->in_buf[state->in_off];
+    limit = &state->in_buf[state->in_len];
+    for (end = start; end < limit && *end != '"' && *end != '\n'; ++end) {
+        if (*end == '\\' && end + 1 < limit)
+            ++end;
+    }
+
+    buf = ptrbox_alloc(&state->ptrbox, (end - start) + 1);
+    if (buf == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    while (state->in_off < state->in_len) {
+        c = state->in_buf[state->in_off++];
+        switch (c) {
+        case '"':
+            buf[bufsz] = '\0';
+            res->type = TT_STRING;
+            res->s = buf;
+            res->len = bufsz;
+            return 0;
+        case '\n':
+            trace_error(state, "newline in string literal\n");
+            return -1;
+        case '\\':
+            if ((c = lexer_scan_escape(state)) < 0) {
+                trace_error(state, "bad escape in string literal\n");
+                return -1;
+            }
+
+            break;
+        }
+
+        buf[bufsz++] = c;
+    }
+
+    trace_error(state, "unterminated string literal\n");
+    return -1;
+}
+
 /*
  * Check if an identifier token is actually a keyword
  * and override it if so
@@ -204,6 +421,115 @@ lexer_check_kw(struct token *tok)
             return 0;
         }
 
+        break;
+    case 'u':
+        if (strcmp(tok->s, "u8") == 0) {
+            tok->type = TT_U8;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "u16") == 0) {
+            tok->type = TT_U16;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "u32") == 0) {
+            tok->type = TT_U32;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "u64") == 0) {
+            tok->type = TT_U64;
+            return 0;
+        }
+
+        break;
+    case 't':
+        if (strcmp(tok->s, "tail") == 0) {
+            tok->type = TT_TAIL;
+            return 0;
+        }
+
+        break;
+    case 'r':
+        if (strcmp(tok->s, "return") == 0) {
+            tok->type = TT_RETURN;
+            return 0;
+        }
+
+        break;
+    case 'i':
+        if (strcmp(tok->s, "if") == 0) {
+            tok->type = TT_IF;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "inline") == 0) {
+            tok->type = TT_INLINE;
+            return 0;
+        }
+
+        break;
+    case 'n':
+        if (strcmp(tok->s, "noinline") == 0) {
+            tok->type = TT_NOINLINE;
+            return 0;
+        }
+
+        break;
+    case 'e':
+        if (strcmp(tok->s, "else") == 0) {
+            tok->type = TT_ELSE;
+            return 0;
+        }
+
+        break;
+    case 'w':
+        if (strcmp(tok->s, "while") == 0) {
+            tok->type = TT_WHILE;
+            return 0;
+        }
+
+        break;
+    case 'f':
+        if (strcmp(tok->s, "for") == 0) {
+            tok->type = TT_FOR;
+            return 0;
+        }
+
+        break;
+    case 'b':
+        if (strcmp(tok->s, "break") == 0) {
+            tok->type = TT_BREAK;
+            return 0;
+        }
+
+        break;
+    case 'c':
+        if (strcmp(tok->s, "continue") == 0) {
+            tok->type = TT_CONTINUE;
+            return 0;
+        }
+
+        if (strcmp(tok->s, "case") == 0) {
+            tok->type = TT_CASE;
+            return 0;
+        }
+
+        break;
+    case 's':
+        if (strcmp(tok->s, "switch") == 0) {
+            tok->type = TT_SWITCH;
+            return 0;
+        }
+
+        break;
+    case 'd':
+        if (strcmp(tok->s, "default") == 0) {
+            tok->type = TT_DEFAULT;
+            return 0;
+        }
+
         break;
     case 'v':
         if (strcmp(tok->s, "void") == 0) {
@@ -244,6 +570,10 @@ lexer_scan(struct gup_state *state, struct token *res)
         return -1;
     }
 
+    /* The character consumed always sits just before the offset */
+    res->off = state->in_off - 1;
+    state->tok_off = res->off;
+
     switch (c) {
     case '\n':
         res->type = TT_NEWLINE;
@@ -268,6 +598,15 @@ lexer_scan(struct gup_state *state, struct token *res)
         res->c = c;
         return 0;
     case '/':
+        switch (lexer_skip_comment(state)) {
+        case 0:
+            return lexer_scan(state, res);
+        case 1:
+            break;
+        default:
+            return -1;
+        }
+
         res->type = TT_SLASH;
         res->c = c;
         return 0;
@@ -311,7 +650,40 @@ lexer_scan(struct gup_state *state, struct token *res)
         res->type = TT_SEMI;
         res->c = c;
         return 0;
+    case ',':
+        res->type = TT_COMMA;
+        res->c = c;
+        return 0;
+    case ':':
+        res->type = TT_COLON;
+        res->c = c;
+        return 0;
+    case '=':
+        res->type = TT_EQUALS;
+        res->c = c;
+        if ((c = lexer_consume(state, true)) != '=') {
+            lexer_putback(state, c);
+            return 0;
+        }
+
+        res->type = TT_EQEQ;
+        return 0;
+    case '!':
+        res->type = TT_NE;
+        res->c = c;
+        if ((c = lexer_consume(state, true)) != '=') {
+            lexer_putback(state, c);
+            break;
+        }
+
+        return 0;
+    case '"':
+        return lexer_scan_string(state, res);
     default:
+        if (isdigit(c)) {
+            return lexer_scan_number(state, c, res);
+        }
+
         if (lexer_scan_ident(state, c, res) == 0) {
             lexer_check_kw(res);
             return 0;
@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/opt.h"
+
+/* Most products of a single induction variable reduced */
+#define IVSR_MAX 8
+
+/*
+ * Loop optimization context
+ *
+ * Registers allocated after the context was set up are never
+ * looked at and count as defined within every loop.
+ *
+ * @func:   Function being rewritten
+ * @nregs:  Number of registers when the context was set up
+ * @ndefs:  Definition count (up to two), indexed by register
+ * @def:    Last definition, indexed by register
+ * @inside: Set if defined within the loop at hand, indexed by register
+ * @memory: Set if the loop at hand stores or calls
+ */
+struct loop_ctx {
+    struct ir_func *func;
+    ir_reg_t nregs;
+    uint8_t *ndefs;
+    struct ir_insn **def;
+    uint8_t *inside;
+    bool memory;
+};
+
+/*
+ * Represents the product of an induction variable and a
+ * loop invariant factor, kept in registers of its own
+ *
+ * @k:    Loop invariant factor
+ * @cur:  Product with the value the iteration started with
+ * @next: Product with the value stepped for the next iteration
+ */
+struct ivsr_prod {
+    ir_reg_t k;
+    ir_reg_t cur;
+    ir_reg_t next;
+};
+
+/*
+ * Add every block reaching a back edge without going through
+ * the header to a loop
+ *
+ * @loop:  Loop to add to, the header is already in it
+ * @latch: Block the back edge leaves from
+ * @stack: Work stack, room for every block
+ */
+static void
+loop_walk(struct ir_loop *loop, struct ir_block *latch, struct ir_block **stack)
+{
+    struct ir_block *block, *pred;
+    size_t i, n = 0;
+
+    if (loop->body[latch->id]) {
+        return;
+    }
+
+    loop->body[latch->id] = 1;
+    ++loop->size;
+    stack[n++] = latch;
+    while (n > 0) {
+        block = stack[--n];
+        for (i = 0; i < block->npreds; ++i) {
+            pred = block->preds[i];
+            if (loop->body[pred->id])
+                continue;
+
+            loop->body[pred->id] = 1;
+            ++loop->size;
+            stack[n++] = pred;
+        }
+    }
+}
+
+/*
+ * Find the block entering a loop, if there is a single one
+ * that goes nowhere else
+ *
+ * @loop: Loop to look at
+ */
+static void
+loop_entry(struct ir_loop *loop)
+{
+    struct ir_block *header = loop->header, *entry = NULL;
+    size_t i, nentry = 0;
+
+    for (i = 0; i < header->npreds; ++i) {
+        if (loop->body[header->preds[i]->id])
+            continue;
+
+        entry = header->preds[i];
+        ++nentry;
+    }
+
+    if (nentry == 1 && entry->nsuccs == 1) {
+        loop->pre = entry;
+    }
+}
+
+int
+ir_loop_find(struct ir_func *func, struct ir_loop_q *res)
+{
+    struct ir_block *block, *pred, **stack;
+    struct ir_loop *loop, *iter;
+    size_t i, nlatch;
+
+    if (func == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    stack = arena_alloc(func->arena, func->block_count * sizeof(*stack));
+    if (stack == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* An edge to a block dominating its source closes a loop */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        loop = NULL;
+        nlatch = 0;
+        for (i = 0; i < block->npreds; ++i) {
+            pred = block->preds[i];
+            if (!ir_dominates(block, pred))
+                continue;
+
+            if (loop == NULL) {
+                loop = arena_alloc(func->arena, sizeof(*loop));
+                if (loop == NULL) {
+                    errno = -ENOMEM;
+                    return -1;
+                }
+
+                loop->body = arena_alloc(func->arena, func->block_count);
+                if (loop->body == NULL) {
+                    errno = -ENOMEM;
+                    return -1;
+                }
+
+                loop->header = block;
+                loop->body[block->id] = 1;
+                loop->size = 1;
+            }
+
+            loop->latch = pred;
+            ++nlatch;
+            loop_walk(loop, pred, stack);
+        }
+
+        if (loop == NULL) {
+            continue;
+        }
+
+        if (nlatch > 1) {
+            loop->latch = NULL;
+        }
+
+        /* A loop within another one has fewer blocks */
+        loop_entry(loop);
+        TAILQ_FOREACH(iter, res, link) {
+            if (iter->size > loop->size)
+                break;
+        }
+
+        if (iter != NULL) {
+            TAILQ_INSERT_BEFORE(iter, loop, link);
+        } else {
+            TAILQ_INSERT_TAIL(res, loop, link);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Set up a loop optimization context
+ *
+ * @ctx:  Context to set up
+ * @func: Function being rewritten
+ *
+ * Returns zero on success
+ */
+static int
+loop_init(struct loop_ctx *ctx, struct ir_func *func)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->func = func;
+    ctx->nregs = func->reg_count;
+    ctx->ndefs = arena_alloc(func->arena, ctx->nregs + 1);
+    ctx->def = arena_alloc(func->arena, (ctx->nregs + 1) * sizeof(*ctx->def));
+    ctx->inside = arena_alloc(func->arena, ctx->nregs + 1);
+    if (ctx->ndefs == NULL || ctx->def == NULL || ctx->inside == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst == 0)
+                continue;
+            if (ctx->ndefs[insn->dst] < 2)
+                ++ctx->ndefs[insn->dst];
+
+            ctx->def[insn->dst] = insn;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the only definition of a register, NULL if it has
+ * several or is newer than the context
+ *
+ * @ctx: Loop context
+ * @reg: Register to look up
+ */
+static inline struct ir_insn *
+loop_def(struct loop_ctx *ctx, ir_reg_t reg)
+{
+    if (reg == 0 || reg > ctx->nregs || ctx->ndefs[reg] != 1) {
+        return NULL;
+    }
+
+    return ctx->def[reg];
+}
+
+/*
+ * Returns true if a register may change from one iteration
+ * of the loop at hand to the next
+ *
+ * @ctx: Loop context
+ * @reg: Register to check
+ */
+static inline bool
+loop_inside(struct loop_ctx *ctx, ir_reg_t reg)
+{
+    return reg > ctx->nregs || ctx->inside[reg];
+}
+
+/*
+ * Note what a loop defines and whether it touches memory
+ *
+ * @ctx:  Loop context
+ * @loop: Loop about to be rewritten
+ */
+static void
+loop_scan(struct loop_ctx *ctx, struct ir_loop *loop)
+{
+    struct ir_block *block;
+    struct ir_insn *insn;
+
+    memset(ctx->inside, 0, ctx->nregs + 1);
+    ctx->memory = false;
+    TAILQ_FOREACH(block, &ctx->func->blocks, link) {
+        if (!loop->body[block->id])
+            continue;
+
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst != 0 && insn->dst <= ctx->nregs)
+                ctx->inside[insn->dst] = 1;
+
+            switch (insn->op) {
+            case IR_STORE:
+            case IR_CALL:
+            case IR_TAIL:
+                ctx->memory = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Allocate an instruction with a fresh destination register
+ * in front of another one
+ *
+ * @ctx:   Loop context
+ * @block: Block to allocate in
+ * @pos:   Instruction to go in front of
+ * @op:    Instruction operation
+ * @res:   Instruction result
+ *
+ * Returns zero on success
+ */
+static int
+loop_insn(struct loop_ctx *ctx, struct ir_block *block, struct ir_insn *pos,
+    ir_op_t op, struct ir_insn **res)
+{
+    if (ir_insn_new(ctx->func, block, op, res) < 0) {
+        return -1;
+    }
+
+    TAILQ_REMOVE(&block->insns, *res, link);
+    TAILQ_INSERT_BEFORE(pos, *res, link);
+    (*res)->dst = ir_reg_new(ctx->func);
+    return 0;
+}
+
+/*
+ * Returns true if an instruction computes the same value on
+ * every iteration of the loop at hand
+ *
+ * @ctx:  Loop context
+ * @insn: Instruction to check
+ */
+static bool
+licm_invariant(struct loop_ctx *ctx, struct ir_insn *insn)
+{
+    size_t i;
+
+    if (!ir_is_pure(insn) || insn->op == IR_PHI || insn->op == IR_PARAM) {
+        return false;
+    }
+
+    /*
+     * Only globals and locals are ever loaded from, so a load
+     * is safe to do early as long as nothing changes memory.
+     */
+    if (insn->op == IR_LOAD && ctx->memory) {
+        return false;
+    }
+
+    if (loop_def(ctx, insn->dst) != insn) {
+        return false;
+    }
+
+    for (i = 0; i < ir_nuses(insn); ++i) {
+        if (loop_inside(ctx, *ir_use(insn, i)))
+            return false;
+    }
+
+    return true;
+}
+
+int
+ir_licm(struct ir_func *func, struct ir_loop_q *loops)
+{
+    struct loop_ctx ctx;
+    struct ir_loop *loop;
+    struct ir_block *block;
+    struct ir_insn *insn, *next, *term;
+    bool changed;
+
+    if (func == NULL || loops == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (loop_init(&ctx, func) < 0) {
+        return -1;
+    }
+
+    /*
+     * Inner loops go first, what leaves them lands in a block
+     * of the outer loop and may well leave that too.
+     */
+    TAILQ_FOREACH(loop, loops, link) {
+        if (loop->pre == NULL)
+            continue;
+
+        loop_scan(&ctx, loop);
+        term = ir_block_term(loop->pre);
+        do {
+            changed = false;
+            TAILQ_FOREACH(block, &func->blocks, link) {
+                if (!loop->body[block->id])
+                    continue;
+
+                for (insn = TAILQ_FIRST(&block->insns); insn != NULL; insn = next) {
+                    next = TAILQ_NEXT(insn, link);
+                    if (!licm_invariant(&ctx, insn))
+                        continue;
+
+                    TAILQ_REMOVE(&block->insns, insn, link);
+                    TAILQ_INSERT_BEFORE(term, insn, link);
+                    insn->block = loop->pre;
+                    ctx.inside[insn->dst] = 0;
+                    changed = true;
+                }
+            }
+        } while (changed);
+    }
+
+    return 0;
+}
+
+/*
+ * Emit the product of two loop invariant registers at the
+ * end of the block entering a loop, folding constants
+ *
+ * @ctx:  Loop context
+ * @loop: Loop being rewritten
+ * @a:    First factor
+ * @b:    Second factor
+ * @res:  Register holding the product
+ *
+ * Returns zero on success
+ */
+static int
+ivsr_mul(struct loop_ctx *ctx, struct ir_loop *loop, ir_reg_t a, ir_reg_t b,
+    ir_reg_t *res)
+{
+    struct ir_insn *da, *db, *insn;
+
+    da = loop_def(ctx, a);
+    db = loop_def(ctx, b);
+    if (da != NULL && da->op == IR_IMM && da->imm == 1) {
+        *res = b;
+        return 0;
+    }
+
+    if (db != NULL && db->op == IR_IMM && db->imm == 1) {
+        *res = a;
+        return 0;
+    }
+
+    if (loop_insn(ctx, loop->pre, ir_block_term(loop->pre), IR_MUL, &insn) < 0) {
+        return -1;
+    }
+
+    insn->src[0] = a;
+    insn->src[1] = b;
+    if ((da != NULL && da->op == IR_IMM && da->imm == 0) ||
+        (db != NULL && db->op == IR_IMM && db->imm == 0)) {
+        insn->op = IR_IMM;
+        insn->src[0] = 0;
+        insn->src[1] = 0;
+    } else if (da != NULL && db != NULL && da->op == IR_IMM && db->op == IR_IMM) {
+        insn->op = IR_IMM;
+        insn->imm = da->imm * db->imm;
+        insn->src[0] = 0;
+        insn->src[1] = 0;
+    }
+
+    *res = insn->dst;
+    return 0;
+}
+
+/*
+ * Give the product of an induction variable and a factor
+ * registers of its own, stepped right where the induction
+ * variable is
+ *
+ * @ctx:  Loop context
+ * @loop: Loop being rewritten
+ * @phi:  Phi of the induction variable in the header
+ * @inc:  Instruction stepping the induction variable
+ * @step: Amount it is stepped by
+ * @prod: Product to set up, 'k' is already filled in
+ *
+ * Returns zero on success
+ */
+static int
+ivsr_prod_new(struct loop_ctx *ctx, struct ir_loop *loop, struct ir_insn *phi,
+    struct ir_insn *inc, ir_reg_t step, struct ivsr_prod *prod)
+{
+    struct ir_block *header = loop->header;
+    struct ir_insn *cur, *next;
+    ir_reg_t base, delta;
+    size_t i;
+
+    for (i = 0; i < header->npreds && header->preds[i] != loop->pre; ++i);
+    if (ivsr_mul(ctx, loop, phi->args[i], prod->k, &base) < 0) {
+        return -1;
+    }
+
+    if (ivsr_mul(ctx, loop, step, prod->k, &delta) < 0) {
+        return -1;
+    }
+
+    if (loop_insn(ctx, header, phi, IR_PHI, &cur) < 0) {
+        return -1;
+    }
+
+    if (loop_insn(ctx, inc->block, TAILQ_NEXT(inc, link), inc->op, &next) < 0) {
+        return -1;
+    }
+
+    cur->argc = header->npreds;
+    cur->args = arena_alloc(ctx->func->arena, cur->argc * sizeof(*cur->args));
+    if (cur->args == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    cur->args[i] = base;
+    cur->args[1 - i] = next->dst;
+    next->src[0] = cur->dst;
+    next->src[1] = delta;
+    prod->cur = cur->dst;
+    prod->next = next->dst;
+    return 0;
+}
+
+/*
+ * Reduce the multiplications of a single induction variable
+ *
+ * @ctx:  Loop context
+ * @loop: Loop being rewritten
+ * @phi:  Phi that may be an induction variable
+ *
+ * Returns zero on success
+ */
+static int
+ivsr_iv(struct loop_ctx *ctx, struct ir_loop *loop, struct ir_insn *phi)
+{
+    struct ivsr_prod prods[IVSR_MAX], *prod;
+    struct ir_insn *inc, *insn;
+    struct ir_block *block;
+    ir_reg_t iv = phi->dst, next, step, x, k;
+    size_t i, j, nprods = 0;
+
+    /* The value coming around the back edge must be iv +/- step */
+    for (i = 0; i < phi->argc && loop->header->preds[i] != loop->latch; ++i);
+    next = phi->args[i];
+    inc = loop_def(ctx, next);
+    if (inc == NULL || !loop->body[inc->block->id]) {
+        return 0;
+    }
+
+    switch (inc->op) {
+    case IR_ADD:
+        step = (inc->src[0] == iv) ? inc->src[1] : 0;
+        if (inc->src[1] == iv)
+            step = inc->src[0];
+        break;
+    case IR_SUB:
+        step = (inc->src[0] == iv) ? inc->src[1] : 0;
+        break;
+    default:
+        return 0;
+    }
+
+    if (step == 0 || loop_inside(ctx, step)) {
+        return 0;
+    }
+
+    TAILQ_FOREACH(block, &ctx->func->blocks, link) {
+        if (!loop->body[block->id])
+            continue;
+
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op != IR_MUL || loop_def(ctx, insn->dst) != insn)
+                continue;
+
+            /* Either side may be the induction variable */
+            for (i = 0; i < 2; ++i) {
+                x = insn->src[i];
+                k = insn->src[1 - i];
+                if ((x == iv || x == next) && k != 0 && !loop_inside(ctx, k))
+                    break;
+            }
+
+            if (i == 2)
+                continue;
+
+            for (j = 0; j < nprods && prods[j].k != k; ++j);
+            prod = &prods[j];
+            if (j == nprods) {
+                if (nprods == IVSR_MAX)
+                    return 0;
+
+                prod->k = k;
+                if (ivsr_prod_new(ctx, loop, phi, inc, step, prod) < 0)
+                    return -1;
+
+                ++nprods;
+            }
+
+            insn->op = IR_COPY;
+            insn->src[0] = (x == iv) ? prod->cur : prod->next;
+            insn->src[1] = 0;
+        }
+    }
+
+    return 0;
+}
+
+int
+ir_ivsr(struct ir_func *func, struct ir_loop_q *loops)
+{
+    struct loop_ctx ctx;
+    struct ir_loop *loop;
+    struct ir_insn *insn;
+
+    if (func == NULL || loops == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (loop_init(&ctx, func) < 0) {
+        return -1;
+    }
+
+    /* Only loops entered one way and closed by one back edge */
+    TAILQ_FOREACH(loop, loops, link) {
+        if (loop->pre == NULL || loop->latch == NULL || loop->header->npreds != 2)
+            continue;
+
+        loop_scan(&ctx, loop);
+        TAILQ_FOREACH(insn, &loop->header->insns, link) {
+            if (insn->op != IR_PHI)
+                break;
+            if (insn->dst > ctx.nregs)
+                continue;
+            if (ivsr_iv(&ctx, loop, insn) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
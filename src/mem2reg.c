@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/opt.h"
+
+/*
+ * Promotion context
+ *
+ * @func:    Function being rewritten
+ * @promote: Set for slots being promoted, indexed by slot
+ * @slot_of: Slot plus one a register is the address of, indexed by register
+ * @cur:     Value each slot holds at the current point, indexed by slot
+ * @zero:    Register holding zero, for slots read before any store
+ * @base:    Registers above this are ours, phis already there
+ *           (from inlined code) are left alone
+ * @df:      Dominance frontier of each block, indexed by block ID
+ * @ndf:     Size of each dominance frontier
+ * @kids:    Blocks each block immediately dominates, indexed by block ID
+ * @nkids:   Number of blocks each block immediately dominates
+ */
+struct m2r_ctx {
+    struct ir_func *func;
+    uint8_t *promote;
+    size_t *slot_of;
+    ir_reg_t *cur;
+    ir_reg_t zero;
+    ir_reg_t base;
+    struct ir_block ***df;
+    size_t *ndf;
+    struct ir_block ***kids;
+    size_t *nkids;
+};
+
+/*
+ * Allocate a list of blocks, empty lists are left NULL
+ *
+ * @func:  Owning function
+ * @count: Number of blocks
+ * @res:   Result is written here
+ *
+ * Returns zero on success
+ */
+static int
+m2r_blocks(struct ir_func *func, size_t count, struct ir_block ***res)
+{
+    *res = NULL;
+    if (count == 0) {
+        return 0;
+    }
+
+    if ((*res = arena_alloc(func->arena, count * sizeof(**res))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Find the slots whose address is only ever loaded from or
+ * stored to, anything else lets the address escape
+ *
+ * @ctx: Promotion context
+ */
+static void
+m2r_candidates(struct m2r_ctx *ctx)
+{
+    struct ir_func *func = ctx->func;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    size_t i, slot;
+
+    memset(ctx->promote, 1, func->slot_count);
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op == IR_SLOT)
+                ctx->slot_of[insn->dst] = insn->imm + 1;
+        }
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            for (i = 0; i < ir_nuses(insn); ++i) {
+                if ((slot = ctx->slot_of[*ir_use(insn, i)]) == 0)
+                    continue;
+
+                --slot;
+                if (i != 0 || (insn->op != IR_LOAD && insn->op != IR_STORE))
+                    ctx->promote[slot] = 0;
+                else if (insn->size != func->slot_size[slot])
+                    ctx->promote[slot] = 0;
+            }
+        }
+    }
+}
+
+/*
+ * Compute dominance frontiers and the dominator tree
+ *
+ * @ctx: Promotion context
+ *
+ * Returns zero on success
+ */
+static int
+m2r_dom_info(struct m2r_ctx *ctx)
+{
+    struct ir_func *func = ctx->func;
+    struct ir_block *block, *runner, **last;
+    size_t i, pass;
+
+    if (m2r_blocks(func, func->block_count, &last) < 0) {
+        return -1;
+    }
+
+    /*
+     * A join is in the frontier of every block on the way up
+     * from each predecessor to the immediate dominator of the
+     * join. Counted first, filled in on the second pass.
+     */
+    for (pass = 0; pass < 2; ++pass) {
+        TAILQ_FOREACH(block, &func->blocks, link) {
+            if (block->npreds < 2)
+                continue;
+
+            for (i = 0; i < block->npreds; ++i) {
+                runner = block->preds[i];
+                while (runner != block->idom) {
+                    if (last[runner->id] == block)
+                        break;
+
+                    last[runner->id] = block;
+                    if (pass == 0)
+                        ++ctx->ndf[runner->id];
+                    else
+                        ctx->df[runner->id][ctx->ndf[runner->id]++] = block;
+
+                    runner = runner->idom;
+                }
+            }
+        }
+
+        if (pass > 0) {
+            break;
+        }
+
+        TAILQ_FOREACH(block, &func->blocks, link) {
+            if (m2r_blocks(func, ctx->ndf[block->id], &ctx->df[block->id]) < 0)
+                return -1;
+
+            ctx->ndf[block->id] = 0;
+            last[block->id] = NULL;
+        }
+    }
+
+    /* Same again for the dominator tree */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if (block->idom != NULL)
+            ++ctx->nkids[block->idom->id];
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if (m2r_blocks(func, ctx->nkids[block->id], &ctx->kids[block->id]) < 0)
+            return -1;
+
+        ctx->nkids[block->id] = 0;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if (block->idom != NULL) {
+            runner = block->idom;
+            ctx->kids[runner->id][ctx->nkids[runner->id]++] = block;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Place phis for a slot wherever two of its stores meet,
+ * the iterated dominance frontier of the stores
+ *
+ * @ctx:  Promotion context
+ * @slot: Slot to place phis for
+ * @work: Worklist with room for every block
+ * @mark: Per block ID, set to slot + 1 once queued
+ * @has:  Per block ID, set to slot + 1 once given a phi
+ *
+ * Returns zero on success
+ */
+static int
+m2r_place(struct m2r_ctx *ctx, size_t slot, struct ir_block **work,
+    size_t *mark, size_t *has)
+{
+    struct ir_func *func = ctx->func;
+    struct ir_block *block, *join;
+    struct ir_insn *insn, *phi;
+    size_t i, nwork = 0;
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op != IR_STORE || ctx->slot_of[insn->src[0]] != slot + 1)
+                continue;
+
+            mark[block->id] = slot + 1;
+            work[nwork++] = block;
+            break;
+        }
+    }
+
+    while (nwork > 0) {
+        block = work[--nwork];
+        for (i = 0; i < ctx->ndf[block->id]; ++i) {
+            join = ctx->df[block->id][i];
+            if (has[join->id] == slot + 1)
+                continue;
+
+            if (ir_insn_new(func, join, IR_PHI, &phi) < 0) {
+                return -1;
+            }
+
+            /* Phis come first */
+            TAILQ_REMOVE(&join->insns, phi, link);
+            TAILQ_INSERT_HEAD(&join->insns, phi, link);
+            phi->dst = ir_reg_new(func);
+            phi->imm = slot;
+            phi->argc = join->npreds;
+            phi->args = arena_alloc(func->arena, join->npreds * sizeof(*phi->args));
+            if (phi->args == NULL) {
+                errno = -ENOMEM;
+                return -1;
+            }
+
+            has[join->id] = slot + 1;
+            if (mark[join->id] != slot + 1) {
+                mark[join->id] = slot + 1;
+                work[nwork++] = join;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the register holding the value of a slot at the
+ * current point
+ *
+ * @ctx:  Promotion context
+ * @slot: Slot to read
+ */
+static ir_reg_t
+m2r_value(struct m2r_ctx *ctx, size_t slot)
+{
+    struct ir_block *entry;
+    struct ir_insn *insn, *after = NULL;
+
+    if (ctx->cur[slot] != 0) {
+        return ctx->cur[slot];
+    }
+
+    if (ctx->zero != 0) {
+        return ctx->zero;
+    }
+
+    /* Placed after the parameters, which must be picked up first */
+    entry = TAILQ_FIRST(&ctx->func->blocks);
+    TAILQ_FOREACH(insn, &entry->insns, link) {
+        if (insn->op != IR_PARAM)
+            break;
+
+        after = insn;
+    }
+
+    if (ir_insn_new(ctx->func, entry, IR_IMM, &insn) < 0) {
+        return 0;
+    }
+
+    TAILQ_REMOVE(&entry->insns, insn, link);
+    if (after != NULL) {
+        TAILQ_INSERT_AFTER(&entry->insns, after, insn, link);
+    } else {
+        TAILQ_INSERT_HEAD(&entry->insns, insn, link);
+    }
+
+    insn->dst = ir_reg_new(ctx->func);
+    ctx->zero = insn->dst;
+    return ctx->zero;
+}
+
+/*
+ * Rewrite the loads and stores of promoted slots within a
+ * block and the blocks it dominates
+ *
+ * @ctx:   Promotion context
+ * @block: Block to rewrite
+ *
+ * Returns zero on success
+ */
+static int
+m2r_rename(struct m2r_ctx *ctx, struct ir_block *block)
+{
+    struct ir_func *func = ctx->func;
+    struct ir_block *succ;
+    struct ir_insn *insn, *next;
+    ir_reg_t *saved;
+    size_t i, j, slot;
+
+    if ((saved = arena_alloc(func->arena, func->slot_count * sizeof(*saved))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    memcpy(saved, ctx->cur, func->slot_count * sizeof(*saved));
+    for (insn = TAILQ_FIRST(&block->insns); insn != NULL; insn = next) {
+        next = TAILQ_NEXT(insn, link);
+        switch (insn->op) {
+        case IR_PHI:
+            if (insn->dst > ctx->base)
+                ctx->cur[insn->imm] = insn->dst;
+            break;
+        case IR_LOAD:
+            if ((slot = ctx->slot_of[insn->src[0]]) == 0 || !ctx->promote[slot - 1])
+                break;
+
+            insn->op = IR_COPY;
+            insn->size = 0;
+            if ((insn->src[0] = m2r_value(ctx, slot - 1)) == 0)
+                return -1;
+            break;
+        case IR_STORE:
+            if ((slot = ctx->slot_of[insn->src[0]]) == 0 || !ctx->promote[slot - 1])
+                break;
+
+            /* The store truncated, loads zero extended */
+            if (insn->size < 8) {
+                insn->op = IR_ZEXT;
+                insn->dst = ir_reg_new(func);
+                insn->src[0] = insn->src[1];
+                insn->src[1] = 0;
+                ctx->cur[slot - 1] = insn->dst;
+                break;
+            }
+
+            ctx->cur[slot - 1] = insn->src[1];
+            TAILQ_REMOVE(&block->insns, insn, link);
+            break;
+        case IR_SLOT:
+            if (ctx->promote[insn->imm])
+                TAILQ_REMOVE(&block->insns, insn, link);
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (i = 0; i < block->nsuccs; ++i) {
+        succ = block->succs[i];
+        for (j = 0; j < succ->npreds && succ->preds[j] != block; ++j);
+        TAILQ_FOREACH(insn, &succ->insns, link) {
+            if (insn->op != IR_PHI)
+                break;
+            if (insn->dst <= ctx->base)
+                continue;
+            if ((insn->args[j] = m2r_value(ctx, insn->imm)) == 0)
+                return -1;
+        }
+    }
+
+    for (i = 0; i < ctx->nkids[block->id]; ++i) {
+        if (m2r_rename(ctx, ctx->kids[block->id][i]) < 0)
+            return -1;
+    }
+
+    memcpy(ctx->cur, saved, func->slot_count * sizeof(*saved));
+    return 0;
+}
+
+/*
+ * Give the slots left in memory consecutive indices
+ *
+ * @ctx: Promotion context
+ *
+ * Returns zero on success
+ */
+static int
+m2r_compact(struct m2r_ctx *ctx)
+{
+    struct ir_func *func = ctx->func;
+    struct ir_block *block;
+    struct ir_insn *insn;
+    size_t slot, count = 0, *remap;
+
+    if (func->slot_count == 0) {
+        return 0;
+    }
+
+    remap = arena_alloc(func->arena, func->slot_count * sizeof(*remap));
+    if (remap == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (slot = 0; slot < func->slot_count; ++slot) {
+        if (ctx->promote[slot])
+            continue;
+
+        remap[slot] = count;
+        func->slot_size[count++] = func->slot_size[slot];
+    }
+
+    func->slot_count = count;
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op == IR_SLOT)
+                insn->imm = remap[insn->imm];
+        }
+    }
+
+    return 0;
+}
+
+int
+ir_mem2reg(struct ir_func *func)
+{
+    struct m2r_ctx ctx;
+    struct ir_block **work;
+    size_t *mark, *has;
+    size_t slot;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Nothing to promote, or no edge-free entry to start from */
+    if (func->slot_count == 0 || TAILQ_FIRST(&func->blocks)->npreds > 0) {
+        return 0;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.func = func;
+    ctx.base = func->reg_count;
+    ctx.promote = arena_alloc(func->arena, func->slot_count);
+    ctx.cur = arena_alloc(func->arena, func->slot_count * sizeof(*ctx.cur));
+    ctx.slot_of = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.slot_of));
+    ctx.df = arena_alloc(func->arena, func->block_count * sizeof(*ctx.df));
+    ctx.ndf = arena_alloc(func->arena, func->block_count * sizeof(*ctx.ndf));
+    ctx.kids = arena_alloc(func->arena, func->block_count * sizeof(*ctx.kids));
+    ctx.nkids = arena_alloc(func->arena, func->block_count * sizeof(*ctx.nkids));
+    if (ctx.promote == NULL || ctx.cur == NULL || ctx.slot_of == NULL ||
+        ctx.df == NULL || ctx.ndf == NULL || ctx.kids == NULL || ctx.nkids == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    work = arena_alloc(func->arena, func->block_count * sizeof(*work));
+    mark = arena_alloc(func->arena, func->block_count * sizeof(*mark));
+    has = arena_alloc(func->arena, func->block_count * sizeof(*has));
+    if (work == NULL || mark == NULL || has == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    m2r_candidates(&ctx);
+    if (m2r_dom_info(&ctx) < 0) {
+        return -1;
+    }
+
+    for (slot = 0; slot < func->slot_count; ++slot) {
+        if (!ctx.promote[slot])
+            continue;
+        if (m2r_place(&ctx, slot, work, mark, has) < 0)
+            return -1;
+    }
+
+    if (m2r_rename(&ctx, TAILQ_FIRST(&func->blocks)) < 0) {
+        return -1;
+    }
+
+    return m2r_compact(&ctx);
+}
+
+int
+ir_ssa_lower(struct ir_func *func)
+{
+    struct ir_block *block, *pred;
+    struct ir_insn *insn, *copy, *term;
+    ir_reg_t tmp;
+    size_t i;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /*
+     * Every incoming value goes through a fresh register copied
+     * at the end of the predecessor, so phis read all their
+     * values before any of them is written.
+     */
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->op != IR_PHI)
+                continue;
+
+            tmp = ir_reg_new(func);
+            for (i = 0; i < insn->argc; ++i) {
+                pred = block->preds[i];
+                term = ir_block_term(pred);
+                if (ir_insn_new(func, pred, IR_COPY, &copy) < 0)
+                    return -1;
+
+                TAILQ_REMOVE(&pred->insns, copy, link);
+                TAILQ_INSERT_BEFORE(term, copy, link);
+                copy->dst = tmp;
+                copy->src[0] = insn->args[i];
+            }
+
+            insn->op = IR_COPY;
+            insn->src[0] = tmp;
+            insn->imm = 0;
+            insn->args = NULL;
+            insn->argc = 0;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "gup/opt.h"
+
+/*
+ * Lowering context
+ *
+ * Registers defined more than once (inlined returns) are
+ * never taken to be constant.
+ *
+ * @func:  Function being rewritten
+ * @nregs: Number of registers when the context was set up
+ * @ndefs: Definition count (up to two), indexed by register
+ * @def:   Last definition, indexed by register
+ */
+struct muldiv_ctx {
+    struct ir_func *func;
+    ir_reg_t nregs;
+    uint8_t *ndefs;
+    struct ir_insn **def;
+};
+
+/*
+ * Returns true if a register always holds the same constant
+ *
+ * @ctx: Lowering context
+ * @reg: Register to check
+ * @res: Constant is written here
+ */
+static bool
+muldiv_const(struct muldiv_ctx *ctx, ir_reg_t reg, uint64_t *res)
+{
+    struct ir_insn *def;
+
+    if (reg == 0 || reg > ctx->nregs || ctx->ndefs[reg] != 1) {
+        return false;
+    }
+
+    def = ctx->def[reg];
+    if (def->op != IR_IMM) {
+        return false;
+    }
+
+    *res = def->imm;
+    return true;
+}
+
+/*
+ * Returns the base two logarithm of a value, rounded down
+ *
+ * @v: Value, must not be zero
+ */
+static inline uint8_t
+muldiv_log2(uint64_t v)
+{
+    uint8_t l = 0;
+
+    while (v >>= 1) {
+        ++l;
+    }
+
+    return l;
+}
+
+/*
+ * Divide a 128-bit value by a 64-bit one, the quotient must
+ * fit in 64 bits (hi < d)
+ *
+ * @hi:  High half of the dividend
+ * @lo:  Low half of the dividend
+ * @d:   Divisor
+ * @rem: Remainder is written here
+ */
+static uint64_t
+muldiv_div128(uint64_t hi, uint64_t lo, uint64_t d, uint64_t *rem)
+{
+    uint64_t q = 0;
+    bool carry;
+    int i;
+
+    for (i = 63; i >= 0; --i) {
+        carry = (hi >> 63) != 0;
+        hi = (hi << 1) | ((lo >> i) & 1);
+        q <<= 1;
+        if (carry || hi >= d) {
+            hi -= d;
+            q |= 1;
+        }
+    }
+
+    *rem = hi;
+    return q;
+}
+
+/*
+ * Allocate an instruction with a fresh destination register
+ * in front of another one
+ *
+ * @ctx: Lowering context
+ * @pos: Instruction to go in front of
+ * @op:  Instruction operation
+ * @res: Instruction result
+ *
+ * Returns zero on success
+ */
+static int
+muldiv_insn(struct muldiv_ctx *ctx, struct ir_insn *pos, ir_op_t op,
+    struct ir_insn **res)
+{
+    struct ir_block *block = pos->block;
+
+    if (ir_insn_new(ctx->func, block, op, res) < 0) {
+        return -1;
+    }
+
+    TAILQ_REMOVE(&block->insns, *res, link);
+    TAILQ_INSERT_BEFORE(pos, *res, link);
+    (*res)->dst = ir_reg_new(ctx->func);
+    return 0;
+}
+
+/*
+ * Turn an instruction into a shift of a register
+ *
+ * @insn:  Instruction to rewrite
+ * @op:    IR_SHL or IR_SHR
+ * @src:   Register to shift
+ * @count: Shift count
+ */
+static void
+muldiv_shift(struct ir_insn *insn, ir_op_t op, ir_reg_t src, uint8_t count)
+{
+    if (count == 0) {
+        insn->op = IR_COPY;
+    } else {
+        insn->op = op;
+    }
+
+    insn->src[0] = src;
+    insn->src[1] = 0;
+    insn->imm = count;
+}
+
+/*
+ * Lower a multiplication by a power of two, other constants
+ * are moved to the right where the backend can see them
+ *
+ * @ctx:  Lowering context
+ * @insn: IR_MUL instruction
+ */
+static void
+muldiv_mul(struct muldiv_ctx *ctx, struct ir_insn *insn)
+{
+    uint64_t c;
+    ir_reg_t src;
+
+    if (muldiv_const(ctx, insn->src[0], &c)) {
+        src = insn->src[0];
+        insn->src[0] = insn->src[1];
+        insn->src[1] = src;
+    }
+
+    if (!muldiv_const(ctx, insn->src[1], &c)) {
+        return;
+    }
+
+    if (c != 0 && (c & (c - 1)) == 0) {
+        muldiv_shift(insn, IR_SHL, insn->src[0], muldiv_log2(c));
+    }
+}
+
+/*
+ * Lower a division by a constant, the quotient is found by
+ * multiplying with a fixed point reciprocal of the divisor
+ * and keeping the high half of the product
+ *
+ * @ctx:  Lowering context
+ * @insn: IR_DIV instruction
+ *
+ * Returns zero on success
+ */
+static int
+muldiv_div(struct muldiv_ctx *ctx, struct ir_insn *insn)
+{
+    struct ir_insn *imm, *hi, *sub, *half, *add;
+    uint64_t d, m, rem, twice;
+    ir_reg_t n = insn->src[0];
+    uint8_t l;
+
+    /* Division by zero is left to trap at runtime */
+    if (!muldiv_const(ctx, insn->src[1], &d) || d == 0) {
+        return 0;
+    }
+
+    l = muldiv_log2(d);
+    if ((d & (d - 1)) == 0) {
+        muldiv_shift(insn, IR_SHR, n, l);
+        return 0;
+    }
+
+    /* Past half the range the quotient can only be zero or one */
+    if (l == 63) {
+        insn->op = IR_GE;
+        return 0;
+    }
+
+    /*
+     * m = 2^(64 + l) / d rounded down. Rounded up it is exact
+     * enough on its own if the error stays under 2^l, if not
+     * one more bit of precision is needed, its top bit does
+     * not fit and is added back in by hand.
+     */
+    m = muldiv_div128((uint64_t)1 << l, 0, d, &rem);
+    if (d - rem >= ((uint64_t)1 << l)) {
+        twice = rem + rem;
+        m += m;
+        if (twice >= d || twice < rem)
+            ++m;
+    }
+
+    if (muldiv_insn(ctx, insn, IR_IMM, &imm) < 0) {
+        return -1;
+    }
+
+    imm->imm = m + 1;
+    if (muldiv_insn(ctx, insn, IR_MULH, &hi) < 0) {
+        return -1;
+    }
+
+    hi->src[0] = n;
+    hi->src[1] = imm->dst;
+    if (d - rem < ((uint64_t)1 << l)) {
+        muldiv_shift(insn, IR_SHR, hi->dst, l);
+        return 0;
+    }
+
+    /* ((n - hi) / 2 + hi) can't overflow like (n + hi) would */
+    if (muldiv_insn(ctx, insn, IR_SUB, &sub) < 0) {
+        return -1;
+    }
+
+    sub->src[0] = n;
+    sub->src[1] = hi->dst;
+    if (muldiv_insn(ctx, insn, IR_SHR, &half) < 0) {
+        return -1;
+    }
+
+    half->src[0] = sub->dst;
+    half->imm = 1;
+    if (muldiv_insn(ctx, insn, IR_ADD, &add) < 0) {
+        return -1;
+    }
+
+    add->src[0] = half->dst;
+    add->src[1] = hi->dst;
+    muldiv_shift(insn, IR_SHR, add->dst, l);
+    return 0;
+}
+
+int
+ir_muldiv(struct ir_func *func)
+{
+    struct muldiv_ctx ctx;
+    struct ir_block *block;
+    struct ir_insn *insn;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    ctx.func = func;
+    ctx.nregs = func->reg_count;
+    ctx.ndefs = arena_alloc(func->arena, ctx.nregs + 1);
+    ctx.def = arena_alloc(func->arena, (ctx.nregs + 1) * sizeof(*ctx.def));
+    if (ctx.ndefs == NULL || ctx.def == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            if (insn->dst == 0)
+                continue;
+            if (ctx.ndefs[insn->dst] < 2)
+                ++ctx.ndefs[insn->dst];
+
+            ctx.def[insn->dst] = insn;
+        }
+    }
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        TAILQ_FOREACH(insn, &block->insns, link) {
+            switch (insn->op) {
+            case IR_MUL:
+                muldiv_mul(&ctx, insn);
+                break;
+            case IR_DIV:
+                if (muldiv_div(&ctx, insn) < 0)
+                    return -1;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
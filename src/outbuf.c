@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <sys/uio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include "gup/outbuf.h"
+
+/*
+ * Move on to the next chunk, writing every chunk out first
+ * if they are all full
+ *
+ * @ob: Buffer to advance
+ *
+ * Returns zero on success
+ */
+static int
+outbuf_next(struct outbuf *ob)
+{
+    ob->fill[ob->cur] = ob->len;
+    if (ob->cur + 1 >= OUTBUF_CHUNK_MAX) {
+        return outbuf_flush(ob);
+    }
+
+    ++ob->cur;
+    if (ob->chunks[ob->cur] == NULL) {
+        ob->chunks[ob->cur] = malloc(OUTBUF_CHUNK_SIZE);
+        if (ob->chunks[ob->cur] == NULL) {
+            --ob->cur;
+            ob->error = 1;
+            errno = -ENOMEM;
+            return -1;
+        }
+    }
+
+    ob->head = ob->chunks[ob->cur];
+    ob->len = 0;
+    return 0;
+}
+
+int
+outbuf_init(struct outbuf *res, int fd)
+{
+    if (res == NULL || fd < 0) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    res->fd = fd;
+    res->chunks[0] = malloc(OUTBUF_CHUNK_SIZE);
+    if (res->chunks[0] == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    res->head = res->chunks[0];
+    return 0;
+}
+
+int
+outbuf_flush(struct outbuf *ob)
+{
+    struct iovec iov[OUTBUF_CHUNK_MAX];
+    struct iovec *vp = iov;
+    size_t i, count = 0;
+    ssize_t n;
+
+    if (ob == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    ob->fill[ob->cur] = ob->len;
+    for (i = 0; i <= ob->cur; ++i) {
+        if (ob->fill[i] == 0)
+            continue;
+
+        iov[count].iov_base = ob->chunks[i];
+        iov[count++].iov_len = ob->fill[i];
+    }
+
+    /* Everything goes out in as few system calls as possible */
+    while (count > 0 && !ob->error) {
+        n = writev(ob->fd, vp, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ob->error = 1;
+            break;
+        }
+
+        while (count > 0 && (size_t)n >= vp->iov_len) {
+            n -= vp->iov_len;
+            ++vp;
+            --count;
+        }
+
+        if (count > 0) {
+            vp->iov_base = (char *)vp->iov_base + n;
+            vp->iov_len -= n;
+        }
+    }
+
+    for (i = 0; i <= ob->cur; ++i) {
+        ob->fill[i] = 0;
+    }
+
+    ob->cur = 0;
+    ob->head = ob->chunks[0];
+    ob->len = 0;
+    return ob->error ? -1 : 0;
+}
+
+void
+outbuf_destroy(struct outbuf *ob)
+{
+    size_t i;
+
+    if (ob == NULL) {
+        return;
+    }
+
+    for (i = 0; i < OUTBUF_CHUNK_MAX; ++i) {
+        free(ob->chunks[i]);
+        ob->chunks[i] = NULL;
+    }
+
+    ob->head = NULL;
+}
+
+int
+outbuf_write_slow(struct outbuf *ob, const void *data, size_t len)
+{
+    const char *p = data;
+    size_t n;
+
+    while (len > 0) {
+        n = OUTBUF_CHUNK_SIZE - ob->len;
+        if (n == 0) {
+            if (outbuf_next(ob) < 0)
+                return -1;
+            continue;
+        }
+
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(ob->head + ob->len, p, n);
+        ob->len += n;
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int
+outbuf_putu(struct outbuf *ob, uint64_t v)
+{
+    char buf[20];
+    size_t i = sizeof(buf);
+
+    /* Digits are rendered back to front */
+    do {
+        buf[--i] = '0' + (v % 10);
+        v /= 10;
+    } while (v != 0);
+
+    return outbuf_write(ob, &buf[i], sizeof(buf) - i);
+}
+
+int
+outbuf_puti(struct outbuf *ob, int64_t v)
+{
+    if (v < 0) {
+        outbuf_putc(ob, '-');
+        return outbuf_putu(ob, -(uint64_t)v);
+    }
+
+    return outbuf_putu(ob, v);
+}
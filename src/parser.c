@@ -3,9 +3,11 @@
  * Provided under the BSD-3 clause.
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "gup/lexer.h"
 #include "gup/parser.h"
 #include "gup/trace.h"
@@ -58,6 +60,8 @@ static const char *toktab[] = {
     [TT_NONE]     = symtok("none"),
     [TT_NEWLINE]  = symtok("newline"),
     [TT_IDENT]    = symtok("ident"),
+    [TT_STRING]   = symtok("string"),
+    [TT_NUMBER]   = symtok("number"),
     [TT_DEFINE]   = qtok("#define"),
     [TT_IFDEF]    = qtok("#ifdef"),
     [TT_IFNDEF]   = qtok("#ifndef"),
@@ -76,9 +80,31 @@ static const char *toktab[] = {
     [TT_LBRACE]   = qtok("{"),
     [TT_RBRACE]   = qtok("}"),
     [TT_SEMI]     = qtok(";"),
+    [TT_COMMA]    = qtok(","),
+    [TT_COLON]    = qtok(":"),
+    [TT_EQUALS]   = qtok("="),
+    [TT_EQEQ]     = qtok("=="),
+    [TT_NE]       = qtok("!="),
     [TT_PUB]      = qtok("pub"),
     [TT_PROC]     = qtok("proc"),
-    [TT_VOID]     = qtok("void")
+    [TT_VOID]     = qtok("void"),
+    [TT_U8]       = qtok("u8"),
+    [TT_U16]      = qtok("u16"),
+    [TT_U32]      = qtok("u32"),
+    [TT_U64]      = qtok("u64"),
+    [TT_RETURN]   = qtok("return"),
+    [TT_IF]       = qtok("if"),
+    [TT_ELSE]     = qtok("else"),
+    [TT_TAIL]     = qtok("tail"),
+    [TT_INLINE]   = qtok("inline"),
+    [TT_NOINLINE] = qtok("noinline"),
+    [TT_WHILE]    = qtok("while"),
+    [TT_FOR]      = qtok("for"),
+    [TT_BREAK]    = qtok("break"),
+    [TT_CONTINUE] = qtok("continue"),
+    [TT_SWITCH]   = qtok("switch"),
+    [TT_CASE]     = qtok("case"),
+    [TT_DEFAULT]  = qtok("default")
 };
 
 /*
@@ -101,7 +127,9 @@ parse_check_expand(struct gup_state *state, struct symbol *symbol)
         return NULL;
     }
 
+    /* Rewind so the macro can be expanded more than once */
     state->mactoks = &symbol->mactok;
+    state->mactoks->tail = 0;
     return tokbuf_pop(state->mactoks);
 }
 
@@ -161,6 +189,7 @@ parse_scan(struct gup_state *state, struct token *tok)
                 popped = tmp;
         }
 
+        state->tok_off = popped->off;
         *tok = *popped;
         return 0;
     }
@@ -168,6 +197,34 @@ parse_scan(struct gup_state *state, struct token *tok)
     return -1;
 }
 
+/*
+ * Peek at the next token in the parsing pass without
+ * consuming it
+ *
+ * @state: Compiler state
+ *
+ * Returns NULL if there are no more tokens
+ */
+static struct token *
+parse_peek(struct gup_state *state)
+{
+    struct token *tok = NULL;
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    if (state->mactoks != NULL) {
+        tok = tokbuf_peek(state->mactoks);
+    }
+
+    if (tok == NULL) {
+        tok = tokbuf_peek(&state->tokbuf);
+    }
+
+    return tok;
+}
+
 /*
  * Assert that the next token is of a specific type
  *
@@ -437,7 +494,46 @@ parse_curate(struct gup_state *state)
 }
 
 /*
- * Parse a procedure
+ * Parse a data type, the token following the type is left
+ * in the token result
+ *
+ * @state: Compiler state
+ * @tok:   Last token (the base type)
+ * @res:   Data type result
+ *
+ * Returns zero on success
+ */
+static int
+parse_type(struct gup_state *state, struct token *tok, struct data_type *res)
+{
+    if (state == NULL || tok == NULL || res == NULL) {
+        return -1;
+    }
+
+    if ((res->type = tok_to_type(tok->type)) == GUP_TYPE_BAD) {
+        utok(state, symtok("type"), tokstr(tok));
+        return -1;
+    }
+
+    res->ptr_depth = 0;
+    for (;;) {
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (tok->type != TT_STAR) {
+            break;
+        }
+
+        ++res->ptr_depth;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a global variable
  *
  * @state: Compiler state
  * @tok:   Last token
@@ -446,194 +542,1602 @@ parse_curate(struct gup_state *state)
  * Returns zero on success
  */
 static int
-parse_proc(struct gup_state *state, struct token *tok, struct ast_node **res)
+parse_global(struct gup_state *state, struct token *tok, struct ast_node **res)
 {
     struct token *prevtok;
-    struct ast_node *root;
-    gup_type_t type;
+    struct ast_node *root, *init = NULL;
+    struct data_type dtype;
     struct symbol *symbol;
-    int error;
+    size_t size;
 
-    if (state == NULL || tok == NULL) {
+    if (state == NULL || tok == NULL || res == NULL) {
         return -1;
     }
 
-    if (tok->type != TT_PROC) {
+    prevtok = tokbuf_lookbehind(&state->tokbuf, 1);
+    if (prevtok == NULL) {
+        trace_error(state, "global lookbehind failure\n");
         return -1;
     }
 
-    prevtok = tokbuf_lookbehind(&state->tokbuf, 1);
-    if (prevtok == NULL) {
-        trace_error(state, "proc lookbehind failure\n");
+    if (parse_type(state, tok, &dtype) < 0) {
+        return -1;
+    }
+
+    if ((size = type_size(&dtype)) == 0) {
+        trace_error(state, "global has no size\n");
         return -1;
     }
 
     /* EXPECT <IDENT> */
-    if (parse_expect(state, tok, TT_IDENT) < 0) {
+    if (tok->type != TT_IDENT) {
+        utok(state, tokstr1(TT_IDENT), tokstr(tok));
         return -1;
     }
 
-    error = symbol_new(
-        &state->symtab,
-        tok->s,
-        SYMBOL_FUNC,
-        &symbol
-    );
+    if (symbol_from_name(&state->symtab, tok->s) != NULL) {
+        trace_error(state, "redefinition of '%s'\n", tok->s);
+        return -1;
+    }
 
-    if (error < 0) {
+    if (symbol_new(&state->symtab, tok->s, SYMBOL_VAR, &symbol) < 0) {
         trace_error(state, "failed to allocate symbol\n");
         return -1;
     }
 
-    /* Was the token before 'proc', 'pub'? */
+    symbol->dtype = dtype;
     if (prevtok->type == TT_PUB) {
         symbol->pub = 1;
     }
 
-    /* EXPECT '(' */
-    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+    if (prevtok->type == TT_INLINE || prevtok->type == TT_NOINLINE) {
+        trace_error(state, "%s only applies to procedures\n", tokstr(prevtok));
         return -1;
     }
 
-    /* EXPECT 'void' : TODO: ALLOW ARGUMENTS */
-    if (parse_expect(state, tok, TT_VOID) < 0) {
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
         return -1;
     }
 
-    /* EXPECT ')' */
-    if (parse_expect(state, tok, TT_RPAREN) < 0) {
+    /* EXPECT '=' OR ';' */
+    switch (tok->type) {
+    case TT_SEMI:
+        break;
+    case TT_EQUALS:
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (tok->type == TT_NUMBER) {
+            if (size < 8 && tok->v >> (size * 8) != 0) {
+                trace_error(state, "initializer too large for type\n");
+                return -1;
+            }
+
+            if (ast_node_allocate(state, AST_NUMBER, &init) < 0) {
+                return -1;
+            }
+
+            init->v = tok->v;
+        } else if (tok->type == TT_STRING) {
+            if (dtype.ptr_depth == 0) {
+                trace_error(state, "string initializer for non-pointer\n");
+                return -1;
+            }
+
+            if (ast_node_allocate(state, AST_STRING, &init) < 0) {
+                return -1;
+            }
+
+            init->str.s = tok->s;
+            init->str.len = tok->len;
+        } else {
+            utok(state, symtok("initializer"), tokstr(tok));
+            return -1;
+        }
+
+        /* EXPECT ';' */
+        if (parse_expect(state, tok, TT_SEMI) < 0) {
+            return -1;
+        }
+
+        break;
+    default:
+        utok1(state, tok);
         return -1;
     }
 
-    /* EXPECT '->' */
-    if (parse_expect(state, tok, TT_ARROW) < 0) {
+    if (ast_node_allocate(state, AST_GLOBAL, &root) < 0) {
+        trace_error(state, "failed to allocate AST_GLOBAL\n");
         return -1;
     }
 
+    root->symid = symbol->id;
+    root->right = init;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse the parameter list of a procedure up to and including
+ * the closing parenthesis, either 'void' or a comma separated
+ * list of '<type> <name>'
+ *
+ * @state:   Compiler state
+ * @tok:     Last token (the opening parenthesis)
+ * @params:  Parameter types are written here
+ * @names:   Parameter names are written here
+ * @nparams: Number of parameters is written here
+ *
+ * Returns zero on success
+ */
+static int
+parse_params(struct gup_state *state, struct token *tok,
+    struct data_type *params, char **names, uint8_t *nparams)
+{
+    *nparams = 0;
     if (parse_scan(state, tok) < 0) {
         ueof(state);
         return -1;
     }
 
-    if ((type = tok_to_type(tok->type)) == GUP_TYPE_BAD) {
-        utok(state, symtok("type"), tokstr(tok));
-        return -1;
+    if (tok->type == TT_VOID) {
+        return parse_expect(state, tok, TT_RPAREN);
     }
 
-    symbol->dtype.type = type;
-    if (parse_scan(state, tok) < 0) {
-        return -1;
-    }
+    for (;;) {
+        if (*nparams >= PROC_MAX_PARAMS) {
+            trace_error(state, "too many parameters\n");
+            return -1;
+        }
 
-    /* EXPECT ';' OR '{' */
-    switch (tok->type) {
-    case TT_SEMI:
-        return 0;
-    case TT_LBRACE:
-        if (scope_push(state, TT_PROC) < 0) {
+        if (parse_type(state, tok, &params[*nparams]) < 0) {
             return -1;
         }
 
-        if (ast_node_allocate(state, AST_PROC, &root) < 0) {
-            trace_error(state, "failed to allocate AST_PROC\n");
+        if (type_size(&params[*nparams]) == 0) {
+            trace_error(state, "parameter has no size\n");
             return -1;
         }
 
-        root->symid = symbol->id;
-        *res = root;
-        break;
-    default:
-        utok1(state, tok);
-        return -1;
+        /* EXPECT <IDENT> */
+        if (tok->type != TT_IDENT) {
+            utok(state, tokstr1(TT_IDENT), tokstr(tok));
+            return -1;
+        }
+
+        names[(*nparams)++] = tok->s;
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (tok->type == TT_RPAREN) {
+            break;
+        }
+
+        /* EXPECT ',' */
+        if (tok->type != TT_COMMA) {
+            utok(state, qtok(")"), tokstr(tok));
+            return -1;
+        }
+
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
     }
 
     return 0;
 }
 
 /*
- * Parse an RBRACE token
+ * Declare the parameters of the procedure being defined so
+ * its body can refer to them
  *
- * @state: Compiler state
- * @tok:   Last token
- * @res:   AST node result
+ * @state:  Compiler state
+ * @symbol: Procedure symbol
+ * @names:  Parameter names
  *
  * Returns zero on success
  */
 static int
-parse_rbrace(struct gup_state *state, struct token *tok, struct ast_node **res)
+parse_declare_params(struct gup_state *state, struct symbol *symbol,
+    char **names)
 {
-    struct ast_node *root;
-    tt_t scope;
-
-    if (state == NULL || tok == NULL) {
-        return -1;
-    }
+    struct symbol *param;
+    uint8_t i;
 
-    if (tok->type != TT_RBRACE) {
-        return -1;
-    }
+    for (i = 0; i < symbol->nparams; ++i) {
+        if (symbol_from_name(&state->symtab, names[i]) != NULL) {
+            trace_error(state, "redefinition of '%s'\n", names[i]);
+            return -1;
+        }
 
-    scope = scope_pop(state);
-    switch (scope) {
-    case TT_PROC:
-        if (ast_node_allocate(state, AST_PROC, &root) < 0) {
-            trace_error(state, "failed to allocate AST_PROC\n");
+        if (symbol_new(&state->symtab, names[i], SYMBOL_PARAM, &param) < 0) {
+            trace_error(state, "failed to allocate symbol\n");
             return -1;
         }
 
-        root->epilogue = 1;
-        *res = root;
-        break;
-    default:
-        break;
+        param->dtype = symbol->params[i];
+        param->argno = i;
     }
 
     return 0;
 }
 
 /*
- * Begin parsing tokens
+ * Parse a procedure
  *
  * @state: Compiler state
- * @tok:   Most recent token
+ * @tok:   Last token
+ * @res:   AST node result
  *
  * Returns zero on success
  */
 static int
-parse_begin(struct gup_state *state, struct token *tok)
+parse_proc(struct gup_state *state, struct token *tok, struct ast_node **res)
 {
-    struct ast_node *root = NULL;
+    struct data_type params[PROC_MAX_PARAMS];
+    char *names[PROC_MAX_PARAMS];
+    struct data_type dtype;
+    struct token *prevtok;
+    struct ast_node *root;
+    struct symbol *symbol;
+    uint8_t nparams, i;
+    bool declared, pub = false;
+    bool inl = false, noinl = false;
+    off_t n;
+    int error;
 
     if (state == NULL || tok == NULL) {
         return -1;
     }
 
-    switch (tok->type) {
-    case TT_PROC:
-        if (parse_proc(state, tok, &root) < 0) {
+    if (tok->type != TT_PROC) {
+        return -1;
+    }
+
+    /* Modifiers come in any order right before 'proc' */
+    for (n = 1; n < (off_t)state->tokbuf.tail; ++n) {
+        prevtok = tokbuf_lookbehind(&state->tokbuf, n);
+        if (prevtok == NULL) {
+            trace_error(state, "proc lookbehind failure\n");
             return -1;
         }
 
-        break;
-    case TT_PUB:
-        /* Modifier */
-        break;
-    case TT_RBRACE:
-        if (state->scope_depth == 0) {
-            trace_error(
-                state,
-                "got unexpected %s\n",
-                qtok("}")
-            );
+        if (prevtok->type == TT_PUB) {
+            pub = true;
+        } else if (prevtok->type == TT_INLINE) {
+            inl = true;
+        } else if (prevtok->type == TT_NOINLINE) {
+            noinl = true;
+        } else {
+            break;
+        }
+    }
+
+    /* EXPECT <IDENT> */
+    if (parse_expect(state, tok, TT_IDENT) < 0) {
+        return -1;
+    }
+
+    /* A previous prototype shares its symbol with the body */
+    symbol = symbol_from_name(&state->symtab, tok->s);
+    if (symbol != NULL && symbol->type != SYMBOL_FUNC) {
+        trace_error(state, "redefinition of '%s'\n", tok->s);
+        return -1;
+    }
 
+    declared = symbol != NULL;
+    if (symbol == NULL) {
+        error = symbol_new(
+            &state->symtab,
+            tok->s,
+            SYMBOL_FUNC,
+            &symbol
+        );
+
+        if (error < 0) {
+            trace_error(state, "failed to allocate symbol\n");
             return -1;
         }
+    }
+
+    if (pub) {
+        symbol->pub = 1;
+    }
+
+    /* Any declaration may ask, but they must not disagree */
+    symbol->always_inline |= inl;
+    symbol->noinline |= noinl;
+    if (symbol->always_inline && symbol->noinline) {
+        trace_error(state, "conflicting inline modifiers for '%s'\n", symbol->name);
+        return -1;
+    }
+
+    /* EXPECT '(' */
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_params(state, tok, params, names, &nparams) < 0) {
+        return -1;
+    }
+
+    /* Every declaration must agree on the parameters */
+    if (declared && nparams != symbol->nparams) {
+        trace_error(state, "conflicting parameters for '%s'\n", symbol->name);
+        return -1;
+    }
 
-        if (parse_rbrace(state, tok, &root) < 0) {
+    for (i = 0; declared && i < nparams; ++i) {
+        if (params[i].type != symbol->params[i].type ||
+            params[i].ptr_depth != symbol->params[i].ptr_depth) {
+            trace_error(state, "conflicting parameters for '%s'\n", symbol->name);
             return -1;
         }
+    }
 
-        break;
+    symbol->nparams = nparams;
+    memcpy(symbol->params, params, nparams * sizeof(*params));
+
+    /* EXPECT '->' */
+    if (parse_expect(state, tok, TT_ARROW) < 0) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (parse_type(state, tok, &dtype) < 0) {
+        return -1;
+    }
+
+    /* Every declaration must agree on the return type too */
+    if (declared && (dtype.type != symbol->dtype.type ||
+        dtype.ptr_depth != symbol->dtype.ptr_depth)) {
+        trace_error(state, "conflicting return type for '%s'\n", symbol->name);
+        return -1;
+    }
+
+    symbol->dtype = dtype;
+
+    /* EXPECT ';' OR '{' */
+    switch (tok->type) {
+    case TT_SEMI:
+        return 0;
+    case TT_LBRACE:
+        if (symbol->defined) {
+            trace_error(state, "redefinition of '%s'\n", symbol->name);
+            return -1;
+        }
+
+        if (scope_push(state, TT_PROC) < 0) {
+            return -1;
+        }
+
+        symbol->defined = 1;
+        if (parse_declare_params(state, symbol, names) < 0) {
+            return -1;
+        }
+
+        if (ast_node_allocate(state, AST_PROC, &root) < 0) {
+            trace_error(state, "failed to allocate AST_PROC\n");
+            return -1;
+        }
+
+        root->symid = symbol->id;
+        *res = root;
+        break;
+    default:
+        utok1(state, tok);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the precedence of a binary operator, otherwise
+ * zero if the token is not a binary operator
+ *
+ * @tt: Token type to check
+ */
+static inline int
+parse_binprec(tt_t tt)
+{
+    switch (tt) {
+    case TT_EQEQ:
+    case TT_NE:
+        return 1;
+    case TT_LT:
+    case TT_GT:
+    case TT_LTE:
+    case TT_GTE:
+        return 2;
+    case TT_PLUS:
+    case TT_MINUS:
+        return 3;
+    case TT_STAR:
+    case TT_SLASH:
+        return 4;
+    default:
+        return 0;
+    }
+
+    return 0;
+}
+
+static int parse_expr(struct gup_state *state, struct token *tok, struct ast_node **res);
+
+/*
+ * Parse a procedure call, the token after the call is left
+ * in the token result
+ *
+ * @state:  Compiler state
+ * @tok:    Last token (the procedure name)
+ * @symbol: Procedure symbol
+ * @res:    AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_call(struct gup_state *state, struct token *tok, struct symbol *symbol,
+    struct ast_node **res)
+{
+    struct ast_node *root, *args[PROC_MAX_PARAMS];
+    size_t argc = 0;
+
+    if (state == NULL || tok == NULL || symbol == NULL) {
+        return -1;
+    }
+
+    /* EXPECT '(' */
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    while (tok->type != TT_RPAREN) {
+        if (argc >= PROC_MAX_PARAMS) {
+            trace_error(state, "too many arguments\n");
+            return -1;
+        }
+
+        if (parse_expr(state, tok, &args[argc++]) < 0) {
+            return -1;
+        }
+
+        if (tok->type == TT_RPAREN) {
+            break;
+        }
+
+        /* EXPECT ',' */
+        if (tok->type != TT_COMMA) {
+            utok(state, qtok(")"), tokstr(tok));
+            return -1;
+        }
+
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+    }
+
+    if (argc != symbol->nparams) {
+        trace_error(
+            state, "'%s' takes %u arguments, got %zu\n",
+            symbol->name, symbol->nparams, argc
+        );
+
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_CALL, &root) < 0) {
+        trace_error(state, "failed to allocate AST_CALL\n");
+        return -1;
+    }
+
+    if (argc > 0) {
+        root->args = ptrbox_alloc(&state->ptrbox, argc * sizeof(*args));
+        if (root->args == NULL)
+            return -1;
+
+        memcpy(root->args, args, argc * sizeof(*args));
+    }
+
+    root->symid = symbol->id;
+    root->argc = argc;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a primary expression, the token after the expression
+ * is left in the token result
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_primary(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *operand;
+    struct symbol *symbol;
+
+    if (state == NULL || tok == NULL || res == NULL) {
+        return -1;
+    }
+
+    switch (tok->type) {
+    case TT_NUMBER:
+        if (ast_node_allocate(state, AST_NUMBER, &root) < 0) {
+            return -1;
+        }
+
+        root->v = tok->v;
+        break;
+    case TT_STRING:
+        if (ast_node_allocate(state, AST_STRING, &root) < 0) {
+            return -1;
+        }
+
+        root->str.s = tok->s;
+        root->str.len = tok->len;
+        break;
+    case TT_IDENT:
+        symbol = symbol_from_name(&state->symtab, tok->s);
+        if (symbol == NULL) {
+            trace_error(state, "undefined symbol '%s'\n", tok->s);
+            return -1;
+        }
+
+        if (symbol->type == SYMBOL_FUNC) {
+            if (parse_call(state, tok, symbol, &root) < 0)
+                return -1;
+
+            break;
+        }
+
+        switch (symbol->type) {
+        case SYMBOL_VAR:
+        case SYMBOL_PARAM:
+        case SYMBOL_LOCAL:
+            break;
+        default:
+            utok1(state, tok);
+            return -1;
+        }
+
+        if (ast_node_allocate(state, AST_IDENT, &root) < 0) {
+            return -1;
+        }
+
+        root->symid = symbol->id;
+        break;
+    case TT_LPAREN:
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (parse_expr(state, tok, &root) < 0) {
+            return -1;
+        }
+
+        if (tok->type != TT_RPAREN) {
+            utok(state, qtok(")"), tokstr(tok));
+            return -1;
+        }
+
+        break;
+    case TT_MINUS:
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        /* Unary operators bind tighter than anything binary */
+        if (parse_primary(state, tok, &operand) < 0) {
+            return -1;
+        }
+
+        if (ast_node_allocate(state, AST_UNOP, &root) < 0) {
+            return -1;
+        }
+
+        root->op = TT_MINUS;
+        root->left = operand;
+        *res = root;
+        return 0;
+    default:
+        utok(state, symtok("expression"), tokstr(tok));
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a binary expression by precedence climbing
+ *
+ * @state:    Compiler state
+ * @tok:      Last token
+ * @min_prec: Lowest operator precedence to accept
+ * @res:      AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_binexpr(struct gup_state *state, struct token *tok, int min_prec,
+    struct ast_node **res)
+{
+    struct ast_node *lhs, *rhs, *root;
+    int prec;
+    tt_t op;
+
+    if (parse_primary(state, tok, &lhs) < 0) {
+        return -1;
+    }
+
+    while ((prec = parse_binprec(tok->type)) >= min_prec) {
+        op = tok->type;
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (parse_binexpr(state, tok, prec + 1, &rhs) < 0) {
+            return -1;
+        }
+
+        if (ast_node_allocate(state, AST_BINOP, &root) < 0) {
+            return -1;
+        }
+
+        root->op = op;
+        root->left = lhs;
+        root->right = rhs;
+        lhs = root;
+    }
+
+    *res = lhs;
+    return 0;
+}
+
+/*
+ * Parse an expression, the token after the expression is left
+ * in the token result
+ *
+ * @state: Compiler state
+ * @tok:   Last token (the first token of the expression)
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_expr(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    if (state == NULL || tok == NULL || res == NULL) {
+        return -1;
+    }
+
+    return parse_binexpr(state, tok, 1, res);
+}
+
+/*
+ * Parse a 'return' statement
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_return(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *value = NULL;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_RETURN) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (tok->type != TT_SEMI) {
+        if (parse_expr(state, tok, &value) < 0)
+            return -1;
+    }
+
+    /* EXPECT ';' */
+    if (tok->type != TT_SEMI) {
+        utok(state, qtok(";"), tokstr(tok));
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_RETURN, &root) < 0) {
+        trace_error(state, "failed to allocate AST_RETURN\n");
+        return -1;
+    }
+
+    root->left = value;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a 'tail return' statement, the returned value must
+ * be a call which then reuses the frame of the caller
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_tail(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_TAIL) {
+        return -1;
+    }
+
+    /* EXPECT 'return' */
+    if (parse_expect(state, tok, TT_RETURN) < 0) {
+        return -1;
+    }
+
+    if (parse_return(state, tok, &root) < 0) {
+        return -1;
+    }
+
+    if (root->left == NULL || root->left->type != AST_CALL) {
+        trace_error(state, "tail return needs a procedure call\n");
+        return -1;
+    }
+
+    root->tail = 1;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse an 'if' statement
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_if(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *cond;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_IF) {
+        return -1;
+    }
+
+    /* EXPECT '(' */
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (parse_expr(state, tok, &cond) < 0) {
+        return -1;
+    }
+
+    /* EXPECT ')' */
+    if (tok->type != TT_RPAREN) {
+        utok(state, qtok(")"), tokstr(tok));
+        return -1;
+    }
+
+    /* EXPECT '{' */
+    if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        return -1;
+    }
+
+    if (scope_push(state, TT_IF) < 0) {
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_IF, &root) < 0) {
+        trace_error(state, "failed to allocate AST_IF\n");
+        return -1;
+    }
+
+    root->left = cond;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a local variable declaration, the local is visible
+ * until the end of the enclosing scope
+ *
+ * @state: Compiler state
+ * @tok:   Last token (the type)
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_local(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *init = NULL;
+    struct data_type dtype;
+    struct symbol *symbol;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (parse_type(state, tok, &dtype) < 0) {
+        return -1;
+    }
+
+    if (type_size(&dtype) == 0) {
+        trace_error(state, "local has no size\n");
+        return -1;
+    }
+
+    /* EXPECT <IDENT> */
+    if (tok->type != TT_IDENT) {
+        utok(state, tokstr1(TT_IDENT), tokstr(tok));
+        return -1;
+    }
+
+    if (symbol_from_name(&state->symtab, tok->s) != NULL) {
+        trace_error(state, "redefinition of '%s'\n", tok->s);
+        return -1;
+    }
+
+    if (symbol_new(&state->symtab, tok->s, SYMBOL_LOCAL, &symbol) < 0) {
+        trace_error(state, "failed to allocate symbol\n");
+        return -1;
+    }
+
+    symbol->dtype = dtype;
+    symbol->depth = state->scope_depth;
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    /* Without an initializer the local starts out zero */
+    if (tok->type == TT_EQUALS) {
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (parse_expr(state, tok, &init) < 0) {
+            return -1;
+        }
+    }
+
+    /* EXPECT ';' */
+    if (tok->type != TT_SEMI) {
+        utok(state, qtok(";"), tokstr(tok));
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_LOCAL, &root) < 0) {
+        trace_error(state, "failed to allocate AST_LOCAL\n");
+        return -1;
+    }
+
+    root->symid = symbol->id;
+    root->right = init;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse an assignment or a bare procedure call, leaving
+ * whatever terminates it to the caller
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_simple(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *lhs, *rhs;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (parse_expr(state, tok, &lhs) < 0) {
+        return -1;
+    }
+
+    switch (tok->type) {
+    case TT_EQUALS:
+        if (lhs->type != AST_IDENT) {
+            trace_error(state, "cannot assign to expression\n");
+            return -1;
+        }
+
+        if (parse_scan(state, tok) < 0) {
+            ueof(state);
+            return -1;
+        }
+
+        if (parse_expr(state, tok, &rhs) < 0) {
+            return -1;
+        }
+
+        if (ast_node_allocate(state, AST_ASSIGN, &root) < 0) {
+            trace_error(state, "failed to allocate AST_ASSIGN\n");
+            return -1;
+        }
+
+        root->left = lhs;
+        root->right = rhs;
+        break;
+    default:
+        if (lhs->type != AST_CALL) {
+            trace_error(state, "expression result unused\n");
+            return -1;
+        }
+
+        root = lhs;
+        break;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse an expression statement, either an assignment or
+ * a bare procedure call
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_exprstmt(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    if (parse_simple(state, tok, res) < 0) {
+        return -1;
+    }
+
+    /* EXPECT ';' */
+    if (tok->type != TT_SEMI) {
+        utok(state, qtok(";"), tokstr(tok));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a 'while' loop
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_while(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *cond;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_WHILE) {
+        return -1;
+    }
+
+    /* EXPECT '(' */
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (parse_expr(state, tok, &cond) < 0) {
+        return -1;
+    }
+
+    /* EXPECT ')' */
+    if (tok->type != TT_RPAREN) {
+        utok(state, qtok(")"), tokstr(tok));
+        return -1;
+    }
+
+    /* EXPECT '{' */
+    if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        return -1;
+    }
+
+    if (scope_push(state, TT_WHILE) < 0) {
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_WHILE, &root) < 0) {
+        trace_error(state, "failed to allocate AST_WHILE\n");
+        return -1;
+    }
+
+    root->left = cond;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a 'for' loop, each of the initializer, condition and
+ * step may be left out. A local declared by the initializer
+ * is only visible within the loop.
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_for(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *init = NULL, *cond = NULL, *step = NULL;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_FOR) {
+        return -1;
+    }
+
+    /* EXPECT '(' */
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (scope_push(state, TT_FOR) < 0) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    switch (tok->type) {
+    case TT_SEMI:
+        break;
+    case TT_U8:
+    case TT_U16:
+    case TT_U32:
+    case TT_U64:
+        if (parse_local(state, tok, &init) < 0) {
+            return -1;
+        }
+
+        break;
+    default:
+        if (parse_exprstmt(state, tok, &init) < 0) {
+            return -1;
+        }
+
+        break;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (tok->type != TT_SEMI) {
+        if (parse_expr(state, tok, &cond) < 0)
+            return -1;
+    }
+
+    /* EXPECT ';' */
+    if (tok->type != TT_SEMI) {
+        utok(state, qtok(";"), tokstr(tok));
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (tok->type != TT_RPAREN) {
+        if (parse_simple(state, tok, &step) < 0)
+            return -1;
+    }
+
+    /* EXPECT ')' */
+    if (tok->type != TT_RPAREN) {
+        utok(state, qtok(")"), tokstr(tok));
+        return -1;
+    }
+
+    /* EXPECT '{' */
+    if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_FOR, &root) < 0) {
+        trace_error(state, "failed to allocate AST_FOR\n");
+        return -1;
+    }
+
+    root->init = init;
+    root->left = cond;
+    root->right = step;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a 'switch' statement, the body is made up of 'case'
+ * and 'default' labels that control falls through between
+ * unless it breaks out
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_switch(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *sel;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_SWITCH) {
+        return -1;
+    }
+
+    /* EXPECT '(' */
+    if (parse_expect(state, tok, TT_LPAREN) < 0) {
+        return -1;
+    }
+
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (parse_expr(state, tok, &sel) < 0) {
+        return -1;
+    }
+
+    /* EXPECT ')' */
+    if (tok->type != TT_RPAREN) {
+        utok(state, qtok(")"), tokstr(tok));
+        return -1;
+    }
+
+    /* EXPECT '{' */
+    if (parse_expect(state, tok, TT_LBRACE) < 0) {
+        return -1;
+    }
+
+    if (scope_push(state, TT_SWITCH) < 0) {
+        return -1;
+    }
+
+    if (ast_node_allocate(state, AST_SWITCH, &root) < 0) {
+        trace_error(state, "failed to allocate AST_SWITCH\n");
+        return -1;
+    }
+
+    root->left = sel;
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a 'case' or 'default' label, case values must be
+ * numeric constants
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_case(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root, *value = NULL;
+    tt_t type;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_CASE && tok->type != TT_DEFAULT) {
+        return -1;
+    }
+
+    if (scope_top(state) != TT_SWITCH) {
+        trace_error(state, "%s outside of a switch\n", tokstr(tok));
+        return -1;
+    }
+
+    type = tok->type;
+    if (parse_scan(state, tok) < 0) {
+        ueof(state);
+        return -1;
+    }
+
+    if (type == TT_CASE) {
+        if (parse_expr(state, tok, &value) < 0)
+            return -1;
+        if (value->type != AST_NUMBER) {
+            trace_error(state, "case value must be a constant\n");
+            return -1;
+        }
+    }
+
+    /* EXPECT ':' */
+    if (tok->type != TT_COLON) {
+        utok(state, qtok(":"), tokstr(tok));
+        return -1;
+    }
+
+    if (ast_node_allocate(state, (type == TT_CASE) ? AST_CASE : AST_DEFAULT, &root) < 0) {
+        trace_error(state, "failed to allocate case node\n");
+        return -1;
+    }
+
+    if (value != NULL) {
+        root->v = value->v;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse a 'break' or 'continue' statement, 'break' also
+ * leaves a 'switch'
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_jump(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root;
+    ast_type_t type;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    switch (tok->type) {
+    case TT_BREAK:
+        type = AST_BREAK;
+        break;
+    case TT_CONTINUE:
+        type = AST_CONTINUE;
+        break;
+    default:
+        return -1;
+    }
+
+    if (type == AST_BREAK && scope_break(state) < 0) {
+        trace_error(state, "%s outside of a loop or switch\n", tokstr(tok));
+        return -1;
+    }
+
+    if (type == AST_CONTINUE && scope_loop(state) < 0) {
+        trace_error(state, "%s outside of a loop\n", tokstr(tok));
+        return -1;
+    }
+
+    /* EXPECT ';' */
+    if (parse_expect(state, tok, TT_SEMI) < 0) {
+        return -1;
+    }
+
+    if (ast_node_allocate(state, type, &root) < 0) {
+        trace_error(state, "failed to allocate jump node\n");
+        return -1;
+    }
+
+    *res = root;
+    return 0;
+}
+
+/*
+ * Parse an RBRACE token
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_rbrace(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    struct ast_node *root;
+    struct token *next;
+    ast_type_t type;
+    tt_t scope;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    if (tok->type != TT_RBRACE) {
+        return -1;
+    }
+
+    /* Locals go out of scope with their block */
+    scope = scope_pop(state);
+    if (scope != TT_WHILE && scope != TT_FOR) {
+        symbol_drop_scope(&state->symtab, state->scope_depth);
+    }
+
+    switch (scope) {
+    case TT_PROC:
+        /* Parameters go out of scope with the body */
+        symbol_drop(&state->symtab, SYMBOL_PARAM);
+        if (ast_node_allocate(state, AST_PROC, &root) < 0) {
+            trace_error(state, "failed to allocate AST_PROC\n");
+            return -1;
+        }
+
+        root->epilogue = 1;
+        *res = root;
+        break;
+    case TT_IF:
+        next = parse_peek(state);
+        if (next == NULL || next->type != TT_ELSE) {
+            if (ast_node_allocate(state, AST_IF, &root) < 0) {
+                trace_error(state, "failed to allocate AST_IF\n");
+                return -1;
+            }
+
+            root->epilogue = 1;
+            *res = root;
+            break;
+        }
+
+        /* Consume the 'else' and EXPECT '{' */
+        if (parse_scan(state, tok) < 0) {
+            return -1;
+        }
+
+        if (parse_expect(state, tok, TT_LBRACE) < 0) {
+            return -1;
+        }
+
+        if (scope_push(state, TT_ELSE) < 0) {
+            return -1;
+        }
+
+        if (ast_node_allocate(state, AST_ELSE, &root) < 0) {
+            trace_error(state, "failed to allocate AST_ELSE\n");
+            return -1;
+        }
+
+        *res = root;
+        break;
+    case TT_ELSE:
+        if (ast_node_allocate(state, AST_ELSE, &root) < 0) {
+            trace_error(state, "failed to allocate AST_ELSE\n");
+            return -1;
+        }
+
+        root->epilogue = 1;
+        *res = root;
+        break;
+    case TT_WHILE:
+    case TT_FOR:
+        type = (scope == TT_WHILE) ? AST_WHILE : AST_FOR;
+        if (ast_node_allocate(state, type, &root) < 0) {
+            trace_error(state, "failed to allocate loop node\n");
+            return -1;
+        }
+
+        /* The step may still refer to locals of the loop */
+        root->epilogue = 1;
+        if (cg_resolve_node(state, root) < 0) {
+            return -1;
+        }
+
+        symbol_drop_scope(&state->symtab, state->scope_depth);
+        break;
+    case TT_SWITCH:
+        if (ast_node_allocate(state, AST_SWITCH, &root) < 0) {
+            trace_error(state, "failed to allocate AST_SWITCH\n");
+            return -1;
+        }
+
+        root->epilogue = 1;
+        *res = root;
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a statement within a procedure body
+ *
+ * @state: Compiler state
+ * @tok:   Last token
+ * @res:   AST node result
+ *
+ * Returns zero on success
+ */
+static int
+parse_stmt(struct gup_state *state, struct token *tok, struct ast_node **res)
+{
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    switch (tok->type) {
+    case TT_RETURN:
+        return parse_return(state, tok, res);
+    case TT_TAIL:
+        return parse_tail(state, tok, res);
+    case TT_IF:
+        return parse_if(state, tok, res);
+    case TT_WHILE:
+        return parse_while(state, tok, res);
+    case TT_FOR:
+        return parse_for(state, tok, res);
+    case TT_BREAK:
+    case TT_CONTINUE:
+        return parse_jump(state, tok, res);
+    case TT_SWITCH:
+        return parse_switch(state, tok, res);
+    case TT_CASE:
+    case TT_DEFAULT:
+        return parse_case(state, tok, res);
+    case TT_U8:
+    case TT_U16:
+    case TT_U32:
+    case TT_U64:
+        return parse_local(state, tok, res);
+    case TT_RBRACE:
+        return parse_rbrace(state, tok, res);
+    case TT_PROC:
+    case TT_PUB:
+    case TT_INLINE:
+    case TT_NOINLINE:
+        trace_error(state, "nested procedures are not allowed\n");
+        return -1;
+    default:
+        break;
+    }
+
+    return parse_exprstmt(state, tok, res);
+}
+
+/*
+ * Begin parsing tokens
+ *
+ * @state: Compiler state
+ * @tok:   Most recent token
+ *
+ * Returns zero on success
+ */
+static int
+parse_begin(struct gup_state *state, struct token *tok)
+{
+    struct ast_node *root = NULL;
+
+    if (state == NULL || tok == NULL) {
+        return -1;
+    }
+
+    /* Statements only live within procedures */
+    if (state->scope_depth > 0) {
+        if (parse_stmt(state, tok, &root) < 0)
+            return -1;
+
+        return (root != NULL) ? cg_resolve_node(state, root) : 0;
+    }
+
+    switch (tok->type) {
+    case TT_PROC:
+        if (parse_proc(state, tok, &root) < 0) {
+            return -1;
+        }
+
+        break;
+    case TT_U8:
+    case TT_U16:
+    case TT_U32:
+    case TT_U64:
+        if (parse_global(state, tok, &root) < 0) {
+            return -1;
+        }
+
+        break;
+    case TT_PUB:
+    case TT_INLINE:
+    case TT_NOINLINE:
+        /* Modifier */
+        break;
+    case TT_RBRACE:
+        trace_error(
+            state,
+            "got unexpected %s\n",
+            qtok("}")
+        );
+
+        return -1;
     default:
         utok1(state, tok);
         return -1;
@@ -669,6 +2173,7 @@ parse_loop(struct gup_state *state)
             break;
         }
 
+        state->tok_off = tok->off;
         if (parse_begin(state, tok) < 0) {
             return -1;
         }
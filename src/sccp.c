@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "gup/opt.h"
+
+/*
+ * Lattice a register value moves down through
+ *
+ * @SCCP_TOP:    Nothing seen yet, may still be anything
+ * @SCCP_CONST:  Always the same constant
+ * @SCCP_BOTTOM: Varies at runtime
+ */
+typedef enum {
+    SCCP_TOP,
+    SCCP_CONST,
+    SCCP_BOTTOM
+} sccp_state_t;
+
+/*
+ * Represents the value of a register
+ *
+ * @state: Lattice state
+ * @c:     Constant (SCCP_CONST)
+ */
+struct sccp_val {
+    sccp_state_t state;
+    uint64_t c;
+};
+
+/*
+ * Propagation context
+ *
+ * Registers may have more than one definition (inlined
+ * returns), their value is the meet of every definition in
+ * a block that can run.
+ *
+ * @func:    Function being propagated through
+ * @vals:    Register values, indexed by register
+ * @live:    Blocks that can run, indexed by block ID
+ * @changed: Set if anything moved down the lattice
+ */
+struct sccp_ctx {
+    struct ir_func *func;
+    struct sccp_val *vals;
+    uint8_t *live;
+    bool changed;
+};
+
+static const struct sccp_val sccp_top = { SCCP_TOP, 0 };
+static const struct sccp_val sccp_bottom = { SCCP_BOTTOM, 0 };
+
+static inline struct sccp_val
+sccp_const(uint64_t c)
+{
+    struct sccp_val val = { SCCP_CONST, c };
+
+    return val;
+}
+
+/*
+ * Merge a value into that of a register
+ *
+ * @ctx: Propagation context
+ * @reg: Register to merge into
+ * @val: Value to merge
+ */
+static void
+sccp_meet(struct sccp_ctx *ctx, ir_reg_t reg, struct sccp_val val)
+{
+    struct sccp_val *cur = &ctx->vals[reg];
+
+    if (cur->state == SCCP_BOTTOM || val.state == SCCP_TOP) {
+        return;
+    }
+
+    if (cur->state == SCCP_CONST && val.state == SCCP_CONST && cur->c == val.c) {
+        return;
+    }
+
+    *cur = (cur->state == SCCP_TOP) ? val : sccp_bottom;
+    ctx->changed = true;
+}
+
+/*
+ * Mark a block as able to run
+ *
+ * @ctx:   Propagation context
+ * @block: Block to mark
+ */
+static void
+sccp_reach(struct sccp_ctx *ctx, struct ir_block *block)
+{
+    if (!ctx->live[block->id]) {
+        ctx->live[block->id] = 1;
+        ctx->changed = true;
+    }
+}
+
+/*
+ * Returns the high 64 bits of the product of two values
+ *
+ * @a: First factor
+ * @b: Second factor
+ */
+static uint64_t
+sccp_mulh(uint64_t a, uint64_t b)
+{
+    uint64_t al = a & 0xFFFFFFFF, ah = a >> 32;
+    uint64_t bl = b & 0xFFFFFFFF, bh = b >> 32;
+    uint64_t mid, lo;
+
+    lo = al * bl;
+    mid = ah * bl + (lo >> 32);
+    lo = al * bh + (mid & 0xFFFFFFFF);
+    return ah * bh + (mid >> 32) + (lo >> 32);
+}
+
+/*
+ * Fold a binary operation on two constants
+ *
+ * @op:  Operation
+ * @a:   First operand
+ * @b:   Second operand
+ * @res: Result is written here
+ *
+ * Returns false if the operation can't be folded
+ */
+static bool
+sccp_fold(ir_op_t op, uint64_t a, uint64_t b, uint64_t *res)
+{
+    switch (op) {
+    case IR_ADD: *res = a + b; break;
+    case IR_SUB: *res = a - b; break;
+    case IR_MUL: *res = a * b; break;
+    case IR_MULH: *res = sccp_mulh(a, b); break;
+    case IR_EQ:  *res = a == b; break;
+    case IR_NE:  *res = a != b; break;
+    case IR_LT:  *res = a < b; break;
+    case IR_GT:  *res = a > b; break;
+    case IR_LE:  *res = a <= b; break;
+    case IR_GE:  *res = a >= b; break;
+    case IR_DIV:
+        /* Division by zero is left to trap at runtime */
+        if (b == 0)
+            return false;
+        *res = a / b;
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Compute the value an instruction produces
+ *
+ * @ctx:  Propagation context
+ * @insn: Instruction to evaluate
+ */
+static struct sccp_val
+sccp_eval(struct sccp_ctx *ctx, struct ir_insn *insn)
+{
+    struct sccp_val a, b;
+    uint64_t res;
+    size_t i;
+
+    switch (insn->op) {
+    case IR_IMM:
+        return sccp_const(insn->imm);
+    case IR_PHI:
+        /* Only values coming in from blocks that can run count */
+        a = sccp_top;
+        for (i = 0; i < insn->argc; ++i) {
+            if (!ctx->live[insn->block->preds[i]->id])
+                continue;
+
+            b = ctx->vals[insn->args[i]];
+            if (b.state == SCCP_TOP)
+                continue;
+            if (a.state == SCCP_TOP)
+                a = b;
+            else if (b.state == SCCP_BOTTOM || a.c != b.c)
+                return sccp_bottom;
+        }
+
+        return a;
+    case IR_COPY:
+        return ctx->vals[insn->src[0]];
+    case IR_ZEXT:
+        a = ctx->vals[insn->src[0]];
+        if (a.state == SCCP_CONST && insn->size < 8)
+            a.c &= ((uint64_t)1 << (insn->size * 8)) - 1;
+        return a;
+    case IR_NEG:
+        a = ctx->vals[insn->src[0]];
+        if (a.state == SCCP_CONST)
+            a.c = -a.c;
+        return a;
+    case IR_SHL:
+    case IR_SHR:
+        a = ctx->vals[insn->src[0]];
+        if (a.state == SCCP_CONST)
+            a.c = (insn->op == IR_SHL) ? a.c << insn->imm : a.c >> insn->imm;
+        return a;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MULH:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_GT:
+    case IR_LE:
+    case IR_GE:
+        break;
+    default:
+        return sccp_bottom;
+    }
+
+    a = ctx->vals[insn->src[0]];
+    b = ctx->vals[insn->src[1]];
+
+    /* Anything times zero is zero, either half of it */
+    if (insn->op == IR_MUL || insn->op == IR_MULH) {
+        if ((a.state == SCCP_CONST && a.c == 0) || (b.state == SCCP_CONST && b.c == 0))
+            return sccp_const(0);
+    }
+
+    if (a.state == SCCP_BOTTOM || b.state == SCCP_BOTTOM) {
+        return sccp_bottom;
+    }
+
+    if (a.state == SCCP_TOP || b.state == SCCP_TOP) {
+        return sccp_top;
+    }
+
+    if (!sccp_fold(insn->op, a.c, b.c, &res)) {
+        return sccp_bottom;
+    }
+
+    return sccp_const(res);
+}
+
+/*
+ * Propagate through a block that can run
+ *
+ * @ctx:   Propagation context
+ * @block: Block to visit
+ */
+static void
+sccp_visit(struct sccp_ctx *ctx, struct ir_block *block)
+{
+    struct ir_insn *insn;
+    struct sccp_val cond;
+    size_t i;
+
+    TAILQ_FOREACH(insn, &block->insns, link) {
+        if (insn->dst != 0) {
+            sccp_meet(ctx, insn->dst, sccp_eval(ctx, insn));
+        }
+
+        switch (insn->op) {
+        case IR_JMP:
+            sccp_reach(ctx, insn->target[0]);
+            break;
+        case IR_BR:
+            /* Only the side a constant picks can ever run */
+            cond = ctx->vals[insn->src[0]];
+            if (cond.state == SCCP_BOTTOM || (cond.state == SCCP_CONST && cond.c != 0))
+                sccp_reach(ctx, insn->target[0]);
+            if (cond.state == SCCP_BOTTOM || (cond.state == SCCP_CONST && cond.c == 0))
+                sccp_reach(ctx, insn->target[1]);
+            break;
+        case IR_SWITCH:
+            /* Likewise only the entry a constant index picks */
+            cond = ctx->vals[insn->src[0]];
+            for (i = 0; i < insn->imm; ++i) {
+                if (cond.state == SCCP_BOTTOM || (cond.state == SCCP_CONST && cond.c == i))
+                    sccp_reach(ctx, insn->table[i]);
+            }
+
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * Rewrite a block with what propagation found
+ *
+ * @ctx:   Propagation context
+ * @block: Block to rewrite
+ */
+static void
+sccp_rewrite(struct sccp_ctx *ctx, struct ir_block *block)
+{
+    struct ir_insn *insn;
+    struct sccp_val val;
+
+    TAILQ_FOREACH(insn, &block->insns, link) {
+        if (insn->op == IR_BR) {
+            val = ctx->vals[insn->src[0]];
+            if (val.state != SCCP_CONST)
+                continue;
+
+            insn->op = IR_JMP;
+            insn->src[0] = 0;
+            if (val.c == 0)
+                insn->target[0] = insn->target[1];
+
+            insn->target[1] = NULL;
+            continue;
+        }
+
+        if (insn->op == IR_SWITCH) {
+            val = ctx->vals[insn->src[0]];
+            if (val.state != SCCP_CONST || val.c >= insn->imm)
+                continue;
+
+            insn->op = IR_JMP;
+            insn->src[0] = 0;
+            insn->target[0] = insn->table[val.c];
+            insn->table = NULL;
+            insn->imm = 0;
+            continue;
+        }
+
+        if (insn->dst == 0 || insn->op == IR_IMM) {
+            continue;
+        }
+
+        /* A folded division never divides by zero */
+        if (!ir_is_pure(insn) && insn->op != IR_DIV) {
+            continue;
+        }
+
+        val = ctx->vals[insn->dst];
+        if (val.state != SCCP_CONST) {
+            continue;
+        }
+
+        insn->op = IR_IMM;
+        insn->imm = val.c;
+        insn->size = 0;
+        insn->src[0] = 0;
+        insn->src[1] = 0;
+        insn->label = NULL;
+        insn->sym = NULL;
+        insn->args = NULL;
+        insn->argc = 0;
+    }
+}
+
+int
+ir_sccp(struct ir_func *func)
+{
+    struct sccp_ctx ctx;
+    struct ir_block *block;
+    ir_reg_t r;
+
+    if (func == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    ctx.func = func;
+    ctx.vals = arena_alloc(func->arena, (func->reg_count + 1) * sizeof(*ctx.vals));
+    ctx.live = arena_alloc(func->arena, func->block_count);
+    if (ctx.vals == NULL || ctx.live == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* Register zero (none) never holds anything known */
+    for (r = 0; r <= func->reg_count; ++r) {
+        ctx.vals[r] = sccp_top;
+    }
+
+    ctx.vals[0] = sccp_bottom;
+    ctx.live[TAILQ_FIRST(&func->blocks)->id] = 1;
+    do {
+        ctx.changed = false;
+        TAILQ_FOREACH(block, &func->blocks, link) {
+            if (ctx.live[block->id])
+                sccp_visit(&ctx, block);
+        }
+    } while (ctx.changed);
+
+    TAILQ_FOREACH(block, &func->blocks, link) {
+        if (ctx.live[block->id])
+            sccp_rewrite(&ctx, block);
+    }
+
+    return 0;
+}
@@ -47,3 +47,44 @@ scope_top(struct gup_state *state)
 
     return state->scope_stack[state->scope_depth - 1];
 }
+
+int
+scope_loop(struct gup_state *state)
+{
+    int i;
+
+    for (i = (int)state->scope_depth - 1; i >= 0; --i) {
+        switch (state->scope_stack[i]) {
+        case TT_WHILE:
+        case TT_FOR:
+            return i;
+        case TT_PROC:
+            return -1;
+        default:
+            break;
+        }
+    }
+
+    return -1;
+}
+
+int
+scope_break(struct gup_state *state)
+{
+    int i;
+
+    for (i = (int)state->scope_depth - 1; i >= 0; --i) {
+        switch (state->scope_stack[i]) {
+        case TT_WHILE:
+        case TT_FOR:
+        case TT_SWITCH:
+            return i;
+        case TT_PROC:
+            return -1;
+        default:
+            break;
+        }
+    }
+
+    return -1;
+}
@@ -7,12 +7,65 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/stat.h>
+#include <elf.h>
 #include "gup/state.h"
 #include "gup/symbol.h"
 
+/*
+ * Read the entire input source into memory so that the lexer
+ * can scan it directly rather than pulling it in a byte at a
+ * time.
+ *
+ * @res:     Compiler state
+ * @in_path: Input file path
+ *
+ * Returns zero on success
+ */
+static int
+gup_state_read_input(struct gup_state *res, const char *in_path)
+{
+    struct stat st;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(in_path, O_RDONLY)) < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* One extra byte so the buffer is always NUL terminated */
+    res->in_buf = malloc(st.st_size + 1);
+    if (res->in_buf == NULL) {
+        close(fd);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    res->in_len = 0;
+    while (res->in_len < (size_t)st.st_size) {
+        n = read(fd, &res->in_buf[res->in_len], st.st_size - res->in_len);
+        if (n <= 0) {
+            break;
+        }
+
+        res->in_len += n;
+    }
+
+    res->in_buf[res->in_len] = '\0';
+    res->in_off = 0;
+    close(fd);
+    return 0;
+}
+
 int
 gup_state_init(struct gup_state *res, const char *in_path, const char *out_path)
 {
@@ -21,10 +74,6 @@ gup_state_init(struct gup_state *res, const char *in_path, const char *out_path)
         return -1;
     }
 
-    if (out_path == NULL) {
-        return -1;
-    }
-
     memset(res, 0, sizeof(*res));
     if (tokbuf_init(&res->tokbuf) < 0) {
         perror("tokbuf_init");
@@ -36,30 +85,153 @@ gup_state_init(struct gup_state *res, const char *in_path, const char *out_path)
         return -1;
     }
 
-    res->out_fp = fopen(out_path, "w");
-    if (res->out_fp == NULL) {
+    /* Without an output path nothing is written (e.g., JIT) */
+    res->out_fd = -1;
+    if (out_path != NULL) {
+        res->out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (res->out_fd < 0) {
+            tokbuf_destroy(&res->tokbuf);
+            symbol_table_destroy(&res->symtab);
+            return -1;
+        }
+
+        if (outbuf_init(&res->out, res->out_fd) < 0) {
+            tokbuf_destroy(&res->tokbuf);
+            symbol_table_destroy(&res->symtab);
+            close(res->out_fd);
+            return -1;
+        }
+    }
+
+    if (ptrbox_init(&res->ptrbox) < 0) {
         tokbuf_destroy(&res->tokbuf);
         symbol_table_destroy(&res->symtab);
+        outbuf_destroy(&res->out);
+        close(res->out_fd);
         return -1;
     }
 
-    if (ptrbox_init(&res->ptrbox) < 0) {
+    if (strpool_init(&res->strpool) < 0) {
         tokbuf_destroy(&res->tokbuf);
+        ptrbox_destroy(&res->ptrbox);
         symbol_table_destroy(&res->symtab);
-        fclose(res->out_fp);
+        outbuf_destroy(&res->out);
+        close(res->out_fd);
         return -1;
     }
 
-    res->in_fd = open(in_path, O_RDONLY);
-    if (res->in_fd < 0) {
+    if (arena_init(&res->ir_arena) < 0) {
         tokbuf_destroy(&res->tokbuf);
         ptrbox_destroy(&res->ptrbox);
         symbol_table_destroy(&res->symtab);
-        fclose(res->out_fp);
+        strpool_destroy(&res->strpool);
+        outbuf_destroy(&res->out);
+        close(res->out_fd);
+        return -1;
+    }
+
+    TAILQ_INIT(&res->procs);
+
+    /* The backend fills in the machine type */
+    if (elf_init(&res->elf, EM_NONE) < 0) {
+        tokbuf_destroy(&res->tokbuf);
+        ptrbox_destroy(&res->ptrbox);
+        symbol_table_destroy(&res->symtab);
+        strpool_destroy(&res->strpool);
+        arena_destroy(&res->ir_arena);
+        outbuf_destroy(&res->out);
+        close(res->out_fd);
+        return -1;
+    }
+
+    if (gup_state_read_input(res, in_path) < 0) {
+        tokbuf_destroy(&res->tokbuf);
+        ptrbox_destroy(&res->ptrbox);
+        symbol_table_destroy(&res->symtab);
+        strpool_destroy(&res->strpool);
+        arena_destroy(&res->ir_arena);
+        elf_destroy(&res->elf);
+        outbuf_destroy(&res->out);
+        close(res->out_fd);
         return -1;
     }
 
-    res->line_num = 1;
+    return 0;
+}
+
+/*
+ * Build the newline index for the input source
+ *
+ * @state: Compiler state
+ *
+ * Returns zero on success
+ */
+static int
+gup_state_index_nl(struct gup_state *state)
+{
+    const char *p, *end;
+    size_t cap = 64;
+
+    state->nl_index = malloc(cap * sizeof(*state->nl_index));
+    if (state->nl_index == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    p = state->in_buf;
+    end = &state->in_buf[state->in_len];
+    state->nl_count = 0;
+
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        if (state->nl_count >= cap) {
+            cap *= 2;
+            state->nl_index = realloc(
+                state->nl_index,
+                cap * sizeof(*state->nl_index)
+            );
+        }
+
+        if (state->nl_index == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        state->nl_index[state->nl_count++] = p - state->in_buf;
+        ++p;
+    }
+
+    return 0;
+}
+
+int
+gup_state_locate(struct gup_state *state, size_t off, size_t *line, size_t *col)
+{
+    size_t lo, hi, mid;
+
+    if (state == NULL || line == NULL || col == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (state->nl_index == NULL) {
+        if (gup_state_index_nl(state) < 0)
+            return -1;
+    }
+
+    /* Find the number of newlines strictly before the offset */
+    lo = 0;
+    hi = state->nl_count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (state->nl_index[mid] < off) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *line = lo + 1;
+    *col = (lo == 0) ? off + 1 : off - state->nl_index[lo - 1];
     return 0;
 }
 
@@ -70,9 +242,16 @@ gup_state_destroy(struct gup_state *state)
         return;
     }
 
-    close(state->in_fd);
+    free(state->in_buf);
+    free(state->nl_index);
     tokbuf_destroy(&state->tokbuf);
     ptrbox_destroy(&state->ptrbox);
     symbol_table_destroy(&state->symtab);
-    fclose(state->out_fp);
+    strpool_destroy(&state->strpool);
+    arena_destroy(&state->ir_arena);
+    elf_destroy(&state->elf);
+    outbuf_destroy(&state->out);
+    if (state->out_fd >= 0) {
+        close(state->out_fd);
+    }
 }
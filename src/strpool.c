@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/strpool.h"
+
+#define STRPOOL_INIT_BUCKETS 64
+
+/* FNV-1a parameters */
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+/*
+ * Hash string data with FNV-1a
+ *
+ * @data: Data to hash
+ * @len:  Length of data
+ */
+static uint64_t
+strpool_hash(const char *data, size_t len)
+{
+    uint64_t hash = FNV_OFFSET;
+
+    while (len-- > 0) {
+        hash ^= (uint8_t)*data++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Double the number of hash buckets and rehash every entry
+ *
+ * @pool: Pool to grow
+ *
+ * Returns zero on success
+ */
+static int
+strpool_grow(struct strpool *pool)
+{
+    struct strpool_entry **buckets, *entry;
+    size_t count, index;
+
+    count = pool->bucket_count * 2;
+    buckets = calloc(count, sizeof(*buckets));
+    if (buckets == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    TAILQ_FOREACH(entry, &pool->entries, link) {
+        index = entry->hash & (count - 1);
+        entry->chain = buckets[index];
+        buckets[index] = entry;
+    }
+
+    free(pool->buckets);
+    pool->buckets = buckets;
+    pool->bucket_count = count;
+    return 0;
+}
+
+int
+strpool_init(struct strpool *res)
+{
+    if (res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    TAILQ_INIT(&res->entries);
+    res->entry_count = 0;
+    res->bucket_count = STRPOOL_INIT_BUCKETS;
+    res->buckets = calloc(res->bucket_count, sizeof(*res->buckets));
+    if (res->buckets == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+strpool_intern(struct strpool *pool, const char *data, size_t len,
+    struct strpool_entry **res)
+{
+    struct strpool_entry *entry;
+    uint64_t hash;
+    size_t index;
+
+    if (pool == NULL || data == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    hash = strpool_hash(data, len);
+    index = hash & (pool->bucket_count - 1);
+    for (entry = pool->buckets[index]; entry != NULL; entry = entry->chain) {
+        if (entry->hash != hash || entry->len != len) {
+            continue;
+        }
+
+        if (memcmp(entry->data, data, len) == 0) {
+            *res = entry;
+            return 0;
+        }
+    }
+
+    /* Keep the load factor under 3/4 */
+    if ((pool->entry_count + 1) * 4 > pool->bucket_count * 3) {
+        if (strpool_grow(pool) < 0)
+            return -1;
+
+        index = hash & (pool->bucket_count - 1);
+    }
+
+    if ((entry = malloc(sizeof(*entry))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    if ((entry->data = malloc(len + 1)) == NULL) {
+        free(entry);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    memcpy(entry->data, data, len);
+    entry->data[len] = '\0';
+    entry->len = len;
+    entry->hash = hash;
+    entry->id = pool->entry_count++;
+    entry->chain = pool->buckets[index];
+    pool->buckets[index] = entry;
+    TAILQ_INSERT_TAIL(&pool->entries, entry, link);
+    *res = entry;
+    return 0;
+}
+
+void
+strpool_destroy(struct strpool *pool)
+{
+    struct strpool_entry *entry;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    while ((entry = TAILQ_FIRST(&pool->entries)) != NULL) {
+        TAILQ_REMOVE(&pool->entries, entry, link);
+        free(entry->data);
+        free(entry);
+    }
+
+    free(pool->buckets);
+    pool->buckets = NULL;
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2026, Ian Moffett.
+ * Provided under the BSD-3 clause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "gup/switch.h"
+
+/* Initial capacity of the case array */
+#define SWITCH_INIT_CAP 8
+
+/*
+ * Represents a run of cases tested together, either a single
+ * case or a jump table
+ *
+ * @lo:     Lowest case value
+ * @hi:     Highest case value
+ * @cases:  Cases in ascending order
+ * @ncases: Number of cases
+ */
+struct switch_cluster {
+    uint64_t lo;
+    uint64_t hi;
+    const struct ir_case *cases;
+    size_t ncases;
+};
+
+/*
+ * Lowering context
+ *
+ * @func: Function the switch is in
+ * @sel:  Register holding the selector
+ * @def:  Block taken when no case matches
+ */
+struct switch_ctx {
+    struct ir_func *func;
+    ir_reg_t sel;
+    struct ir_block *def;
+};
+
+int
+ir_switch_add(struct ir_func *func, struct ir_switch *sw, uint64_t v,
+    struct ir_block *block)
+{
+    struct ir_case *cases;
+    size_t cap;
+
+    if (func == NULL || sw == NULL || block == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* The arena can't grow in place, so double into a new array */
+    if (sw->ncases >= sw->cap) {
+        cap = (sw->cap == 0) ? SWITCH_INIT_CAP : sw->cap * 2;
+        cases = arena_alloc(func->arena, cap * sizeof(*cases));
+        if (cases == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        if (sw->ncases > 0)
+            memcpy(cases, sw->cases, sw->ncases * sizeof(*cases));
+
+        sw->cases = cases;
+        sw->cap = cap;
+    }
+
+    sw->cases[sw->ncases].v = v;
+    sw->cases[sw->ncases].block = block;
+    ++sw->ncases;
+    return 0;
+}
+
+/*
+ * Order cases by ascending value (qsort() callback)
+ */
+static int
+switch_cmp(const void *a, const void *b)
+{
+    const struct ir_case *ca = a, *cb = b;
+
+    if (ca->v == cb->v) {
+        return 0;
+    }
+
+    return (ca->v < cb->v) ? -1 : 1;
+}
+
+/*
+ * Terminate a block with a jump
+ *
+ * @ctx:    Lowering context
+ * @block:  Block to terminate
+ * @target: Jump target
+ *
+ * Returns zero on success
+ */
+static int
+switch_jmp(struct switch_ctx *ctx, struct ir_block *block, struct ir_block *target)
+{
+    struct ir_insn *insn;
+
+    if (ir_insn_new(ctx->func, block, IR_JMP, &insn) < 0) {
+        return -1;
+    }
+
+    insn->target[0] = target;
+    return 0;
+}
+
+/*
+ * Compare a register against a constant and branch on the
+ * result
+ *
+ * @ctx:   Lowering context
+ * @block: Block to terminate
+ * @op:    Comparison (IR_EQ, IR_LT or IR_LE)
+ * @reg:   Register to compare
+ * @v:     Constant to compare against
+ * @yes:   Taken if the comparison holds
+ * @no:    Taken otherwise
+ *
+ * Returns zero on success
+ */
+static int
+switch_test(struct switch_ctx *ctx, struct ir_block *block, ir_op_t op,
+    ir_reg_t reg, uint64_t v, struct ir_block *yes, struct ir_block *no)
+{
+    struct ir_insn *imm, *cmp, *br;
+
+    if (ir_insn_new(ctx->func, block, IR_IMM, &imm) < 0) {
+        return -1;
+    }
+
+    imm->dst = ir_reg_new(ctx->func);
+    imm->imm = v;
+    if (ir_insn_new(ctx->func, block, op, &cmp) < 0) {
+        return -1;
+    }
+
+    cmp->dst = ir_reg_new(ctx->func);
+    cmp->src[0] = reg;
+    cmp->src[1] = imm->dst;
+    if (ir_insn_new(ctx->func, block, IR_BR, &br) < 0) {
+        return -1;
+    }
+
+    br->src[0] = cmp->dst;
+    br->target[0] = yes;
+    br->target[1] = no;
+    return 0;
+}
+
+/*
+ * Group sorted cases into clusters, each dense enough run
+ * becomes a jump table and every other case stands alone
+ *
+ * @cases:    Cases in ascending order
+ * @ncases:   Number of cases
+ * @clusters: Clusters are written here (room for one per case)
+ *
+ * Returns the number of clusters
+ */
+static size_t
+switch_cluster(const struct ir_case *cases, size_t ncases,
+    struct switch_cluster *clusters)
+{
+    size_t i, j, end, n = 0;
+    uint64_t span;
+
+    for (i = 0; i < ncases; i = end) {
+        /* Take the longest run from here that is still dense */
+        end = i + 1;
+        for (j = i + 1; j < ncases; ++j) {
+            span = cases[j].v - cases[i].v;
+            if (span >= SWITCH_TABLE_MAX)
+                break;
+            if ((j - i + 1) * 100 >= SWITCH_DENSITY * (span + 1))
+                end = j + 1;
+        }
+
+        if (end - i < SWITCH_TABLE_MIN) {
+            end = i + 1;
+        }
+
+        clusters[n].lo = cases[i].v;
+        clusters[n].hi = cases[end - 1].v;
+        clusters[n].cases = &cases[i];
+        clusters[n].ncases = end - i;
+        ++n;
+    }
+
+    return n;
+}
+
+/*
+ * Test a single cluster, the selector is known to lie
+ * within [lo, hi]
+ *
+ * @ctx:   Lowering context
+ * @block: Block to test in
+ * @cl:    Cluster to test
+ * @lo:    Lowest value the selector can have
+ * @hi:    Highest value the selector can have
+ * @next:  Taken if no case of the cluster matches
+ *
+ * Returns zero on success
+ */
+static int
+switch_emit(struct switch_ctx *ctx, struct ir_block *block,
+    const struct switch_cluster *cl, uint64_t lo, uint64_t hi,
+    struct ir_block *next)
+{
+    struct ir_block *body, *target = cl->cases[0].block;
+    struct ir_insn *imm, *sub, *sw;
+    uint64_t range = cl->hi - cl->lo;
+    bool covered, uniform;
+    ir_reg_t idx = ctx->sel;
+    size_t i;
+
+    covered = lo >= cl->lo && hi <= cl->hi;
+    if (cl->ncases == 1) {
+        if (covered)
+            return switch_jmp(ctx, block, target);
+
+        return switch_test(ctx, block, IR_EQ, ctx->sel, cl->lo, target, next);
+    }
+
+    /* A gapless run going to one place only needs a range check */
+    uniform = cl->ncases == range + 1;
+    for (i = 1; uniform && i < cl->ncases; ++i) {
+        uniform = cl->cases[i].block == target;
+    }
+
+    if (uniform && covered) {
+        return switch_jmp(ctx, block, target);
+    }
+
+    /* Rebased, values below the table wrap around above it */
+    if (cl->lo != 0) {
+        if (ir_insn_new(ctx->func, block, IR_IMM, &imm) < 0)
+            return -1;
+
+        imm->dst = ir_reg_new(ctx->func);
+        imm->imm = cl->lo;
+        if (ir_insn_new(ctx->func, block, IR_SUB, &sub) < 0)
+            return -1;
+
+        sub->dst = ir_reg_new(ctx->func);
+        sub->src[0] = ctx->sel;
+        sub->src[1] = imm->dst;
+        idx = sub->dst;
+    }
+
+    if (uniform) {
+        return switch_test(ctx, block, IR_LE, idx, range, target, next);
+    }
+
+    if (!covered) {
+        if (ir_block_new(ctx->func, &body) < 0)
+            return -1;
+        if (switch_test(ctx, block, IR_LE, idx, range, body, next) < 0)
+            return -1;
+
+        block = body;
+    }
+
+    if (ir_insn_new(ctx->func, block, IR_SWITCH, &sw) < 0) {
+        return -1;
+    }
+
+    sw->src[0] = idx;
+    sw->imm = range + 1;
+    sw->table = arena_alloc(ctx->func->arena, sw->imm * sizeof(*sw->table));
+    if (sw->table == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < sw->imm; ++i) {
+        sw->table[i] = ctx->def;
+    }
+
+    for (i = 0; i < cl->ncases; ++i) {
+        sw->table[cl->cases[i].v - cl->lo] = cl->cases[i].block;
+    }
+
+    return 0;
+}
+
+/*
+ * Test clusters one after another
+ *
+ * @ctx:   Lowering context
+ * @block: Block to start testing in
+ * @cl:    Clusters to test
+ * @n:     Number of clusters
+ * @lo:    Lowest value the selector can have
+ * @hi:    Highest value the selector can have
+ *
+ * Returns zero on success
+ */
+static int
+switch_chain(struct switch_ctx *ctx, struct ir_block *block,
+    const struct switch_cluster *cl, size_t n, uint64_t lo, uint64_t hi)
+{
+    struct ir_block *next;
+    size_t i;
+
+    if (n == 0) {
+        return switch_jmp(ctx, block, ctx->def);
+    }
+
+    for (i = 0; i < n; ++i) {
+        next = ctx->def;
+        if (i + 1 < n && ir_block_new(ctx->func, &next) < 0)
+            return -1;
+        if (switch_emit(ctx, block, &cl[i], lo, hi, next) < 0)
+            return -1;
+
+        block = next;
+    }
+
+    return 0;
+}
+
+/*
+ * Binary search for the cluster the selector falls in,
+ * splitting at the middle cluster until few enough are left
+ * to test in turn
+ *
+ * @ctx:   Lowering context
+ * @block: Block to start searching in
+ * @cl:    Clusters to search
+ * @n:     Number of clusters
+ * @lo:    Lowest value the selector can have
+ * @hi:    Highest value the selector can have
+ *
+ * Returns zero on success
+ */
+static int
+switch_tree(struct switch_ctx *ctx, struct ir_block *block,
+    const struct switch_cluster *cl, size_t n, uint64_t lo, uint64_t hi)
+{
+    struct ir_block *left, *right;
+    uint64_t pivot;
+    size_t mid;
+
+    if (n <= SWITCH_CHAIN_MAX) {
+        return switch_chain(ctx, block, cl, n, lo, hi);
+    }
+
+    mid = n / 2;
+    pivot = cl[mid].lo;
+    if (ir_block_new(ctx->func, &left) < 0) {
+        return -1;
+    }
+
+    if (ir_block_new(ctx->func, &right) < 0) {
+        return -1;
+    }
+
+    if (switch_test(ctx, block, IR_LT, ctx->sel, pivot, left, right) < 0) {
+        return -1;
+    }
+
+    if (switch_tree(ctx, left, cl, mid, lo, pivot - 1) < 0) {
+        return -1;
+    }
+
+    return switch_tree(ctx, right, &cl[mid], n - mid, pivot, hi);
+}
+
+int
+ir_switch_lower(struct ir_func *func, struct ir_switch *sw,
+    struct ir_block *exit)
+{
+    struct switch_cluster *clusters = NULL;
+    struct switch_ctx ctx;
+    size_t n;
+
+    if (func == NULL || sw == NULL || exit == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    ctx.func = func;
+    ctx.sel = sw->sel;
+    ctx.def = (sw->def != NULL) ? sw->def : exit;
+    if (sw->ncases > 0) {
+        clusters = arena_alloc(func->arena, sw->ncases * sizeof(*clusters));
+        if (clusters == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        qsort(sw->cases, sw->ncases, sizeof(*sw->cases), switch_cmp);
+    }
+
+    n = switch_cluster(sw->cases, sw->ncases, clusters);
+    return switch_tree(&ctx, sw->dispatch, clusters, n, 0, UINT64_MAX);
+}
@@ -110,6 +110,53 @@ symbol_from_id(struct symbol_table *table, symid_t id)
     return NULL;
 }
 
+void
+symbol_drop(struct symbol_table *table, symbol_type_t type)
+{
+    struct symbol *symbol, *next;
+
+    if (table == NULL) {
+        return;
+    }
+
+    symbol = TAILQ_FIRST(&table->entries);
+    while (symbol != NULL) {
+        next = TAILQ_NEXT(symbol, link);
+        if (symbol->type == type) {
+            TAILQ_REMOVE(&table->entries, symbol, link);
+            if (symbol->type == SYMBOL_MACRO)
+                tokbuf_destroy(&symbol->mactok);
+
+            free(symbol->name);
+            free(symbol);
+        }
+
+        symbol = next;
+    }
+}
+
+void
+symbol_drop_scope(struct symbol_table *table, uint8_t depth)
+{
+    struct symbol *symbol, *next;
+
+    if (table == NULL) {
+        return;
+    }
+
+    symbol = TAILQ_FIRST(&table->entries);
+    while (symbol != NULL) {
+        next = TAILQ_NEXT(symbol, link);
+        if (symbol->type == SYMBOL_LOCAL && symbol->depth > depth) {
+            TAILQ_REMOVE(&table->entries, symbol, link);
+            free(symbol->name);
+            free(symbol);
+        }
+
+        symbol = next;
+    }
+}
+
 void
 symbol_table_destroy(struct symbol_table *table)
 {
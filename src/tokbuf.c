@@ -70,6 +70,20 @@ tokbuf_pop(struct tokbuf *buf)
     return &buf->ring[buf->tail++];
 }
 
+struct token *
+tokbuf_peek(struct tokbuf *buf)
+{
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    if (buf->tail == buf->head) {
+        return NULL;
+    }
+
+    return &buf->ring[buf->tail];
+}
+
 struct token *
 tokbuf_lookbehind(struct tokbuf *buf, off_t n)
 {